@@ -0,0 +1,1705 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Headless runner for the benchmarks in demo/Bench.c.
+// Steps each benchmark with a regular cpSpace and with a cpHastySpace at several thread counts,
+// and reports the time per step. Doesn't depend on any of the graphics code used by the demo app.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#elif defined(__APPLE__)
+	#include <mach/mach_time.h>
+#else
+	#include <time.h>
+#endif
+
+#if defined(__APPLE__)
+	#include <malloc/malloc.h>
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	#include <malloc.h>
+	#define HAVE_MALLINFO2 1
+#endif
+
+#include "chipmunk/chipmunk_private.h"
+#include "chipmunk/cpHastySpace.h"
+#include "ChipmunkDemo.h"
+
+extern ChipmunkDemo bench_list[];
+extern int bench_count;
+extern int bench_hasty_threads;
+
+#define MAX_THREAD_COUNTS 16
+
+//MARK: Demo Functions
+
+// Bench.c only needs a couple of the demo app's functions.
+
+void ChipmunkDemoDefaultDrawImpl(cpSpace *space){}
+
+static void ShapeFreeWrap(cpSpace *space, cpShape *shape, void *unused){
+	cpSpaceRemoveShape(space, shape);
+	cpShapeFree(shape);
+}
+
+static void PostShapeFree(cpShape *shape, cpSpace *space){
+	cpSpaceAddPostStepCallback(space, (cpPostStepFunc)ShapeFreeWrap, shape, NULL);
+}
+
+static void ConstraintFreeWrap(cpSpace *space, cpConstraint *constraint, void *unused){
+	cpSpaceRemoveConstraint(space, constraint);
+	cpConstraintFree(constraint);
+}
+
+static void PostConstraintFree(cpConstraint *constraint, cpSpace *space){
+	cpSpaceAddPostStepCallback(space, (cpPostStepFunc)ConstraintFreeWrap, constraint, NULL);
+}
+
+static void BodyFreeWrap(cpSpace *space, cpBody *body, void *unused){
+	cpSpaceRemoveBody(space, body);
+	cpBodyFree(body);
+}
+
+static void PostBodyFree(cpBody *body, cpSpace *space){
+	cpSpaceAddPostStepCallback(space, (cpPostStepFunc)BodyFreeWrap, body, NULL);
+}
+
+void
+ChipmunkDemoFreeSpaceChildren(cpSpace *space)
+{
+	// Must remove these BEFORE freeing the body or you will access dangling pointers.
+	cpSpaceEachShape(space, (cpSpaceShapeIteratorFunc)PostShapeFree, space);
+	cpSpaceEachConstraint(space, (cpSpaceConstraintIteratorFunc)PostConstraintFree, space);
+	
+	cpSpaceEachBody(space, (cpSpaceBodyIteratorFunc)PostBodyFree, space);
+}
+
+//MARK: Timing
+
+static uint64_t
+TimeNS(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)((double)counter.QuadPart*(1e9/(double)frequency.QuadPart));
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if(timebase.denom == 0) mach_timebase_info(&timebase);
+	return mach_absolute_time()*timebase.numer/timebase.denom;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec*1000000000ull + (uint64_t)time.tv_nsec;
+#endif
+}
+
+static int
+CompareTimes(const void *a, const void *b)
+{
+	uint64_t ta = *(const uint64_t *)a, tb = *(const uint64_t *)b;
+	return (ta > tb) - (ta < tb);
+}
+
+// Nearest rank percentile of a sorted array.
+static uint64_t
+Percentile(const uint64_t *sorted, int count, double percent)
+{
+	int rank = (int)(percent*count + 0.999999);
+	return sorted[(rank > 0 ? rank - 1 : 0)];
+}
+
+// Bytes currently allocated from the heap, or 0 if the platform has no cheap way to ask.
+static size_t
+HeapBytes(void)
+{
+#if defined(__APPLE__)
+	return mstats().bytes_used;
+#elif defined(HAVE_MALLINFO2)
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+//MARK: Running Benchmarks
+
+struct Result {
+	const char *name;
+	
+	// Number of hasty space threads, or -1 for a regular cpSpace.
+	int threads;
+	
+	int steps;
+	double mean;
+	uint64_t p50, p99, min, max;
+	
+	// Hash of the final state of the bodies.
+	uint64_t hash;
+	
+	// Sum of the step stats over all the steps. Only filled in when Chipmunk is built with step stats enabled.
+	cpSpaceStepStats stats;
+};
+
+static const char *
+BenchName(ChipmunkDemo *bench)
+{
+	const char *prefix = "benchmark - ";
+	size_t length = strlen(prefix);
+	return (strncmp(bench->name, prefix, length) == 0 ? bench->name + length : bench->name);
+}
+
+static cpBool
+Selected(ChipmunkDemo *bench, const char **filters, int filterCount)
+{
+	if(filterCount == 0) return cpTrue;
+	
+	for(int i=0; i<filterCount; i++){
+		if(strstr(BenchName(bench), filters[i])) return cpTrue;
+	}
+	
+	return cpFalse;
+}
+
+#define ADD_STATS(__field__) (sum->__field__ += stats.__field__)
+
+static void
+AddStats(cpSpaceStepStats *sum, cpSpaceStepStats stats)
+{
+	ADD_STATS(step); ADD_STATS(integratePositions); ADD_STATS(sweepBullets); ADD_STATS(updateBBs); ADD_STATS(broadphase); ADD_STATS(narrowphase);
+	ADD_STATS(components); ADD_STATS(filterArbiters); ADD_STATS(preStep); ADD_STATS(integrateVelocities);
+	ADD_STATS(warmStart); ADD_STATS(solve); ADD_STATS(callbacks);
+	ADD_STATS(pairsTested); ADD_STATS(pairsRejected); ADD_STATS(pairsCulled); ADD_STATS(gjkIterations); ADD_STATS(epaIterations);
+	ADD_STATS(arbitersCreated); ADD_STATS(contactsCreated); ADD_STATS(bulletImpacts);
+}
+
+// FNV-1a hash of the raw bits of the body state.
+static void
+HashBytes(uint64_t *hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for(size_t i=0; i<size; i++) *hash = (*hash ^ bytes[i])*1099511628211ull;
+}
+
+static void
+HashBody(cpBody *body, uint64_t *hash)
+{
+	cpVect p = cpBodyGetPosition(body), v = cpBodyGetVelocity(body);
+	cpFloat a = cpBodyGetAngle(body), w = cpBodyGetAngularVelocity(body);
+	
+	HashBytes(hash, &p, sizeof(p));
+	HashBytes(hash, &v, sizeof(v));
+	HashBytes(hash, &a, sizeof(a));
+	HashBytes(hash, &w, sizeof(w));
+}
+
+static struct Result
+RunBench(ChipmunkDemo *bench, int threads, cpBool deterministic, int steps, uint64_t *times)
+{
+	struct Result result = {BenchName(bench), threads, steps, 0.0, 0, 0, 0, 0, 1469598103934665603ull, {0}};
+	
+	// Reset the random seed so every run sets up exactly the same scene.
+	srand(45073);
+	bench_hasty_threads = threads;
+	cpSpace *space = bench->initFunc();
+	if(threads >= 0) cpHastySpaceSetDeterministic(space, deterministic);
+	
+	uint64_t total = 0;
+	for(int i=0; i<steps; i++){
+		uint64_t start = TimeNS();
+		bench->updateFunc(space, bench->timestep);
+		times[i] = TimeNS() - start;
+		
+		total += times[i];
+		AddStats(&result.stats, cpSpaceGetStepStats(space));
+	}
+	
+	cpSpaceEachBody(space, (cpSpaceBodyIteratorFunc)HashBody, &result.hash);
+	bench->destroyFunc(space);
+	bench_hasty_threads = -1;
+	
+	qsort(times, steps, sizeof(uint64_t), CompareTimes);
+	result.mean = (double)total/(double)steps;
+	result.p50 = Percentile(times, steps, 0.50);
+	result.p99 = Percentile(times, steps, 0.99);
+	result.min = times[0];
+	result.max = times[steps - 1];
+	
+	return result;
+}
+
+//MARK: Output
+
+static void
+PrintResult(FILE *file, struct Result *result)
+{
+	char space[32];
+	if(result->threads < 0){
+		sprintf(space, "cpSpace");
+	} else {
+		sprintf(space, "cpHastySpace/%d", result->threads);
+	}
+	
+	fprintf(file, "%-30s %-16s mean %10.0f ns  p50 %10llu ns  p99 %10llu ns  state %016llx\n",
+		result->name, space, result->mean, (unsigned long long)result->p50, (unsigned long long)result->p99, (unsigned long long)result->hash
+	);
+}
+
+#define JSON_STAT(__field__) fprintf(file, ",\n\t\t\t\t\"" #__field__ "\": %.1f", (double)stats->__field__/(double)result->steps)
+
+static void
+WriteJSONResult(FILE *file, struct Result *result)
+{
+	fprintf(file, "\t\t{\n");
+	fprintf(file, "\t\t\t\"name\": \"%s\",\n", result->name);
+	fprintf(file, "\t\t\t\"space\": \"%s\",\n", (result->threads < 0 ? "cpSpace" : "cpHastySpace"));
+	fprintf(file, "\t\t\t\"threads\": %d,\n", (result->threads < 0 ? 1 : result->threads));
+	fprintf(file, "\t\t\t\"steps\": %d,\n", result->steps);
+	fprintf(file, "\t\t\t\"mean_ns\": %.1f,\n", result->mean);
+	fprintf(file, "\t\t\t\"p50_ns\": %llu,\n", (unsigned long long)result->p50);
+	fprintf(file, "\t\t\t\"p99_ns\": %llu,\n", (unsigned long long)result->p99);
+	fprintf(file, "\t\t\t\"min_ns\": %llu,\n", (unsigned long long)result->min);
+	fprintf(file, "\t\t\t\"max_ns\": %llu,\n", (unsigned long long)result->max);
+	fprintf(file, "\t\t\t\"state_hash\": \"%016llx\"", (unsigned long long)result->hash);
+	
+	// Per step averages of the step stats.
+	cpSpaceStepStats *stats = &result->stats;
+	if(stats->step > 0){
+		fprintf(file, ",\n\t\t\t\"stats\": {\n\t\t\t\t\"step\": %.1f", (double)stats->step/(double)result->steps);
+		JSON_STAT(integratePositions); JSON_STAT(sweepBullets); JSON_STAT(updateBBs); JSON_STAT(broadphase); JSON_STAT(narrowphase);
+		JSON_STAT(components); JSON_STAT(filterArbiters); JSON_STAT(preStep); JSON_STAT(integrateVelocities);
+		JSON_STAT(warmStart); JSON_STAT(solve); JSON_STAT(callbacks);
+		JSON_STAT(pairsTested); JSON_STAT(pairsRejected); JSON_STAT(pairsCulled); JSON_STAT(gjkIterations); JSON_STAT(epaIterations);
+		JSON_STAT(arbitersCreated); JSON_STAT(contactsCreated); JSON_STAT(bulletImpacts);
+		fprintf(file, "\n\t\t\t}");
+	}
+	
+	fprintf(file, "\n\t\t}");
+}
+
+static void
+WriteJSON(FILE *file, struct Result *results, int count, cpBool deterministic)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"chipmunk_version\": \"%s\",\n", cpVersionString);
+	fprintf(file, "\t\"cpfloat_bytes\": %d,\n", (int)sizeof(cpFloat));
+	fprintf(file, "\t\"deterministic\": %s,\n", (deterministic ? "true" : "false"));
+	fprintf(file, "\t\"results\": [\n");
+	
+	for(int i=0; i<count; i++){
+		WriteJSONResult(file, results + i);
+		fprintf(file, (i < count - 1 ? ",\n" : "\n"));
+	}
+	
+	fprintf(file, "\t]\n}\n");
+}
+
+//MARK: Spatial Index Benchmarks
+
+// Times the spatial indexes on their own, without the rest of the step getting in the way.
+// Circles bounce around a square world and are reindexed every step, followed by a batch of queries.
+// A few circles are also removed and reinserted somewhere else every step to churn the index.
+
+#define INDEX_BENCH_DYNAMIC_COUNT 4000
+#define INDEX_BENCH_STATIC_COUNT 1000
+#define INDEX_BENCH_QUERY_COUNT 256
+#define INDEX_BENCH_CHURN_COUNT 40
+#define INDEX_BENCH_SIZE 1000.0
+
+struct IndexType {
+	const char *name;
+	cpSpatialIndex *(*construct)(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+	void (*setVelocityFunc)(cpSpatialIndex *index, cpBBTreeVelocityFunc func);
+	cpBBTreeQuality (*getQuality)(cpSpatialIndex *index);
+	// Used for the static objects instead of 'construct' when set.
+	cpSpatialIndex *(*constructStatic)(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+};
+
+// Start from a poor guess to make the hash tune itself.
+static cpSpatialIndex *
+AutoSpaceHashNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndex *index = cpSpaceHashNew(100.0f, 100, bbfunc, staticIndex);
+	cpSpaceHashSetAutoTune(index, cpTrue);
+	return index;
+}
+
+static struct IndexType index_types[] = {
+	{"cpBBTree", cpBBTreeNew, cpBBTreeSetVelocityFunc, cpBBTreeGetQuality, NULL},
+	{"cpCompactBBTree", cpCompactBBTreeNew, cpCompactBBTreeSetVelocityFunc, cpCompactBBTreeGetQuality, NULL},
+	{"cpBBTree/cpStaticBVH", cpBBTreeNew, cpBBTreeSetVelocityFunc, cpBBTreeGetQuality, cpStaticBVHNew},
+	{"cpSweep1D/cpStaticBVH", cpSweep1DNew, NULL, NULL, cpStaticBVHNew},
+	{"cpSpaceHash (auto)", AutoSpaceHashNew, NULL, NULL, NULL},
+	{"cpHGrid", cpHGridNew, NULL, NULL, NULL},
+};
+
+// Circles, or rounded segments from p - d to p + d when d is non-zero.
+struct IndexObject {
+	cpVect p, v, d;
+	cpFloat r;
+};
+
+static cpBB
+IndexObjectBB(struct IndexObject *obj)
+{
+	cpVect p = obj->p, d = obj->d;
+	cpFloat r = obj->r;
+	return cpBBNew(p.x - cpfabs(d.x) - r, p.y - cpfabs(d.y) - r, p.x + cpfabs(d.x) + r, p.y + cpfabs(d.y) + r);
+}
+
+static cpVect IndexObjectVelocity(struct IndexObject *obj){return obj->v;}
+
+static cpCollisionID IndexCountPair(void *a, void *b, cpCollisionID id, unsigned long *count){(*count)++; return id;}
+static cpFloat IndexCountSegment(void *a, void *b, unsigned long *count){(*count)++; return 1.0f;}
+
+// Every index needs to see exactly the same objects and queries, so don't depend on rand().
+static cpFloat
+IndexRandom(uint32_t *seed)
+{
+	*seed = (*seed)*1664525u + 1013904223u;
+	return (cpFloat)(*seed >> 8)/(cpFloat)(1u << 24);
+}
+
+struct IndexResult {
+	double reindexMean, queryMean;
+	uint64_t reindexP99, queryP99;
+	unsigned long pairs, hits;
+	
+	// Quality of the dynamic index at the end of the run.
+	cpBBTreeQuality quality;
+};
+
+static struct IndexResult
+RunIndexBench(struct IndexType *type, int steps, uint64_t *reindexTimes, uint64_t *queryTimes)
+{
+	struct IndexResult result = {0.0, 0.0, 0, 0, 0, 0, {0.0f, 0}};
+	uint32_t seed = 1;
+	
+	int count = INDEX_BENCH_DYNAMIC_COUNT + INDEX_BENCH_STATIC_COUNT;
+	struct IndexObject *objects = (struct IndexObject *)calloc(count, sizeof(struct IndexObject));
+	
+	cpSpatialIndex *staticIndex = (type->constructStatic ? type->constructStatic : type->construct)((cpSpatialIndexBBFunc)IndexObjectBB, NULL);
+	cpSpatialIndex *index = type->construct((cpSpatialIndexBBFunc)IndexObjectBB, staticIndex);
+	if(type->setVelocityFunc) type->setVelocityFunc(index, (cpBBTreeVelocityFunc)IndexObjectVelocity);
+	
+	for(int i=0; i<count; i++){
+		struct IndexObject *obj = objects + i;
+		obj->p = cpv(IndexRandom(&seed)*INDEX_BENCH_SIZE, IndexRandom(&seed)*INDEX_BENCH_SIZE);
+		
+		if(i < INDEX_BENCH_DYNAMIC_COUNT){
+			obj->v = cpvmult(cpv(IndexRandom(&seed) - 0.5f, IndexRandom(&seed) - 0.5f), 200.0f);
+			obj->r = 1.0f + 4.0f*IndexRandom(&seed);
+			cpSpatialIndexInsert(index, obj, i);
+		} else {
+			obj->v = cpvzero;
+			obj->r = 2.0f + 10.0f*IndexRandom(&seed);
+			cpSpatialIndexInsert(staticIndex, obj, i);
+		}
+	}
+	
+	uint64_t reindexTotal = 0, queryTotal = 0;
+	for(int step=0; step<steps; step++){
+		for(int i=0; i<INDEX_BENCH_DYNAMIC_COUNT; i++){
+			struct IndexObject *obj = objects + i;
+			obj->p = cpvadd(obj->p, cpvmult(obj->v, 1.0f/60.0f));
+			if(obj->p.x < 0.0f || obj->p.x > INDEX_BENCH_SIZE) obj->v.x = -obj->v.x;
+			if(obj->p.y < 0.0f || obj->p.y > INDEX_BENCH_SIZE) obj->v.y = -obj->v.y;
+		}
+		
+		uint64_t start = TimeNS();
+		for(int i=0; i<INDEX_BENCH_CHURN_COUNT; i++){
+			int j = (int)(IndexRandom(&seed)*INDEX_BENCH_DYNAMIC_COUNT);
+			cpSpatialIndexRemove(index, objects + j, j);
+			objects[j].p = cpv(IndexRandom(&seed)*INDEX_BENCH_SIZE, IndexRandom(&seed)*INDEX_BENCH_SIZE);
+			cpSpatialIndexInsert(index, objects + j, j);
+		}
+		
+		cpSpatialIndexReindexQuery(index, (cpSpatialIndexQueryFunc)IndexCountPair, &result.pairs);
+		reindexTimes[step] = TimeNS() - start;
+		
+		start = TimeNS();
+		for(int i=0; i<INDEX_BENCH_QUERY_COUNT; i++){
+			cpVect a = cpv(IndexRandom(&seed)*INDEX_BENCH_SIZE, IndexRandom(&seed)*INDEX_BENCH_SIZE);
+			cpVect b = cpvadd(a, cpvmult(cpv(IndexRandom(&seed) - 0.5f, IndexRandom(&seed) - 0.5f), 200.0f));
+			
+			cpSpatialIndexQuery(index, NULL, cpBBNewForCircle(a, 20.0f), (cpSpatialIndexQueryFunc)IndexCountPair, &result.hits);
+			cpSpatialIndexQuery(staticIndex, NULL, cpBBNewForCircle(a, 20.0f), (cpSpatialIndexQueryFunc)IndexCountPair, &result.hits);
+			cpSpatialIndexSegmentQuery(index, NULL, a, b, 1.0f, (cpSpatialIndexSegmentQueryFunc)IndexCountSegment, &result.hits);
+		}
+		queryTimes[step] = TimeNS() - start;
+		
+		reindexTotal += reindexTimes[step];
+		queryTotal += queryTimes[step];
+	}
+	
+	if(type->getQuality) result.quality = type->getQuality(index);
+	
+	cpSpatialIndexFree(index);
+	cpSpatialIndexFree(staticIndex);
+	free(objects);
+	
+	qsort(reindexTimes, steps, sizeof(uint64_t), CompareTimes);
+	qsort(queryTimes, steps, sizeof(uint64_t), CompareTimes);
+	result.reindexMean = (double)reindexTotal/(double)steps;
+	result.reindexP99 = Percentile(reindexTimes, steps, 0.99);
+	result.queryMean = (double)queryTotal/(double)steps;
+	result.queryP99 = Percentile(queryTimes, steps, 0.99);
+	
+	return result;
+}
+
+static void
+RunIndexBenchmarks(FILE *log, int steps)
+{
+	fprintf(log, "Spatial indexes: %d dynamic and %d static circles, %d reinserted and %d queries per step.\n",
+		INDEX_BENCH_DYNAMIC_COUNT, INDEX_BENCH_STATIC_COUNT, INDEX_BENCH_CHURN_COUNT, INDEX_BENCH_QUERY_COUNT
+	);
+	
+	uint64_t *reindexTimes = (uint64_t *)calloc(steps, sizeof(uint64_t));
+	uint64_t *queryTimes = (uint64_t *)calloc(steps, sizeof(uint64_t));
+	
+	for(size_t i=0; i<sizeof(index_types)/sizeof(*index_types); i++){
+		struct IndexType *type = index_types + i;
+		struct IndexResult result = RunIndexBench(type, steps, reindexTimes, queryTimes);
+		
+		// The pair and hit counts should agree closely between indexes.
+		// Indexes with rounded bounds may report a few extra pairs that just touch.
+		// Static indexes that aren't trees don't share pairs with the dynamic tree,
+		// so they are collided using the exact bounds instead of the padded ones and report fewer pairs.
+		fprintf(log, "%-20s reindex mean %10.0f ns  p99 %10llu ns  query mean %10.0f ns  p99 %10llu ns  pairs %lu  hits %lu  sah %.2f  depth %d\n",
+			type->name,
+			result.reindexMean, (unsigned long long)result.reindexP99,
+			result.queryMean, (unsigned long long)result.queryP99,
+			result.pairs, result.hits, result.quality.sahCost, result.quality.maxDepth
+		);
+	}
+	
+	free(reindexTimes);
+	free(queryTimes);
+}
+
+//MARK: Spatial Index Comparison
+
+// Drives every index type through the same workloads in lockstep and checks that they agree.
+// Indexes may report "loose" pairs and hits whose exact bounds don't overlap (padded or rounded bounds),
+// but once those are filtered out, each one must report exactly what a brute force search finds, without duplicates.
+
+#define INDEX_COMPARE_QUERY_COUNT 64
+#define INDEX_COMPARE_CHURN_COUNT 20
+
+struct IndexWorkload {
+	const char *name;
+	int dynamicCount, staticCount;
+	void (*init)(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed);
+};
+
+static cpVect
+IndexRandomPoint(uint32_t *seed)
+{
+	return cpv(IndexRandom(seed)*INDEX_BENCH_SIZE, IndexRandom(seed)*INDEX_BENCH_SIZE);
+}
+
+static cpVect
+IndexRandomVelocity(uint32_t *seed, cpFloat speed)
+{
+	return cpvmult(cpv(IndexRandom(seed) - 0.5f, IndexRandom(seed) - 0.5f), 2.0f*speed);
+}
+
+static cpVect
+IndexRandomHalfLength(uint32_t *seed, cpFloat min, cpFloat max)
+{
+	cpVect dir = cpvforangle(2.0f*(cpFloat)CP_PI*IndexRandom(seed));
+	return cpvmult(dir, 0.5f*(min + (max - min)*IndexRandom(seed)));
+}
+
+static void
+UniformInit(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed)
+{
+	obj->p = IndexRandomPoint(seed);
+	
+	if(dynamic){
+		obj->v = IndexRandomVelocity(seed, 100.0f);
+		obj->r = 1.0f + 4.0f*IndexRandom(seed);
+	} else {
+		obj->r = 2.0f + 10.0f*IndexRandom(seed);
+	}
+}
+
+// Eight dense, slowly settling piles with long floors scattered around them.
+static void
+ClusteredInit(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed)
+{
+	if(dynamic){
+		// Summing a few randoms gives a roughly normal distribution around the center of the pile.
+		cpVect center = cpv(150.0f + 700.0f*(i%4)/3.0f, 250.0f + 500.0f*((i/4)%2));
+		cpVect offset = cpv(
+			IndexRandom(seed) + IndexRandom(seed) + IndexRandom(seed) - 1.5f,
+			IndexRandom(seed) + IndexRandom(seed) + IndexRandom(seed) - 1.5f
+		);
+		
+		obj->p = cpvadd(center, cpvmult(offset, 60.0f));
+		obj->v = IndexRandomVelocity(seed, 5.0f);
+		obj->r = 2.0f + 2.0f*IndexRandom(seed);
+	} else {
+		obj->p = IndexRandomPoint(seed);
+		obj->d = cpv(100.0f + 100.0f*IndexRandom(seed), 0.0f);
+		obj->r = 1.0f;
+	}
+}
+
+static void
+SegmentsInit(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed)
+{
+	obj->p = IndexRandomPoint(seed);
+	
+	if(dynamic){
+		obj->v = IndexRandomVelocity(seed, 50.0f);
+		obj->d = IndexRandomHalfLength(seed, 20.0f, 200.0f);
+		obj->r = 0.5f;
+	} else {
+		obj->d = IndexRandomHalfLength(seed, 100.0f, 400.0f);
+		obj->r = 1.0f;
+	}
+}
+
+static void
+MixedInit(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed)
+{
+	obj->p = IndexRandomPoint(seed);
+	if(dynamic) obj->v = IndexRandomVelocity(seed, 50.0f);
+	
+	cpBool huge = (i%(dynamic ? 50 : 20) == 0);
+	obj->r = (huge ? 50.0f + 100.0f*IndexRandom(seed) : 0.25f + 0.75f*IndexRandom(seed));
+}
+
+// A quarter of the circles move 50 units per step on average, several times their size.
+static void
+BulletsInit(struct IndexObject *obj, int i, cpBool dynamic, uint32_t *seed)
+{
+	obj->p = IndexRandomPoint(seed);
+	
+	if(dynamic){
+		cpBool bullet = (i%4 == 0);
+		obj->v = IndexRandomVelocity(seed, bullet ? 6000.0f : 50.0f);
+		obj->r = (bullet ? 1.0f : 1.0f + 2.0f*IndexRandom(seed));
+	} else {
+		obj->r = 2.0f + 10.0f*IndexRandom(seed);
+	}
+}
+
+static struct IndexWorkload index_workloads[] = {
+	{"uniform particles", 4000, 1000, UniformInit},
+	{"clustered piles", 4000, 64, ClusteredInit},
+	{"long thin segments", 2000, 200, SegmentsInit},
+	{"huge and tiny", 4000, 1000, MixedInit},
+	{"bullets", 4000, 1000, BulletsInit},
+};
+
+// Pairs are stored as (low id, high id) and query hits as (query, id) packed into a single key.
+struct IndexKeys {
+	uint64_t *keys;
+	size_t count, capacity;
+};
+
+static void
+IndexKeysPush(struct IndexKeys *list, uint64_t key)
+{
+	if(list->count == list->capacity){
+		list->capacity = (list->capacity ? 2*list->capacity : 1024);
+		list->keys = (uint64_t *)realloc(list->keys, list->capacity*sizeof(uint64_t));
+	}
+	
+	list->keys[list->count++] = key;
+}
+
+static inline uint64_t
+IndexKey(uint32_t a, uint32_t b)
+{
+	return (uint64_t)a<<32 | b;
+}
+
+static inline uint64_t
+IndexPairKey(uint32_t a, uint32_t b)
+{
+	return (a < b ? IndexKey(a, b) : IndexKey(b, a));
+}
+
+struct IndexCollector {
+	struct IndexObject *objects;
+	struct IndexKeys keys;
+	uint32_t query;
+};
+
+static cpCollisionID
+IndexCollectPair(struct IndexObject *a, struct IndexObject *b, cpCollisionID id, struct IndexCollector *collector)
+{
+	IndexKeysPush(&collector->keys, IndexPairKey((uint32_t)(a - collector->objects), (uint32_t)(b - collector->objects)));
+	return id;
+}
+
+static cpCollisionID
+IndexCollectHit(void *query, struct IndexObject *obj, cpCollisionID id, struct IndexCollector *collector)
+{
+	IndexKeysPush(&collector->keys, IndexKey(collector->query, (uint32_t)(obj - collector->objects)));
+	return id;
+}
+
+static cpFloat
+IndexCollectSegmentHit(void *query, struct IndexObject *obj, struct IndexCollector *collector)
+{
+	IndexKeysPush(&collector->keys, IndexKey(collector->query, (uint32_t)(obj - collector->objects)));
+	return 1.0f;
+}
+
+struct IndexEdge {
+	cpFloat l;
+	uint32_t id;
+};
+
+// The exact answers for the current step.
+struct IndexReference {
+	cpBB *bbs;
+	cpBB queryBBs[INDEX_COMPARE_QUERY_COUNT];
+	cpVect segmentA[INDEX_COMPARE_QUERY_COUNT], segmentB[INDEX_COMPARE_QUERY_COUNT];
+	struct IndexKeys pairs, hits, segmentHits;
+	
+	// Scratch space for the sweep.
+	struct IndexEdge *edges;
+};
+
+typedef cpBool (*IndexOverlapFunc)(struct IndexReference *ref, uint64_t key);
+
+static cpBool
+IndexPairOverlaps(struct IndexReference *ref, uint64_t key)
+{
+	return cpBBIntersects(ref->bbs[key>>32], ref->bbs[(uint32_t)key]);
+}
+
+static cpBool
+IndexHitOverlaps(struct IndexReference *ref, uint64_t key)
+{
+	return cpBBIntersects(ref->queryBBs[key>>32], ref->bbs[(uint32_t)key]);
+}
+
+// Separating axis test so the check doesn't depend on how cpBBSegmentQuery() handles infinities.
+static cpBool
+IndexSegmentHitOverlaps(struct IndexReference *ref, uint64_t key)
+{
+	cpBB bb = ref->bbs[(uint32_t)key];
+	cpVect a = ref->segmentA[key>>32], b = ref->segmentB[key>>32];
+	if(!cpBBIntersects(bb, cpBBNew(cpfmin(a.x, b.x), cpfmin(a.y, b.y), cpfmax(a.x, b.x), cpfmax(a.y, b.y)))) return cpFalse;
+	
+	cpVect n = cpvperp(cpvsub(b, a));
+	cpFloat d0 = cpvdot(n, cpvsub(cpv(bb.l, bb.b), a));
+	cpFloat d1 = cpvdot(n, cpvsub(cpv(bb.l, bb.t), a));
+	cpFloat d2 = cpvdot(n, cpvsub(cpv(bb.r, bb.b), a));
+	cpFloat d3 = cpvdot(n, cpvsub(cpv(bb.r, bb.t), a));
+	return !((d0 > 0.0f && d1 > 0.0f && d2 > 0.0f && d3 > 0.0f) || (d0 < 0.0f && d1 < 0.0f && d2 < 0.0f && d3 < 0.0f));
+}
+
+static int
+CompareEdges(const void *a, const void *b)
+{
+	const struct IndexEdge *ea = (const struct IndexEdge *)a, *eb = (const struct IndexEdge *)b;
+	return (ea->l > eb->l) - (ea->l < eb->l);
+}
+
+// Sort and sweep along x, skipping the static/static pairs that the indexes don't report.
+static void
+IndexReferencePairs(struct IndexReference *ref, int count, int dynamicCount)
+{
+	for(int i=0; i<count; i++){
+		ref->edges[i].l = ref->bbs[i].l;
+		ref->edges[i].id = (uint32_t)i;
+	}
+	qsort(ref->edges, count, sizeof(struct IndexEdge), CompareEdges);
+	
+	ref->pairs.count = 0;
+	for(int i=0; i<count; i++){
+		uint32_t a = ref->edges[i].id;
+		cpBB bb = ref->bbs[a];
+		
+		for(int j=i+1; j<count && ref->edges[j].l <= bb.r; j++){
+			uint32_t b = ref->edges[j].id;
+			if(a >= (uint32_t)dynamicCount && b >= (uint32_t)dynamicCount) continue;
+			if(cpBBIntersects(bb, ref->bbs[b])) IndexKeysPush(&ref->pairs, IndexPairKey(a, b));
+		}
+	}
+	
+	qsort(ref->pairs.keys, ref->pairs.count, sizeof(uint64_t), CompareTimes);
+}
+
+static void
+IndexReferenceHits(struct IndexReference *ref, int count, struct IndexKeys *hits, IndexOverlapFunc overlaps)
+{
+	hits->count = 0;
+	for(uint32_t q=0; q<INDEX_COMPARE_QUERY_COUNT; q++){
+		for(uint32_t i=0; i<(uint32_t)count; i++){
+			if(overlaps(ref, IndexKey(q, i))) IndexKeysPush(hits, IndexKey(q, i));
+		}
+	}
+}
+
+struct IndexCheck {
+	unsigned long reported, loose, missing, unexpected, duplicates;
+};
+
+// Filters out the loose keys, then compares what's left against the sorted reference keys.
+static void
+IndexCompareKeys(struct IndexReference *ref, struct IndexKeys *found, struct IndexKeys *expected, IndexOverlapFunc overlaps, struct IndexCheck *check)
+{
+	size_t kept = 0;
+	for(size_t i=0; i<found->count; i++){
+		if(overlaps(ref, found->keys[i])) found->keys[kept++] = found->keys[i];
+	}
+	
+	check->reported += found->count;
+	check->loose += found->count - kept;
+	qsort(found->keys, kept, sizeof(uint64_t), CompareTimes);
+	
+	size_t i = 0, j = 0;
+	while(i < kept || j < expected->count){
+		if(i > 0 && i < kept && found->keys[i] == found->keys[i - 1]){
+			check->duplicates++; i++;
+		} else if(j == expected->count || (i < kept && found->keys[i] < expected->keys[j])){
+			check->unexpected++; i++;
+		} else if(i == kept || expected->keys[j] < found->keys[i]){
+			check->missing++; j++;
+		} else {
+			i++; j++;
+		}
+	}
+}
+
+struct IndexCompareResult {
+	cpSpatialIndex *index, *staticIndex;
+	uint64_t insertTime, churnTime, reindexTime, queryTime, segmentTime;
+	size_t buildBytes, endBytes;
+	struct IndexCheck pairs, hits;
+};
+
+static unsigned long
+IndexCheckErrors(struct IndexCheck *check)
+{
+	return check->missing + check->unexpected + check->duplicates;
+}
+
+static unsigned long
+RunIndexCompare(FILE *log, struct IndexWorkload *workload, int steps)
+{
+	int typeCount = (int)(sizeof(index_types)/sizeof(*index_types));
+	int dynamicCount = workload->dynamicCount, count = workload->dynamicCount + workload->staticCount;
+	uint32_t seed = 1;
+	
+	struct IndexObject *objects = (struct IndexObject *)calloc(count, sizeof(struct IndexObject));
+	for(int i=0; i<count; i++) workload->init(objects + i, i, i < dynamicCount, &seed);
+	
+	struct IndexCompareResult *results = (struct IndexCompareResult *)calloc(typeCount, sizeof(struct IndexCompareResult));
+	for(int t=0; t<typeCount; t++){
+		struct IndexType *type = index_types + t;
+		struct IndexCompareResult *result = results + t;
+		
+		size_t bytes = HeapBytes();
+		uint64_t start = TimeNS();
+		result->staticIndex = (type->constructStatic ? type->constructStatic : type->construct)((cpSpatialIndexBBFunc)IndexObjectBB, NULL);
+		result->index = type->construct((cpSpatialIndexBBFunc)IndexObjectBB, result->staticIndex);
+		if(type->setVelocityFunc) type->setVelocityFunc(result->index, (cpBBTreeVelocityFunc)IndexObjectVelocity);
+		
+		for(int i=0; i<count; i++){
+			cpSpatialIndexInsert(i < dynamicCount ? result->index : result->staticIndex, objects + i, i);
+		}
+		
+		result->insertTime = TimeNS() - start;
+		result->buildBytes = HeapBytes() - bytes;
+	}
+	
+	struct IndexReference ref;
+	memset(&ref, 0, sizeof(ref));
+	ref.bbs = (cpBB *)calloc(count, sizeof(cpBB));
+	ref.edges = (struct IndexEdge *)calloc(count, sizeof(struct IndexEdge));
+	
+	struct IndexCollector collector;
+	memset(&collector, 0, sizeof(collector));
+	collector.objects = objects;
+	
+	for(int step=0; step<steps; step++){
+		for(int i=0; i<dynamicCount; i++){
+			struct IndexObject *obj = objects + i;
+			obj->p = cpvadd(obj->p, cpvmult(obj->v, 1.0f/60.0f));
+			if(obj->p.x < 0.0f || obj->p.x > INDEX_BENCH_SIZE) obj->v.x = -obj->v.x;
+			if(obj->p.y < 0.0f || obj->p.y > INDEX_BENCH_SIZE) obj->v.y = -obj->v.y;
+		}
+		
+		// Teleport a few objects by removing and reinserting them. One per slice so the same object isn't removed twice.
+		int churn[INDEX_COMPARE_CHURN_COUNT], slice = dynamicCount/INDEX_COMPARE_CHURN_COUNT;
+		for(int c=0; c<INDEX_COMPARE_CHURN_COUNT; c++) churn[c] = c*slice + (int)(IndexRandom(&seed)*slice);
+		
+		for(int t=0; t<typeCount; t++){
+			uint64_t start = TimeNS();
+			for(int c=0; c<INDEX_COMPARE_CHURN_COUNT; c++) cpSpatialIndexRemove(results[t].index, objects + churn[c], churn[c]);
+			results[t].churnTime += TimeNS() - start;
+		}
+		
+		for(int c=0; c<INDEX_COMPARE_CHURN_COUNT; c++) objects[churn[c]].p = IndexRandomPoint(&seed);
+		
+		for(int t=0; t<typeCount; t++){
+			uint64_t start = TimeNS();
+			for(int c=0; c<INDEX_COMPARE_CHURN_COUNT; c++) cpSpatialIndexInsert(results[t].index, objects + churn[c], churn[c]);
+			results[t].churnTime += TimeNS() - start;
+		}
+		
+		for(int i=0; i<count; i++) ref.bbs[i] = IndexObjectBB(objects + i);
+		IndexReferencePairs(&ref, count, dynamicCount);
+		
+		for(int t=0; t<typeCount; t++){
+			collector.keys.count = 0;
+			uint64_t start = TimeNS();
+			cpSpatialIndexReindexQuery(results[t].index, (cpSpatialIndexQueryFunc)IndexCollectPair, &collector);
+			results[t].reindexTime += TimeNS() - start;
+			
+			IndexCompareKeys(&ref, &collector.keys, &ref.pairs, IndexPairOverlaps, &results[t].pairs);
+		}
+		
+		for(int q=0; q<INDEX_COMPARE_QUERY_COUNT; q++){
+			cpVect a = IndexRandomPoint(&seed);
+			ref.queryBBs[q] = cpBBNewForCircle(a, 20.0f);
+			ref.segmentA[q] = a;
+			ref.segmentB[q] = cpvadd(a, IndexRandomVelocity(&seed, 100.0f));
+		}
+		
+		IndexReferenceHits(&ref, count, &ref.hits, IndexHitOverlaps);
+		IndexReferenceHits(&ref, count, &ref.segmentHits, IndexSegmentHitOverlaps);
+		
+		for(int t=0; t<typeCount; t++){
+			struct IndexCompareResult *result = results + t;
+			
+			collector.keys.count = 0;
+			uint64_t start = TimeNS();
+			for(uint32_t q=0; q<INDEX_COMPARE_QUERY_COUNT; q++){
+				collector.query = q;
+				cpSpatialIndexQuery(result->index, NULL, ref.queryBBs[q], (cpSpatialIndexQueryFunc)IndexCollectHit, &collector);
+				cpSpatialIndexQuery(result->staticIndex, NULL, ref.queryBBs[q], (cpSpatialIndexQueryFunc)IndexCollectHit, &collector);
+			}
+			result->queryTime += TimeNS() - start;
+			IndexCompareKeys(&ref, &collector.keys, &ref.hits, IndexHitOverlaps, &result->hits);
+			
+			collector.keys.count = 0;
+			start = TimeNS();
+			for(uint32_t q=0; q<INDEX_COMPARE_QUERY_COUNT; q++){
+				collector.query = q;
+				cpSpatialIndexSegmentQuery(result->index, NULL, ref.segmentA[q], ref.segmentB[q], 1.0f, (cpSpatialIndexSegmentQueryFunc)IndexCollectSegmentHit, &collector);
+				cpSpatialIndexSegmentQuery(result->staticIndex, NULL, ref.segmentA[q], ref.segmentB[q], 1.0f, (cpSpatialIndexSegmentQueryFunc)IndexCollectSegmentHit, &collector);
+			}
+			result->segmentTime += TimeNS() - start;
+			IndexCompareKeys(&ref, &collector.keys, &ref.segmentHits, IndexSegmentHitOverlaps, &result->hits);
+		}
+	}
+	
+	fprintf(log, "%s: %d dynamic and %d static objects.\n", workload->name, dynamicCount, workload->staticCount);
+	
+	unsigned long errors = 0;
+	double queries = (double)steps*INDEX_COMPARE_QUERY_COUNT;
+	for(int t=0; t<typeCount; t++){
+		struct IndexCompareResult *result = results + t;
+		
+		// Freeing the indexes shows how much memory they were holding on to by the end.
+		size_t bytes = HeapBytes();
+		cpSpatialIndexFree(result->index);
+		cpSpatialIndexFree(result->staticIndex);
+		result->endBytes = bytes - HeapBytes();
+		
+		fprintf(log, "  %-22s insert %6.0f ns  reinsert %6.0f ns  reindex %6.1f ns/obj  query %6.0f ns  segment %6.0f ns  memory %6.1f -> %6.1f B/obj  pairs %lu (%lu loose)",
+			index_types[t].name,
+			(double)result->insertTime/count,
+			(double)result->churnTime/((double)steps*INDEX_COMPARE_CHURN_COUNT),
+			(double)result->reindexTime/((double)steps*dynamicCount),
+			(double)result->queryTime/queries,
+			(double)result->segmentTime/queries,
+			(double)result->buildBytes/count, (double)result->endBytes/count,
+			result->pairs.reported - result->pairs.loose, result->pairs.loose
+		);
+		
+		unsigned long pairErrors = IndexCheckErrors(&result->pairs), hitErrors = IndexCheckErrors(&result->hits);
+		if(pairErrors + hitErrors == 0){
+			fprintf(log, "  ok\n");
+		} else {
+			fprintf(log, "  MISMATCH pairs %lu/%lu/%lu hits %lu/%lu/%lu (missing/unexpected/duplicate)\n",
+				result->pairs.missing, result->pairs.unexpected, result->pairs.duplicates,
+				result->hits.missing, result->hits.unexpected, result->hits.duplicates
+			);
+		}
+		
+		errors += pairErrors + hitErrors;
+	}
+	
+	free(ref.bbs);
+	free(ref.edges);
+	free(ref.pairs.keys);
+	free(ref.hits.keys);
+	free(ref.segmentHits.keys);
+	free(collector.keys.keys);
+	free(results);
+	free(objects);
+	
+	return errors;
+}
+
+static unsigned long
+RunIndexComparisons(FILE *log, int steps)
+{
+	fprintf(log, "Comparing spatial indexes, %d reinserted and %d box and segment queries per step. Times and memory are per operation or object.\n",
+		INDEX_COMPARE_CHURN_COUNT, INDEX_COMPARE_QUERY_COUNT
+	);
+	
+	unsigned long errors = 0;
+	for(size_t i=0; i<sizeof(index_workloads)/sizeof(*index_workloads); i++){
+		errors += RunIndexCompare(log, index_workloads + i, steps);
+	}
+	
+	if(errors) fprintf(stderr, "Spatial indexes disagreed %lu times.\n", errors);
+	return errors;
+}
+
+//MARK: Collision Benchmarks
+
+// Times cpShapesCollide() for each pair of shape types using a fixed set of random, mostly overlapping, poses.
+// Poly pairs that collide using the separating axis test are also run through GJK/EPA to check that the contacts match.
+// Pairs that spaces collide in batches are timed both through cpCollide() and cpCollideBatch(), and checked against each other.
+
+#define COLLIDE_BENCH_POSES 1000
+
+typedef cpShape *(*CollideShapeFunc)(cpBody *body);
+
+static cpShape *CollideCircle(cpBody *body){return cpCircleShapeNew(body, 10.0f, cpvzero);}
+static cpShape *CollideSegment(cpBody *body){return cpSegmentShapeNew(body, cpv(-20.0f, 0.0f), cpv(20.0f, 0.0f), 2.0f);}
+static cpShape *CollideBox(cpBody *body){return cpBoxShapeNew(body, 20.0f, 20.0f, 0.0f);}
+static cpShape *CollideRoundedBox(cpBody *body){return cpBoxShapeNew(body, 16.0f, 16.0f, 2.0f);}
+
+static cpShape *
+CollideRegularPoly(cpBody *body, int count)
+{
+	cpVect verts[24];
+	for(int i=0; i<count; i++) verts[i] = cpvmult(cpvforangle(2.0f*(cpFloat)CP_PI*i/count), 12.0f);
+	return cpPolyShapeNew(body, count, verts, cpTransformIdentity, 0.0f);
+}
+
+static cpShape *CollideHexagon(cpBody *body){return CollideRegularPoly(body, 6);}
+static cpShape *CollideDodecagon(cpBody *body){return CollideRegularPoly(body, 12);}
+static cpShape *CollideIcositetragon(cpBody *body){return CollideRegularPoly(body, 24);}
+
+struct CollideType {
+	const char *name;
+	CollideShapeFunc a, b;
+};
+
+static struct CollideType collide_types[] = {
+	{"circle/circle", CollideCircle, CollideCircle},
+	{"circle/segment", CollideCircle, CollideSegment},
+	{"segment/segment", CollideSegment, CollideSegment},
+	{"circle/box", CollideCircle, CollideBox},
+	{"segment/box", CollideSegment, CollideBox},
+	{"box/box", CollideBox, CollideBox},
+	{"box/hexagon", CollideBox, CollideHexagon},
+	{"hexagon/hexagon", CollideHexagon, CollideHexagon},
+	{"rounded box/rounded box", CollideRoundedBox, CollideRoundedBox},
+	{"box/rounded box", CollideBox, CollideRoundedBox},
+	{"12-gon/12-gon", CollideDodecagon, CollideDodecagon},
+	{"24-gon/24-gon", CollideIcositetragon, CollideIcositetragon},
+};
+
+static cpBool
+CollideUsesSAT(cpShape *shape)
+{
+	return (shape->klass->type == CP_POLY_SHAPE && cpPolyShapeGetCount(shape) <= cpCollidePolySATMaxCount);
+}
+
+static double
+TimeCollisions(cpShape **a, cpShape **b, int steps)
+{
+	unsigned long contacts = 0;
+	
+	uint64_t start = TimeNS();
+	for(int step=0; step<steps; step++){
+		for(int i=0; i<COLLIDE_BENCH_POSES; i++) contacts += cpShapesCollide(a[i], b[i]).count;
+	}
+	uint64_t elapsed = TimeNS() - start;
+	
+	// Use the contact count so the compiler can't throw away the calls.
+	return (double)elapsed/((double)steps*COLLIDE_BENCH_POSES) + (contacts == (unsigned long)-1 ? 1.0 : 0.0);
+}
+
+// Times the narrow-phase the way a space runs it for pairs that aren't batched.
+static double
+TimeSingleCollisions(cpShape **a, cpShape **b, int steps)
+{
+	struct cpContact contacts[CP_MAX_CONTACTS_PER_ARBITER];
+	unsigned long count = 0;
+	
+	uint64_t start = TimeNS();
+	for(int step=0; step<steps; step++){
+		for(int i=0; i<COLLIDE_BENCH_POSES; i++) count += cpCollide(a[i], b[i], 0, 0.0f, contacts).count;
+	}
+	uint64_t elapsed = TimeNS() - start;
+	
+	return (double)elapsed/((double)steps*COLLIDE_BENCH_POSES) + (count == (unsigned long)-1 ? 1.0 : 0.0);
+}
+
+static double
+TimeBatchCollisions(struct cpBatchPair *pairs, struct cpBatchCollision *results, int steps)
+{
+	unsigned long count = 0;
+	
+	uint64_t start = TimeNS();
+	for(int step=0; step<steps; step++){
+		for(int i=0; i<COLLIDE_BENCH_POSES; i += CP_COLLISION_BATCH_SIZE){
+			int batch = (COLLIDE_BENCH_POSES - i < CP_COLLISION_BATCH_SIZE ? COLLIDE_BENCH_POSES - i : CP_COLLISION_BATCH_SIZE);
+			cpCollideBatch(pairs + i, batch, results + i);
+			count += results[i].touching;
+		}
+	}
+	uint64_t elapsed = TimeNS() - start;
+	
+	return (double)elapsed/((double)steps*COLLIDE_BENCH_POSES) + (count == (unsigned long)-1 ? 1.0 : 0.0);
+}
+
+static cpBool
+ContactSetsMatch(const cpContactPointSet *set1, const cpContactPointSet *set2)
+{
+	if(set1->count != set2->count) return cpFalse;
+	if(set1->count > 0 && !cpvnear(set1->normal, set2->normal, 1e-5f)) return cpFalse;
+	
+	for(int i=0; i<set1->count; i++){
+		if(!cpvnear(set1->points[i].pointA, set2->points[i].pointA, 1e-4f)) return cpFalse;
+		if(!cpvnear(set1->points[i].pointB, set2->points[i].pointB, 1e-4f)) return cpFalse;
+	}
+	
+	return cpTrue;
+}
+
+static void
+RunCollideBenchmarks(FILE *log, int steps)
+{
+	fprintf(log, "Collisions: %d random poses per shape pair, times are per collision.\n", COLLIDE_BENCH_POSES);
+	
+	cpBody *bodies[2*COLLIDE_BENCH_POSES];
+	cpShape *a[COLLIDE_BENCH_POSES], *b[COLLIDE_BENCH_POSES];
+	
+	for(size_t t=0; t<sizeof(collide_types)/sizeof(*collide_types); t++){
+		struct CollideType *type = collide_types + t;
+		uint32_t seed = 1;
+		
+		for(int i=0; i<COLLIDE_BENCH_POSES; i++){
+			cpBody *bodyA = bodies[2*i + 0] = cpBodyNew(1.0f, 1.0f);
+			cpBodySetAngle(bodyA, 2.0f*(cpFloat)CP_PI*IndexRandom(&seed));
+			
+			cpBody *bodyB = bodies[2*i + 1] = cpBodyNew(1.0f, 1.0f);
+			cpBodySetPosition(bodyB, cpvmult(cpv(IndexRandom(&seed) - 0.5f, IndexRandom(&seed) - 0.5f), 50.0f));
+			cpBodySetAngle(bodyB, 2.0f*(cpFloat)CP_PI*IndexRandom(&seed));
+			
+			a[i] = type->a(bodyA);
+			b[i] = type->b(bodyB);
+			cpShapeCacheBB(a[i]);
+			cpShapeCacheBB(b[i]);
+		}
+		
+		int touching = 0;
+		for(int i=0; i<COLLIDE_BENCH_POSES; i++) touching += (cpShapesCollide(a[i], b[i]).count > 0);
+		
+		double time = TimeCollisions(a, b, steps);
+		fprintf(log, "%-24s %7.1f ns  touching %3d%%", type->name, time, 100*touching/COLLIDE_BENCH_POSES);
+		
+		if(CollideUsesSAT(a[0]) && CollideUsesSAT(b[0])){
+			int mismatches = 0;
+			int maxCount = cpCollidePolySATMaxCount;
+			
+			cpCollidePolySATMaxCount = 0;
+			double gjkTime = TimeCollisions(a, b, steps);
+			
+			for(int i=0; i<COLLIDE_BENCH_POSES; i++){
+				cpContactPointSet gjk = cpShapesCollide(a[i], b[i]);
+				cpCollidePolySATMaxCount = maxCount;
+				cpContactPointSet sat = cpShapesCollide(a[i], b[i]);
+				cpCollidePolySATMaxCount = 0;
+				
+				mismatches += !ContactSetsMatch(&sat, &gjk);
+			}
+			
+			cpCollidePolySATMaxCount = maxCount;
+			fprintf(log, "  GJK/EPA %7.1f ns  mismatched contacts %d\n", gjkTime, mismatches);
+		} else if(cpShapesCollideInBatches(a[0], b[0])){
+			struct cpBatchPair pairs[COLLIDE_BENCH_POSES];
+			struct cpBatchCollision results[COLLIDE_BENCH_POSES];
+			for(int i=0; i<COLLIDE_BENCH_POSES; i++) pairs[i] = (struct cpBatchPair){a[i], b[i], 0, 0.0f};
+			
+			double singleTime = TimeSingleCollisions(a, b, steps);
+			double batchTime = TimeBatchCollisions(pairs, results, steps);
+			
+			int mismatches = 0;
+			for(int i=0; i<COLLIDE_BENCH_POSES; i++){
+				cpContactPointSet single = cpShapesCollide(a[i], b[i]);
+				
+				cpContactPointSet batched = {0};
+				if(results[i].touching){
+					batched.count = 1;
+					batched.normal = results[i].n;
+					batched.points[0].pointA = results[i].r1;
+					batched.points[0].pointB = results[i].r2;
+				}
+				
+				mismatches += !ContactSetsMatch(&single, &batched);
+			}
+			
+			fprintf(log, "  cpCollide %7.1f ns  batched %7.1f ns  mismatched contacts %d\n", singleTime, batchTime, mismatches);
+		} else {
+			fprintf(log, "\n");
+		}
+		
+		for(int i=0; i<COLLIDE_BENCH_POSES; i++){
+			cpShapeFree(a[i]);
+			cpShapeFree(b[i]);
+		}
+		
+		for(int i=0; i<2*COLLIDE_BENCH_POSES; i++) cpBodyFree(bodies[i]);
+	}
+}
+
+//MARK: Speculative Contact Benchmarks
+
+// Fires fast bullets and debris at thin walls and compares stepping at 240 Hz, the usual way to keep them from tunneling,
+// with stepping at a quarter of that rate with and without speculative contacts or flagging the bodies as bullets.
+
+#define SPECULATIVE_BENCH_BODIES 200
+#define SPECULATIVE_BENCH_HZ 60
+
+struct SpeculativeScene {
+	const char *name;
+	void (*populate)(cpSpace *space, uint32_t *seed);
+	// Returns true if the body ended up outside of the walls.
+	cpBool (*escaped)(cpBody *body);
+};
+
+struct SpeculativeConfig {
+	const char *name;
+	int substeps;
+	cpBool speculative;
+	cpBool bullets;
+};
+
+static const struct SpeculativeConfig speculative_configs[] = {
+	{"240 Hz", 4, cpFalse, cpFalse},
+	{" 60 Hz", 1, cpFalse, cpFalse},
+	{" 60 Hz speculative", 1, cpTrue, cpFalse},
+	{" 60 Hz bullets", 1, cpFalse, cpTrue},
+};
+
+static cpBody *
+SpeculativeAddBody(cpSpace *space, uint32_t *seed, cpVect p, cpVect v)
+{
+	cpFloat size = 6.0f;
+	cpBody *body;
+	cpShape *shape;
+	
+	// Mix in circles, boxes and long thin bars spinning quickly.
+	int kind = (int)(3.0f*IndexRandom(seed));
+	if(kind == 0){
+		body = cpSpaceAddBody(space, cpBodyNew(1.0f, cpMomentForCircle(1.0f, 0.0f, size/2.0f, cpvzero)));
+		shape = cpSpaceAddShape(space, cpCircleShapeNew(body, size/2.0f, cpvzero));
+	} else if(kind == 1){
+		body = cpSpaceAddBody(space, cpBodyNew(1.0f, cpMomentForBox(1.0f, size, size)));
+		shape = cpSpaceAddShape(space, cpBoxShapeNew(body, size, size, 0.0f));
+	} else {
+		body = cpSpaceAddBody(space, cpBodyNew(1.0f, cpMomentForBox(1.0f, 4.0f*size, size/2.0f)));
+		shape = cpSpaceAddShape(space, cpBoxShapeNew(body, 4.0f*size, size/2.0f, 0.0f));
+		cpBodySetAngularVelocity(body, 40.0f*(IndexRandom(seed) - 0.5f));
+	}
+	
+	cpShapeSetElasticity(shape, 0.5f);
+	cpShapeSetFriction(shape, 0.7f);
+	cpBodySetPosition(body, p);
+	cpBodySetVelocity(body, v);
+	return body;
+}
+
+static void
+SpeculativeAddWall(cpSpace *space, cpVect a, cpVect b)
+{
+	cpShape *wall = cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), a, b, 2.0f));
+	cpShapeSetElasticity(wall, 0.5f);
+	cpShapeSetFriction(wall, 0.7f);
+}
+
+// Bullets fired in every direction from the center of a closed box.
+static void
+SpeculativeBulletsPopulate(cpSpace *space, uint32_t *seed)
+{
+	cpSpaceSetGravity(space, cpv(0.0f, -100.0f));
+	SpeculativeAddWall(space, cpv(-300.0f, -300.0f), cpv( 300.0f, -300.0f));
+	SpeculativeAddWall(space, cpv( 300.0f, -300.0f), cpv( 300.0f,  300.0f));
+	SpeculativeAddWall(space, cpv( 300.0f,  300.0f), cpv(-300.0f,  300.0f));
+	SpeculativeAddWall(space, cpv(-300.0f,  300.0f), cpv(-300.0f, -300.0f));
+	
+	for(int i=0; i<SPECULATIVE_BENCH_BODIES; i++){
+		cpVect p = cpv(200.0f*(IndexRandom(seed) - 0.5f), 200.0f*(IndexRandom(seed) - 0.5f));
+		cpVect v = cpvmult(cpvforangle(2.0f*(cpFloat)CP_PI*IndexRandom(seed)), 400.0f + 600.0f*IndexRandom(seed));
+		SpeculativeAddBody(space, seed, p, v);
+	}
+}
+
+static cpBool
+SpeculativeBulletsEscaped(cpBody *body)
+{
+	cpVect p = cpBodyGetPosition(body);
+	return (cpfabs(p.x) > 300.0f || cpfabs(p.y) > 300.0f);
+}
+
+// Debris thrown down onto a thin floor where it piles up.
+static void
+SpeculativeDebrisPopulate(cpSpace *space, uint32_t *seed)
+{
+	cpSpaceSetGravity(space, cpv(0.0f, -500.0f));
+	SpeculativeAddWall(space, cpv(-300.0f, 0.0f), cpv(300.0f, 0.0f));
+	SpeculativeAddWall(space, cpv(-300.0f, 0.0f), cpv(-300.0f, 1000.0f));
+	SpeculativeAddWall(space, cpv( 300.0f, 0.0f), cpv( 300.0f, 1000.0f));
+	
+	for(int i=0; i<SPECULATIVE_BENCH_BODIES; i++){
+		cpVect p = cpv(500.0f*(IndexRandom(seed) - 0.5f), 100.0f + 800.0f*IndexRandom(seed));
+		cpVect v = cpv(200.0f*(IndexRandom(seed) - 0.5f), -400.0f - 600.0f*IndexRandom(seed));
+		SpeculativeAddBody(space, seed, p, v);
+	}
+}
+
+static cpBool
+SpeculativeDebrisEscaped(cpBody *body)
+{
+	cpVect p = cpBodyGetPosition(body);
+	return (p.y < 0.0f || cpfabs(p.x) > 300.0f);
+}
+
+static const struct SpeculativeScene speculative_scenes[] = {
+	{"bullets", SpeculativeBulletsPopulate, SpeculativeBulletsEscaped},
+	{"debris", SpeculativeDebrisPopulate, SpeculativeDebrisEscaped},
+};
+
+struct SpeculativeResult {
+	int escaped;
+	// Average height of the bodies that stayed inside, to compare where they came to rest.
+	cpFloat height;
+	// Deepest overlap of any contact at the end of the run.
+	cpFloat depth;
+};
+
+static void
+SpeculativeMeasureBody(cpBody *body, void *data)
+{
+	void **context = (void **)data;
+	const struct SpeculativeScene *scene = (const struct SpeculativeScene *)context[0];
+	struct SpeculativeResult *result = (struct SpeculativeResult *)context[1];
+	
+	if(scene->escaped(body)){
+		result->escaped++;
+	} else {
+		result->height += cpBodyGetPosition(body).y;
+	}
+}
+
+static void
+SpeculativeMeasureArbiter(cpBody *body, cpArbiter *arb, struct SpeculativeResult *result)
+{
+	for(int i=0; i<cpArbiterGetCount(arb); i++) result->depth = cpfmax(result->depth, -cpArbiterGetDepth(arb, i));
+}
+
+static void
+SpeculativeMeasureArbiters(cpBody *body, struct SpeculativeResult *result)
+{
+	cpBodyEachArbiter(body, (cpBodyArbiterIteratorFunc)SpeculativeMeasureArbiter, result);
+}
+
+static void
+SpeculativeSetBullet(cpBody *body, void *unused)
+{
+	cpBodySetBullet(body, cpTrue);
+}
+
+static void
+RunSpeculativeBenchmarks(FILE *log, int steps)
+{
+	fprintf(log, "Speculative contacts and bullets: %d bodies, %.1f simulated seconds per run.\n", SPECULATIVE_BENCH_BODIES, (double)steps/SPECULATIVE_BENCH_HZ);
+	
+	for(size_t s=0; s<sizeof(speculative_scenes)/sizeof(*speculative_scenes); s++){
+		const struct SpeculativeScene *scene = speculative_scenes + s;
+		
+		for(size_t c=0; c<sizeof(speculative_configs)/sizeof(*speculative_configs); c++){
+			const struct SpeculativeConfig *config = speculative_configs + c;
+			
+			cpSpace *space = cpSpaceNew();
+			cpSpaceSetIterations(space, 10);
+			cpSpaceSetSpeculativeContacts(space, config->speculative);
+			
+			uint32_t seed = 1;
+			scene->populate(space, &seed);
+			if(config->bullets) cpSpaceEachBody(space, SpeculativeSetBullet, NULL);
+			
+			cpFloat dt = 1.0f/(SPECULATIVE_BENCH_HZ*config->substeps);
+			uint64_t start = TimeNS();
+			for(int step=0; step<steps*config->substeps; step++) cpSpaceStep(space, dt);
+			uint64_t elapsed = TimeNS() - start;
+			
+			struct SpeculativeResult result = {0, 0.0f, 0.0f};
+			void *context[] = {(void *)scene, &result};
+			cpSpaceEachBody(space, SpeculativeMeasureBody, context);
+			cpSpaceEachBody(space, (cpSpaceBodyIteratorFunc)SpeculativeMeasureArbiters, &result);
+			
+			int inside = SPECULATIVE_BENCH_BODIES - result.escaped;
+			fprintf(log, "  %-8s %-20s escaped %3d/%d  mean height %7.1f  max depth %5.2f  %8.2f ms per simulated second\n",
+				scene->name, config->name, result.escaped, SPECULATIVE_BENCH_BODIES, (inside ? result.height/inside : 0.0f), result.depth,
+				1e-6*(double)elapsed*SPECULATIVE_BENCH_HZ/steps
+			);
+			
+			ChipmunkDemoFreeSpaceChildren(space);
+			cpSpaceFree(space);
+		}
+	}
+}
+
+//MARK: Contact Solver Comparisons
+
+// Steps each benchmark with each contact solver in lockstep and compares the bodies to the colored scalar solver after every step.
+// The SIMD solvers solve the contacts in the same order as the colored scalar solver, but the compiler may round their math differently.
+// Those differences grow without bound in busy scenes, so the bodies are copied from the colored solver after each comparison.
+// This way each step only measures the difference from solving the same contacts once.
+// The plain scalar solver solves the contacts in a different order. Its difference is only printed.
+
+// Largest difference allowed in a single step between the SIMD solvers and the colored scalar solver.
+#define SOLVER_BENCH_TOLERANCE 1e-6
+
+struct SolverType {
+	const char *name;
+	cpContactSolverType type;
+};
+
+static const struct SolverType solver_types[] = {
+	{"colored", CP_CONTACT_SOLVER_SCALAR_COLORED},
+	{"scalar", CP_CONTACT_SOLVER_SCALAR},
+	{"SSE2", CP_CONTACT_SOLVER_SSE2},
+	{"AVX2", CP_CONTACT_SOLVER_AVX2},
+};
+
+#define SOLVER_TYPE_COUNT (int)(sizeof(solver_types)/sizeof(*solver_types))
+
+struct SolverSpace {
+	cpSpace *space;
+	int count, capacity;
+	cpBody **bodies;
+	// Largest difference from the colored solver in any step.
+	cpFloat difference;
+};
+
+static void
+SolverStoreBody(cpBody *body, struct SolverSpace *solver)
+{
+	if(cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC) return;
+	
+	if(solver->count == solver->capacity){
+		solver->capacity = (solver->capacity ? 2*solver->capacity : 256);
+		solver->bodies = (cpBody **)realloc(solver->bodies, solver->capacity*sizeof(cpBody *));
+	}
+	
+	solver->bodies[solver->count++] = body;
+}
+
+static void
+SolverSpaceInit(struct SolverSpace *solver, ChipmunkDemo *bench, int threads, cpContactSolverType type)
+{
+	solver->count = 0;
+	solver->difference = 0.0f;
+	
+	srand(45073);
+	solver->space = bench->initFunc();
+	cpSpaceSetContactSolver(solver->space, type);
+	// Use the parallel code paths for any number of threads.
+	if(threads >= 0) cpHastySpaceSetDeterministic(solver->space, cpTrue);
+	
+	cpSpaceEachBody(solver->space, (cpSpaceBodyIteratorFunc)SolverStoreBody, solver);
+}
+
+static inline cpFloat
+SolverBodyDifference(cpBody *a, cpBody *b)
+{
+	cpVect dp = cpvsub(cpBodyGetPosition(a), cpBodyGetPosition(b));
+	cpVect dv = cpvsub(cpBodyGetVelocity(a), cpBodyGetVelocity(b));
+	cpFloat da = cpBodyGetAngle(a) - cpBodyGetAngle(b);
+	cpFloat dw = cpBodyGetAngularVelocity(a) - cpBodyGetAngularVelocity(b);
+	
+	return cpfmax(cpfmax(cpfmax(cpfabs(dp.x), cpfabs(dp.y)), cpfmax(cpfabs(dv.x), cpfabs(dv.y))), cpfmax(cpfabs(da), cpfabs(dw)));
+}
+
+// Compare the bodies to the reference, then copy the reference bodies so the next step starts from the same state.
+static void
+SolverSpaceSync(struct SolverSpace *solver, struct SolverSpace *reference)
+{
+	if(solver->count != reference->count){
+		solver->difference = INFINITY;
+		return;
+	}
+	
+	for(int i=0; i<solver->count; i++){
+		cpBody *body = solver->bodies[i], *ref = reference->bodies[i];
+		solver->difference = cpfmax(solver->difference, SolverBodyDifference(body, ref));
+		
+		// Set the angle first since setting the position depends on it.
+		cpBodySetAngle(body, cpBodyGetAngle(ref));
+		cpBodySetPosition(body, cpBodyGetPosition(ref));
+		cpBodySetVelocity(body, cpBodyGetVelocity(ref));
+		cpBodySetAngularVelocity(body, cpBodyGetAngularVelocity(ref));
+	}
+}
+
+static int
+RunSolverComparisons(FILE *log, int steps, const int *threadCounts, int threadCountCount, const char **filters, int filterCount)
+{
+	fprintf(log, "Contact solvers: SIMD solvers must be within %g of the colored scalar solver after each step.\n", SOLVER_BENCH_TOLERANCE);
+	
+	struct SolverSpace solvers[SOLVER_TYPE_COUNT];
+	memset(solvers, 0, sizeof(solvers));
+	int failures = 0;
+	
+	for(int i=0; i<bench_count; i++){
+		ChipmunkDemo *bench = bench_list + i;
+		if(!Selected(bench, filters, filterCount)) continue;
+		
+		// Run each benchmark in a regular cpSpace followed by each of the hasty space thread counts.
+		for(int t=-1; t<threadCountCount; t++){
+			int threads = (t < 0 ? -1 : threadCounts[t]);
+			
+			char space[32];
+			if(threads < 0){
+				sprintf(space, "cpSpace");
+			} else {
+				sprintf(space, "cpHastySpace/%d", threads);
+			}
+			
+			bench_hasty_threads = threads;
+			for(int s=0; s<SOLVER_TYPE_COUNT; s++){
+				solvers[s].space = NULL;
+				if(cpContactSolverIsSupported(solver_types[s].type)) SolverSpaceInit(solvers + s, bench, threads, solver_types[s].type);
+			}
+			
+			for(int step=0; step<steps; step++){
+				for(int s=0; s<SOLVER_TYPE_COUNT; s++){
+					if(solvers[s].space) bench->updateFunc(solvers[s].space, bench->timestep);
+				}
+				
+				// The colored solver is the reference that the rest are compared to.
+				for(int s=1; s<SOLVER_TYPE_COUNT; s++){
+					if(solvers[s].space) SolverSpaceSync(solvers + s, solvers + 0);
+				}
+			}
+			
+			for(int s=0; s<SOLVER_TYPE_COUNT; s++){
+				const struct SolverType *solver = solver_types + s;
+				
+				if(solvers[s].space == NULL){
+					fprintf(log, "%-30s %-16s %-8s not supported by this CPU\n", BenchName(bench), space, solver->name);
+				} else if(s == 0){
+					fprintf(log, "%-30s %-16s %-8s reference\n", BenchName(bench), space, solver->name);
+				} else {
+					const char *status = "";
+					if(solver->type != CP_CONTACT_SOLVER_SCALAR && !(solvers[s].difference <= SOLVER_BENCH_TOLERANCE)){
+						status = "  FAILED";
+						failures++;
+					}
+					
+					fprintf(log, "%-30s %-16s %-8s max step difference %9.3g%s\n", BenchName(bench), space, solver->name, (double)solvers[s].difference, status);
+				}
+				
+				if(solvers[s].space) bench->destroyFunc(solvers[s].space);
+			}
+			bench_hasty_threads = -1;
+		}
+	}
+	
+	for(int s=0; s<SOLVER_TYPE_COUNT; s++) free(solvers[s].bodies);
+	
+	fprintf(log, "%d solver comparisons failed.\n", failures);
+	return failures;
+}
+
+//MARK: Main
+
+static void
+Usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [-steps n] [-threads 1,2,4] [-bench name] [-deterministic] [-json file] [-list] [-index] [-compare] [-collide] [-speculative] [-solver]\n"
+		"  -steps n        Number of steps to time for each benchmark. (default 1000)\n"
+		"  -threads list   Comma separated hasty space thread counts to run. 0 uses one thread per CPU. (default 1,2,4)\n"
+		"  -bench name     Only run benchmarks containing name. Can be used more than once.\n"
+		"  -deterministic  Run the hasty spaces in deterministic mode, and fail if their final states differ between thread counts.\n"
+		"  -json file      Write the results as JSON to file, or to stdout if file is '-'.\n"
+		"  -list           List the benchmarks and exit.\n"
+		"  -index          Time reindexing and queries for each spatial index type instead of running the benchmarks.\n"
+		"  -compare        Run each spatial index type through several workloads, and fail if they don't find the same pairs and query hits.\n"
+		"  -collide        Time collisions between each pair of shape types instead of running the benchmarks. -steps sets the number of passes.\n"
+		"  -speculative    Compare thin walls hit by fast bodies at 240 Hz and at 60 Hz with speculative contacts or bullet bodies. -steps sets the number of 60 Hz steps.\n"
+		"  -solver         Step the benchmarks with each contact solver, and fail if the SSE2 or AVX2 solvers differ from the colored scalar solver by more than %g in any step.\n",
+		program, SOLVER_BENCH_TOLERANCE
+	);
+}
+
+int
+main(int argc, const char **argv)
+{
+	int steps = 1000;
+	int threadCounts[MAX_THREAD_COUNTS] = {1, 2, 4};
+	int threadCountCount = 3;
+	const char *jsonPath = NULL;
+	cpBool deterministic = cpFalse;
+	cpBool indexes = cpFalse;
+	cpBool compare = cpFalse;
+	cpBool collide = cpFalse;
+	cpBool speculative = cpFalse;
+	cpBool solver = cpFalse;
+	
+	const char **filters = (const char **)calloc(argc, sizeof(const char *));
+	int filterCount = 0;
+	
+	for(int i=1; i<argc; i++){
+		if(strcmp(argv[i], "-steps") == 0 && i + 1 < argc){
+			steps = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc){
+			const char *list = argv[++i];
+			threadCountCount = 0;
+			
+			while(*list && threadCountCount < MAX_THREAD_COUNTS){
+				threadCounts[threadCountCount++] = atoi(list);
+				list += strcspn(list, ",");
+				if(*list == ',') list++;
+			}
+		} else if(strcmp(argv[i], "-bench") == 0 && i + 1 < argc){
+			filters[filterCount++] = argv[++i];
+		} else if(strcmp(argv[i], "-deterministic") == 0){
+			deterministic = cpTrue;
+		} else if(strcmp(argv[i], "-json") == 0 && i + 1 < argc){
+			jsonPath = argv[++i];
+		} else if(strcmp(argv[i], "-list") == 0){
+			for(int j=0; j<bench_count; j++) printf("%s\n", BenchName(bench_list + j));
+			return EXIT_SUCCESS;
+		} else if(strcmp(argv[i], "-index") == 0){
+			indexes = cpTrue;
+		} else if(strcmp(argv[i], "-compare") == 0){
+			compare = cpTrue;
+		} else if(strcmp(argv[i], "-collide") == 0){
+			collide = cpTrue;
+		} else if(strcmp(argv[i], "-speculative") == 0){
+			speculative = cpTrue;
+		} else if(strcmp(argv[i], "-solver") == 0){
+			solver = cpTrue;
+		} else {
+			Usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	if(steps <= 0){
+		Usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	// Keep stdout clean for the JSON output.
+	FILE *log = (jsonPath && strcmp(jsonPath, "-") == 0 ? stderr : stdout);
+	fprintf(log, "Chipmunk %s, %d steps per benchmark.\n", cpVersionString, steps);
+	
+	if(indexes){
+		RunIndexBenchmarks(log, steps);
+		free(filters);
+		return EXIT_SUCCESS;
+	}
+	
+	if(collide){
+		RunCollideBenchmarks(log, steps);
+		free(filters);
+		return EXIT_SUCCESS;
+	}
+	
+	if(speculative){
+		RunSpeculativeBenchmarks(log, steps);
+		free(filters);
+		return EXIT_SUCCESS;
+	}
+	
+	if(solver){
+		int failures = RunSolverComparisons(log, steps, threadCounts, threadCountCount, filters, filterCount);
+		free(filters);
+		return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	
+	if(compare){
+		unsigned long errors = RunIndexComparisons(log, steps);
+		free(filters);
+		return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	
+	struct Result *results = (struct Result *)calloc(bench_count*(threadCountCount + 1), sizeof(struct Result));
+	int resultCount = 0;
+	uint64_t *times = (uint64_t *)calloc(steps, sizeof(uint64_t));
+	int mismatches = 0;
+	
+	for(int i=0; i<bench_count; i++){
+		ChipmunkDemo *bench = bench_list + i;
+		if(!Selected(bench, filters, filterCount)) continue;
+		
+		// Run the regular space first, followed by the hasty space at each thread count.
+		struct Result *first = results + resultCount;
+		for(int j=-1; j<threadCountCount; j++){
+			struct Result *result = results + resultCount++;
+			*result = RunBench(bench, (j < 0 ? -1 : threadCounts[j]), deterministic, steps, times);
+			PrintResult(log, result);
+			
+			// In deterministic mode the hasty spaces must all end up in the same state.
+			if(deterministic && j > 0 && result->hash != first[1].hash){
+				fprintf(stderr, "%s: cpHastySpace state with %d threads doesn't match the state with %d threads.\n", result->name, result->threads, first[1].threads);
+				mismatches++;
+			}
+		}
+	}
+	
+	if(jsonPath){
+		FILE *file = (strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w"));
+		if(!file){
+			fprintf(stderr, "Could not open '%s' for writing.\n", jsonPath);
+			return EXIT_FAILURE;
+		}
+		
+		WriteJSON(file, results, resultCount, deterministic);
+		if(file != stdout) fclose(file);
+	}
+	
+	free(times);
+	free(results);
+	free(filters);
+	
+	return (mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
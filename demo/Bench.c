@@ -2,24 +2,43 @@
 #include "chipmunk/chipmunk_unsafe.h"
 #include "ChipmunkDemo.h"
 
-#define ENABLE_HASTY 0
-#if ENABLE_HASTY
-	#include "chipmunk/cpHastySpace.h"
-	
-	static cpSpace *MakeHastySpace(){
+#include "chipmunk/cpHastySpace.h"
+
+// Run the benchmarks using a cpHastySpace with this many threads (0 picks the number of CPUs).
+// A regular cpSpace is used when negative. Changed by the headless benchmark runner to compare the two.
+int bench_hasty_threads = -1;
+
+static cpSpace *
+BenchSpaceNew(void)
+{
+	if(bench_hasty_threads >= 0){
 		cpSpace *space = cpHastySpaceNew();
-		cpHastySpaceSetThreads(space, 0);
+		cpHastySpaceSetThreads(space, bench_hasty_threads);
 		return space;
+	} else {
+		return cpSpaceNew();
 	}
-	
-	#define BENCH_SPACE_NEW MakeHastySpace
-	#define BENCH_SPACE_FREE cpHastySpaceFree
-	#define BENCH_SPACE_STEP cpHastySpaceStep
-#else
-	#define BENCH_SPACE_NEW cpSpaceNew
-	#define BENCH_SPACE_FREE cpSpaceFree
-	#define BENCH_SPACE_STEP cpSpaceStep
-#endif
+}
+
+static void
+BenchSpaceFree(cpSpace *space)
+{
+	if(bench_hasty_threads >= 0){
+		cpHastySpaceFree(space);
+	} else {
+		cpSpaceFree(space);
+	}
+}
+
+static void
+BenchSpaceStep(cpSpace *space, cpFloat dt)
+{
+	if(bench_hasty_threads >= 0){
+		cpHastySpaceStep(space, dt);
+	} else {
+		cpSpaceStep(space, dt);
+	}
+}
 
 const cpFloat bevel = 1.0;
 
@@ -80,7 +99,7 @@ static void add_hexagon(cpSpace *space, int index, cpFloat radius){
 
 static cpSpace *
 SetupSpace_simpleTerrain(){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	cpSpaceSetGravity(space, cpv(0, -100));
 	cpSpaceSetCollisionSlop(space, 0.5f);
@@ -215,7 +234,7 @@ static cpVect complex_terrain_verts[] = {
 static int complex_terrain_count = sizeof(complex_terrain_verts)/sizeof(cpVect);
 
 static cpSpace *init_ComplexTerrainCircles_1000(void){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	cpSpaceSetGravity(space, cpv(0, -100));
 	cpSpaceSetCollisionSlop(space, 0.5f);
@@ -240,7 +259,7 @@ static cpSpace *init_ComplexTerrainCircles_1000(void){
 }
 
 static cpSpace *init_ComplexTerrainHexagons_1000(void){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	cpSpaceSetGravity(space, cpv(0, -100));
 	cpSpaceSetCollisionSlop(space, 0.5f);
@@ -320,7 +339,7 @@ static cpVect bouncy_terrain_verts[] = {
 static int bouncy_terrain_count = sizeof(bouncy_terrain_verts)/sizeof(cpVect);
 
 static cpSpace *init_BouncyTerrainCircles_500(void){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	
 	cpVect offset = cpv(-320, -240);
@@ -345,7 +364,7 @@ static cpSpace *init_BouncyTerrainCircles_500(void){
 }
 
 static cpSpace *init_BouncyTerrainHexagons_500(void){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	
 	cpVect offset = cpv(-320, -240);
@@ -386,7 +405,7 @@ static cpBool NoCollide_begin(cpArbiter *arb, cpSpace *space, void *data){
 
 
 static cpSpace *init_NoCollide(void){
-	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpace *space = BenchSpaceNew();
 	cpSpaceSetIterations(space, 10);
 	
 	cpCollisionHandler *handler = cpSpaceAddCollisionHandler(space, 2, 2);
@@ -440,12 +459,12 @@ static cpSpace *init_NoCollide(void){
 
 // Build benchmark list
 static void update(cpSpace *space, double dt){
-	BENCH_SPACE_STEP(space, dt);
+	BenchSpaceStep(space, dt);
 }
 
 static void destroy(cpSpace *space){
 	ChipmunkDemoFreeSpaceChildren(space);
-	BENCH_SPACE_FREE(space);
+	BenchSpaceFree(space);
 }
 
 // Make a second demo declaration for this demo to use in the regular demo set.
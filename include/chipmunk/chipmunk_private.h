@@ -31,6 +31,30 @@
 // TODO: Eww. Magic numbers.
 #define MAGIC_EPSILON 1e-5
 
+// Step stats are only collected when the library is built with CP_STEP_STATS enabled.
+#if CP_STEP_STATS
+	// Monotonic time in nanoseconds.
+	uint64_t cpStepStatsTime(void);
+	
+	// Start a timer used to time a sequence of phases.
+	#define CP_STATS_START(__timer__) uint64_t __timer__ = cpStepStatsTime()
+	// Restart a timer without recording the time since the last lap.
+	#define CP_STATS_RESTART(__timer__) (__timer__ = cpStepStatsTime())
+	// Add the time since the timer's last lap to a field of a cpSpaceStepStats.
+	#define CP_STATS_LAP(__timer__, __stats__, __field__) do { \
+		uint64_t __now__ = cpStepStatsTime(); \
+		(__stats__)->__field__ += __now__ - __timer__; \
+		__timer__ = __now__; \
+	} while(0)
+	// Add to a counter field.
+	#define CP_STATS_COUNT(__stats__, __field__, __n__) ((__stats__)->__field__ += (__n__))
+#else
+	#define CP_STATS_START(__timer__)
+	#define CP_STATS_RESTART(__timer__)
+	#define CP_STATS_LAP(__timer__, __stats__, __field__)
+	#define CP_STATS_COUNT(__stats__, __field__, __n__)
+#endif
+
 
 //MARK: cpArray
 
@@ -57,6 +81,7 @@ void cpHashSetSetDefaultValue(cpHashSet *set, void *default_value);
 void cpHashSetFree(cpHashSet *set);
 
 int cpHashSetCount(cpHashSet *set);
+void cpHashSetReserve(cpHashSet *set, int count);
 const void *cpHashSetInsert(cpHashSet *set, cpHashValue hash, const void *ptr, cpHashSetTransFunc trans, void *data);
 const void *cpHashSetRemove(cpHashSet *set, cpHashValue hash, const void *ptr);
 const void *cpHashSetFind(cpHashSet *set, cpHashValue hash, const void *ptr);
@@ -68,6 +93,58 @@ typedef cpBool (*cpHashSetFilterFunc)(void *elt, void *data);
 void cpHashSetFilter(cpHashSet *set, cpHashSetFilterFunc func, void *data);
 
 
+//MARK: cpObjTable
+
+// Open addressed table that maps objects to indexes in a spatial index's own entry array.
+// Only the hash ids are stored, so finding an object asks the spatial index for the object at each candidate index.
+// Removing uses backward shift deletion so there are never any tombstones to skip over.
+
+#define CP_OBJ_TABLE_EMPTY (0xFFFFFFFFu)
+
+struct cpObjTableSlot {
+	cpHashValue hashid;
+	uint32_t index;
+};
+
+typedef struct cpObjTable {
+	struct cpObjTableSlot *slots;
+	uint32_t mask, count;
+} cpObjTable;
+
+// Returns the object stored at an index of the spatial index's entry array.
+typedef void *(*cpObjTableObjFunc)(const void *data, uint32_t index);
+
+void cpObjTableInit(cpObjTable *table);
+void cpObjTableDestroy(cpObjTable *table);
+
+void cpObjTableInsert(cpObjTable *table, cpHashValue hashid, uint32_t index);
+void cpObjTableRemove(cpObjTable *table, uint32_t slot);
+// Remove everything without freeing the slots, used before reinserting entries that moved.
+void cpObjTableClear(cpObjTable *table);
+
+static inline uint32_t
+cpObjTableHash(cpHashValue hashid)
+{
+	return (uint32_t)(hashid*CP_HASH_COEF);
+}
+
+// Returns the slot holding obj, or CP_OBJ_TABLE_EMPTY if it's not in the table.
+// Inlined so the compiler can inline objFunc too.
+static inline uint32_t
+cpObjTableFind(const cpObjTable *table, void *obj, cpHashValue hashid, cpObjTableObjFunc objFunc, const void *data)
+{
+	const struct cpObjTableSlot *slots = table->slots;
+	if(!slots) return CP_OBJ_TABLE_EMPTY;
+	
+	uint32_t mask = table->mask;
+	for(uint32_t i = cpObjTableHash(hashid)&mask; slots[i].index != CP_OBJ_TABLE_EMPTY; i = (i + 1)&mask){
+		if(slots[i].hashid == hashid && objFunc(data, slots[i].index) == obj) return i;
+	}
+	
+	return CP_OBJ_TABLE_EMPTY;
+}
+
+
 //MARK: Bodies
 
 void cpBodyAddShape(cpBody *body, cpShape *shape);
@@ -78,11 +155,58 @@ void cpBodyAccumulateMassFromShapes(cpBody *body);
 
 void cpBodyRemoveConstraint(cpBody *body, cpConstraint *constraint);
 
+// Move the center of gravity to p and set the angle without waking the body or clearing its forces.
+void cpBodySetPose(cpBody *body, cpVect p, cpFloat a);
+
 
 //MARK: Spatial Index Functions
 
 cpSpatialIndex *cpSpatialIndexInit(cpSpatialIndex *index, cpSpatialIndexClass *klass, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
 
+// Returns true if the index was created by cpBBTreeNew() or cpCompactBBTreeNew() respectively.
+cpBool cpBBTreeIsTree(cpSpatialIndex *index);
+cpBool cpCompactBBTreeIsTree(cpSpatialIndex *index);
+
+// Round to the nearest float that is no greater or no less than x.
+static inline float
+cpRoundDownFloat(cpFloat x)
+{
+	float f = (float)x;
+	return ((cpFloat)f > x ? nextafterf(f, -INFINITY) : f);
+}
+
+static inline float
+cpRoundUpFloat(cpFloat x)
+{
+	float f = (float)x;
+	return ((cpFloat)f < x ? nextafterf(f, INFINITY) : f);
+}
+
+// Single precision bounding box used by the compact spatial indexes.
+// Bounds made from a cpBB are rounded outwards so they always contain it.
+struct cpIndexBounds {
+	float l, b, r, t;
+};
+
+static inline struct cpIndexBounds
+cpIndexBoundsFromBB(cpBB bb)
+{
+	struct cpIndexBounds bounds = {cpRoundDownFloat(bb.l), cpRoundDownFloat(bb.b), cpRoundUpFloat(bb.r), cpRoundUpFloat(bb.t)};
+	return bounds;
+}
+
+static inline struct cpIndexBounds
+cpIndexBoundsMerge(struct cpIndexBounds a, struct cpIndexBounds b)
+{
+	struct cpIndexBounds bounds = {
+		(a.l < b.l ? a.l : b.l),
+		(a.b < b.b ? a.b : b.b),
+		(a.r > b.r ? a.r : b.r),
+		(a.t > b.t ? a.t : b.t),
+	};
+	return bounds;
+}
+
 
 //MARK: Arbiters
 
@@ -100,6 +224,8 @@ void cpArbiterUpdate(cpArbiter *arb, struct cpCollisionInfo *info, cpSpace *spac
 void cpArbiterPreStep(cpArbiter *arb, cpFloat dt, cpFloat bias, cpFloat slop);
 void cpArbiterApplyCachedImpulse(cpArbiter *arb, cpFloat dt_coef);
 void cpArbiterApplyImpulse(cpArbiter *arb);
+void cpArbiterSolverApplyCachedImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpFloat dt_coef);
+void cpArbiterSolverApplyImpulse(cpArbiter *arb, struct cpSolverBody *bodies);
 
 
 //MARK: Shapes/Collisions
@@ -115,7 +241,29 @@ cpShapeActive(cpShape *shape)
 }
 
 // Note: This function returns contact points with r1/r2 in absolute coordinates, not body relative.
-struct cpCollisionInfo cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, struct cpContact *contacts);
+// Shapes less than margin apart are given speculative contacts for the solver to keep from closing the gap too far.
+struct cpCollisionInfo cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, cpFloat margin, struct cpContact *contacts);
+
+// Polys with at most this many vertexes collide with each other using the separating axis test instead of GJK/EPA.
+// Setting it to 0 always uses GJK. (defaults to 12)
+extern int cpCollidePolySATMaxCount;
+
+// Number of pairs a space queues up before colliding them in a batch.
+#define CP_COLLISION_BATCH_SIZE 64
+
+// Circle/circle and circle/segment pairs are cheap enough that dispatching them through cpCollide() one at a time
+// is a large part of their cost. Instead they are queued up and collided in batches, one pair per SIMD lane.
+static inline cpBool
+cpShapesCollideInBatches(const cpShape *a, const cpShape *b)
+{
+	return (a->klass->type + b->klass->type <= CP_SEGMENT_SHAPE);
+}
+
+// Collide the pairs and store the result for pairs[i] in results[i]. Pairs are bucketed by their shape types.
+// Each pair must pass cpShapesCollideInBatches() and have the circle as a.
+void cpCollideBatch(const struct cpBatchPair *pairs, int count, struct cpBatchCollision *results);
+// Make the collision info that cpCollide() would have returned for a batched pair.
+struct cpCollisionInfo cpCollisionInfoForBatch(const struct cpBatchPair *pair, const struct cpBatchCollision *result, struct cpContact *contacts);
 
 static inline void
 CircleSegmentQuery(cpShape *shape, cpVect center, cpFloat r1, cpVect a, cpVect b, cpFloat r2, cpSegmentQueryInfo *info)
@@ -182,8 +330,16 @@ normal_relative_velocity(cpBody *a, cpBody *b, cpVect r1, cpVect r2, cpVect n){
 	return cpvdot(relative_velocity(a, b, r1, r2), n);
 }
 
+// Static and kinematic bodies have no inverse mass or moment, so impulses can't change their velocity.
+// The solver never writes to them, which lets several threads solve items sharing them at the same time.
+static inline cpBool
+body_is_fixed(cpBody *body){
+	return (body->m_inv == 0.0f && body->i_inv == 0.0f);
+}
+
 static inline void
 apply_impulse(cpBody *body, cpVect j, cpVect r){
+	if(body_is_fixed(body)) return;
 	body->v = cpvadd(body->v, cpvmult(j, body->m_inv));
 	body->w += body->i_inv*cpvcross(r, j);
 }
@@ -198,6 +354,7 @@ apply_impulses(cpBody *a , cpBody *b, cpVect r1, cpVect r2, cpVect j)
 static inline void
 apply_bias_impulse(cpBody *body, cpVect j, cpVect r)
 {
+	if(body_is_fixed(body)) return;
 	body->v_bias = cpvadd(body->v_bias, cpvmult(j, body->m_inv));
 	body->w_bias += body->i_inv*cpvcross(r, j);
 }
@@ -209,6 +366,48 @@ apply_bias_impulses(cpBody *a , cpBody *b, cpVect r1, cpVect r2, cpVect j)
 	apply_bias_impulse(b, j, r2);
 }
 
+static inline cpVect
+solver_relative_velocity(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2){
+	cpVect v1_sum = cpvadd(a->v, cpvmult(cpvperp(r1), a->w));
+	cpVect v2_sum = cpvadd(b->v, cpvmult(cpvperp(r2), b->w));
+	
+	return cpvsub(v2_sum, v1_sum);
+}
+
+static inline cpBool
+solver_body_is_fixed(struct cpSolverBody *body){
+	return (body->m_inv == 0.0f && body->i_inv == 0.0f);
+}
+
+static inline void
+solver_apply_impulse(struct cpSolverBody *body, cpVect j, cpVect r){
+	if(solver_body_is_fixed(body)) return;
+	body->v = cpvadd(body->v, cpvmult(j, body->m_inv));
+	body->w += body->i_inv*cpvcross(r, j);
+}
+
+static inline void
+solver_apply_impulses(struct cpSolverBody *a , struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect j)
+{
+	solver_apply_impulse(a, cpvneg(j), r1);
+	solver_apply_impulse(b, j, r2);
+}
+
+static inline void
+solver_apply_bias_impulse(struct cpSolverBody *body, cpVect j, cpVect r)
+{
+	if(solver_body_is_fixed(body)) return;
+	body->v_bias = cpvadd(body->v_bias, cpvmult(j, body->m_inv));
+	body->w_bias += body->i_inv*cpvcross(r, j);
+}
+
+static inline void
+solver_apply_bias_impulses(struct cpSolverBody *a , struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect j)
+{
+	solver_apply_bias_impulse(a, cpvneg(j), r1);
+	solver_apply_bias_impulse(b, j, r2);
+}
+
 static inline cpFloat
 k_scalar_body(cpBody *body, cpVect r, cpVect n)
 {
@@ -286,10 +485,15 @@ void cpSpacePushFreshContactBuffer(cpSpace *space);
 struct cpContact *cpContactBufferGetArray(cpSpace *space);
 void cpSpacePushContacts(cpSpace *space, int count);
 
+cpContactBufferHeader *cpContactBufferRingPushFresh(cpContactBufferHeader *head, cpArray *allocatedBuffers, cpTimestamp stamp, cpTimestamp persistence);
+struct cpContact *cpContactBufferRingGetArray(cpContactBufferHeader **head, cpArray *allocatedBuffers, cpTimestamp stamp, cpTimestamp persistence);
+void cpContactBufferRingPushContacts(cpContactBufferHeader *head, int count);
+
 cpPostStepCallback *cpSpaceGetPostStepCallback(cpSpace *space, void *key);
 
 cpBool cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space);
 void cpSpaceFilterArbiters(cpSpace *space, cpBody *body, cpShape *filter);
+void cpSpaceFilterSeparatingAxes(cpSpace *space, cpShape *shape);
 
 void cpSpaceActivateBody(cpSpace *space, cpBody *body);
 void cpSpaceLock(cpSpace *space);
@@ -313,6 +517,49 @@ cpSpaceArrayForBodyType(cpSpace *space, cpBodyType type)
 
 void cpShapeUpdateFunc(cpShape *shape, void *unused);
 cpCollisionID cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space);
+// Collide the pairs cpSpaceCollideShapes() queued for batching. Must be called after the broadphase query.
+void cpSpaceCollideBatchedShapes(cpSpace *space);
+cpBool cpSpaceShapesQueryReject(cpShape *a, cpShape *b, cpFloat margin);
+cpBool cpSpaceProcessCollision(cpSpace *space, struct cpCollisionInfo *info, cpArbiter *arb);
+
+// How far apart a pair of shapes can be while still getting contacts. 0 unless speculative contacts are enabled.
+cpFloat cpSpaceSpeculativeMargin(cpSpace *space, const cpShape *a, const cpShape *b);
+// How far a shape's bounding box is grown in the dynamic index so it finds pairs within their speculative margin.
+cpFloat cpSpaceShapeSpeculativeMargin(cpSpace *space, const cpShape *shape);
+
+// Only the collision functions that use GJK or SAT are expensive enough to be worth caching a separating axis for.
+static inline cpBool
+cpShapesCacheSeparatingAxes(const cpShape *a, const cpShape *b)
+{
+	return (a->klass->type + b->klass->type >= 2*CP_SEGMENT_SHAPE);
+}
+
+// Looks up the cached separating axis for a pair of shapes and checks if it still separates them.
+// Only reads from the cache so it's safe to call from several threads at once.
+cpBool cpSpaceSeparatingAxisCulls(cpSpace *space, const cpShape *a, const cpShape *b, cpFloat margin, struct cpSeparatingAxis **axis);
+// Cache the separating axis from a narrow-phase result. axis is the cached axis for the pair if there was one.
+void cpSpaceCacheSeparatingAxis(cpSpace *space, struct cpCollisionInfo *info, struct cpSeparatingAxis *axis);
+cpBool cpSpaceSeparatingAxisFilter(struct cpSeparatingAxis *axis, cpSpace *space);
+
+// Sweep the bullet bodies from their poses before the positions were integrated against the static shapes,
+// and move them back to their first time of impact. Must be called after integrating the positions.
+void cpSpaceSweepBullets(cpSpace *space);
+
+void cpSpaceSolve(cpSpace *space, cpFloat dt_coef);
+struct cpContactSolver *cpSpaceSolverBegin(cpSpace *space);
+void cpSpaceSolverEnd(cpSpace *space, struct cpContactSolver *contactSolver);
+void cpSpaceScatterSolverBodies(cpSpace *space, cpArray *bodies);
+void cpSpaceGatherSolverBodies(cpSpace *space, cpArray *bodies);
+
+struct cpContactSolver *cpSpacePrepareContactSolver(cpSpace *space);
+void cpContactSolverFree(struct cpContactSolver *solver);
+int cpContactSolverGroupCount(struct cpContactSolver *solver);
+int cpContactSolverColorCount(struct cpContactSolver *solver);
+void cpContactSolverGetColorGroups(struct cpContactSolver *solver, int color, int *start, int *end);
+cpArray *cpContactSolverGetOverflow(struct cpContactSolver *solver);
+void cpContactSolverWarmStart(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end, cpFloat dt_coef);
+void cpContactSolverApplyImpulse(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end);
+void cpContactSolverFinish(struct cpContactSolver *solver);
 
 
 //MARK: Foreach loops
@@ -78,6 +78,22 @@ struct cpBody {
 		cpBody *next;
 		cpFloat idleTime;
 	} sleeping;
+	
+	// Continuous collision detection against static shapes.
+	struct {
+		cpBool enabled;
+		// Position and angle before the positions were integrated.
+		cpVect p;
+		cpFloat a;
+	} bullet;
+	
+	// Per-step scratch data for the solver.
+	struct {
+		// Index of the body's state in the space's solver body array.
+		int id;
+		// Bitmask of the solver batch colors that already use this body. (cpHastySpace only)
+		uint32_t colors;
+	} solver;
 };
 
 enum cpArbiterState {
@@ -113,12 +129,34 @@ struct cpContact {
 struct cpCollisionInfo {
 	const cpShape *a, *b;
 	cpCollisionID id;
+	// Shapes closer than this are given speculative contacts with a positive separation.
+	cpFloat margin;
 	
 	cpVect n;
+	// When the shapes aren't touching, the collision functions that can cheaply find a separating axis
+	// store it in n along with the distance between the shapes along it. Otherwise it's 0.
+	cpFloat separation;
 	
 	int count;
 	// TODO Should this be a unique struct type?
 	struct cpContact *arr;
+	
+#if CP_STEP_STATS
+	int gjkIterations, epaIterations;
+#endif
+};
+
+// Shape pair waiting to be collided in a batch. a is always the circle.
+struct cpBatchPair {
+	const cpShape *a, *b;
+	cpCollisionID id;
+	cpFloat margin;
+};
+
+// Result of colliding a batched pair. Circle/circle and circle/segment collisions have at most one contact.
+struct cpBatchCollision {
+	cpBool touching;
+	cpVect n, r1, r2;
 };
 
 struct cpArbiter {
@@ -136,6 +174,12 @@ struct cpArbiter {
 	struct cpContact *contacts;
 	cpVect n;
 	
+	// Collision id from the last narrow-phase update, used to warm start the next one.
+	cpCollisionID id;
+	
+	// Indexes of the bodies in the space's solver body array for the current step.
+	int solver_a, solver_b;
+	
 	// Regular, wildcard A and wildcard B collision handlers.
 	cpCollisionHandler *handler, *handlerA, *handlerB;
 	cpBool swapped;
@@ -144,6 +188,23 @@ struct cpArbiter {
 	enum cpArbiterState state;
 };
 
+// Separating axis cached for a pair of shapes that weren't touching.
+// The pair can skip the narrow-phase as long as the bodies haven't moved enough to close the gap.
+struct cpSeparatingAxis {
+	const cpShape *a, *b;
+	
+	// Axis pointing from a to b, and the distance between the shapes along it.
+	cpVect n;
+	cpFloat d;
+	
+	// Rotations and translations of the body transforms when the axis was found.
+	cpVect qa, ta, qb, tb;
+	// Geometry stamps of the shapes when the axis was found.
+	cpTimestamp geometryA, geometryB;
+	
+	cpTimestamp stamp;
+};
+
 struct cpShapeMassInfo {
 	cpFloat m;
 	cpFloat i;
@@ -182,6 +243,9 @@ struct cpShape {
 	struct cpShapeMassInfo massInfo;
 	cpBB bb;
 	
+	// Incremented each time the geometry is changed using chipmunk_unsafe.h.
+	cpTimestamp geometryStamp;
+	
 	cpBool sensor;
 	
 	cpFloat e;
@@ -405,6 +469,7 @@ struct cpSpace {
 	cpFloat collisionSlop;
 	cpFloat collisionBias;
 	cpTimestamp collisionPersistence;
+	cpBool speculativeContacts;
 	
 	cpDataPointer userData;
 	
@@ -427,6 +492,13 @@ struct cpSpace {
 	cpHashSet *cachedArbiters;
 	cpArray *pooledArbiters;
 	
+	cpHashSet *separatingAxes;
+	cpArray *pooledSeparatingAxes;
+	
+	// Circle pairs found by the broadphase that are waiting to be collided in a batch.
+	int batchedCount;
+	struct cpBatchPair *batchedPairs;
+	
 	cpArray *allocatedBuffers;
 	int locked;
 	
@@ -439,6 +511,44 @@ struct cpSpace {
 	
 	cpBody *staticBody;
 	cpBody _staticBody;
+	
+	// Compact copy of the velocity state of the bodies touched by the contact solver, indexed by cpBody.solver.id.
+	// solverBodies holds the body for each entry so the results can be copied back after solving.
+	// Constraints still work on the bodies directly, so solverSyncBodies are copied back and forth around them.
+	cpArray *solverBodies;
+	cpArray *solverSyncBodies;
+	int solverStateCapacity;
+	struct cpSolverBody *solverState;
+	
+	cpContactSolverType contactSolverType;
+	struct cpContactSolver *contactSolver;
+	
+	cpSpaceStepStats stepStats;
+	
+	// Awake islands found by cpSpaceProcessComponents(). Only built when buildIslands is set.
+	// Island bodies, arbiters and constraints are grouped in the arrays by island.
+	// Arbiters and constraints that don't belong to an awake island are stored after the last island.
+	cpBool buildIslands;
+	int islandCount, islandCapacity;
+	struct cpIsland *islands;
+	cpArray *islandBodies;
+	cpArray *islandArbiters;
+	cpArray *islandConstraints;
+};
+
+// Body state used by the contact solver. Fits in a single 64 byte cache line when cpFloat is a double.
+struct cpSolverBody {
+	cpVect v, v_bias;
+	cpFloat w, w_bias;
+	cpFloat m_inv, i_inv;
+};
+
+// A connected component of awake bodies in the contact graph.
+// The ranges index into the space's island arrays.
+struct cpIsland {
+	int bodyStart, bodyCount;
+	int arbiterStart, arbiterCount;
+	int constraintStart, constraintCount;
 };
 
 typedef struct cpPostStepCallback {
@@ -76,6 +76,15 @@ CP_EXPORT void cpBodySleepWithGroup(cpBody *body, cpBody *group);
 /// Returns true if the body is sleeping.
 CP_EXPORT cpBool cpBodyIsSleeping(const cpBody *body);
 
+/// Returns true if the body is a bullet.
+CP_EXPORT cpBool cpBodyIsBullet(const cpBody *body);
+/// Flag a fast moving dynamic body as a bullet.
+/// After integrating its position each step, a space sweeps a bullet's shapes against the static shapes
+/// and moves it back to its first time of impact so it can't tunnel through thin walls.
+/// Only static shapes are swept against, and collision handlers aren't consulted, so use shape filters
+/// for static shapes that bullets should pass through. Defaults to false.
+CP_EXPORT void cpBodySetBullet(cpBody *body, cpBool bullet);
+
 /// Get the type of the body.
 CP_EXPORT cpBodyType cpBodyGetType(cpBody *body);
 /// Set the type of the body.
@@ -14,14 +14,90 @@ typedef struct cpHastySpace cpHastySpace;
 CP_EXPORT cpSpace *cpHastySpaceNew(void);
 CP_EXPORT void cpHastySpaceFree(cpSpace *space);
 
-/// Set the number of threads to use for the solver.
-/// Currently Chipmunk is limited to 2 threads as using more generally provides very minimal performance gains.
-/// Passing 0 as the thread count on iOS or OS X will cause Chipmunk to automatically detect the number of threads it should use.
-/// On other platforms passing 0 for the thread count will set 1 thread.
+/// Set the number of threads to use for the solver and narrow-phase collision detection.
+/// When using more than one thread, collision pairs are processed in parallel and then merged in broadphase order,
+/// so the begin/preSolve callbacks are still called from the thread that called cpHastySpaceStep().
+/// The solver colors the arbiters and constraints into batches that don't share any dynamic bodies and solves each batch in parallel.
+/// Results are reproducible for a given thread count, or for any thread count in deterministic mode. Chipmunk is currently limited to 32 threads.
+/// Passing 0 as the thread count will cause Chipmunk to automatically detect the number of threads it should use.
 CP_EXPORT void cpHastySpaceSetThreads(cpSpace *space, unsigned long threads);
 
 /// Returns the number of threads the solver is using to run.
 CP_EXPORT unsigned long cpHastySpaceGetThreads(cpSpace *space);
 
+/// Enable or disable deterministic mode. Disabled by default.
+/// Normally a hasty space running a single thread uses the same serial code paths as cpSpaceStep(),
+/// so its results differ slightly from the multithreaded ones.
+/// In deterministic mode the parallel code paths are always used, which makes the results bit-identical
+/// for any number of threads or task backend workers (for the same build of Chipmunk on the same platform).
+/// This allows lockstep and replay systems to use multiple threads, at the cost of a little single threaded performance.
+CP_EXPORT void cpHastySpaceSetDeterministic(cpSpace *space, cpBool deterministic);
+/// Returns true if deterministic mode is enabled.
+CP_EXPORT cpBool cpHastySpaceGetDeterministic(cpSpace *space);
+
+/// Enable or disable island stepping. Disabled by default.
+/// When enabled, each awake island (a group of bodies connected by collisions or constraints) is presteped, integrated and solved
+/// as an independent task on the worker threads, with small islands batched together.
+/// This scales well for spaces with many independent piles of objects as islands never share any dynamic bodies.
+/// Islands are always solved by the scalar contact solver, and the space's contact solver (see cpSpaceSetContactSolver()) is ignored.
+CP_EXPORT void cpHastySpaceSetIslandStepping(cpSpace *space, cpBool enabled);
+/// Returns true if island stepping is enabled.
+CP_EXPORT cpBool cpHastySpaceGetIslandStepping(cpSpace *space);
+
+/// Set the minimum number of items (collision pairs, solver batch items, etc) handed to a single job.
+/// Work is split in half and shared with idle threads until the pieces are smaller than this. Defaults to 32.
+CP_EXPORT void cpHastySpaceSetGrainSize(cpSpace *space, unsigned long grain);
+/// Returns the grain size used to split up work between the threads.
+CP_EXPORT unsigned long cpHastySpaceGetGrainSize(cpSpace *space);
+
+/// Task function run by a task backend over the range [start, end).
+/// @c worker must be the index of the worker running the task, in the range [0, workerCount).
+/// Two tasks must never run on the same worker index at the same time.
+typedef void (*cpHastySpaceTaskFunc)(void *data, unsigned long start, unsigned long end, unsigned long worker);
+/// Start running @c func over the range [0, count) in chunks of at least @c grain items. May return before the work is finished.
+typedef void (*cpHastySpaceParallelForFunc)(void *context, unsigned long count, unsigned long grain, cpHastySpaceTaskFunc func, void *data);
+/// Wait for all of the work started with the backend's parallelFor function to finish.
+typedef void (*cpHastySpaceWaitFunc)(void *context);
+
+/// Task system used to run the parallel parts of cpHastySpaceStep().
+/// This lets a hasty space share an existing job system instead of running its own threads.
+typedef struct cpHastySpaceTaskBackend {
+	cpHastySpaceParallelForFunc parallelFor;
+	cpHastySpaceWaitFunc wait;
+	/// Number of worker indexes the backend passes to task functions.
+	unsigned long workerCount;
+	/// User definable context pointer passed to the backend's functions.
+	void *context;
+} cpHastySpaceTaskBackend;
+
+/// Run the integration, bounding box update, narrow-phase and solver batches using a custom task backend.
+/// This shuts down the space's own worker threads. Passing NULL or calling cpHastySpaceSetThreads() restores the built-in threads.
+/// Body position and velocity functions are called from the backend's workers, as are the narrow-phase collision functions.
+/// The collision and constraint callbacks are still called from the thread that called cpHastySpaceStep().
+CP_EXPORT void cpHastySpaceSetTaskBackend(cpSpace *space, const cpHastySpaceTaskBackend *backend);
+/// Returns the task backend currently used by the space. By default this is the built-in pthread based job system.
+CP_EXPORT cpHastySpaceTaskBackend cpHastySpaceGetTaskBackend(cpSpace *space);
+/// Returns a task backend that runs everything serially on the calling thread.
+/// It still uses the same code paths as the multithreaded backends, which makes it useful for debugging.
+CP_EXPORT cpHastySpaceTaskBackend cpHastySpaceSerialTaskBackend(void);
+
+/// Job function type used with cpHastySpaceSubmitJob().
+typedef void (*cpHastySpaceJobFunc)(void *data);
+
+/// Run a job on the space's worker threads.
+/// Jobs must be submitted from the thread that steps the space and must not submit other jobs themselves.
+/// Jobs may also be run by that thread while it's waiting on the space's own work in cpHastySpaceStep().
+/// Jobs must not access the space while it is being stepped.
+/// When using a custom task backend, jobs are only run by cpHastySpaceWaitJobs().
+CP_EXPORT void cpHastySpaceSubmitJob(cpSpace *space, cpHastySpaceJobFunc func, void *data);
+/// Wait for all submitted jobs to finish, helping to run them on the calling thread.
+CP_EXPORT void cpHastySpaceWaitJobs(cpSpace *space);
+
 /// When stepping a hasty space, you must use this function.
 CP_EXPORT void cpHastySpaceStep(cpSpace *space, cpFloat dt);
+
+/// Get the step stats for the work done by a single thread (or task backend worker) during the last step.
+/// Only the time spent in the thread's tasks and the narrow-phase counters are recorded per thread.
+/// cpSpaceGetStepStats() still returns the wall clock times and totals for the whole step.
+/// With island stepping enabled, the prestep, velocity integration and warm starting are counted as part of the solve.
+CP_EXPORT cpSpaceStepStats cpHastySpaceGetThreadStepStats(cpSpace *space, unsigned long thread);
@@ -59,6 +59,21 @@ struct cpCollisionHandler {
 	cpDataPointer userData;
 };
 
+/// Contact solver implementations. See cpSpaceSetContactSolver().
+typedef enum cpContactSolverType {
+	/// Solve the contacts one at a time. This is the default.
+	CP_CONTACT_SOLVER_SCALAR,
+	/// Use the fastest SIMD contact solver supported by the CPU.
+	CP_CONTACT_SOLVER_SIMD,
+	/// SSE2 contact solver. Solves 2 (double precision) or 4 (single precision) arbiters at once.
+	CP_CONTACT_SOLVER_SSE2,
+	/// AVX2 contact solver. Solves 4 (double precision) or 8 (single precision) arbiters at once.
+	CP_CONTACT_SOLVER_AVX2,
+	/// Solve the contacts one at a time, but in the same order as the SIMD solvers.
+	/// Slower than CP_CONTACT_SOLVER_SCALAR, but matches the SIMD solvers up to rounding, which is useful to check them.
+	CP_CONTACT_SOLVER_SCALAR_COLORED,
+} cpContactSolverType;
+
 // TODO: Make timestep a parameter?
 
 
@@ -83,6 +98,17 @@ CP_EXPORT void cpSpaceFree(cpSpace *space);
 CP_EXPORT int cpSpaceGetIterations(const cpSpace *space);
 CP_EXPORT void cpSpaceSetIterations(cpSpace *space, int iterations);
 
+/// Contact solver implementation used by the space. Defaults to CP_CONTACT_SOLVER_SCALAR.
+/// The SIMD solvers solve groups of arbiters that don't share any bodies together, so the order contacts are solved in
+/// (and the results) will differ slightly from the scalar solver. Constraints are always solved by the scalar solver.
+/// If the CPU doesn't support the solver, the space falls back to the next best one that it does support.
+/// A cpHastySpace with island stepping enabled always uses the scalar solver while stepping islands.
+CP_EXPORT cpContactSolverType cpSpaceGetContactSolver(const cpSpace *space);
+CP_EXPORT void cpSpaceSetContactSolver(cpSpace *space, cpContactSolverType solver);
+
+/// Returns true if the CPU supports the contact solver.
+CP_EXPORT cpBool cpContactSolverIsSupported(cpContactSolverType solver);
+
 /// Gravity to pass to rigid bodies when integrating velocity.
 CP_EXPORT cpVect cpSpaceGetGravity(const cpSpace *space);
 CP_EXPORT void cpSpaceSetGravity(cpSpace *space, cpVect gravity);
@@ -123,6 +149,14 @@ CP_EXPORT void cpSpaceSetCollisionBias(cpSpace *space, cpFloat collisionBias);
 CP_EXPORT cpTimestamp cpSpaceGetCollisionPersistence(const cpSpace *space);
 CP_EXPORT void cpSpaceSetCollisionPersistence(cpSpace *space, cpTimestamp collisionPersistence);
 
+/// Generate contacts for shapes that aren't touching yet, but could be by the end of the step.
+/// The solver only lets these speculative contacts close the gap, so fast bodies can't tunnel through each other
+/// and large timesteps remain stable without needing substeps. Contacts reported to callbacks can have a positive depth,
+/// and begin callbacks may be called up to a step before the shapes actually touch.
+/// Defaults to false.
+CP_EXPORT cpBool cpSpaceGetSpeculativeContacts(const cpSpace *space);
+CP_EXPORT void cpSpaceSetSpeculativeContacts(cpSpace *space, cpBool speculativeContacts);
+
 /// User definable data pointer.
 /// Generally this points to your game's controller or game state
 /// class so you can access it when given a cpSpace reference in a callback.
@@ -157,6 +191,10 @@ CP_EXPORT cpCollisionHandler *cpSpaceAddWildcardHandler(cpSpace *space, cpCollis
 /// Add a collision shape to the simulation.
 /// If the shape is attached to a static body, it will be added as a static shape.
 CP_EXPORT cpShape* cpSpaceAddShape(cpSpace *space, cpShape *shape);
+/// Add several collision shapes to the simulation at once.
+/// Same as calling cpSpaceAddShape() for each shape, but the spatial indexes can insert them all in a single pass.
+/// Much faster when loading levels with many static shapes.
+CP_EXPORT void cpSpaceAddShapes(cpSpace *space, cpShape **shapes, int count);
 /// Add a rigid body to the simulation.
 CP_EXPORT cpBody* cpSpaceAddBody(cpSpace *space, cpBody *body);
 /// Add a constraint to the simulation.
@@ -245,8 +283,30 @@ CP_EXPORT void cpSpaceReindexShape(cpSpace *space, cpShape *shape);
 /// Update the collision detection data for all shapes attached to a body.
 CP_EXPORT void cpSpaceReindexShapesForBody(cpSpace *space, cpBody *body);
 
+/// Replace the spatial index used for the static shapes with a new one made by @c constructor.
+/// The space uses cpBBTreeNew() by default. cpStaticBVHNew() is usually faster to query for large static levels.
+/// The shapes are moved over to the new index, so this can be called at any time the space isn't locked.
+CP_EXPORT void cpSpaceSetStaticIndex(cpSpace *space, cpSpatialIndexNewFunc constructor);
+/// Replace the spatial index used for the dynamic shapes with a new one made by @c constructor,
+/// such as cpBBTreeNew(), cpCompactBBTreeNew(), cpSweep1DNew() or cpHGridNew(). The default is cpBBTreeNew().
+/// The bounding box trees are given the space's shape velocity function so they can pad the bounding boxes
+/// of moving shapes. Use cpSpaceGetDynamicIndex() to change their padding or other settings afterwards.
+CP_EXPORT void cpSpaceSetDynamicIndex(cpSpace *space, cpSpatialIndexNewFunc constructor);
+/// Get the spatial index used for the static shapes, to change its settings or measure it.
+/// Don't add or remove objects from it yourself.
+CP_EXPORT cpSpatialIndex* cpSpaceGetStaticIndex(cpSpace *space);
+/// Get the spatial index used for the dynamic shapes, to change its settings or measure it.
+/// Don't add or remove objects from it yourself.
+CP_EXPORT cpSpatialIndex* cpSpaceGetDynamicIndex(cpSpace *space);
+
 /// Switch the space to use a spatial has as it's spatial index.
 CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
+/// Switch the space to use spatial hashes that tune their own cell size and table size as the shapes change.
+/// @c dim and @c count are only the starting point. See cpSpaceHashSetAutoTune().
+CP_EXPORT void cpSpaceUseAutoSpatialHash(cpSpace *space, cpFloat dim, int count);
+/// Get the statistics of the space's dynamic spatial hash so they can be logged.
+/// Warns and returns zeroed stats if the space isn't using a spatial hash.
+CP_EXPORT cpSpaceHashStats cpSpaceGetSpatialHashStats(cpSpace *space);
 
 
 //MARK: Time Stepping
@@ -254,6 +314,58 @@ CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
 /// Step the space forward in time by @c dt.
 CP_EXPORT void cpSpaceStep(cpSpace *space, cpFloat dt);
 
+/// Timings and counters for the last call to cpSpaceStep().
+/// They are only collected when Chipmunk is built with CP_STEP_STATS defined to 1 (the STEP_STATS CMake option),
+/// otherwise the instrumentation is compiled out and the stats are always zero. Times are in nanoseconds.
+typedef struct cpSpaceStepStats {
+	/// Total time spent in cpSpaceStep().
+	uint64_t step;
+	/// Time spent integrating body positions.
+	uint64_t integratePositions;
+	/// Time spent sweeping bullet bodies against the static shapes to find their time of impact.
+	uint64_t sweepBullets;
+	/// Time spent updating the bounding boxes of the dynamic shapes.
+	uint64_t updateBBs;
+	/// Time spent in the spatial index finding colliding pairs, not including the narrow-phase.
+	uint64_t broadphase;
+	/// Time spent in the narrow-phase, including the begin and preSolve collision callbacks.
+	uint64_t narrowphase;
+	/// Time spent rebuilding the contact graph and processing sleeping bodies.
+	uint64_t components;
+	/// Time spent filtering the cached arbiters, including the separate collision callbacks.
+	uint64_t filterArbiters;
+	/// Time spent prestepping the arbiters and constraints.
+	uint64_t preStep;
+	/// Time spent integrating body velocities.
+	uint64_t integrateVelocities;
+	/// Time spent applying the cached impulses.
+	uint64_t warmStart;
+	/// Time spent running the solver iterations.
+	uint64_t solve;
+	/// Time spent running the postSolve and post-step callbacks.
+	uint64_t callbacks;
+	
+	/// Number of shape pairs found by the broadphase.
+	unsigned long pairsTested;
+	/// Number of shape pairs rejected before the narrow-phase by their filters, sensors or body types.
+	unsigned long pairsRejected;
+	/// Number of shape pairs skipped because the separating axis cached when they last weren't touching still separates them.
+	unsigned long pairsCulled;
+	/// Number of GJK iterations run by the narrow-phase.
+	unsigned long gjkIterations;
+	/// Number of EPA iterations run by the narrow-phase.
+	unsigned long epaIterations;
+	/// Number of arbiters created for newly touching shape pairs.
+	unsigned long arbitersCreated;
+	/// Number of contacts generated by the narrow-phase.
+	unsigned long contactsCreated;
+	/// Number of bullet bodies moved back to their time of impact.
+	unsigned long bulletImpacts;
+} cpSpaceStepStats;
+
+/// Get the timings and counters for the last step.
+CP_EXPORT cpSpaceStepStats cpSpaceGetStepStats(const cpSpace *space);
+
 
 //MARK: Debug API
 
@@ -49,6 +49,13 @@ typedef void (*cpSpatialIndexIteratorFunc)(void *obj, void *data);
 typedef cpCollisionID (*cpSpatialIndexQueryFunc)(void *obj1, void *obj2, cpCollisionID id, void *data);
 /// Spatial segment query callback function type.
 typedef cpFloat (*cpSpatialIndexSegmentQueryFunc)(void *obj1, void *obj2, void *data);
+/// Spatial index task callback function type.
+/// Processes the items in the range [start, end). @c worker is the index of the thread running the task.
+typedef void (*cpSpatialIndexTaskFunc)(void *data, unsigned long start, unsigned long end, unsigned long worker);
+/// Spatial index parallel-for callback function type.
+/// Must call @c func over the range [0, count) in chunks of roughly @c grain items, possibly from several threads at once,
+/// and only return once all of them have finished. Matches the signature of cpHastySpaceParallelForFunc.
+typedef void (*cpSpatialIndexParallelForFunc)(void *context, unsigned long count, unsigned long grain, cpSpatialIndexTaskFunc func, void *data);
 
 
 typedef struct cpSpatialIndexClass cpSpatialIndexClass;
@@ -63,6 +70,10 @@ struct cpSpatialIndex {
 	cpSpatialIndex *staticIndex, *dynamicIndex;
 };
 
+/// Spatial index constructor function type, such as cpBBTreeNew() or cpHGridNew().
+/// Pass one to cpSpaceSetStaticIndex() or cpSpaceSetDynamicIndex() to pick the spatial indexes a space uses.
+typedef cpSpatialIndex *(*cpSpatialIndexNewFunc)(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+
 
 //MARK: Spatial Hash
 
@@ -81,6 +92,43 @@ CP_EXPORT cpSpatialIndex* cpSpaceHashNew(cpFloat celldim, int cells, cpSpatialIn
 /// Some trial and error is required to find the optimum numbers for efficiency.
 CP_EXPORT void cpSpaceHashResize(cpSpaceHash *hash, cpFloat celldim, int numcells);
 
+/// Spatial hash statistics.
+/// Everything but the cell size, table size and resize count is gathered by the last full rehash,
+/// either cpSpatialIndexReindexQuery() or cpSpatialIndexReindex().
+typedef struct cpSpaceHashStats {
+	/// Current cell size.
+	cpFloat celldim;
+	/// Current number of cells in the table.
+	int numcells;
+	/// Number of objects hashed.
+	int objects;
+	/// Number of bins (object and cell pairs) stored in the table.
+	int bins;
+	/// Number of table cells holding at least one bin.
+	int occupiedCells;
+	/// Average of the width and height of the objects' bounding boxes.
+	cpFloat meanExtent;
+	/// Average number of grid cells covered by each object.
+	cpFloat cellsPerObject;
+	/// Average number of bins in each occupied table cell.
+	cpFloat handlesPerCell;
+	/// Number of objects covering more than 3x3 grid cells.
+	int spanningObjects;
+	/// Number of times auto tuning has resized the hash.
+	int resizes;
+} cpSpaceHashStats;
+
+/// Get the statistics of a spatial hash, useful for logging or tuning it by hand.
+CP_EXPORT cpSpaceHashStats cpSpaceHashGetStats(cpSpatialIndex *index);
+
+/// Enable or disable auto tuning. Disabled by default.
+/// When enabled, the hash checks the statistics of the last full rehash before rehashing again
+/// and resizes itself when the objects span too many cells, pile up in too few cells,
+/// or the table is too full or too empty. It waits several rehashes after each resize
+/// and only changes the cell size when it's well off from the mean object size, so it settles quickly.
+/// The cell size and table size passed to cpSpaceHashNew() are only used as the starting point.
+CP_EXPORT void cpSpaceHashSetAutoTune(cpSpatialIndex *index, cpBool autoTune);
+
 //MARK: AABB Tree
 
 typedef struct cpBBTree cpBBTree;
@@ -95,11 +143,93 @@ CP_EXPORT cpSpatialIndex* cpBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialInde
 /// Perform a static top down optimization of the tree.
 CP_EXPORT void cpBBTreeOptimize(cpSpatialIndex *index);
 
+/// Same as cpSpatialIndexReindexQuery(), but updates the leaves and finds the collision pairs using parallel tasks.
+/// @c func is only called from the calling thread, in exactly the same order as cpSpatialIndexReindexQuery() would call it.
+/// Falls back to cpSpatialIndexReindexQuery() for small trees and other kinds of spatial indexes.
+CP_EXPORT void cpBBTreeReindexQueryParallel(cpSpatialIndex *index, cpSpatialIndexQueryFunc func, void *data, cpSpatialIndexParallelForFunc parallelFor, void *context);
+
+/// Bounding box tree quality metrics.
+typedef struct cpBBTreeQuality {
+	/// Surface area heuristic cost of the tree.
+	/// The summed area of the internal nodes relative to the area of the root. Lower is better.
+	cpFloat sahCost;
+	/// Depth of the deepest leaf. The root is at depth 0.
+	int maxDepth;
+} cpBBTreeQuality;
+
+/// Measure the quality of the tree.
+/// The tree rebalances itself with rotations as objects are inserted, removed and reindexed,
+/// so this should stay fairly flat for long running spaces. Walks the whole tree so it's not free.
+CP_EXPORT cpBBTreeQuality cpBBTreeGetQuality(cpSpatialIndex *index);
+
 /// Bounding box tree velocity callback function.
 /// This function should return an estimate for the object's velocity.
 typedef cpVect (*cpBBTreeVelocityFunc)(void *obj);
 /// Set the velocity function for the bounding box tree to enable temporal coherence.
 CP_EXPORT void cpBBTreeSetVelocityFunc(cpSpatialIndex *index, cpBBTreeVelocityFunc func);
+/// Set how much the bounding boxes in the tree are padded by when a velocity function is set.
+/// Each bounding box is grown by @c margin times its size on each side, and stretched in the direction
+/// the object is moving by its velocity times @c velocityScale. Both default to 0.1.
+/// Bigger boxes need to be updated less often as objects move, but find more pairs that don't actually touch.
+CP_EXPORT void cpBBTreeSetPadding(cpSpatialIndex *index, cpFloat margin, cpFloat velocityScale);
+
+//MARK: Compact AABB Tree
+
+typedef struct cpCompactBBTree cpCompactBBTree;
+
+/// Allocate a compact bounding box tree.
+/// Works like cpBBTree, but stores its nodes in a single array linked by 32 bit indexes
+/// with single precision bounds that are rounded outward. This keeps the tree small and cache friendly.
+CP_EXPORT cpCompactBBTree* cpCompactBBTreeAlloc(void);
+/// Initialize a compact bounding box tree.
+CP_EXPORT cpSpatialIndex* cpCompactBBTreeInit(cpCompactBBTree *tree, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+/// Allocate and initialize a compact bounding box tree.
+CP_EXPORT cpSpatialIndex* cpCompactBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+
+/// Perform a static top down optimization of the tree.
+CP_EXPORT void cpCompactBBTreeOptimize(cpSpatialIndex *index);
+/// Measure the quality of the tree.
+CP_EXPORT cpBBTreeQuality cpCompactBBTreeGetQuality(cpSpatialIndex *index);
+/// Set the velocity function for the compact bounding box tree to enable temporal coherence.
+CP_EXPORT void cpCompactBBTreeSetVelocityFunc(cpSpatialIndex *index, cpBBTreeVelocityFunc func);
+/// Set how much the bounding boxes in the compact tree are padded by. See cpBBTreeSetPadding().
+CP_EXPORT void cpCompactBBTreeSetPadding(cpSpatialIndex *index, cpFloat margin, cpFloat velocityScale);
+
+//MARK: Static BVH
+
+typedef struct cpStaticBVH cpStaticBVH;
+
+/// Allocate a static bounding volume hierarchy.
+/// Meant for objects that rarely move such as static shapes. The tree is built all at once
+/// and stored as a flat array of 4 wide nodes whose children are tested with SIMD instructions.
+/// Inserting, removing or reindexing objects patches the tree and rebuilds it once enough changes pile up.
+/// cpSpatialIndexReindex() always rebuilds it.
+CP_EXPORT cpStaticBVH* cpStaticBVHAlloc(void);
+/// Initialize a static bounding volume hierarchy.
+CP_EXPORT cpSpatialIndex* cpStaticBVHInit(cpStaticBVH *bvh, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+/// Allocate and initialize a static bounding volume hierarchy.
+CP_EXPORT cpSpatialIndex* cpStaticBVHNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+
+/// Set when the hierarchy is rebuilt from scratch instead of being patched.
+/// It's rebuilt once the number of objects inserted, removed or reindexed since the last build
+/// passes @c threshold times the number of objects in it, and at least 32. Defaults to 0.25.
+/// Lower values keep queries fast for objects that change often, higher values make the changes cheaper.
+CP_EXPORT void cpStaticBVHSetRebuildThreshold(cpSpatialIndex *index, cpFloat threshold);
+
+//MARK: Hierarchical Grid
+
+typedef struct cpHGrid cpHGrid;
+
+/// Allocate a hierarchical grid.
+/// Works like a stack of spatial hashes whose cell sizes double from one level to the next.
+/// Each object is put into the level with cells just larger than it, so worlds that mix tiny and huge objects
+/// don't need to be tuned by hand like cpSpaceHash does. The smallest cell size is picked from the objects
+/// each time the grid is reindexed.
+CP_EXPORT cpHGrid* cpHGridAlloc(void);
+/// Initialize a hierarchical grid.
+CP_EXPORT cpSpatialIndex* cpHGridInit(cpHGrid *grid, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+/// Allocate and initialize a hierarchical grid.
+CP_EXPORT cpSpatialIndex* cpHGridNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
 
 //MARK: Single Axis Sweep
 
@@ -130,6 +260,9 @@ typedef void (*cpSpatialIndexReindexQueryImpl)(cpSpatialIndex *index, cpSpatialI
 typedef void (*cpSpatialIndexQueryImpl)(cpSpatialIndex *index, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data);
 typedef void (*cpSpatialIndexSegmentQueryImpl)(cpSpatialIndex *index, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data);
 
+typedef void (*cpSpatialIndexInsertBulkImpl)(cpSpatialIndex *index, void **objs, cpHashValue *hashids, int count);
+typedef void (*cpSpatialIndexReindexQueryParallelImpl)(cpSpatialIndex *index, cpSpatialIndexQueryFunc func, void *data, cpSpatialIndexParallelForFunc parallelFor, void *context);
+
 struct cpSpatialIndexClass {
 	cpSpatialIndexDestroyImpl destroy;
 	
@@ -146,6 +279,11 @@ struct cpSpatialIndexClass {
 	
 	cpSpatialIndexQueryImpl query;
 	cpSpatialIndexSegmentQueryImpl segmentQuery;
+	
+	// Optional, cpSpatialIndexInsertBulk() inserts the objects one at a time when NULL.
+	cpSpatialIndexInsertBulkImpl insertBulk;
+	// Optional, cpSpatialIndexReindexQueryParallel() falls back to reindexQuery when NULL.
+	cpSpatialIndexReindexQueryParallelImpl reindexQueryParallel;
 };
 
 /// Destroy and free a spatial index.
@@ -185,6 +323,20 @@ static inline void cpSpatialIndexInsert(cpSpatialIndex *index, void *obj, cpHash
 	index->klass->insert(index, obj, hashid);
 }
 
+/// Add several objects to a spatial index at once.
+/// @c hashids holds the hash value for each object in @c objs.
+/// Much faster than inserting them one at a time for spatial indexes that can build their structure in a single pass.
+static inline void cpSpatialIndexInsertBulk(cpSpatialIndex *index, void **objs, cpHashValue *hashids, int count)
+{
+	if(count <= 0) return;
+	
+	if(index->klass->insertBulk){
+		index->klass->insertBulk(index, objs, hashids, count);
+	} else {
+		for(int i=0; i<count; i++) index->klass->insert(index, objs[i], hashids[i]);
+	}
+}
+
 /// Remove an object from a spatial index.
 /// Most spatial indexes use hashed storage, so you must provide a hash value too.
 static inline void cpSpatialIndexRemove(cpSpatialIndex *index, void *obj, cpHashValue hashid)
@@ -224,4 +376,16 @@ static inline void cpSpatialIndexReindexQuery(cpSpatialIndex *index, cpSpatialIn
 	index->klass->reindexQuery(index, func, data);
 }
 
+/// Same as cpSpatialIndexReindexQuery(), but spreads the work over several threads using @c parallelFor.
+/// @c func is only called from the calling thread, in exactly the same order as cpSpatialIndexReindexQuery() would call it.
+/// Spatial indexes that can't work in parallel simply call cpSpatialIndexReindexQuery().
+static inline void cpSpatialIndexReindexQueryParallel(cpSpatialIndex *index, cpSpatialIndexQueryFunc func, void *data, cpSpatialIndexParallelForFunc parallelFor, void *context)
+{
+	if(index->klass->reindexQueryParallel){
+		index->klass->reindexQueryParallel(index, func, data, parallelFor, context);
+	} else {
+		index->klass->reindexQuery(index, func, data);
+	}
+}
+
 ///@}
@@ -328,6 +328,7 @@ cpArbiterInit(cpArbiter *arb, cpShape *a, cpShape *b)
 	
 	arb->count = 0;
 	arb->contacts = NULL;
+	arb->id = 0;
 	
 	arb->a = a; arb->body_a = a->body;
 	arb->b = b; arb->body_b = b->body;
@@ -361,6 +362,7 @@ cpArbiterUpdate(cpArbiter *arb, struct cpCollisionInfo *info, cpSpace *space)
 	// For collisions between two similar primitive types, the order could have been swapped since the last frame.
 	arb->a = a; arb->body_a = a->body;
 	arb->b = b; arb->body_b = b->body;
+	arb->id = info->id;
 	
 	// Iterate over the possible pairs to look for hash value matches.
 	for(int i=0; i<info->count; i++){
@@ -434,7 +436,15 @@ cpArbiterPreStep(cpArbiter *arb, cpFloat dt, cpFloat slop, cpFloat bias)
 		con->jBias = 0.0f;
 		
 		// Calculate the target bounce velocity.
-		con->bounce = normal_relative_velocity(a, b, con->r1, con->r2, n)*arb->e;
+		cpFloat vrn = normal_relative_velocity(a, b, con->r1, con->r2, n);
+		if(dist > 0.0f){
+			// Speculative contacts let the shapes close the gap, but not pass through each other.
+			// Only the part of the velocity that would make them overlap is bounced.
+			cpFloat closing = dist/dt;
+			con->bounce = closing + cpfmin(0.0f, vrn + closing)*arb->e;
+		} else {
+			con->bounce = vrn*arb->e;
+		}
 	}
 }
 
@@ -496,3 +506,62 @@ cpArbiterApplyImpulse(cpArbiter *arb)
 		apply_impulses(a, b, r1, r2, cpvrotate(n, cpv(con->jnAcc - jnOld, con->jtAcc - jtOld)));
 	}
 }
+
+// Same as cpArbiterApplyCachedImpulse(), but applied to the space's solver body array.
+void
+cpArbiterSolverApplyCachedImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpFloat dt_coef)
+{
+	if(cpArbiterIsFirstContact(arb)) return;
+	
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
+	cpVect n = arb->n;
+	
+	for(int i=0; i<arb->count; i++){
+		struct cpContact *con = &arb->contacts[i];
+		cpVect j = cpvrotate(n, cpv(con->jnAcc, con->jtAcc));
+		solver_apply_impulses(a, b, con->r1, con->r2, cpvmult(j, dt_coef));
+	}
+}
+
+// Same as cpArbiterApplyImpulse(), but applied to the space's solver body array.
+void
+cpArbiterSolverApplyImpulse(cpArbiter *arb, struct cpSolverBody *bodies)
+{
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
+	cpVect n = arb->n;
+	cpVect surface_vr = arb->surface_vr;
+	cpFloat friction = arb->u;
+
+	for(int i=0; i<arb->count; i++){
+		struct cpContact *con = &arb->contacts[i];
+		cpFloat nMass = con->nMass;
+		cpVect r1 = con->r1;
+		cpVect r2 = con->r2;
+		
+		cpVect vb1 = cpvadd(a->v_bias, cpvmult(cpvperp(r1), a->w_bias));
+		cpVect vb2 = cpvadd(b->v_bias, cpvmult(cpvperp(r2), b->w_bias));
+		cpVect vr = cpvadd(solver_relative_velocity(a, b, r1, r2), surface_vr);
+		
+		cpFloat vbn = cpvdot(cpvsub(vb2, vb1), n);
+		cpFloat vrn = cpvdot(vr, n);
+		cpFloat vrt = cpvdot(vr, cpvperp(n));
+		
+		cpFloat jbn = (con->bias - vbn)*nMass;
+		cpFloat jbnOld = con->jBias;
+		con->jBias = cpfmax(jbnOld + jbn, 0.0f);
+		
+		cpFloat jn = -(con->bounce + vrn)*nMass;
+		cpFloat jnOld = con->jnAcc;
+		con->jnAcc = cpfmax(jnOld + jn, 0.0f);
+		
+		cpFloat jtMax = friction*con->jnAcc;
+		cpFloat jt = -vrt*con->tMass;
+		cpFloat jtOld = con->jtAcc;
+		con->jtAcc = cpfclamp(jtOld + jt, -jtMax, jtMax);
+		
+		solver_apply_bias_impulses(a, b, r1, r2, cpvmult(n, con->jBias - jbnOld));
+		solver_apply_impulses(a, b, r1, r2, cpvrotate(n, cpv(con->jnAcc - jnOld, con->jtAcc - jtOld)));
+	}
+}
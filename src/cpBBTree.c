@@ -26,12 +26,17 @@
 
 static inline cpSpatialIndexClass *Klass(void);
 
+struct ParallelBuffers;
+static void ParallelBuffersFree(struct ParallelBuffers *buffers);
+
 typedef struct Node Node;
 typedef struct Pair Pair;
 
 struct cpBBTree {
 	cpSpatialIndex spatialIndex;
 	cpBBTreeVelocityFunc velocityFunc;
+	// How much the bounding boxes are padded by when the velocity function is set.
+	cpFloat margin, velocityScale;
 	
 	cpHashSet *leaves;
 	Node *root;
@@ -41,6 +46,9 @@ struct cpBBTree {
 	cpArray *allocatedBuffers;
 	
 	cpTimestamp stamp;
+	
+	// Scratch buffers for cpBBTreeReindexQueryParallel(), allocated on first use.
+	struct ParallelBuffers *parallel;
 };
 
 struct Node {
@@ -86,11 +94,11 @@ GetBB(cpBBTree *tree, void *obj)
 	
 	cpBBTreeVelocityFunc velocityFunc = tree->velocityFunc;
 	if(velocityFunc){
-		cpFloat coef = 0.1f;
+		cpFloat coef = tree->margin;
 		cpFloat x = (bb.r - bb.l)*coef;
 		cpFloat y = (bb.t - bb.b)*coef;
 		
-		cpVect v = cpvmult(velocityFunc(obj), 0.1f);
+		cpVect v = cpvmult(velocityFunc(obj), tree->velocityScale);
 		return cpBBNew(bb.l + cpfmin(-x, v.x), bb.b + cpfmin(-y, v.y), bb.r + cpfmax(x, v.x), bb.t + cpfmax(y, v.y));
 	} else {
 		return bb;
@@ -295,6 +303,43 @@ NodeOther(Node *node, Node *child)
 	return (node->A == child ? node->B : node->A);
 }
 
+// Tree rotations keep the tree from degrading as leaves are inserted and removed.
+// Swaps a grandchild with its uncle when that shrinks the child it moves into the most.
+// The bounds of the node itself don't change since it still contains the same leaves.
+static void
+NodeRotate(Node *node, cpBBTree *tree)
+{
+	Node *a = node->A, *b = node->B;
+	
+	cpFloat best = 0.0f;
+	Node *child = NULL, *grandchild = NULL;
+	
+	if(!NodeIsLeaf(b)){
+		cpFloat area = cpBBArea(b->bb);
+		cpFloat cost_a = cpBBMergedArea(a->bb, b->B->bb) - area;
+		cpFloat cost_b = cpBBMergedArea(a->bb, b->A->bb) - area;
+		
+		if(cost_a < best){best = cost_a; child = a; grandchild = b->A;}
+		if(cost_b < best){best = cost_b; child = a; grandchild = b->B;}
+	}
+	
+	if(!NodeIsLeaf(a)){
+		cpFloat area = cpBBArea(a->bb);
+		cpFloat cost_a = cpBBMergedArea(b->bb, a->B->bb) - area;
+		cpFloat cost_b = cpBBMergedArea(b->bb, a->A->bb) - area;
+		
+		if(cost_a < best){best = cost_a; child = b; grandchild = a->A;}
+		if(cost_b < best){best = cost_b; child = b; grandchild = a->B;}
+	}
+	
+	if(child){
+		Node *parent = grandchild->parent;
+		if(node->A == child) NodeSetA(node, grandchild); else NodeSetB(node, grandchild);
+		if(parent->A == grandchild) NodeSetA(parent, child); else NodeSetB(parent, child);
+		parent->bb = cpBBMerge(parent->A->bb, parent->B->bb);
+	}
+}
+
 static inline void
 NodeReplaceChild(Node *parent, Node *child, Node *value, cpBBTree *tree)
 {
@@ -311,6 +356,7 @@ NodeReplaceChild(Node *parent, Node *child, Node *value, cpBBTree *tree)
 	
 	for(Node *node=parent; node; node = node->parent){
 		node->bb = cpBBMerge(node->A->bb, node->B->bb);
+		NodeRotate(node, tree);
 	}
 }
 
@@ -345,6 +391,7 @@ SubtreeInsert(Node *subtree, Node *leaf, cpBBTree *tree)
 		}
 		
 		subtree->bb = cpBBMerge(subtree->bb, leaf->bb);
+		NodeRotate(subtree, tree);
 		return subtree;
 	}
 }
@@ -495,21 +542,25 @@ LeafNew(cpBBTree *tree, void *obj, cpBB bb)
 	return node;
 }
 
+static void
+LeafReinsert(Node *leaf, cpBB bb, cpBBTree *tree)
+{
+	leaf->bb = bb;
+	
+	Node *root = SubtreeRemove(tree->root, leaf, tree);
+	tree->root = SubtreeInsert(root, leaf, tree);
+	
+	PairsClear(leaf, tree);
+	leaf->STAMP = GetMasterTree(tree)->stamp;
+}
+
 static cpBool
 LeafUpdate(Node *leaf, cpBBTree *tree)
 {
-	Node *root = tree->root;
 	cpBB bb = tree->spatialIndex.bbfunc(leaf->obj);
 	
 	if(!cpBBContainsBB(leaf->bb, bb)){
-		leaf->bb = GetBB(tree, leaf->obj);
-		
-		root = SubtreeRemove(root, leaf, tree);
-		tree->root = SubtreeInsert(root, leaf, tree);
-		
-		PairsClear(leaf, tree);
-		leaf->STAMP = GetMasterTree(tree)->stamp;
-		
+		LeafReinsert(leaf, GetBB(tree, leaf->obj), tree);
 		return cpTrue;
 	} else {
 		return cpFalse;
@@ -562,6 +613,7 @@ cpBBTreeInit(cpBBTree *tree, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *static
 	cpSpatialIndexInit((cpSpatialIndex *)tree, Klass(), bbfunc, staticIndex);
 	
 	tree->velocityFunc = NULL;
+	tree->margin = tree->velocityScale = 0.1f;
 	
 	tree->leaves = cpHashSetNew(0, (cpHashSetEqlFunc)leafSetEql);
 	tree->root = NULL;
@@ -570,10 +622,17 @@ cpBBTreeInit(cpBBTree *tree, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *static
 	tree->allocatedBuffers = cpArrayNew(0);
 	
 	tree->stamp = 0;
+	tree->parallel = NULL;
 	
 	return (cpSpatialIndex *)tree;
 }
 
+cpBool
+cpBBTreeIsTree(cpSpatialIndex *index)
+{
+	return (index && index->klass == Klass());
+}
+
 void
 cpBBTreeSetVelocityFunc(cpSpatialIndex *index, cpBBTreeVelocityFunc func)
 {
@@ -585,6 +644,21 @@ cpBBTreeSetVelocityFunc(cpSpatialIndex *index, cpBBTreeVelocityFunc func)
 	((cpBBTree *)index)->velocityFunc = func;
 }
 
+void
+cpBBTreeSetPadding(cpSpatialIndex *index, cpFloat margin, cpFloat velocityScale)
+{
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpBBTreeSetPadding() call to non-tree spatial index.");
+		return;
+	}
+	
+	cpAssertHard(margin >= 0.0f && velocityScale >= 0.0f, "The margin and velocity scale must not be negative.");
+	
+	cpBBTree *tree = (cpBBTree *)index;
+	tree->margin = margin;
+	tree->velocityScale = velocityScale;
+}
+
 cpSpatialIndex *
 cpBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
 {
@@ -598,10 +672,18 @@ cpBBTreeDestroy(cpBBTree *tree)
 	
 	if(tree->allocatedBuffers) cpArrayFreeEach(tree->allocatedBuffers, cpfree);
 	cpArrayFree(tree->allocatedBuffers);
+	
+	ParallelBuffersFree(tree->parallel);
 }
 
 //MARK: Insert/Remove
 
+static void
+fillNodeArray(Node *node, Node ***cursor){
+	(**cursor) = node;
+	(*cursor)++;
+}
+
 static void
 cpBBTreeInsert(cpBBTree *tree, void *obj, cpHashValue hashid)
 {
@@ -615,6 +697,43 @@ cpBBTreeInsert(cpBBTree *tree, void *obj, cpHashValue hashid)
 	IncrementStamp(tree);
 }
 
+static Node *BuildSubtree(cpBBTree *tree, Node **leaves, int count);
+
+static void
+cpBBTreeInsertBulk(cpBBTree *tree, void **objs, cpHashValue *hashids, int count)
+{
+	int existing = cpHashSetCount(tree->leaves);
+	cpHashSetReserve(tree->leaves, existing + count);
+	
+	// Adding a few objects to a large tree is cheaper than rebuilding it.
+	if(count < existing){
+		for(int i=0; i<count; i++) cpBBTreeInsert(tree, objs[i], hashids[i]);
+		return;
+	}
+	
+	Node **leaves = (Node **)cpcalloc(existing + count, sizeof(Node *));
+	Node **cursor = leaves;
+	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)fillNodeArray, &cursor);
+	
+	cpTimestamp stamp = GetMasterTree(tree)->stamp;
+	for(int i=0; i<count; i++){
+		Node *leaf = (Node *)cpHashSetInsert(tree->leaves, hashids[i], objs[i], (cpHashSetTransFunc)leafSetTrans, tree);
+		leaf->STAMP = stamp;
+		leaves[existing + i] = leaf;
+	}
+	
+	// Rebuild the whole tree from scratch.
+	if(tree->root) SubtreeRecycle(tree, tree->root);
+	tree->root = BuildSubtree(tree, leaves, existing + count);
+	tree->root->parent = NULL;
+	
+	// All of the new leaves share the same stamp so each pair between them is only added once.
+	for(int i=0; i<count; i++) LeafAddPairs(leaves[existing + i], tree);
+	IncrementStamp(tree);
+	
+	cpfree(leaves);
+}
+
 static void
 cpBBTreeRemove(cpBBTree *tree, void *obj, cpHashValue hashid)
 {
@@ -669,6 +788,245 @@ cpBBTreeReindexObject(cpBBTree *tree, void *obj, cpHashValue hashid)
 	}
 }
 
+//MARK: Parallel Reindex
+
+// cpBBTreeReindexQueryParallel() runs the same steps as cpBBTreeReindexQuery(), but splits the expensive parts into tasks.
+// 1) Check which leaves moved out of their bounds and calculate their new bounds. (parallel)
+// 2) Reinsert the moved leaves. (serial)
+// 3) Query the tree for each moved leaf, recording what MarkLeaf() would do into a separate list for each subtree. (parallel)
+// 4) Play back the lists in tree order, inserting pairs and calling the query function. (serial)
+// Tasks are split up the same way regardless of the number of threads,
+// and the query function sees exactly the same pairs in the same order as cpBBTreeReindexQuery().
+
+// Number of leaves checked by a single update task.
+#define PARALLEL_UPDATE_GRAIN 256
+// The tree is split into subtrees at this depth for marking, giving at most 2^depth tasks.
+#define PARALLEL_MARK_DEPTH 6
+#define PARALLEL_MARK_TASKS (1<<PARALLEL_MARK_DEPTH)
+
+// Trees with fewer leaves than this are reindexed serially.
+#define PARALLEL_MIN_LEAVES 1024
+
+enum {
+	MARK_PAIR = 1,
+	MARK_CALL = 2,
+	MARK_REPLAY = 4,
+};
+
+// MARK_PAIR inserts the pair (a, b), MARK_CALL calls the query function with (b, a),
+// and MARK_REPLAY calls the query function for the cached pairs of leaf a.
+typedef struct MarkEvent {
+	Node *a, *b;
+	int flags;
+} MarkEvent;
+
+typedef struct MarkTask {
+	Node *subtree;
+	int count, capacity;
+	MarkEvent *events;
+} MarkTask;
+
+struct ParallelBuffers {
+	int capacity;
+	Node **leaves;
+	cpBB *bbs;
+	cpBool *moved;
+	
+	int taskCount;
+	MarkTask tasks[PARALLEL_MARK_TASKS];
+};
+
+typedef struct ParallelContext {
+	cpBBTree *tree;
+	struct ParallelBuffers *buffers;
+	Node *staticRoot;
+} ParallelContext;
+
+static void
+ParallelBuffersFree(struct ParallelBuffers *buffers)
+{
+	if(buffers){
+		cpfree(buffers->leaves);
+		cpfree(buffers->bbs);
+		cpfree(buffers->moved);
+		for(int i=0; i<PARALLEL_MARK_TASKS; i++) cpfree(buffers->tasks[i].events);
+		cpfree(buffers);
+	}
+}
+
+static struct ParallelBuffers *
+ParallelBuffersReserve(cpBBTree *tree, int count)
+{
+	struct ParallelBuffers *buffers = tree->parallel;
+	if(!buffers) buffers = tree->parallel = (struct ParallelBuffers *)cpcalloc(1, sizeof(struct ParallelBuffers));
+	
+	if(count > buffers->capacity){
+		buffers->capacity = 2*count;
+		buffers->leaves = (Node **)cprealloc(buffers->leaves, buffers->capacity*sizeof(Node *));
+		buffers->bbs = (cpBB *)cprealloc(buffers->bbs, buffers->capacity*sizeof(cpBB));
+		buffers->moved = (cpBool *)cprealloc(buffers->moved, buffers->capacity*sizeof(cpBool));
+	}
+	
+	return buffers;
+}
+
+static void
+ParallelLeafCheck(ParallelContext *context, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpBBTree *tree = context->tree;
+	struct ParallelBuffers *buffers = context->buffers;
+	
+	for(unsigned long i=start; i<end; i++){
+		Node *leaf = buffers->leaves[i];
+		cpBB bb = tree->spatialIndex.bbfunc(leaf->obj);
+		
+		buffers->moved[i] = !cpBBContainsBB(leaf->bb, bb);
+		if(buffers->moved[i]) buffers->bbs[i] = GetBB(tree, leaf->obj);
+	}
+}
+
+static void
+MarkTaskPush(MarkTask *task, Node *a, Node *b, int flags)
+{
+	if(task->count == task->capacity){
+		task->capacity = (task->capacity ? 2*task->capacity : 256);
+		task->events = (MarkEvent *)cprealloc(task->events, task->capacity*sizeof(MarkEvent));
+	}
+	
+	MarkEvent event = {a, b, flags};
+	task->events[task->count++] = event;
+}
+
+// Read only versions of MarkLeafQuery(), MarkLeaf() and MarkSubtree() that record their actions instead.
+static void
+RecordLeafQuery(Node *subtree, Node *leaf, cpBool left, MarkTask *task)
+{
+	if(cpBBIntersects(leaf->bb, subtree->bb)){
+		if(NodeIsLeaf(subtree)){
+			if(left){
+				MarkTaskPush(task, leaf, subtree, MARK_PAIR);
+			} else {
+				MarkTaskPush(task, subtree, leaf, (subtree->STAMP < leaf->STAMP ? MARK_PAIR : 0) | MARK_CALL);
+			}
+		} else {
+			RecordLeafQuery(subtree->A, leaf, left, task);
+			RecordLeafQuery(subtree->B, leaf, left, task);
+		}
+	}
+}
+
+static void
+RecordLeaf(Node *leaf, ParallelContext *context, MarkTask *task)
+{
+	if(leaf->STAMP == GetMasterTree(context->tree)->stamp){
+		Node *staticRoot = context->staticRoot;
+		if(staticRoot) RecordLeafQuery(staticRoot, leaf, cpFalse, task);
+		
+		for(Node *node = leaf; node->parent; node = node->parent){
+			if(node == node->parent->A){
+				RecordLeafQuery(node->parent->B, leaf, cpTrue, task);
+			} else {
+				RecordLeafQuery(node->parent->A, leaf, cpFalse, task);
+			}
+		}
+	} else {
+		MarkTaskPush(task, leaf, NULL, MARK_REPLAY);
+	}
+}
+
+static void
+RecordSubtree(Node *subtree, ParallelContext *context, MarkTask *task)
+{
+	if(NodeIsLeaf(subtree)){
+		RecordLeaf(subtree, context, task);
+	} else {
+		RecordSubtree(subtree->A, context, task);
+		RecordSubtree(subtree->B, context, task);
+	}
+}
+
+static void
+ParallelRecord(ParallelContext *context, unsigned long start, unsigned long end, unsigned long worker)
+{
+	for(unsigned long i=start; i<end; i++){
+		MarkTask *task = context->buffers->tasks + i;
+		task->count = 0;
+		RecordSubtree(task->subtree, context, task);
+	}
+}
+
+// Split the tree into subtrees in traversal order.
+static void
+CollectSubtrees(Node *node, int depth, struct ParallelBuffers *buffers)
+{
+	if(NodeIsLeaf(node) || depth == PARALLEL_MARK_DEPTH){
+		buffers->tasks[buffers->taskCount++].subtree = node;
+	} else {
+		CollectSubtrees(node->A, depth + 1, buffers);
+		CollectSubtrees(node->B, depth + 1, buffers);
+	}
+}
+
+static void
+PlaybackEvents(cpBBTree *tree, MarkTask *task, cpSpatialIndexQueryFunc func, void *data)
+{
+	for(int i=0; i<task->count; i++){
+		MarkEvent event = task->events[i];
+		
+		if(event.flags & MARK_REPLAY){
+			Node *leaf = event.a;
+			Pair *pair = leaf->PAIRS;
+			while(pair){
+				if(leaf == pair->b.leaf){
+					pair->id = func(pair->a.leaf->obj, leaf->obj, pair->id, data);
+					pair = pair->b.next;
+				} else {
+					pair = pair->a.next;
+				}
+			}
+		} else {
+			if(event.flags & MARK_PAIR) PairInsert(event.a, event.b, tree);
+			if(event.flags & MARK_CALL) func(event.b->obj, event.a->obj, 0, data);
+		}
+	}
+}
+
+void
+cpBBTreeReindexQueryParallel(cpSpatialIndex *index, cpSpatialIndexQueryFunc func, void *data, cpSpatialIndexParallelForFunc parallelFor, void *context)
+{
+	cpBBTree *tree = GetTree(index);
+	int count = (tree ? cpHashSetCount(tree->leaves) : 0);
+	
+	if(count < PARALLEL_MIN_LEAVES){
+		cpSpatialIndexReindexQuery(index, func, data);
+		return;
+	}
+	
+	struct ParallelBuffers *buffers = ParallelBuffersReserve(tree, count);
+	
+	cpSpatialIndex *staticIndex = tree->spatialIndex.staticIndex;
+	Node *staticRoot = GetRootIfTree(staticIndex);
+	ParallelContext parallelContext = {tree, buffers, staticRoot};
+	
+	// Update the leaves in the same order as cpBBTreeReindexQuery().
+	Node **cursor = buffers->leaves;
+	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)fillNodeArray, &cursor);
+	parallelFor(context, count, PARALLEL_UPDATE_GRAIN, (cpSpatialIndexTaskFunc)ParallelLeafCheck, &parallelContext);
+	
+	for(int i=0; i<count; i++){
+		if(buffers->moved[i]) LeafReinsert(buffers->leaves[i], buffers->bbs[i], tree);
+	}
+	
+	buffers->taskCount = 0;
+	CollectSubtrees(tree->root, 0, buffers);
+	parallelFor(context, buffers->taskCount, 1, (cpSpatialIndexTaskFunc)ParallelRecord, &parallelContext);
+	
+	for(int i=0; i<buffers->taskCount; i++) PlaybackEvents(tree, buffers->tasks + i, func, data);
+	if(staticIndex && !staticRoot) cpSpatialIndexCollideStatic((cpSpatialIndex *)tree, staticIndex, func, data);
+	
+	IncrementStamp(tree);
+}
+
 //MARK: Query
 
 static void
@@ -722,6 +1080,9 @@ static cpSpatialIndexClass klass = {
 	
 	(cpSpatialIndexQueryImpl)cpBBTreeQuery,
 	(cpSpatialIndexSegmentQueryImpl)cpBBTreeSegmentQuery,
+	
+	(cpSpatialIndexInsertBulkImpl)cpBBTreeInsertBulk,
+	(cpSpatialIndexReindexQueryParallelImpl)cpBBTreeReindexQueryParallel,
 };
 
 static inline cpSpatialIndexClass *Klass(){return &klass;}
@@ -734,16 +1095,10 @@ cpfcompare(const cpFloat *a, const cpFloat *b){
 	return (*a < *b ? -1 : (*b < *a ? 1 : 0));
 }
 
-static void
-fillNodeArray(Node *node, Node ***cursor){
-	(**cursor) = node;
-	(*cursor)++;
-}
-
 static Node *
 partitionNodes(cpBBTree *tree, Node **nodes, int count)
 {
-	if(count == 1){
+	if(count <= 1){
 		return nodes[0];
 	} else if(count == 2) {
 		return NodeNew(tree, nodes[0], nodes[1]);
@@ -847,6 +1202,177 @@ cpBBTreeOptimize(cpSpatialIndex *index)
 	cpfree(nodes);
 }
 
+//MARK: Bulk Building
+
+// Number of bins used when looking for the best split.
+#define SAH_BINS 16
+
+// Leaves are copied into a flat array while building so the passes over them don't chase pointers.
+typedef struct BuildItem {
+	cpBB bb;
+	cpVect center;
+	Node *leaf;
+} BuildItem;
+
+static inline int
+SAHBin(cpFloat value, cpFloat min, cpFloat scale)
+{
+	int bin = (int)((value - min)*scale);
+	return (bin < SAH_BINS - 1 ? bin : SAH_BINS - 1);
+}
+
+// Top down binned SAH build.
+// The leaves are sorted into bins by the centers of their bounds along each axis,
+// and the split between bins with the lowest surface area heuristic cost is used.
+static Node *
+BuildItems(cpBBTree *tree, BuildItem *items, int count)
+{
+	if(count <= 1){
+		return items[0].leaf;
+	} else if(count == 2){
+		return NodeNew(tree, items[0].leaf, items[1].leaf);
+	}
+	
+	// Find the bounds of the leaf centers.
+	cpVect center = items[0].center;
+	cpBB centers = cpBBNew(center.x, center.y, center.x, center.y);
+	for(int i=1; i<count; i++) centers = cpBBExpand(centers, items[i].center);
+	
+	cpFloat mins[] = {centers.l, centers.b};
+	cpFloat extents[] = {centers.r - centers.l, centers.t - centers.b};
+	
+	cpFloat scales[] = {
+		(extents[0] > 0.0f ? SAH_BINS/extents[0] : 0.0f),
+		(extents[1] > 0.0f ? SAH_BINS/extents[1] : 0.0f),
+	};
+	
+	// Bin the items along both axes in a single pass.
+	int binCounts[2][SAH_BINS] = {{0}};
+	cpBB binBBs[2][SAH_BINS];
+	for(int i=0; i<SAH_BINS; i++) binBBs[0][i] = binBBs[1][i] = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+	
+	for(int i=0; i<count; i++){
+		BuildItem *item = items + i;
+		
+		int x = SAHBin(item->center.x, mins[0], scales[0]);
+		binBBs[0][x] = cpBBMerge(binBBs[0][x], item->bb);
+		binCounts[0][x]++;
+		
+		int y = SAHBin(item->center.y, mins[1], scales[1]);
+		binBBs[1][y] = cpBBMerge(binBBs[1][y], item->bb);
+		binCounts[1][y]++;
+	}
+	
+	cpFloat bestCost = INFINITY;
+	int bestAxis = -1, bestSplit = 0;
+	
+	for(int axis=0; axis<2; axis++){
+		if(extents[axis] <= 0.0f) continue;
+		
+		// Sweep from the right to find the area and count on the right side of each split.
+		cpFloat rightAreas[SAH_BINS];
+		int rightCounts[SAH_BINS];
+		cpBB bb = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+		int n = 0;
+		for(int i=SAH_BINS - 1; i>0; i--){
+			bb = cpBBMerge(bb, binBBs[axis][i]);
+			n += binCounts[axis][i];
+			rightAreas[i] = (n ? cpBBArea(bb) : 0.0f);
+			rightCounts[i] = n;
+		}
+		
+		// Then sweep from the left to find the cost of each split.
+		bb = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+		n = 0;
+		for(int i=0; i<SAH_BINS - 1; i++){
+			bb = cpBBMerge(bb, binBBs[axis][i]);
+			n += binCounts[axis][i];
+			if(n == 0 || rightCounts[i + 1] == 0) continue;
+			
+			cpFloat cost = cpBBArea(bb)*n + rightAreas[i + 1]*rightCounts[i + 1];
+			if(cost < bestCost){
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+	
+	// When all the centers are the same any split is as good as any other.
+	int right = count/2;
+	
+	if(bestAxis >= 0){
+		// Partition the leaves around the best split.
+		cpFloat min = mins[bestAxis], scale = scales[bestAxis];
+		right = count;
+		
+		for(int left=0; left < right;){
+			BuildItem item = items[left];
+			if(SAHBin(bestAxis == 0 ? item.center.x : item.center.y, min, scale) > bestSplit){
+				right--;
+				items[left] = items[right];
+				items[right] = item;
+			} else {
+				left++;
+			}
+		}
+	}
+	
+	Node *a = BuildItems(tree, items, right);
+	Node *b = BuildItems(tree, items + right, count - right);
+	return NodeNew(tree, a, b);
+}
+
+static Node *
+BuildSubtree(cpBBTree *tree, Node **leaves, int count)
+{
+	BuildItem *items = (BuildItem *)cpcalloc(count, sizeof(BuildItem));
+	for(int i=0; i<count; i++){
+		BuildItem item = {leaves[i]->bb, cpBBCenter(leaves[i]->bb), leaves[i]};
+		items[i] = item;
+	}
+	
+	Node *root = BuildItems(tree, items, count);
+	cpfree(items);
+	
+	return root;
+}
+
+//MARK: Tree Quality
+
+static void
+SubtreeQuality(Node *node, int depth, cpBBTreeQuality *quality)
+{
+	if(depth > quality->maxDepth) quality->maxDepth = depth;
+	
+	if(!NodeIsLeaf(node)){
+		quality->sahCost += cpBBArea(node->bb);
+		SubtreeQuality(node->A, depth + 1, quality);
+		SubtreeQuality(node->B, depth + 1, quality);
+	}
+}
+
+cpBBTreeQuality
+cpBBTreeGetQuality(cpSpatialIndex *index)
+{
+	cpBBTreeQuality quality = {0.0f, 0};
+	
+	if(index->klass != &klass){
+		cpAssertWarn(cpFalse, "Ignoring cpBBTreeGetQuality() call to non-tree spatial index.");
+		return quality;
+	}
+	
+	Node *root = ((cpBBTree *)index)->root;
+	if(root){
+		SubtreeQuality(root, 0, &quality);
+		
+		cpFloat area = cpBBArea(root->bb);
+		quality.sahCost = (area > 0.0f ? quality.sahCost/area : 0.0f);
+	}
+	
+	return quality;
+}
+
 //MARK: Debug Draw
 
 //#define CP_BBTREE_DEBUG_DRAW
@@ -45,6 +45,10 @@ cpBodyInit(cpBody *body, cpFloat mass, cpFloat moment)
 	body->sleeping.next = NULL;
 	body->sleeping.idleTime = 0.0f;
 	
+	body->bullet.enabled = cpFalse;
+	body->bullet.p = cpvzero;
+	body->bullet.a = 0.0f;
+	
 	body->p = cpvzero;
 	body->v = cpvzero;
 	body->f = cpvzero;
@@ -133,6 +137,18 @@ cpBodyIsSleeping(const cpBody *body)
 	return (body->sleeping.root != ((cpBody*)0));
 }
 
+cpBool
+cpBodyIsBullet(const cpBody *body)
+{
+	return body->bullet.enabled;
+}
+
+void
+cpBodySetBullet(cpBody *body, cpBool bullet)
+{
+	body->bullet.enabled = bullet;
+}
+
 cpBodyType
 cpBodyGetType(cpBody *body)
 {
@@ -438,6 +454,14 @@ cpBodySetAngle(cpBody *body, cpFloat angle)
 	SetTransform(body, body->p, angle);
 }
 
+void
+cpBodySetPose(cpBody *body, cpVect p, cpFloat a)
+{
+	body->p = p;
+	SetAngle(body, a);
+	SetTransform(body, p, a);
+}
+
 cpFloat
 cpBodyGetAngularVelocity(const cpBody *body)
 {
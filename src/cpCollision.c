@@ -54,6 +54,13 @@ cpCollisionInfoPushContact(struct cpCollisionInfo *info, cpVect p1, cpVect p2, c
 	info->count++;
 }
 
+static inline void
+cpCollisionInfoSetSeparation(struct cpCollisionInfo *info, cpVect n, cpFloat separation)
+{
+	info->n = n;
+	info->separation = separation;
+}
+
 //MARK: Support Points and Edges:
 
 // Support points are the maximal points on a shape's perimeter along a certain axis.
@@ -136,6 +143,9 @@ MinkowskiPointNew(const struct SupportPoint a, const struct SupportPoint b)
 struct SupportContext {
 	const cpShape *shape1, *shape2;
 	SupportPointFunc func1, func2;
+	
+	// Only used to count the GJK and EPA iterations for the step stats.
+	struct cpCollisionInfo *info;
 };
 
 // Calculate the maximal point on the minkowski difference of two shapes along a particular axis.
@@ -327,6 +337,7 @@ EPARecurse(const struct SupportContext *ctx, const int count, const struct Minko
 	} else {
 		// Could not find a new point to insert, so we have found the closest edge of the minkowski difference.
 		cpAssertWarn(iteration < WARN_EPA_ITERATIONS, "High EPA iterations: %d", iteration);
+		CP_STATS_COUNT(ctx->info, epaIterations, iteration);
 		return ClosestPointsNew(v0, v1);
 	}
 }
@@ -350,6 +361,7 @@ GJKRecurse(const struct SupportContext *ctx, const struct MinkowskiPoint v0, con
 {
 	if(iteration > MAX_GJK_ITERATIONS){
 		cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK iterations: %d", iteration);
+		CP_STATS_COUNT(ctx->info, gjkIterations, iteration);
 		return ClosestPointsNew(v0, v1);
 	}
 	
@@ -372,11 +384,13 @@ GJKRecurse(const struct SupportContext *ctx, const struct MinkowskiPoint v0, con
 		if(cpCheckPointGreater(p.ab, v0.ab, cpvzero) && cpCheckPointGreater(v1.ab, p.ab, cpvzero)){
 			// The triangle v0, p, v1 contains the origin. Use EPA to find the MSA.
 			cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK->EPA iterations: %d", iteration);
+			CP_STATS_COUNT(ctx->info, gjkIterations, iteration);
 			return EPA(ctx, v0, p, v1);
 		} else {
 			if(cpCheckAxis(v0.ab, v1.ab, p.ab, n)){
 				// The edge v0, v1 that we already have is the closest to (0, 0) since p was not closer.
 				cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK iterations: %d", iteration);
+				CP_STATS_COUNT(ctx->info, gjkIterations, iteration);
 				return ClosestPointsNew(v0, v1);
 			} else {
 				// p was closer to the origin than our existing edge.
@@ -471,6 +485,15 @@ GJK(const struct SupportContext *ctx, cpCollisionID *id)
 	return points;
 }
 
+// Store the separating axis of shapes that aren't touching so the space can skip them until they move closer.
+// The gap is measured using the support points instead of the GJK distance so it's conservative even if GJK didn't fully converge.
+static inline void
+StoreSeparatingAxis(const struct SupportContext *ctx, const cpVect n, const cpFloat mindist, struct cpCollisionInfo *info)
+{
+	cpFloat separation = cpvdot(n, Support(ctx, cpvneg(n)).ab) - mindist;
+	if(separation > 0.0f) cpCollisionInfoSetSeparation(info, n, separation);
+}
+
 //MARK: Contact Clipping
 
 // Given two support edges, find contact point pairs on their surfaces.
@@ -478,7 +501,7 @@ static inline void
 ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPoints points, struct cpCollisionInfo *info)
 {
 	cpFloat mindist = e1.r + e2.r;
-	if(points.d <= mindist){
+	if(points.d <= mindist + info->margin){
 #ifdef DRAW_CLIP
 	ChipmunkDebugDrawFatSegment(e1.a.p, e1.b.p, e1.r, RGBAColor(0, 1, 0, 1), LAColor(0, 0));
 	ChipmunkDebugDrawFatSegment(e2.a.p, e2.b.p, e2.r, RGBAColor(1, 0, 0, 1), LAColor(0, 0));
@@ -501,7 +524,7 @@ ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPo
 			cpVect p1 = cpvadd(cpvmult(n,  e1.r), cpvlerp(e1.a.p, e1.b.p, cpfclamp01((d_e2_b - d_e1_a)*e1_denom)));
 			cpVect p2 = cpvadd(cpvmult(n, -e2.r), cpvlerp(e2.a.p, e2.b.p, cpfclamp01((d_e1_a - d_e2_a)*e2_denom)));
 			cpFloat dist = cpvdot(cpvsub(p2, p1), n);
-			if(dist <= 0.0f){
+			if(dist <= info->margin){
 				cpHashValue hash_1a2b = CP_HASH_PAIR(e1.a.hash, e2.b.hash);
 				cpCollisionInfoPushContact(info, p1, p2, hash_1a2b);
 			}
@@ -509,7 +532,7 @@ ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPo
 			cpVect p1 = cpvadd(cpvmult(n,  e1.r), cpvlerp(e1.a.p, e1.b.p, cpfclamp01((d_e2_a - d_e1_a)*e1_denom)));
 			cpVect p2 = cpvadd(cpvmult(n, -e2.r), cpvlerp(e2.a.p, e2.b.p, cpfclamp01((d_e1_b - d_e2_a)*e2_denom)));
 			cpFloat dist = cpvdot(cpvsub(p2, p1), n);
-			if(dist <= 0.0f){
+			if(dist <= info->margin){
 				cpHashValue hash_1b2a = CP_HASH_PAIR(e1.b.hash, e2.a.hash);
 				cpCollisionInfoPushContact(info, p1, p2, hash_1b2a);
 			}
@@ -517,6 +540,172 @@ ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPo
 	}
 }
 
+//MARK: Separating Axis Test
+
+// Polygons with at most this many vertexes are collided using the separating axis test instead of GJK/EPA.
+// Most polys are boxes or other small shapes, and testing each of their edges is cheaper than iterating GJK and EPA.
+int cpCollidePolySATMaxCount = 12;
+
+struct SeparatingAxis {
+	// Distance between the shapes along the axis, negative when they overlap.
+	cpFloat d;
+	// Index of the splitting plane the axis came from.
+	int index;
+};
+
+static inline cpFloat
+PlaneSeparation(const struct cpSplittingPlane plane, const int count, const struct cpSplittingPlane *planes)
+{
+	cpVect n = plane.n;
+	cpFloat min = cpvdot(n, planes[0].v0);
+	for(int i=1; i<count; i++) min = cpfmin(min, cpvdot(n, planes[i].v0));
+	
+	return min - cpvdot(n, plane.v0);
+}
+
+// Find the edge of poly1 that poly2 penetrates the least.
+// Stops early once an edge separates the polys by more than mindist since they can't be colliding.
+static inline struct SeparatingAxis
+PolyMaxSeparation(const cpPolyShape *poly1, const cpPolyShape *poly2, const cpFloat mindist)
+{
+	const struct cpSplittingPlane *planes = poly1->planes;
+	struct SeparatingAxis axis = {PlaneSeparation(planes[0], poly2->count, poly2->planes), 0};
+	
+	for(int i=1; i<poly1->count && axis.d <= mindist; i++){
+		cpFloat d = PlaneSeparation(planes[i], poly2->count, poly2->planes);
+		if(d > axis.d){
+			axis.d = d;
+			axis.index = i;
+		}
+	}
+	
+	return axis;
+}
+
+// Collision ids are built the same way as GJK's, from the minkowski difference edge between the closest features.
+// That way GJK still gets a good starting point if the polys switch between the two algorithms.
+static inline cpCollisionID
+PolyEdgeVertexID(const int i, const int count1, const int j)
+{
+	return ((i - 1 + count1)%count1 & 0xFF)<<24 | (j & 0xFF)<<16 | (i & 0xFF)<<8 | (j & 0xFF);
+}
+
+static inline cpCollisionID
+PolyVertexEdgeID(const int i, const int j, const int count2)
+{
+	return (i & 0xFF)<<24 | ((j - 1 + count2)%count2 & 0xFF)<<16 | (i & 0xFF)<<8 | (j & 0xFF);
+}
+
+// Closest point to p on the edge ending at planes[i].
+static inline cpVect
+PolyEdgeClosestPoint(const int count, const struct cpSplittingPlane *planes, const int i, const cpVect p)
+{
+	cpVect a = planes[(i - 1 + count)%count].v0;
+	cpVect delta = cpvsub(planes[i].v0, a);
+	return cpvadd(a, cpvmult(delta, cpfclamp01(cpvdot(delta, cpvsub(p, a))/(cpvlengthsq(delta) + CPFLOAT_MIN))));
+}
+
+// Check if the projection of p onto the line through the edge ending at planes[i] lands on the edge.
+static inline cpBool
+PolyEdgeContains(const int count, const struct cpSplittingPlane *planes, const int i, const cpVect p)
+{
+	cpVect a = planes[(i - 1 + count)%count].v0;
+	cpVect delta = cpvsub(planes[i].v0, a);
+	cpFloat t = cpvdot(delta, cpvsub(p, a));
+	return (0.0f <= t && t <= cpvlengthsq(delta));
+}
+
+// Find the closest points of two polys that don't overlap by checking each vertex against each edge of the other poly.
+static struct ClosestPoints
+PolyClosestPoints(const cpPolyShape *poly1, const cpPolyShape *poly2)
+{
+	int count1 = poly1->count, count2 = poly2->count;
+	const struct cpSplittingPlane *planes1 = poly1->planes, *planes2 = poly2->planes;
+	
+	struct ClosestPoints points = {planes1[0].v0, planes2[0].v0, cpvzero, 0.0f, 0};
+	cpFloat min = cpvdistsq(points.a, points.b);
+	
+	for(int i=0; i<count1; i++){
+		for(int j=0; j<count2; j++){
+			cpVect p1 = PolyEdgeClosestPoint(count1, planes1, i, planes2[j].v0);
+			cpFloat distsq = cpvdistsq(p1, planes2[j].v0);
+			if(distsq < min){
+				struct ClosestPoints closest = {p1, planes2[j].v0, cpvzero, 0.0f, PolyEdgeVertexID(i, count1, j)};
+				points = closest;
+				min = distsq;
+			}
+			
+			cpVect p2 = PolyEdgeClosestPoint(count2, planes2, j, planes1[i].v0);
+			distsq = cpvdistsq(planes1[i].v0, p2);
+			if(distsq < min){
+				struct ClosestPoints closest = {planes1[i].v0, p2, cpvzero, 0.0f, PolyVertexEdgeID(i, j, count2)};
+				points = closest;
+				min = distsq;
+			}
+		}
+	}
+	
+	points.d = cpfsqrt(min);
+	points.n = cpvmult(cpvsub(points.b, points.a), 1.0f/(points.d + CPFLOAT_MIN));
+	return points;
+}
+
+static void
+PolyToPolySAT(const cpPolyShape *poly1, const cpPolyShape *poly2, struct cpCollisionInfo *info)
+{
+	cpFloat mindist = poly1->r + poly2->r;
+	cpFloat maxdist = mindist + info->margin;
+	
+	int count1 = poly1->count, count2 = poly2->count;
+	const struct cpSplittingPlane *planes1 = poly1->planes, *planes2 = poly2->planes;
+	
+	struct SeparatingAxis axis1 = PolyMaxSeparation(poly1, poly2, maxdist);
+	if(axis1.d > maxdist){
+		cpCollisionInfoSetSeparation(info, planes1[axis1.index].n, axis1.d - mindist);
+		return;
+	}
+	
+	struct SeparatingAxis axis2 = PolyMaxSeparation(poly2, poly1, maxdist);
+	if(axis2.d > maxdist){
+		cpCollisionInfoSetSeparation(info, cpvneg(planes2[axis2.index].n), axis2.d - mindist);
+		return;
+	}
+	
+	// The axis of least penetration is the same minimum separating axis that EPA would find.
+	struct ClosestPoints points;
+	cpBool onEdge;
+	if(axis1.d >= axis2.d){
+		int i = axis1.index, j = PolySupportPointIndex(count2, planes2, cpvneg(planes1[i].n));
+		points.n = planes1[i].n;
+		points.d = axis1.d;
+		points.b = planes2[j].v0;
+		points.a = cpvadd(points.b, cpvmult(points.n, -points.d));
+		points.id = PolyEdgeVertexID(i, count1, j);
+		onEdge = PolyEdgeContains(count1, planes1, i, points.a);
+	} else {
+		int j = axis2.index, i = PolySupportPointIndex(count1, planes1, cpvneg(planes2[j].n));
+		points.n = cpvneg(planes2[j].n);
+		points.d = axis2.d;
+		points.a = planes1[i].v0;
+		points.b = cpvadd(points.a, cpvmult(points.n, points.d));
+		points.id = PolyVertexEdgeID(i, j, count2);
+		onEdge = PolyEdgeContains(count2, planes2, j, points.b);
+	}
+	
+	// When only the rounded edges can be touching, the closest points are usually the vertex and edge found above.
+	// Otherwise they are near a corner and might be between two vertexes instead.
+	if(points.d > 0.0f && !onEdge){
+		points = PolyClosestPoints(poly1, poly2);
+		if(points.d > maxdist){
+			cpCollisionInfoSetSeparation(info, points.n, points.d - mindist);
+			return;
+		}
+	}
+	
+	info->id = points.id;
+	ContactPoints(SupportEdgeForPoly(poly1, points.n), SupportEdgeForPoly(poly2, cpvneg(points.n)), points, info);
+}
+
 //MARK: Collision Functions
 
 typedef void (*CollisionFunc)(const cpShape *a, const cpShape *b, struct cpCollisionInfo *info);
@@ -525,11 +714,11 @@ typedef void (*CollisionFunc)(const cpShape *a, const cpShape *b, struct cpColli
 static void
 CircleToCircle(const cpCircleShape *c1, const cpCircleShape *c2, struct cpCollisionInfo *info)
 {
-	cpFloat mindist = c1->r + c2->r;
+	cpFloat maxdist = c1->r + c2->r + info->margin;
 	cpVect delta = cpvsub(c2->tc, c1->tc);
 	cpFloat distsq = cpvlengthsq(delta);
 	
-	if(distsq < mindist*mindist){
+	if(distsq < maxdist*maxdist){
 		cpFloat dist = cpfsqrt(distsq);
 		cpVect n = info->n = (dist ? cpvmult(delta, 1.0f/dist) : cpv(1.0f, 0.0f));
 		cpCollisionInfoPushContact(info, cpvadd(c1->tc, cpvmult(n, c1->r)), cpvadd(c2->tc, cpvmult(n, -c2->r)), 0);
@@ -549,10 +738,10 @@ CircleToSegment(const cpCircleShape *circle, const cpSegmentShape *segment, stru
 	cpVect closest = cpvadd(seg_a, cpvmult(seg_delta, closest_t));
 	
 	// Compare the radii of the two shapes to see if they are colliding.
-	cpFloat mindist = circle->r + segment->r;
+	cpFloat maxdist = circle->r + segment->r + info->margin;
 	cpVect delta = cpvsub(closest, center);
 	cpFloat distsq = cpvlengthsq(delta);
-	if(distsq < mindist*mindist){
+	if(distsq < maxdist*maxdist){
 		cpFloat dist = cpfsqrt(distsq);
 		// Handle coincident shapes as gracefully as possible.
 		cpVect n = info->n = (dist ? cpvmult(delta, 1.0f/dist) : segment->tn);
@@ -571,7 +760,7 @@ CircleToSegment(const cpCircleShape *circle, const cpSegmentShape *segment, stru
 static void
 SegmentToSegment(const cpSegmentShape *seg1, const cpSegmentShape *seg2, struct cpCollisionInfo *info)
 {
-	struct SupportContext context = {(cpShape *)seg1, (cpShape *)seg2, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)SegmentSupportPoint};
+	struct SupportContext context = {(cpShape *)seg1, (cpShape *)seg2, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)SegmentSupportPoint, info};
 	struct ClosestPoints points = GJK(&context, &info->id);
 	
 #if DRAW_CLOSEST
@@ -591,7 +780,7 @@ SegmentToSegment(const cpSegmentShape *seg1, const cpSegmentShape *seg2, struct
 	
 	// If the closest points are nearer than the sum of the radii...
 	if(
-		points.d <= (seg1->r + seg2->r) && (
+		points.d <= (seg1->r + seg2->r + info->margin) && (
 			// Reject endcap collisions if tangents are provided.
 			(!cpveql(points.a, seg1->ta) || cpvdot(n, cpvrotate(seg1->a_tangent, rot1)) <= 0.0) &&
 			(!cpveql(points.a, seg1->tb) || cpvdot(n, cpvrotate(seg1->b_tangent, rot1)) <= 0.0) &&
@@ -600,13 +789,22 @@ SegmentToSegment(const cpSegmentShape *seg1, const cpSegmentShape *seg2, struct
 		)
 	){
 		ContactPoints(SupportEdgeForSegment(seg1, n), SupportEdgeForSegment(seg2, cpvneg(n)), points, info);
+	} else if(points.d > seg1->r + seg2->r){
+		StoreSeparatingAxis(&context, n, seg1->r + seg2->r, info);
 	}
 }
 
 static void
 PolyToPoly(const cpPolyShape *poly1, const cpPolyShape *poly2, struct cpCollisionInfo *info)
 {
-	struct SupportContext context = {(cpShape *)poly1, (cpShape *)poly2, (SupportPointFunc)PolySupportPoint, (SupportPointFunc)PolySupportPoint};
+	// Degenerate polys with fewer than 3 vertexes don't have useful edge normals.
+	int maxCount = cpCollidePolySATMaxCount;
+	if(2 < poly1->count && poly1->count <= maxCount && 2 < poly2->count && poly2->count <= maxCount){
+		PolyToPolySAT(poly1, poly2, info);
+		return;
+	}
+	
+	struct SupportContext context = {(cpShape *)poly1, (cpShape *)poly2, (SupportPointFunc)PolySupportPoint, (SupportPointFunc)PolySupportPoint, info};
 	struct ClosestPoints points = GJK(&context, &info->id);
 	
 #if DRAW_CLOSEST
@@ -621,15 +819,17 @@ PolyToPoly(const cpPolyShape *poly1, const cpPolyShape *poly2, struct cpCollisio
 #endif
 	
 	// If the closest points are nearer than the sum of the radii...
-	if(points.d - poly1->r - poly2->r <= 0.0){
+	if(points.d - poly1->r - poly2->r <= info->margin){
 		ContactPoints(SupportEdgeForPoly(poly1, points.n), SupportEdgeForPoly(poly2, cpvneg(points.n)), points, info);
+	} else {
+		StoreSeparatingAxis(&context, points.n, poly1->r + poly2->r, info);
 	}
 }
 
 static void
 SegmentToPoly(const cpSegmentShape *seg, const cpPolyShape *poly, struct cpCollisionInfo *info)
 {
-	struct SupportContext context = {(cpShape *)seg, (cpShape *)poly, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)PolySupportPoint};
+	struct SupportContext context = {(cpShape *)seg, (cpShape *)poly, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)PolySupportPoint, info};
 	struct ClosestPoints points = GJK(&context, &info->id);
 	
 #if DRAW_CLOSEST
@@ -648,20 +848,22 @@ SegmentToPoly(const cpSegmentShape *seg, const cpPolyShape *poly, struct cpColli
 	
 	if(
 		// If the closest points are nearer than the sum of the radii...
-		points.d - seg->r - poly->r <= 0.0 && (
+		points.d - seg->r - poly->r <= info->margin && (
 			// Reject endcap collisions if tangents are provided.
 			(!cpveql(points.a, seg->ta) || cpvdot(n, cpvrotate(seg->a_tangent, rot)) <= 0.0) &&
 			(!cpveql(points.a, seg->tb) || cpvdot(n, cpvrotate(seg->b_tangent, rot)) <= 0.0)
 		)
 	){
 		ContactPoints(SupportEdgeForSegment(seg, n), SupportEdgeForPoly(poly, cpvneg(n)), points, info);
+	} else if(points.d > seg->r + poly->r){
+		StoreSeparatingAxis(&context, n, seg->r + poly->r, info);
 	}
 }
 
 static void
 CircleToPoly(const cpCircleShape *circle, const cpPolyShape *poly, struct cpCollisionInfo *info)
 {
-	struct SupportContext context = {(cpShape *)circle, (cpShape *)poly, (SupportPointFunc)CircleSupportPoint, (SupportPointFunc)PolySupportPoint};
+	struct SupportContext context = {(cpShape *)circle, (cpShape *)poly, (SupportPointFunc)CircleSupportPoint, (SupportPointFunc)PolySupportPoint, info};
 	struct ClosestPoints points = GJK(&context, &info->id);
 	
 #if DRAW_CLOSEST
@@ -672,9 +874,11 @@ CircleToPoly(const cpCircleShape *circle, const cpPolyShape *poly, struct cpColl
 #endif
 	
 	// If the closest points are nearer than the sum of the radii...
-	if(points.d <= circle->r + poly->r){
+	if(points.d <= circle->r + poly->r + info->margin){
 		cpVect n = info->n = points.n;
 		cpCollisionInfoPushContact(info, cpvadd(points.a, cpvmult(n, circle->r)), cpvadd(points.b, cpvmult(n, -poly->r)), 0);
+	} else {
+		StoreSeparatingAxis(&context, points.n, circle->r + poly->r, info);
 	}
 }
 
@@ -699,9 +903,9 @@ static const CollisionFunc BuiltinCollisionFuncs[9] = {
 static const CollisionFunc *CollisionFuncs = BuiltinCollisionFuncs;
 
 struct cpCollisionInfo
-cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, struct cpContact *contacts)
+cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, cpFloat margin, struct cpContact *contacts)
 {
-	struct cpCollisionInfo info = {a, b, id, cpvzero, 0, contacts};
+	struct cpCollisionInfo info = {a, b, id, margin, cpvzero, 0.0f, 0, contacts};
 	
 	// Make sure the shape types are in order.
 	if(a->klass->type > b->klass->type){
@@ -0,0 +1,416 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chipmunk/chipmunk_private.h"
+#include "cpSIMD.h"
+
+// Batched collisions gather circle/circle and circle/segment pairs into SIMD lanes, one pair per lane.
+// The kernels use the same operations in the same order as CircleToCircle() and CircleToSegment() so the results match exactly.
+// The only branch left for afterwards is rejecting segment endcap collisions, which needs the segment's tangents.
+
+// Distance between the fields of a bucket's lanes.
+#define BATCH_STRIDE CP_COLLISION_BATCH_SIZE
+
+// Per lane values for circle/circle pairs. The fields before CIRCLE_NX are the inputs.
+enum {
+	CIRCLE_AX, CIRCLE_AY, CIRCLE_AR,
+	CIRCLE_BX, CIRCLE_BY, CIRCLE_BR,
+	CIRCLE_MARGIN,
+	CIRCLE_NX, CIRCLE_NY,
+	CIRCLE_DISTSQ, CIRCLE_MAXDISTSQ,
+	CIRCLE_R1X, CIRCLE_R1Y, CIRCLE_R2X, CIRCLE_R2Y,
+	CIRCLE_FIELDS,
+};
+
+// Per lane values for circle/segment pairs. The fields before SEGMENT_NX are the inputs.
+enum {
+	SEGMENT_CX, SEGMENT_CY, SEGMENT_CR,
+	SEGMENT_AX, SEGMENT_AY,
+	SEGMENT_BX, SEGMENT_BY,
+	SEGMENT_TNX, SEGMENT_TNY, SEGMENT_SR,
+	SEGMENT_MARGIN,
+	SEGMENT_NX, SEGMENT_NY,
+	SEGMENT_DISTSQ, SEGMENT_MAXDISTSQ, SEGMENT_T,
+	SEGMENT_R1X, SEGMENT_R1Y, SEGMENT_R2X, SEGMENT_R2Y,
+	SEGMENT_FIELDS,
+};
+
+// Kernels run on count lanes starting at lanes, with each field's values BATCH_STRIDE apart.
+// SIMD kernels require count to be a multiple of their width.
+typedef void (*BatchKernelFunc)(cpFloat *lanes, int count);
+
+struct BatchKernels {
+	int width;
+	BatchKernelFunc circles, segments;
+};
+
+//MARK: Scalar Kernels
+
+static void
+CircleKernel_Scalar(cpFloat *lanes, int count)
+{
+	const int S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i++){
+		cpFloat *l = lanes + i;
+		cpVect c1 = cpv(l[CIRCLE_AX*S], l[CIRCLE_AY*S]), c2 = cpv(l[CIRCLE_BX*S], l[CIRCLE_BY*S]);
+		cpFloat r1 = l[CIRCLE_AR*S], r2 = l[CIRCLE_BR*S];
+		
+		cpFloat maxdist = r1 + r2 + l[CIRCLE_MARGIN*S];
+		cpVect delta = cpvsub(c2, c1);
+		cpFloat distsq = cpvlengthsq(delta);
+		cpFloat dist = cpfsqrt(distsq);
+		cpVect n = (dist ? cpvmult(delta, 1.0f/dist) : cpv(1.0f, 0.0f));
+		cpVect p1 = cpvadd(c1, cpvmult(n, r1)), p2 = cpvadd(c2, cpvmult(n, -r2));
+		
+		l[CIRCLE_NX*S] = n.x; l[CIRCLE_NY*S] = n.y;
+		l[CIRCLE_DISTSQ*S] = distsq; l[CIRCLE_MAXDISTSQ*S] = maxdist*maxdist;
+		l[CIRCLE_R1X*S] = p1.x; l[CIRCLE_R1Y*S] = p1.y;
+		l[CIRCLE_R2X*S] = p2.x; l[CIRCLE_R2Y*S] = p2.y;
+	}
+}
+
+static void
+SegmentKernel_Scalar(cpFloat *lanes, int count)
+{
+	const int S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i++){
+		cpFloat *l = lanes + i;
+		cpVect center = cpv(l[SEGMENT_CX*S], l[SEGMENT_CY*S]);
+		cpVect seg_a = cpv(l[SEGMENT_AX*S], l[SEGMENT_AY*S]);
+		cpVect seg_b = cpv(l[SEGMENT_BX*S], l[SEGMENT_BY*S]);
+		cpFloat cr = l[SEGMENT_CR*S], sr = l[SEGMENT_SR*S];
+		
+		cpVect seg_delta = cpvsub(seg_b, seg_a);
+		cpFloat closest_t = cpfclamp01(cpvdot(seg_delta, cpvsub(center, seg_a))/cpvlengthsq(seg_delta));
+		cpVect closest = cpvadd(seg_a, cpvmult(seg_delta, closest_t));
+		
+		cpFloat maxdist = cr + sr + l[SEGMENT_MARGIN*S];
+		cpVect delta = cpvsub(closest, center);
+		cpFloat distsq = cpvlengthsq(delta);
+		cpFloat dist = cpfsqrt(distsq);
+		cpVect n = (dist ? cpvmult(delta, 1.0f/dist) : cpv(l[SEGMENT_TNX*S], l[SEGMENT_TNY*S]));
+		cpVect p1 = cpvadd(center, cpvmult(n, cr)), p2 = cpvadd(closest, cpvmult(n, -sr));
+		
+		l[SEGMENT_NX*S] = n.x; l[SEGMENT_NY*S] = n.y;
+		l[SEGMENT_DISTSQ*S] = distsq; l[SEGMENT_MAXDISTSQ*S] = maxdist*maxdist; l[SEGMENT_T*S] = closest_t;
+		l[SEGMENT_R1X*S] = p1.x; l[SEGMENT_R1Y*S] = p1.y;
+		l[SEGMENT_R2X*S] = p2.x; l[SEGMENT_R2Y*S] = p2.y;
+	}
+}
+
+static const struct BatchKernels ScalarKernels = {1, CircleKernel_Scalar, SegmentKernel_Scalar};
+
+#if CP_SIMD_X86
+
+//MARK: SSE2 Kernels
+
+static CP_TARGET_SSE2 void
+CircleKernel_SSE2(cpFloat *lanes, int count)
+{
+	const int W = SSE_LANES, S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i += W){
+		cpFloat *l = lanes + i;
+		cpFloatSSE ax = sse_load(l + CIRCLE_AX*S), ay = sse_load(l + CIRCLE_AY*S), ar = sse_load(l + CIRCLE_AR*S);
+		cpFloatSSE bx = sse_load(l + CIRCLE_BX*S), by = sse_load(l + CIRCLE_BY*S), br = sse_load(l + CIRCLE_BR*S);
+		
+		cpFloatSSE maxdist = sse_add(sse_add(ar, br), sse_load(l + CIRCLE_MARGIN*S));
+		cpFloatSSE dx = sse_sub(bx, ax), dy = sse_sub(by, ay);
+		cpFloatSSE distsq = sse_add(sse_mul(dx, dx), sse_mul(dy, dy));
+		cpFloatSSE dist = sse_sqrt(distsq);
+		
+		// Coincident circles use the x-axis as their normal.
+		cpFloatSSE coincident = sse_cmpeq(dist, sse_zero());
+		cpFloatSSE inv = sse_div(sse_set1(1.0f), dist);
+		cpFloatSSE nx = sse_select(coincident, sse_set1(1.0f), sse_mul(dx, inv));
+		cpFloatSSE ny = sse_select(coincident, sse_zero(), sse_mul(dy, inv));
+		
+		sse_store(l + CIRCLE_NX*S, nx); sse_store(l + CIRCLE_NY*S, ny);
+		sse_store(l + CIRCLE_DISTSQ*S, distsq); sse_store(l + CIRCLE_MAXDISTSQ*S, sse_mul(maxdist, maxdist));
+		sse_store(l + CIRCLE_R1X*S, sse_add(ax, sse_mul(nx, ar))); sse_store(l + CIRCLE_R1Y*S, sse_add(ay, sse_mul(ny, ar)));
+		sse_store(l + CIRCLE_R2X*S, sse_sub(bx, sse_mul(nx, br))); sse_store(l + CIRCLE_R2Y*S, sse_sub(by, sse_mul(ny, br)));
+	}
+}
+
+static CP_TARGET_SSE2 void
+SegmentKernel_SSE2(cpFloat *lanes, int count)
+{
+	const int W = SSE_LANES, S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i += W){
+		cpFloat *l = lanes + i;
+		cpFloatSSE cx = sse_load(l + SEGMENT_CX*S), cy = sse_load(l + SEGMENT_CY*S), cr = sse_load(l + SEGMENT_CR*S);
+		cpFloatSSE ax = sse_load(l + SEGMENT_AX*S), ay = sse_load(l + SEGMENT_AY*S), sr = sse_load(l + SEGMENT_SR*S);
+		cpFloatSSE sx = sse_sub(sse_load(l + SEGMENT_BX*S), ax);
+		cpFloatSSE sy = sse_sub(sse_load(l + SEGMENT_BY*S), ay);
+		
+		cpFloatSSE dot = sse_add(sse_mul(sx, sse_sub(cx, ax)), sse_mul(sy, sse_sub(cy, ay)));
+		cpFloatSSE t = sse_div(dot, sse_add(sse_mul(sx, sx), sse_mul(sy, sy)));
+		t = sse_max(sse_zero(), sse_min(t, sse_set1(1.0f)));
+		cpFloatSSE px = sse_add(ax, sse_mul(sx, t));
+		cpFloatSSE py = sse_add(ay, sse_mul(sy, t));
+		
+		cpFloatSSE maxdist = sse_add(sse_add(cr, sr), sse_load(l + SEGMENT_MARGIN*S));
+		cpFloatSSE dx = sse_sub(px, cx), dy = sse_sub(py, cy);
+		cpFloatSSE distsq = sse_add(sse_mul(dx, dx), sse_mul(dy, dy));
+		cpFloatSSE dist = sse_sqrt(distsq);
+		
+		// A circle centered on the segment uses the segment's normal.
+		cpFloatSSE coincident = sse_cmpeq(dist, sse_zero());
+		cpFloatSSE inv = sse_div(sse_set1(1.0f), dist);
+		cpFloatSSE nx = sse_select(coincident, sse_load(l + SEGMENT_TNX*S), sse_mul(dx, inv));
+		cpFloatSSE ny = sse_select(coincident, sse_load(l + SEGMENT_TNY*S), sse_mul(dy, inv));
+		
+		sse_store(l + SEGMENT_NX*S, nx); sse_store(l + SEGMENT_NY*S, ny);
+		sse_store(l + SEGMENT_DISTSQ*S, distsq); sse_store(l + SEGMENT_MAXDISTSQ*S, sse_mul(maxdist, maxdist)); sse_store(l + SEGMENT_T*S, t);
+		sse_store(l + SEGMENT_R1X*S, sse_add(cx, sse_mul(nx, cr))); sse_store(l + SEGMENT_R1Y*S, sse_add(cy, sse_mul(ny, cr)));
+		sse_store(l + SEGMENT_R2X*S, sse_sub(px, sse_mul(nx, sr))); sse_store(l + SEGMENT_R2Y*S, sse_sub(py, sse_mul(ny, sr)));
+	}
+}
+
+static const struct BatchKernels SSE2Kernels = {SSE_LANES, CircleKernel_SSE2, SegmentKernel_SSE2};
+
+//MARK: AVX2 Kernels
+
+static CP_TARGET_AVX2 void
+CircleKernel_AVX2(cpFloat *lanes, int count)
+{
+	const int W = AVX_LANES, S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i += W){
+		cpFloat *l = lanes + i;
+		cpFloatAVX ax = avx_load(l + CIRCLE_AX*S), ay = avx_load(l + CIRCLE_AY*S), ar = avx_load(l + CIRCLE_AR*S);
+		cpFloatAVX bx = avx_load(l + CIRCLE_BX*S), by = avx_load(l + CIRCLE_BY*S), br = avx_load(l + CIRCLE_BR*S);
+		
+		cpFloatAVX maxdist = avx_add(avx_add(ar, br), avx_load(l + CIRCLE_MARGIN*S));
+		cpFloatAVX dx = avx_sub(bx, ax), dy = avx_sub(by, ay);
+		cpFloatAVX distsq = avx_add(avx_mul(dx, dx), avx_mul(dy, dy));
+		cpFloatAVX dist = avx_sqrt(distsq);
+		
+		// Coincident circles use the x-axis as their normal.
+		cpFloatAVX coincident = avx_cmpeq(dist, avx_zero());
+		cpFloatAVX inv = avx_div(avx_set1(1.0f), dist);
+		cpFloatAVX nx = avx_select(coincident, avx_set1(1.0f), avx_mul(dx, inv));
+		cpFloatAVX ny = avx_select(coincident, avx_zero(), avx_mul(dy, inv));
+		
+		avx_store(l + CIRCLE_NX*S, nx); avx_store(l + CIRCLE_NY*S, ny);
+		avx_store(l + CIRCLE_DISTSQ*S, distsq); avx_store(l + CIRCLE_MAXDISTSQ*S, avx_mul(maxdist, maxdist));
+		avx_store(l + CIRCLE_R1X*S, avx_add(ax, avx_mul(nx, ar))); avx_store(l + CIRCLE_R1Y*S, avx_add(ay, avx_mul(ny, ar)));
+		avx_store(l + CIRCLE_R2X*S, avx_sub(bx, avx_mul(nx, br))); avx_store(l + CIRCLE_R2Y*S, avx_sub(by, avx_mul(ny, br)));
+	}
+}
+
+static CP_TARGET_AVX2 void
+SegmentKernel_AVX2(cpFloat *lanes, int count)
+{
+	const int W = AVX_LANES, S = BATCH_STRIDE;
+	
+	for(int i=0; i<count; i += W){
+		cpFloat *l = lanes + i;
+		cpFloatAVX cx = avx_load(l + SEGMENT_CX*S), cy = avx_load(l + SEGMENT_CY*S), cr = avx_load(l + SEGMENT_CR*S);
+		cpFloatAVX ax = avx_load(l + SEGMENT_AX*S), ay = avx_load(l + SEGMENT_AY*S), sr = avx_load(l + SEGMENT_SR*S);
+		cpFloatAVX sx = avx_sub(avx_load(l + SEGMENT_BX*S), ax);
+		cpFloatAVX sy = avx_sub(avx_load(l + SEGMENT_BY*S), ay);
+		
+		cpFloatAVX dot = avx_add(avx_mul(sx, avx_sub(cx, ax)), avx_mul(sy, avx_sub(cy, ay)));
+		cpFloatAVX t = avx_div(dot, avx_add(avx_mul(sx, sx), avx_mul(sy, sy)));
+		t = avx_max(avx_zero(), avx_min(t, avx_set1(1.0f)));
+		cpFloatAVX px = avx_add(ax, avx_mul(sx, t));
+		cpFloatAVX py = avx_add(ay, avx_mul(sy, t));
+		
+		cpFloatAVX maxdist = avx_add(avx_add(cr, sr), avx_load(l + SEGMENT_MARGIN*S));
+		cpFloatAVX dx = avx_sub(px, cx), dy = avx_sub(py, cy);
+		cpFloatAVX distsq = avx_add(avx_mul(dx, dx), avx_mul(dy, dy));
+		cpFloatAVX dist = avx_sqrt(distsq);
+		
+		// A circle centered on the segment uses the segment's normal.
+		cpFloatAVX coincident = avx_cmpeq(dist, avx_zero());
+		cpFloatAVX inv = avx_div(avx_set1(1.0f), dist);
+		cpFloatAVX nx = avx_select(coincident, avx_load(l + SEGMENT_TNX*S), avx_mul(dx, inv));
+		cpFloatAVX ny = avx_select(coincident, avx_load(l + SEGMENT_TNY*S), avx_mul(dy, inv));
+		
+		avx_store(l + SEGMENT_NX*S, nx); avx_store(l + SEGMENT_NY*S, ny);
+		avx_store(l + SEGMENT_DISTSQ*S, distsq); avx_store(l + SEGMENT_MAXDISTSQ*S, avx_mul(maxdist, maxdist)); avx_store(l + SEGMENT_T*S, t);
+		avx_store(l + SEGMENT_R1X*S, avx_add(cx, avx_mul(nx, cr))); avx_store(l + SEGMENT_R1Y*S, avx_add(cy, avx_mul(ny, cr)));
+		avx_store(l + SEGMENT_R2X*S, avx_sub(px, avx_mul(nx, sr))); avx_store(l + SEGMENT_R2Y*S, avx_sub(py, avx_mul(ny, sr)));
+	}
+}
+
+static const struct BatchKernels AVX2Kernels = {AVX_LANES, CircleKernel_AVX2, SegmentKernel_AVX2};
+
+#endif
+
+// Pick the widest kernels the CPU supports.
+static const struct BatchKernels *
+GetBatchKernels(void)
+{
+	static const struct BatchKernels *kernels = NULL;
+	
+	if(kernels == NULL){
+	#if CP_SIMD_X86
+		if(cpCPUSupportsAVX2()){
+			kernels = &AVX2Kernels;
+		} else if(cpCPUSupportsSSE2()){
+			kernels = &SSE2Kernels;
+		} else
+	#endif
+		{
+			kernels = &ScalarKernels;
+		}
+	}
+	
+	return kernels;
+}
+
+//MARK: Buckets
+
+// Pairs of the same shape types waiting to be collided.
+struct BatchBucket {
+	int count;
+	int indexes[BATCH_STRIDE];
+};
+
+// Fill the unused lanes of the last SIMD register with copies of the first pair.
+static inline int
+PadLanes(cpFloat *lanes, int count, int fields, int width)
+{
+	int padded = (count + width - 1)/width*width;
+	
+	for(int i=count; i<padded; i++){
+		for(int field=0; field<fields; field++) lanes[field*BATCH_STRIDE + i] = lanes[field*BATCH_STRIDE];
+	}
+	
+	return padded;
+}
+
+static void
+FlushCircles(struct BatchBucket *bucket, cpFloat *lanes, const struct BatchKernels *kernels, struct cpBatchCollision *results)
+{
+	const int S = BATCH_STRIDE;
+	kernels->circles(lanes, PadLanes(lanes, bucket->count, CIRCLE_NX, kernels->width));
+	
+	for(int i=0; i<bucket->count; i++){
+		const cpFloat *l = lanes + i;
+		struct cpBatchCollision *result = results + bucket->indexes[i];
+		
+		result->touching = (l[CIRCLE_DISTSQ*S] < l[CIRCLE_MAXDISTSQ*S]);
+		result->n = cpv(l[CIRCLE_NX*S], l[CIRCLE_NY*S]);
+		result->r1 = cpv(l[CIRCLE_R1X*S], l[CIRCLE_R1Y*S]);
+		result->r2 = cpv(l[CIRCLE_R2X*S], l[CIRCLE_R2Y*S]);
+	}
+	
+	bucket->count = 0;
+}
+
+static void
+FlushSegments(struct BatchBucket *bucket, cpFloat *lanes, const struct BatchKernels *kernels, const struct cpBatchPair *pairs, struct cpBatchCollision *results)
+{
+	const int S = BATCH_STRIDE;
+	kernels->segments(lanes, PadLanes(lanes, bucket->count, SEGMENT_NX, kernels->width));
+	
+	for(int i=0; i<bucket->count; i++){
+		const cpFloat *l = lanes + i;
+		struct cpBatchCollision *result = results + bucket->indexes[i];
+		
+		cpVect n = result->n = cpv(l[SEGMENT_NX*S], l[SEGMENT_NY*S]);
+		result->r1 = cpv(l[SEGMENT_R1X*S], l[SEGMENT_R1Y*S]);
+		result->r2 = cpv(l[SEGMENT_R2X*S], l[SEGMENT_R2Y*S]);
+		result->touching = (l[SEGMENT_DISTSQ*S] < l[SEGMENT_MAXDISTSQ*S]);
+		
+		// Reject endcap collisions if tangents are provided.
+		cpFloat closest_t = l[SEGMENT_T*S];
+		if(result->touching && (closest_t == 0.0f || closest_t == 1.0f)){
+			const cpSegmentShape *segment = (cpSegmentShape *)pairs[bucket->indexes[i]].b;
+			cpVect rot = cpBodyGetRotation(segment->shape.body);
+			result->touching = (
+				(closest_t != 0.0f || cpvdot(n, cpvrotate(segment->a_tangent, rot)) >= 0.0) &&
+				(closest_t != 1.0f || cpvdot(n, cpvrotate(segment->b_tangent, rot)) >= 0.0)
+			);
+		}
+	}
+	
+	bucket->count = 0;
+}
+
+void
+cpCollideBatch(const struct cpBatchPair *pairs, int count, struct cpBatchCollision *results)
+{
+	const struct BatchKernels *kernels = GetBatchKernels();
+	const int S = BATCH_STRIDE;
+	
+	struct BatchBucket circles, segments;
+	circles.count = segments.count = 0;
+	
+	cpFloat circleLanes[CIRCLE_FIELDS*BATCH_STRIDE];
+	cpFloat segmentLanes[SEGMENT_FIELDS*BATCH_STRIDE];
+	
+	for(int i=0; i<count; i++){
+		const struct cpBatchPair *pair = pairs + i;
+		const cpCircleShape *circle = (cpCircleShape *)pair->a;
+		
+		if(pair->b->klass->type == CP_CIRCLE_SHAPE){
+			const cpCircleShape *other = (cpCircleShape *)pair->b;
+			
+			cpFloat *lanes = circleLanes + circles.count;
+			lanes[CIRCLE_AX*S] = circle->tc.x; lanes[CIRCLE_AY*S] = circle->tc.y; lanes[CIRCLE_AR*S] = circle->r;
+			lanes[CIRCLE_BX*S] = other->tc.x; lanes[CIRCLE_BY*S] = other->tc.y; lanes[CIRCLE_BR*S] = other->r;
+			lanes[CIRCLE_MARGIN*S] = pair->margin;
+			
+			circles.indexes[circles.count++] = i;
+			if(circles.count == BATCH_STRIDE) FlushCircles(&circles, circleLanes, kernels, results);
+		} else {
+			const cpSegmentShape *seg = (cpSegmentShape *)pair->b;
+			
+			cpFloat *lanes = segmentLanes + segments.count;
+			lanes[SEGMENT_CX*S] = circle->tc.x; lanes[SEGMENT_CY*S] = circle->tc.y; lanes[SEGMENT_CR*S] = circle->r;
+			lanes[SEGMENT_AX*S] = seg->ta.x; lanes[SEGMENT_AY*S] = seg->ta.y;
+			lanes[SEGMENT_BX*S] = seg->tb.x; lanes[SEGMENT_BY*S] = seg->tb.y;
+			lanes[SEGMENT_TNX*S] = seg->tn.x; lanes[SEGMENT_TNY*S] = seg->tn.y; lanes[SEGMENT_SR*S] = seg->r;
+			lanes[SEGMENT_MARGIN*S] = pair->margin;
+			
+			segments.indexes[segments.count++] = i;
+			if(segments.count == BATCH_STRIDE) FlushSegments(&segments, segmentLanes, kernels, pairs, results);
+		}
+	}
+	
+	if(circles.count) FlushCircles(&circles, circleLanes, kernels, results);
+	if(segments.count) FlushSegments(&segments, segmentLanes, kernels, pairs, results);
+}
+
+struct cpCollisionInfo
+cpCollisionInfoForBatch(const struct cpBatchPair *pair, const struct cpBatchCollision *result, struct cpContact *contacts)
+{
+	struct cpCollisionInfo info = {pair->a, pair->b, pair->id, pair->margin, cpvzero, 0.0f, 0, contacts};
+	
+	if(result->touching){
+		struct cpContact *con = contacts;
+		con->r1 = result->r1;
+		con->r2 = result->r2;
+		con->hash = 0;
+		
+		info.n = result->n;
+		info.count = 1;
+	}
+	
+	return info;
+}
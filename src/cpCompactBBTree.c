@@ -0,0 +1,1069 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stdlib.h"
+#include "stdio.h"
+
+#include "chipmunk/chipmunk_private.h"
+
+// Same algorithms as cpBBTree, but the nodes live in a single array and reference each other by index.
+// Node bounds are stored as floats rounded outward so the tree stays conservative.
+// Hot data needed to walk the tree (bounds, children) is kept apart from the cold per leaf data (obj, pairs).
+
+static inline cpSpatialIndexClass *Klass(void);
+
+typedef struct cpIndexBounds Bounds;
+typedef struct Node Node;
+typedef struct Leaf Leaf;
+typedef struct Pair Pair;
+
+#define NULL_INDEX (0xFFFFFFFFu)
+// Set on leaf references to leaves owned by the static tree.
+// Both trees share the pair pool of the dynamic tree so pairs need to tell them apart.
+#define STATIC_LEAF (0x80000000u)
+
+#define INITIAL_CAPACITY (64u)
+
+struct cpCompactBBTree {
+	cpSpatialIndex spatialIndex;
+	cpBBTreeVelocityFunc velocityFunc;
+	// How much the bounding boxes are padded by when the velocity function is set.
+	cpFloat margin, velocityScale;
+	
+	Node *nodes;
+	uint32_t *parents;
+	uint32_t nodeCapacity, pooledNodes;
+	uint32_t root;
+	
+	Leaf *leaves;
+	uint32_t leafCapacity, leafCount, pooledLeaves;
+	
+	// Open addressed table that maps objects to their leaves.
+	cpObjTable table;
+	
+	Pair *pairs;
+	uint32_t pairCapacity, pooledPairs;
+	
+	cpTimestamp stamp;
+};
+
+struct Node {
+	Bounds bb;
+	// Children for internal nodes.
+	// Leaves store their leaf index in 'a' and NULL_INDEX in 'b'.
+	uint32_t a, b;
+};
+
+struct Leaf {
+	void *obj;
+	cpTimestamp stamp;
+	uint32_t pairs;
+	uint32_t node;
+};
+
+typedef struct Thread {
+	uint32_t prev;
+	uint32_t leaf;
+	uint32_t next;
+} Thread;
+
+struct Pair {
+	Thread a, b;
+	cpCollisionID id;
+};
+
+//MARK: Bounds Functions
+
+static inline cpBB
+BoundsToBB(Bounds bounds)
+{
+	return cpBBNew(bounds.l, bounds.b, bounds.r, bounds.t);
+}
+
+static inline float
+BoundsArea(Bounds bb)
+{
+	return (bb.r - bb.l)*(bb.t - bb.b);
+}
+
+static inline float
+BoundsMergedArea(Bounds a, Bounds b)
+{
+	return BoundsArea(cpIndexBoundsMerge(a, b));
+}
+
+static inline float
+BoundsProximity(Bounds a, Bounds b)
+{
+	return fabsf(a.l + a.r - b.l - b.r) + fabsf(a.b + a.t - b.b - b.t);
+}
+
+static inline cpBool
+BoundsIntersects(Bounds a, Bounds b)
+{
+	return (a.l <= b.r && b.l <= a.r && a.b <= b.t && b.b <= a.t);
+}
+
+static inline cpBool
+BoundsContainsBB(Bounds a, cpBB b)
+{
+	return (a.l <= b.l && a.r >= b.r && a.b <= b.b && a.t >= b.t);
+}
+
+//MARK: Misc Functions
+
+static inline cpBB
+GetBB(cpCompactBBTree *tree, void *obj)
+{
+	cpBB bb = tree->spatialIndex.bbfunc(obj);
+	
+	cpBBTreeVelocityFunc velocityFunc = tree->velocityFunc;
+	if(velocityFunc){
+		cpFloat coef = tree->margin;
+		cpFloat x = (bb.r - bb.l)*coef;
+		cpFloat y = (bb.t - bb.b)*coef;
+		
+		cpVect v = cpvmult(velocityFunc(obj), tree->velocityScale);
+		return cpBBNew(bb.l + cpfmin(-x, v.x), bb.b + cpfmin(-y, v.y), bb.r + cpfmax(x, v.x), bb.t + cpfmax(y, v.y));
+	} else {
+		return bb;
+	}
+}
+
+static inline cpCompactBBTree *
+GetTree(cpSpatialIndex *index)
+{
+	return (index && index->klass == Klass() ? (cpCompactBBTree *)index : NULL);
+}
+
+static inline cpCompactBBTree *
+GetMasterTree(cpCompactBBTree *tree)
+{
+	cpCompactBBTree *dynamicTree = GetTree(tree->spatialIndex.dynamicIndex);
+	return (dynamicTree ? dynamicTree : tree);
+}
+
+// Tag to apply to the leaf references of a tree.
+static inline uint32_t
+LeafTag(cpCompactBBTree *tree)
+{
+	return (GetTree(tree->spatialIndex.dynamicIndex) ? STATIC_LEAF : 0);
+}
+
+static inline Leaf *
+LeafForRef(cpCompactBBTree *master, uint32_t ref)
+{
+	cpCompactBBTree *tree = (ref & STATIC_LEAF ? GetTree(master->spatialIndex.staticIndex) : master);
+	return tree->leaves + (ref & ~STATIC_LEAF);
+}
+
+static inline void
+IncrementStamp(cpCompactBBTree *tree)
+{
+	GetMasterTree(tree)->stamp++;
+}
+
+//MARK: Pair/Thread Functions
+
+static void
+PairRecycle(cpCompactBBTree *master, uint32_t pair)
+{
+	master->pairs[pair].a.next = master->pooledPairs;
+	master->pooledPairs = pair;
+}
+
+static uint32_t
+PairFromPool(cpCompactBBTree *master)
+{
+	uint32_t pair = master->pooledPairs;
+	
+	if(pair != NULL_INDEX){
+		master->pooledPairs = master->pairs[pair].a.next;
+		return pair;
+	} else {
+		// Pool is exhausted, make more
+		uint32_t count = master->pairCapacity;
+		uint32_t capacity = (count ? 2*count : INITIAL_CAPACITY);
+		cpAssertHard(capacity > count && capacity < NULL_INDEX, "Internal Error: Too many pairs.");
+		
+		master->pairs = (Pair *)cprealloc(master->pairs, capacity*sizeof(Pair));
+		master->pairCapacity = capacity;
+		
+		// push all but the first one, return the first instead
+		for(uint32_t i=capacity - 1; i>count; i--) PairRecycle(master, i);
+		return count;
+	}
+}
+
+static inline void
+ThreadUnlink(cpCompactBBTree *master, Thread thread)
+{
+	uint32_t next = thread.next;
+	uint32_t prev = thread.prev;
+	
+	if(next != NULL_INDEX){
+		Pair *p = master->pairs + next;
+		if(p->a.leaf == thread.leaf) p->a.prev = prev; else p->b.prev = prev;
+	}
+	
+	if(prev != NULL_INDEX){
+		Pair *p = master->pairs + prev;
+		if(p->a.leaf == thread.leaf) p->a.next = next; else p->b.next = next;
+	} else {
+		LeafForRef(master, thread.leaf)->pairs = next;
+	}
+}
+
+static void
+PairsClear(cpCompactBBTree *tree, uint32_t ref)
+{
+	cpCompactBBTree *master = GetMasterTree(tree);
+	
+	Leaf *leaf = LeafForRef(master, ref);
+	uint32_t pair = leaf->pairs;
+	leaf->pairs = NULL_INDEX;
+	
+	while(pair != NULL_INDEX){
+		Pair *p = master->pairs + pair;
+		if(p->a.leaf == ref){
+			uint32_t next = p->a.next;
+			ThreadUnlink(master, p->b);
+			PairRecycle(master, pair);
+			pair = next;
+		} else {
+			uint32_t next = p->b.next;
+			ThreadUnlink(master, p->a);
+			PairRecycle(master, pair);
+			pair = next;
+		}
+	}
+}
+
+static void
+PairInsert(cpCompactBBTree *master, uint32_t a, uint32_t b)
+{
+	// Grab the pair first, growing the pool invalidates pair pointers.
+	uint32_t pair = PairFromPool(master);
+	
+	Leaf *leafA = LeafForRef(master, a), *leafB = LeafForRef(master, b);
+	uint32_t nextA = leafA->pairs, nextB = leafB->pairs;
+	Pair temp = {{NULL_INDEX, a, nextA},{NULL_INDEX, b, nextB}, 0};
+	
+	leafA->pairs = leafB->pairs = pair;
+	master->pairs[pair] = temp;
+	
+	if(nextA != NULL_INDEX){
+		Pair *p = master->pairs + nextA;
+		if(p->a.leaf == a) p->a.prev = pair; else p->b.prev = pair;
+	}
+	
+	if(nextB != NULL_INDEX){
+		Pair *p = master->pairs + nextB;
+		if(p->a.leaf == b) p->a.prev = pair; else p->b.prev = pair;
+	}
+}
+
+//MARK: Node Functions
+
+static void
+NodeRecycle(cpCompactBBTree *tree, uint32_t node)
+{
+	tree->nodes[node].a = tree->pooledNodes;
+	tree->pooledNodes = node;
+}
+
+static uint32_t
+NodeFromPool(cpCompactBBTree *tree)
+{
+	uint32_t node = tree->pooledNodes;
+	
+	if(node != NULL_INDEX){
+		tree->pooledNodes = tree->nodes[node].a;
+		return node;
+	} else {
+		// Pool is exhausted, make more
+		uint32_t count = tree->nodeCapacity;
+		uint32_t capacity = (count ? 2*count : INITIAL_CAPACITY);
+		cpAssertHard(capacity > count && capacity < NULL_INDEX, "Internal Error: Too many nodes.");
+		
+		tree->nodes = (Node *)cprealloc(tree->nodes, capacity*sizeof(Node));
+		tree->parents = (uint32_t *)cprealloc(tree->parents, capacity*sizeof(uint32_t));
+		tree->nodeCapacity = capacity;
+		
+		// push all but the first one, return the first instead
+		for(uint32_t i=capacity - 1; i>count; i--) NodeRecycle(tree, i);
+		return count;
+	}
+}
+
+static inline void
+NodeSetA(cpCompactBBTree *tree, uint32_t node, uint32_t value)
+{
+	tree->nodes[node].a = value;
+	tree->parents[value] = node;
+}
+
+static inline void
+NodeSetB(cpCompactBBTree *tree, uint32_t node, uint32_t value)
+{
+	tree->nodes[node].b = value;
+	tree->parents[value] = node;
+}
+
+static uint32_t
+NodeNew(cpCompactBBTree *tree, uint32_t a, uint32_t b)
+{
+	uint32_t node = NodeFromPool(tree);
+	
+	tree->nodes[node].bb = cpIndexBoundsMerge(tree->nodes[a].bb, tree->nodes[b].bb);
+	tree->parents[node] = NULL_INDEX;
+	
+	NodeSetA(tree, node, a);
+	NodeSetB(tree, node, b);
+	
+	return node;
+}
+
+static inline cpBool
+NodeIsLeaf(const Node *node)
+{
+	return (node->b == NULL_INDEX);
+}
+
+static inline uint32_t
+NodeOther(cpCompactBBTree *tree, uint32_t node, uint32_t child)
+{
+	Node *n = tree->nodes + node;
+	return (n->a == child ? n->b : n->a);
+}
+
+// Same rotations as cpBBTree.
+static void
+NodeRotate(cpCompactBBTree *tree, uint32_t node)
+{
+	Node *nodes = tree->nodes;
+	uint32_t a = nodes[node].a, b = nodes[node].b;
+	
+	float best = 0.0f;
+	uint32_t child = NULL_INDEX, grandchild = NULL_INDEX;
+	
+	if(!NodeIsLeaf(nodes + b)){
+		float area = BoundsArea(nodes[b].bb);
+		float cost_a = BoundsMergedArea(nodes[a].bb, nodes[nodes[b].b].bb) - area;
+		float cost_b = BoundsMergedArea(nodes[a].bb, nodes[nodes[b].a].bb) - area;
+		
+		if(cost_a < best){best = cost_a; child = a; grandchild = nodes[b].a;}
+		if(cost_b < best){best = cost_b; child = a; grandchild = nodes[b].b;}
+	}
+	
+	if(!NodeIsLeaf(nodes + a)){
+		float area = BoundsArea(nodes[a].bb);
+		float cost_a = BoundsMergedArea(nodes[b].bb, nodes[nodes[a].b].bb) - area;
+		float cost_b = BoundsMergedArea(nodes[b].bb, nodes[nodes[a].a].bb) - area;
+		
+		if(cost_a < best){best = cost_a; child = b; grandchild = nodes[a].a;}
+		if(cost_b < best){best = cost_b; child = b; grandchild = nodes[a].b;}
+	}
+	
+	if(child != NULL_INDEX){
+		uint32_t parent = tree->parents[grandchild];
+		if(nodes[node].a == child) NodeSetA(tree, node, grandchild); else NodeSetB(tree, node, grandchild);
+		if(nodes[parent].a == grandchild) NodeSetA(tree, parent, child); else NodeSetB(tree, parent, child);
+		nodes[parent].bb = cpIndexBoundsMerge(nodes[nodes[parent].a].bb, nodes[nodes[parent].b].bb);
+	}
+}
+
+static inline void
+NodeReplaceChild(cpCompactBBTree *tree, uint32_t parent, uint32_t child, uint32_t value)
+{
+	Node *nodes = tree->nodes;
+	cpAssertSoft(!NodeIsLeaf(nodes + parent), "Internal Error: Cannot replace child of a leaf.");
+	cpAssertSoft(child == nodes[parent].a || child == nodes[parent].b, "Internal Error: Node is not a child of parent.");
+	
+	if(nodes[parent].a == child){
+		NodeRecycle(tree, child);
+		NodeSetA(tree, parent, value);
+	} else {
+		NodeRecycle(tree, child);
+		NodeSetB(tree, parent, value);
+	}
+	
+	for(uint32_t node=parent; node != NULL_INDEX; node = tree->parents[node]){
+		nodes[node].bb = cpIndexBoundsMerge(nodes[nodes[node].a].bb, nodes[nodes[node].b].bb);
+		NodeRotate(tree, node);
+	}
+}
+
+//MARK: Subtree Functions
+
+static uint32_t
+SubtreeInsert(cpCompactBBTree *tree, uint32_t subtree, uint32_t leaf)
+{
+	if(subtree == NULL_INDEX){
+		return leaf;
+	} else if(NodeIsLeaf(tree->nodes + subtree)){
+		return NodeNew(tree, leaf, subtree);
+	} else {
+		// Recursing can grow the node array, so don't hold node pointers across it.
+		Node *nodes = tree->nodes;
+		Bounds bb = nodes[leaf].bb;
+		Bounds bb_a = nodes[nodes[subtree].a].bb;
+		Bounds bb_b = nodes[nodes[subtree].b].bb;
+		
+		float cost_a = BoundsArea(bb_b) + BoundsMergedArea(bb_a, bb);
+		float cost_b = BoundsArea(bb_a) + BoundsMergedArea(bb_b, bb);
+		
+		if(cost_a == cost_b){
+			cost_a = BoundsProximity(bb_a, bb);
+			cost_b = BoundsProximity(bb_b, bb);
+		}
+		
+		if(cost_b < cost_a){
+			uint32_t child = SubtreeInsert(tree, nodes[subtree].b, leaf);
+			NodeSetB(tree, subtree, child);
+		} else {
+			uint32_t child = SubtreeInsert(tree, nodes[subtree].a, leaf);
+			NodeSetA(tree, subtree, child);
+		}
+		
+		nodes = tree->nodes;
+		nodes[subtree].bb = cpIndexBoundsMerge(nodes[subtree].bb, bb);
+		NodeRotate(tree, subtree);
+		return subtree;
+	}
+}
+
+static void
+SubtreeQuery(cpCompactBBTree *tree, uint32_t subtree, void *obj, Bounds bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	const Node *node = tree->nodes + subtree;
+	if(BoundsIntersects(node->bb, bb)){
+		if(NodeIsLeaf(node)){
+			func(obj, tree->leaves[node->a].obj, 0, data);
+		} else {
+			uint32_t b = node->b;
+			SubtreeQuery(tree, node->a, obj, bb, func, data);
+			SubtreeQuery(tree, b, obj, bb, func, data);
+		}
+	}
+}
+
+static cpFloat
+SubtreeSegmentQuery(cpCompactBBTree *tree, uint32_t subtree, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	const Node *node = tree->nodes + subtree;
+	if(NodeIsLeaf(node)){
+		return func(obj, tree->leaves[node->a].obj, data);
+	} else {
+		uint32_t child_a = node->a, child_b = node->b;
+		cpFloat t_a = cpBBSegmentQuery(BoundsToBB(tree->nodes[child_a].bb), a, b);
+		cpFloat t_b = cpBBSegmentQuery(BoundsToBB(tree->nodes[child_b].bb), a, b);
+		
+		if(t_a < t_b){
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(tree, child_a, obj, a, b, t_exit, func, data));
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(tree, child_b, obj, a, b, t_exit, func, data));
+		} else {
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(tree, child_b, obj, a, b, t_exit, func, data));
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(tree, child_a, obj, a, b, t_exit, func, data));
+		}
+		
+		return t_exit;
+	}
+}
+
+static void
+SubtreeRecycle(cpCompactBBTree *tree, uint32_t node)
+{
+	Node *n = tree->nodes + node;
+	if(!NodeIsLeaf(n)){
+		uint32_t a = n->a, b = n->b;
+		SubtreeRecycle(tree, a);
+		SubtreeRecycle(tree, b);
+		NodeRecycle(tree, node);
+	}
+}
+
+static inline uint32_t
+SubtreeRemove(cpCompactBBTree *tree, uint32_t subtree, uint32_t leaf)
+{
+	if(leaf == subtree){
+		return NULL_INDEX;
+	} else {
+		uint32_t parent = tree->parents[leaf];
+		if(parent == subtree){
+			uint32_t other = NodeOther(tree, subtree, leaf);
+			tree->parents[other] = tree->parents[subtree];
+			NodeRecycle(tree, subtree);
+			return other;
+		} else {
+			NodeReplaceChild(tree, tree->parents[parent], parent, NodeOther(tree, parent, leaf));
+			return subtree;
+		}
+	}
+}
+
+//MARK: Marking Functions
+
+typedef struct MarkContext {
+	cpCompactBBTree *tree;
+	cpCompactBBTree *master;
+	cpCompactBBTree *staticTree;
+	cpSpatialIndexQueryFunc func;
+	void *data;
+} MarkContext;
+
+// 'tree' and 'tag' identify the tree that 'subtree' belongs to.
+// 'leaf' is a leaf reference, 'bb' its bounds.
+static void
+MarkLeafQuery(cpCompactBBTree *tree, uint32_t tag, uint32_t subtree, uint32_t leaf, Bounds bb, cpBool left, MarkContext *context)
+{
+	const Node *node = tree->nodes + subtree;
+	if(BoundsIntersects(bb, node->bb)){
+		if(NodeIsLeaf(node)){
+			cpCompactBBTree *master = context->master;
+			uint32_t other = (node->a | tag);
+			
+			if(left){
+				PairInsert(master, leaf, other);
+			} else {
+				Leaf *a = LeafForRef(master, other), *b = LeafForRef(master, leaf);
+				if(a->stamp < b->stamp) PairInsert(master, other, leaf);
+				context->func(b->obj, a->obj, 0, context->data);
+			}
+		} else {
+			uint32_t b = node->b;
+			MarkLeafQuery(tree, tag, node->a, leaf, bb, left, context);
+			MarkLeafQuery(tree, tag, b, leaf, bb, left, context);
+		}
+	}
+}
+
+static void
+MarkLeaf(uint32_t node, MarkContext *context)
+{
+	cpCompactBBTree *tree = context->tree;
+	cpCompactBBTree *master = context->master;
+	
+	Node *nodes = tree->nodes;
+	uint32_t *parents = tree->parents;
+	
+	uint32_t tag = LeafTag(tree);
+	Leaf *leaf = tree->leaves + nodes[node].a;
+	uint32_t ref = (nodes[node].a | tag);
+	
+	if(leaf->stamp == master->stamp){
+		Bounds bb = nodes[node].bb;
+		
+		cpCompactBBTree *staticTree = context->staticTree;
+		if(staticTree && staticTree->root != NULL_INDEX) MarkLeafQuery(staticTree, STATIC_LEAF, staticTree->root, ref, bb, cpFalse, context);
+		
+		for(uint32_t n = node; parents[n] != NULL_INDEX; n = parents[n]){
+			uint32_t parent = parents[n];
+			if(n == nodes[parent].a){
+				MarkLeafQuery(tree, tag, nodes[parent].b, ref, bb, cpTrue, context);
+			} else {
+				MarkLeafQuery(tree, tag, nodes[parent].a, ref, bb, cpFalse, context);
+			}
+		}
+	} else {
+		uint32_t pair = leaf->pairs;
+		while(pair != NULL_INDEX){
+			Pair *p = master->pairs + pair;
+			if(ref == p->b.leaf){
+				p->id = context->func(LeafForRef(master, p->a.leaf)->obj, leaf->obj, p->id, context->data);
+				pair = p->b.next;
+			} else {
+				pair = p->a.next;
+			}
+		}
+	}
+}
+
+static void
+MarkSubtree(uint32_t subtree, MarkContext *context)
+{
+	const Node *node = context->tree->nodes + subtree;
+	if(NodeIsLeaf(node)){
+		MarkLeaf(subtree, context);
+	} else {
+		uint32_t b = node->b;
+		MarkSubtree(node->a, context);
+		MarkSubtree(b, context);
+	}
+}
+
+//MARK: Leaf Table Functions
+
+static inline void *
+LeafObj(const void *tree, uint32_t leaf)
+{
+	return ((const cpCompactBBTree *)tree)->leaves[leaf].obj;
+}
+
+static inline uint32_t
+TableFind(cpCompactBBTree *tree, void *obj, cpHashValue hashid)
+{
+	return cpObjTableFind(&tree->table, obj, hashid, LeafObj, tree);
+}
+
+//MARK: Leaf Functions
+
+static void
+LeafRecycle(cpCompactBBTree *tree, uint32_t leaf)
+{
+	tree->leaves[leaf].obj = NULL;
+	tree->leaves[leaf].node = tree->pooledLeaves;
+	tree->pooledLeaves = leaf;
+}
+
+static uint32_t
+LeafFromPool(cpCompactBBTree *tree)
+{
+	uint32_t leaf = tree->pooledLeaves;
+	
+	if(leaf != NULL_INDEX){
+		tree->pooledLeaves = tree->leaves[leaf].node;
+		return leaf;
+	} else {
+		// Pool is exhausted, make more
+		uint32_t count = tree->leafCapacity;
+		uint32_t capacity = (count ? 2*count : INITIAL_CAPACITY);
+		cpAssertHard(capacity > count && capacity <= STATIC_LEAF, "Internal Error: Too many leaves.");
+		
+		tree->leaves = (Leaf *)cprealloc(tree->leaves, capacity*sizeof(Leaf));
+		tree->leafCapacity = capacity;
+		
+		// push all but the first one, return the first instead
+		for(uint32_t i=capacity - 1; i>count; i--) LeafRecycle(tree, i);
+		return count;
+	}
+}
+
+static uint32_t
+LeafNew(cpCompactBBTree *tree, void *obj)
+{
+	uint32_t leaf = LeafFromPool(tree);
+	uint32_t node = NodeFromPool(tree);
+	
+	Leaf *l = tree->leaves + leaf;
+	l->obj = obj;
+	l->stamp = 0;
+	l->pairs = NULL_INDEX;
+	l->node = node;
+	
+	Node *n = tree->nodes + node;
+	n->bb = cpIndexBoundsFromBB(GetBB(tree, obj));
+	n->a = leaf;
+	n->b = NULL_INDEX;
+	tree->parents[node] = NULL_INDEX;
+	
+	tree->leafCount++;
+	return leaf;
+}
+
+static cpBool
+LeafUpdate(cpCompactBBTree *tree, uint32_t leaf)
+{
+	Leaf *l = tree->leaves + leaf;
+	uint32_t node = l->node;
+	cpBB bb = tree->spatialIndex.bbfunc(l->obj);
+	
+	if(!BoundsContainsBB(tree->nodes[node].bb, bb)){
+		tree->nodes[node].bb = cpIndexBoundsFromBB(GetBB(tree, l->obj));
+		
+		uint32_t root = SubtreeRemove(tree, tree->root, node);
+		tree->root = SubtreeInsert(tree, root, node);
+		
+		PairsClear(tree, leaf | LeafTag(tree));
+		l->stamp = GetMasterTree(tree)->stamp;
+		
+		return cpTrue;
+	} else {
+		return cpFalse;
+	}
+}
+
+static cpCollisionID VoidQueryFunc(void *obj1, void *obj2, cpCollisionID id, void *data){return id;}
+
+static void
+LeafAddPairs(cpCompactBBTree *tree, uint32_t leaf)
+{
+	cpSpatialIndex *dynamicIndex = tree->spatialIndex.dynamicIndex;
+	if(dynamicIndex){
+		cpCompactBBTree *dynamicTree = GetTree(dynamicIndex);
+		if(dynamicTree && dynamicTree->root != NULL_INDEX){
+			MarkContext context = {dynamicTree, dynamicTree, NULL, NULL, NULL};
+			Bounds bb = tree->nodes[tree->leaves[leaf].node].bb;
+			MarkLeafQuery(dynamicTree, 0, dynamicTree->root, leaf | STATIC_LEAF, bb, cpTrue, &context);
+		}
+	} else {
+		MarkContext context = {tree, tree, GetTree(tree->spatialIndex.staticIndex), VoidQueryFunc, NULL};
+		MarkLeaf(tree->leaves[leaf].node, &context);
+	}
+}
+
+//MARK: Memory Management Functions
+
+cpCompactBBTree *
+cpCompactBBTreeAlloc(void)
+{
+	return (cpCompactBBTree *)cpcalloc(1, sizeof(cpCompactBBTree));
+}
+
+cpSpatialIndex *
+cpCompactBBTreeInit(cpCompactBBTree *tree, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndexInit((cpSpatialIndex *)tree, Klass(), bbfunc, staticIndex);
+	
+	tree->velocityFunc = NULL;
+	tree->margin = tree->velocityScale = 0.1f;
+	
+	tree->nodes = NULL;
+	tree->parents = NULL;
+	tree->nodeCapacity = 0;
+	tree->pooledNodes = NULL_INDEX;
+	tree->root = NULL_INDEX;
+	
+	tree->leaves = NULL;
+	tree->leafCapacity = tree->leafCount = 0;
+	tree->pooledLeaves = NULL_INDEX;
+	
+	cpObjTableInit(&tree->table);
+	
+	tree->pairs = NULL;
+	tree->pairCapacity = 0;
+	tree->pooledPairs = NULL_INDEX;
+	
+	tree->stamp = 0;
+	
+	return (cpSpatialIndex *)tree;
+}
+
+cpBool
+cpCompactBBTreeIsTree(cpSpatialIndex *index)
+{
+	return (index && index->klass == Klass());
+}
+
+void
+cpCompactBBTreeSetVelocityFunc(cpSpatialIndex *index, cpBBTreeVelocityFunc func)
+{
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpCompactBBTreeSetVelocityFunc() call to non-tree spatial index.");
+		return;
+	}
+	
+	((cpCompactBBTree *)index)->velocityFunc = func;
+}
+
+void
+cpCompactBBTreeSetPadding(cpSpatialIndex *index, cpFloat margin, cpFloat velocityScale)
+{
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpCompactBBTreeSetPadding() call to non-tree spatial index.");
+		return;
+	}
+	
+	cpAssertHard(margin >= 0.0f && velocityScale >= 0.0f, "The margin and velocity scale must not be negative.");
+	
+	cpCompactBBTree *tree = (cpCompactBBTree *)index;
+	tree->margin = margin;
+	tree->velocityScale = velocityScale;
+}
+
+cpSpatialIndex *
+cpCompactBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	return cpCompactBBTreeInit(cpCompactBBTreeAlloc(), bbfunc, staticIndex);
+}
+
+static void
+cpCompactBBTreeDestroy(cpCompactBBTree *tree)
+{
+	cpfree(tree->nodes);
+	cpfree(tree->parents);
+	cpfree(tree->leaves);
+	cpObjTableDestroy(&tree->table);
+	cpfree(tree->pairs);
+}
+
+//MARK: Insert/Remove
+
+static void
+cpCompactBBTreeInsert(cpCompactBBTree *tree, void *obj, cpHashValue hashid)
+{
+	uint32_t leaf = LeafNew(tree, obj);
+	cpObjTableInsert(&tree->table, hashid, leaf);
+	
+	tree->root = SubtreeInsert(tree, tree->root, tree->leaves[leaf].node);
+	
+	tree->leaves[leaf].stamp = GetMasterTree(tree)->stamp;
+	LeafAddPairs(tree, leaf);
+	IncrementStamp(tree);
+}
+
+static void
+cpCompactBBTreeRemove(cpCompactBBTree *tree, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(tree, obj, hashid);
+	if(slot == CP_OBJ_TABLE_EMPTY) return;
+	
+	uint32_t leaf = tree->table.slots[slot].index;
+	uint32_t node = tree->leaves[leaf].node;
+	cpObjTableRemove(&tree->table, slot);
+	
+	tree->root = SubtreeRemove(tree, tree->root, node);
+	PairsClear(tree, leaf | LeafTag(tree));
+	NodeRecycle(tree, node);
+	LeafRecycle(tree, leaf);
+	tree->leafCount--;
+}
+
+static cpBool
+cpCompactBBTreeContains(cpCompactBBTree *tree, void *obj, cpHashValue hashid)
+{
+	return (TableFind(tree, obj, hashid) != CP_OBJ_TABLE_EMPTY);
+}
+
+//MARK: Reindex
+
+static void
+cpCompactBBTreeReindexQuery(cpCompactBBTree *tree, cpSpatialIndexQueryFunc func, void *data)
+{
+	if(tree->root == NULL_INDEX) return;
+	
+	// Walk the leaves in storage order instead of hash order.
+	// LeafUpdate() may modify tree->root. Don't cache it.
+	for(uint32_t i=0, count=tree->leafCapacity; i<count; i++){
+		if(tree->leaves[i].obj) LeafUpdate(tree, i);
+	}
+	
+	cpSpatialIndex *staticIndex = tree->spatialIndex.staticIndex;
+	cpCompactBBTree *staticTree = GetTree(staticIndex);
+	
+	MarkContext context = {tree, GetMasterTree(tree), staticTree, func, data};
+	MarkSubtree(tree->root, &context);
+	if(staticIndex && !staticTree) cpSpatialIndexCollideStatic((cpSpatialIndex *)tree, staticIndex, func, data);
+	
+	IncrementStamp(tree);
+}
+
+static void
+cpCompactBBTreeReindex(cpCompactBBTree *tree)
+{
+	cpCompactBBTreeReindexQuery(tree, VoidQueryFunc, NULL);
+}
+
+static void
+cpCompactBBTreeReindexObject(cpCompactBBTree *tree, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(tree, obj, hashid);
+	if(slot != CP_OBJ_TABLE_EMPTY){
+		uint32_t leaf = tree->table.slots[slot].index;
+		if(LeafUpdate(tree, leaf)) LeafAddPairs(tree, leaf);
+		IncrementStamp(tree);
+	}
+}
+
+//MARK: Query
+
+static void
+cpCompactBBTreeSegmentQuery(cpCompactBBTree *tree, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	uint32_t root = tree->root;
+	if(root != NULL_INDEX) SubtreeSegmentQuery(tree, root, obj, a, b, t_exit, func, data);
+}
+
+static void
+cpCompactBBTreeQuery(cpCompactBBTree *tree, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	if(tree->root != NULL_INDEX) SubtreeQuery(tree, tree->root, obj, cpIndexBoundsFromBB(bb), func, data);
+}
+
+//MARK: Misc
+
+static int
+cpCompactBBTreeCount(cpCompactBBTree *tree)
+{
+	return (int)tree->leafCount;
+}
+
+static void
+cpCompactBBTreeEach(cpCompactBBTree *tree, cpSpatialIndexIteratorFunc func, void *data)
+{
+	for(uint32_t i=0, count=tree->leafCapacity; i<count; i++){
+		void *obj = tree->leaves[i].obj;
+		if(obj) func(obj, data);
+	}
+}
+
+static cpSpatialIndexClass klass = {
+	(cpSpatialIndexDestroyImpl)cpCompactBBTreeDestroy,
+	
+	(cpSpatialIndexCountImpl)cpCompactBBTreeCount,
+	(cpSpatialIndexEachImpl)cpCompactBBTreeEach,
+	
+	(cpSpatialIndexContainsImpl)cpCompactBBTreeContains,
+	(cpSpatialIndexInsertImpl)cpCompactBBTreeInsert,
+	(cpSpatialIndexRemoveImpl)cpCompactBBTreeRemove,
+	
+	(cpSpatialIndexReindexImpl)cpCompactBBTreeReindex,
+	(cpSpatialIndexReindexObjectImpl)cpCompactBBTreeReindexObject,
+	(cpSpatialIndexReindexQueryImpl)cpCompactBBTreeReindexQuery,
+	
+	(cpSpatialIndexQueryImpl)cpCompactBBTreeQuery,
+	(cpSpatialIndexSegmentQueryImpl)cpCompactBBTreeSegmentQuery,
+};
+
+static inline cpSpatialIndexClass *Klass(){return &klass;}
+
+
+//MARK: Tree Optimization
+
+static int
+floatcompare(const float *a, const float *b){
+	return (*a < *b ? -1 : (*b < *a ? 1 : 0));
+}
+
+static uint32_t
+partitionNodes(cpCompactBBTree *tree, uint32_t *nodes, int count)
+{
+	if(count <= 1){
+		return nodes[0];
+	} else if(count == 2) {
+		return NodeNew(tree, nodes[0], nodes[1]);
+	}
+	
+	// Find the AABB for these nodes
+	Bounds bb = tree->nodes[nodes[0]].bb;
+	for(int i=1; i<count; i++) bb = cpIndexBoundsMerge(bb, tree->nodes[nodes[i]].bb);
+	
+	// Split it on it's longest axis
+	cpBool splitWidth = (bb.r - bb.l > bb.t - bb.b);
+	
+	// Sort the bounds and use the median as the splitting point
+	float *bounds = (float *)cpcalloc(count*2, sizeof(float));
+	if(splitWidth){
+		for(int i=0; i<count; i++){
+			bounds[2*i + 0] = tree->nodes[nodes[i]].bb.l;
+			bounds[2*i + 1] = tree->nodes[nodes[i]].bb.r;
+		}
+	} else {
+		for(int i=0; i<count; i++){
+			bounds[2*i + 0] = tree->nodes[nodes[i]].bb.b;
+			bounds[2*i + 1] = tree->nodes[nodes[i]].bb.t;
+		}
+	}
+	
+	qsort(bounds, count*2, sizeof(float), (int (*)(const void *, const void *))floatcompare);
+	float split = (bounds[count - 1] + bounds[count])*0.5f; // use the medain as the split
+	cpfree(bounds);
+	
+	// Generate the child BBs
+	Bounds a = bb, b = bb;
+	if(splitWidth) a.r = b.l = split; else a.t = b.b = split;
+	
+	// Partition the nodes
+	int right = count;
+	for(int left=0; left < right;){
+		uint32_t node = nodes[left];
+		Bounds node_bb = tree->nodes[node].bb;
+		if(BoundsMergedArea(node_bb, b) < BoundsMergedArea(node_bb, a)){
+			right--;
+			nodes[left] = nodes[right];
+			nodes[right] = node;
+		} else {
+			left++;
+		}
+	}
+	
+	if(right == count){
+		uint32_t node = NULL_INDEX;
+		for(int i=0; i<count; i++) node = SubtreeInsert(tree, node, nodes[i]);
+		return node;
+	}
+	
+	// Recurse and build the node!
+	uint32_t node_a = partitionNodes(tree, nodes, right);
+	uint32_t node_b = partitionNodes(tree, nodes + right, count - right);
+	return NodeNew(tree, node_a, node_b);
+}
+
+void
+cpCompactBBTreeOptimize(cpSpatialIndex *index)
+{
+	if(index->klass != &klass){
+		cpAssertWarn(cpFalse, "Ignoring cpCompactBBTreeOptimize() call to non-tree spatial index.");
+		return;
+	}
+	
+	cpCompactBBTree *tree = (cpCompactBBTree *)index;
+	uint32_t root = tree->root;
+	if(root == NULL_INDEX) return;
+	
+	int count = cpCompactBBTreeCount(tree);
+	uint32_t *nodes = (uint32_t *)cpcalloc(count, sizeof(uint32_t));
+	uint32_t *cursor = nodes;
+	
+	for(uint32_t i=0; i<tree->leafCapacity; i++){
+		if(tree->leaves[i].obj) (*cursor++) = tree->leaves[i].node;
+	}
+	
+	SubtreeRecycle(tree, root);
+	tree->root = partitionNodes(tree, nodes, count);
+	cpfree(nodes);
+}
+
+//MARK: Tree Quality
+
+static void
+SubtreeQuality(cpCompactBBTree *tree, uint32_t node, int depth, cpBBTreeQuality *quality)
+{
+	if(depth > quality->maxDepth) quality->maxDepth = depth;
+	
+	const Node *n = tree->nodes + node;
+	if(!NodeIsLeaf(n)){
+		quality->sahCost += BoundsArea(n->bb);
+		SubtreeQuality(tree, n->a, depth + 1, quality);
+		SubtreeQuality(tree, n->b, depth + 1, quality);
+	}
+}
+
+cpBBTreeQuality
+cpCompactBBTreeGetQuality(cpSpatialIndex *index)
+{
+	cpBBTreeQuality quality = {0.0f, 0};
+	
+	if(index->klass != &klass){
+		cpAssertWarn(cpFalse, "Ignoring cpCompactBBTreeGetQuality() call to non-tree spatial index.");
+		return quality;
+	}
+	
+	cpCompactBBTree *tree = (cpCompactBBTree *)index;
+	if(tree->root != NULL_INDEX){
+		SubtreeQuality(tree, tree->root, 0, &quality);
+		
+		cpFloat area = BoundsArea(tree->nodes[tree->root].bb);
+		quality.sahCost = (area > 0.0f ? quality.sahCost/area : 0.0f);
+	}
+	
+	return quality;
+}
@@ -0,0 +1,710 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "chipmunk/chipmunk_private.h"
+#include "cpSIMD.h"
+
+// The SIMD contact solver solves the same contact row of several arbiters at once, one arbiter per SIMD lane.
+// Arbiters are colored so that no two arbiters in the same color share a body that the solver can move,
+// and each color is split into groups of arbiters that are solved together.
+// Arbiters that don't fit in any color are solved by the scalar solver afterwards.
+
+// Maximum number of SIMD lanes. (8 floats in an AVX register)
+#define MAX_LANES 8
+
+// Number of colors to split the arbiters into before falling back to the scalar solver.
+#define COLORS 32
+
+// Per lane values stored for each contact row.
+enum {
+	ROW_R1X, ROW_R1Y, ROW_R2X, ROW_R2Y,
+	ROW_NX, ROW_NY,
+	ROW_NMASS, ROW_TMASS,
+	ROW_BIAS, ROW_BOUNCE, ROW_FRICTION,
+	ROW_SVX, ROW_SVY,
+	ROW_JN, ROW_JT, ROW_JBIAS,
+	// 1 if the cached impulse should be applied, 0 otherwise.
+	ROW_WARM,
+	ROW_FIELDS,
+};
+
+// Per lane body values gathered from the solver body array.
+enum {
+	BODY_VX, BODY_VY, BODY_W,
+	BODY_VBX, BODY_VBY, BODY_WB,
+	BODY_M_INV, BODY_I_INV,
+	BODY_FIELDS,
+};
+
+// A group of arbiters solved together.
+// Lanes past the lane count are padding that repeat the first lane's bodies with empty contact rows.
+struct ContactGroup {
+	int laneCount;
+	int rowStart, rowCount;
+};
+
+typedef void (*ContactSolverWarmStartFunc)(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end, cpFloat dt_coef);
+typedef void (*ContactSolverApplyImpulseFunc)(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end);
+
+struct cpContactSolver {
+	cpContactSolverType type;
+	int width;
+
+	ContactSolverWarmStartFunc warmStart;
+	ContactSolverApplyImpulseFunc applyImpulse;
+
+	// Groups for color c span [colorOffsets[c], colorOffsets[c + 1]).
+	int colorOffsets[COLORS + 1];
+	int groupCount, groupCapacity;
+	struct ContactGroup *groups;
+	// Solver ids of the bodies for each group's lanes. Each group stores width lanes for body a followed by body b.
+	int *bodyIDs;
+
+	// Row values stored as ROW_FIELDS arrays of width values per row.
+	int rowCount, rowCapacity;
+	cpFloat *rows;
+	// Contact for each lane of each row so the accumulated impulses can be stored, NULL for padding.
+	struct cpContact **rowContacts;
+
+	// Arbiters that didn't fit in any color.
+	cpArray *overflow;
+
+	// Scratch space used to color the arbiters.
+	int colorCapacity;
+	uint32_t *bodyColors;
+	unsigned char *arbiterColors;
+	int arbiterCapacity;
+	int *arbiterOrder;
+};
+
+//MARK: Solver Selection
+
+cpBool
+cpContactSolverIsSupported(cpContactSolverType type)
+{
+	switch(type){
+		case CP_CONTACT_SOLVER_SCALAR: return cpTrue;
+		case CP_CONTACT_SOLVER_SCALAR_COLORED: return cpTrue;
+	#if CP_SIMD_X86
+		case CP_CONTACT_SOLVER_SIMD: return cpCPUSupportsSSE2();
+		case CP_CONTACT_SOLVER_SSE2: return cpCPUSupportsSSE2();
+		case CP_CONTACT_SOLVER_AVX2: return cpCPUSupportsAVX2();
+	#endif
+		default: return cpFalse;
+	}
+}
+
+// Find the best supported solver for the requested type.
+static cpContactSolverType
+ResolveType(cpContactSolverType type)
+{
+	if(type == CP_CONTACT_SOLVER_SIMD) type = CP_CONTACT_SOLVER_AVX2;
+	if(type == CP_CONTACT_SOLVER_AVX2 && !cpContactSolverIsSupported(type)) type = CP_CONTACT_SOLVER_SSE2;
+	if(type == CP_CONTACT_SOLVER_SSE2 && !cpContactSolverIsSupported(type)) type = CP_CONTACT_SOLVER_SCALAR;
+
+	return type;
+}
+
+//MARK: Lane Gathering
+
+static inline void
+GatherBodies(struct cpSolverBody *bodies, const int *ids, int width, cpFloat *lanes)
+{
+	for(int i=0; i<width; i++){
+		struct cpSolverBody *body = bodies + ids[i];
+		lanes[BODY_VX*width + i] = body->v.x;
+		lanes[BODY_VY*width + i] = body->v.y;
+		lanes[BODY_W*width + i] = body->w;
+		lanes[BODY_VBX*width + i] = body->v_bias.x;
+		lanes[BODY_VBY*width + i] = body->v_bias.y;
+		lanes[BODY_WB*width + i] = body->w_bias;
+		lanes[BODY_M_INV*width + i] = body->m_inv;
+		lanes[BODY_I_INV*width + i] = body->i_inv;
+	}
+}
+
+// Only the real lanes are scattered since padding lanes may repeat a body.
+// Fixed bodies are shared between threads and never change, so they aren't written back either.
+static inline void
+ScatterBodies(struct cpSolverBody *bodies, const int *ids, int width, int count, const cpFloat *lanes)
+{
+	for(int i=0; i<count; i++){
+		struct cpSolverBody *body = bodies + ids[i];
+		if(solver_body_is_fixed(body)) continue;
+		
+		body->v.x = lanes[BODY_VX*width + i];
+		body->v.y = lanes[BODY_VY*width + i];
+		body->w = lanes[BODY_W*width + i];
+		body->v_bias.x = lanes[BODY_VBX*width + i];
+		body->v_bias.y = lanes[BODY_VBY*width + i];
+		body->w_bias = lanes[BODY_WB*width + i];
+	}
+}
+
+//MARK: SSE2 Solver
+
+#if CP_SIMD_X86
+
+static CP_TARGET_SSE2 void
+ContactSolverWarmStart_SSE2(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end, cpFloat dt_coef)
+{
+	const int W = SSE_LANES;
+	cpFloatSSE coef = sse_set1(dt_coef);
+	cpFloatSSE zero = sse_zero();
+
+	for(int g=start; g<end; g++){
+		struct ContactGroup *group = solver->groups + g;
+		int *ids = solver->bodyIDs + 2*W*g;
+
+		cpFloat lanes[2*BODY_FIELDS*MAX_LANES];
+		cpFloat *la = lanes, *lb = lanes + BODY_FIELDS*W;
+		GatherBodies(bodies, ids, W, la);
+		GatherBodies(bodies, ids + W, W, lb);
+
+		cpFloatSSE vax = sse_load(la + BODY_VX*W), vay = sse_load(la + BODY_VY*W), wa = sse_load(la + BODY_W*W);
+		cpFloatSSE vbx = sse_load(lb + BODY_VX*W), vby = sse_load(lb + BODY_VY*W), wb = sse_load(lb + BODY_W*W);
+		cpFloatSSE ma = sse_load(la + BODY_M_INV*W), ia = sse_load(la + BODY_I_INV*W);
+		cpFloatSSE mb = sse_load(lb + BODY_M_INV*W), ib = sse_load(lb + BODY_I_INV*W);
+
+		for(int r=group->rowStart; r<group->rowStart + group->rowCount; r++){
+			const cpFloat *row = solver->rows + ROW_FIELDS*W*r;
+			cpFloatSSE r1x = sse_load(row + ROW_R1X*W), r1y = sse_load(row + ROW_R1Y*W);
+			cpFloatSSE r2x = sse_load(row + ROW_R2X*W), r2y = sse_load(row + ROW_R2Y*W);
+			cpFloatSSE nx = sse_load(row + ROW_NX*W), ny = sse_load(row + ROW_NY*W);
+			cpFloatSSE jn = sse_load(row + ROW_JN*W), jt = sse_load(row + ROW_JT*W);
+			cpFloatSSE c = sse_mul(coef, sse_load(row + ROW_WARM*W));
+
+			cpFloatSSE jx = sse_mul(sse_sub(sse_mul(nx, jn), sse_mul(ny, jt)), c);
+			cpFloatSSE jy = sse_mul(sse_add(sse_mul(nx, jt), sse_mul(ny, jn)), c);
+
+			vax = sse_add(vax, sse_mul(sse_sub(zero, jx), ma));
+			vay = sse_add(vay, sse_mul(sse_sub(zero, jy), ma));
+			wa = sse_sub(wa, sse_mul(ia, sse_sub(sse_mul(r1x, jy), sse_mul(r1y, jx))));
+			vbx = sse_add(vbx, sse_mul(jx, mb));
+			vby = sse_add(vby, sse_mul(jy, mb));
+			wb = sse_add(wb, sse_mul(ib, sse_sub(sse_mul(r2x, jy), sse_mul(r2y, jx))));
+		}
+
+		sse_store(la + BODY_VX*W, vax); sse_store(la + BODY_VY*W, vay); sse_store(la + BODY_W*W, wa);
+		sse_store(lb + BODY_VX*W, vbx); sse_store(lb + BODY_VY*W, vby); sse_store(lb + BODY_W*W, wb);
+		ScatterBodies(bodies, ids, W, group->laneCount, la);
+		ScatterBodies(bodies, ids + W, W, group->laneCount, lb);
+	}
+}
+
+static CP_TARGET_SSE2 void
+ContactSolverApplyImpulse_SSE2(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end)
+{
+	const int W = SSE_LANES;
+	cpFloatSSE zero = sse_zero();
+
+	for(int g=start; g<end; g++){
+		struct ContactGroup *group = solver->groups + g;
+		int *ids = solver->bodyIDs + 2*W*g;
+
+		cpFloat lanes[2*BODY_FIELDS*MAX_LANES];
+		cpFloat *la = lanes, *lb = lanes + BODY_FIELDS*W;
+		GatherBodies(bodies, ids, W, la);
+		GatherBodies(bodies, ids + W, W, lb);
+
+		cpFloatSSE vax = sse_load(la + BODY_VX*W), vay = sse_load(la + BODY_VY*W), wa = sse_load(la + BODY_W*W);
+		cpFloatSSE vbax = sse_load(la + BODY_VBX*W), vbay = sse_load(la + BODY_VBY*W), wba = sse_load(la + BODY_WB*W);
+		cpFloatSSE vbx = sse_load(lb + BODY_VX*W), vby = sse_load(lb + BODY_VY*W), wb = sse_load(lb + BODY_W*W);
+		cpFloatSSE vbbx = sse_load(lb + BODY_VBX*W), vbby = sse_load(lb + BODY_VBY*W), wbb = sse_load(lb + BODY_WB*W);
+		cpFloatSSE ma = sse_load(la + BODY_M_INV*W), ia = sse_load(la + BODY_I_INV*W);
+		cpFloatSSE mb = sse_load(lb + BODY_M_INV*W), ib = sse_load(lb + BODY_I_INV*W);
+
+		for(int r=group->rowStart; r<group->rowStart + group->rowCount; r++){
+			cpFloat *row = solver->rows + ROW_FIELDS*W*r;
+			cpFloatSSE r1x = sse_load(row + ROW_R1X*W), r1y = sse_load(row + ROW_R1Y*W);
+			cpFloatSSE r2x = sse_load(row + ROW_R2X*W), r2y = sse_load(row + ROW_R2Y*W);
+			cpFloatSSE nx = sse_load(row + ROW_NX*W), ny = sse_load(row + ROW_NY*W);
+
+			// Relative bias and normal velocities.
+			cpFloatSSE vb1x = sse_sub(vbax, sse_mul(r1y, wba)), vb1y = sse_add(vbay, sse_mul(r1x, wba));
+			cpFloatSSE vb2x = sse_sub(vbbx, sse_mul(r2y, wbb)), vb2y = sse_add(vbby, sse_mul(r2x, wbb));
+			cpFloatSSE vrx = sse_add(sse_sub(sse_sub(vbx, sse_mul(r2y, wb)), sse_sub(vax, sse_mul(r1y, wa))), sse_load(row + ROW_SVX*W));
+			cpFloatSSE vry = sse_add(sse_sub(sse_add(vby, sse_mul(r2x, wb)), sse_add(vay, sse_mul(r1x, wa))), sse_load(row + ROW_SVY*W));
+
+			cpFloatSSE vbn = sse_add(sse_mul(sse_sub(vb2x, vb1x), nx), sse_mul(sse_sub(vb2y, vb1y), ny));
+			cpFloatSSE vrn = sse_add(sse_mul(vrx, nx), sse_mul(vry, ny));
+			cpFloatSSE vrt = sse_add(sse_mul(vrx, sse_sub(zero, ny)), sse_mul(vry, nx));
+
+			// Accumulate and clamp the impulses.
+			cpFloatSSE nMass = sse_load(row + ROW_NMASS*W);
+			cpFloatSSE jbn = sse_mul(sse_sub(sse_load(row + ROW_BIAS*W), vbn), nMass);
+			cpFloatSSE jbnOld = sse_load(row + ROW_JBIAS*W);
+			cpFloatSSE jBias = sse_max(sse_add(jbnOld, jbn), zero);
+
+			cpFloatSSE jn = sse_mul(sse_sub(zero, sse_add(sse_load(row + ROW_BOUNCE*W), vrn)), nMass);
+			cpFloatSSE jnOld = sse_load(row + ROW_JN*W);
+			cpFloatSSE jnAcc = sse_max(sse_add(jnOld, jn), zero);
+
+			cpFloatSSE jtMax = sse_mul(sse_load(row + ROW_FRICTION*W), jnAcc);
+			cpFloatSSE jt = sse_mul(sse_sub(zero, vrt), sse_load(row + ROW_TMASS*W));
+			cpFloatSSE jtOld = sse_load(row + ROW_JT*W);
+			cpFloatSSE jtAcc = sse_min(sse_max(sse_add(jtOld, jt), sse_sub(zero, jtMax)), jtMax);
+
+			sse_store(row + ROW_JBIAS*W, jBias);
+			sse_store(row + ROW_JN*W, jnAcc);
+			sse_store(row + ROW_JT*W, jtAcc);
+
+			// Apply the bias impulse.
+			cpFloatSSE djb = sse_sub(jBias, jbnOld);
+			cpFloatSSE jbx = sse_mul(nx, djb), jby = sse_mul(ny, djb);
+			vbax = sse_add(vbax, sse_mul(sse_sub(zero, jbx), ma));
+			vbay = sse_add(vbay, sse_mul(sse_sub(zero, jby), ma));
+			wba = sse_sub(wba, sse_mul(ia, sse_sub(sse_mul(r1x, jby), sse_mul(r1y, jbx))));
+			vbbx = sse_add(vbbx, sse_mul(jbx, mb));
+			vbby = sse_add(vbby, sse_mul(jby, mb));
+			wbb = sse_add(wbb, sse_mul(ib, sse_sub(sse_mul(r2x, jby), sse_mul(r2y, jbx))));
+
+			// Apply the contact impulse.
+			cpFloatSSE djn = sse_sub(jnAcc, jnOld), djt = sse_sub(jtAcc, jtOld);
+			cpFloatSSE jx = sse_sub(sse_mul(nx, djn), sse_mul(ny, djt));
+			cpFloatSSE jy = sse_add(sse_mul(nx, djt), sse_mul(ny, djn));
+			vax = sse_add(vax, sse_mul(sse_sub(zero, jx), ma));
+			vay = sse_add(vay, sse_mul(sse_sub(zero, jy), ma));
+			wa = sse_sub(wa, sse_mul(ia, sse_sub(sse_mul(r1x, jy), sse_mul(r1y, jx))));
+			vbx = sse_add(vbx, sse_mul(jx, mb));
+			vby = sse_add(vby, sse_mul(jy, mb));
+			wb = sse_add(wb, sse_mul(ib, sse_sub(sse_mul(r2x, jy), sse_mul(r2y, jx))));
+		}
+
+		sse_store(la + BODY_VX*W, vax); sse_store(la + BODY_VY*W, vay); sse_store(la + BODY_W*W, wa);
+		sse_store(la + BODY_VBX*W, vbax); sse_store(la + BODY_VBY*W, vbay); sse_store(la + BODY_WB*W, wba);
+		sse_store(lb + BODY_VX*W, vbx); sse_store(lb + BODY_VY*W, vby); sse_store(lb + BODY_W*W, wb);
+		sse_store(lb + BODY_VBX*W, vbbx); sse_store(lb + BODY_VBY*W, vbby); sse_store(lb + BODY_WB*W, wbb);
+		ScatterBodies(bodies, ids, W, group->laneCount, la);
+		ScatterBodies(bodies, ids + W, W, group->laneCount, lb);
+	}
+}
+
+//MARK: AVX2 Solver
+
+static CP_TARGET_AVX2 void
+ContactSolverWarmStart_AVX2(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end, cpFloat dt_coef)
+{
+	const int W = AVX_LANES;
+	cpFloatAVX coef = avx_set1(dt_coef);
+	cpFloatAVX zero = avx_zero();
+
+	for(int g=start; g<end; g++){
+		struct ContactGroup *group = solver->groups + g;
+		int *ids = solver->bodyIDs + 2*W*g;
+
+		cpFloat lanes[2*BODY_FIELDS*MAX_LANES];
+		cpFloat *la = lanes, *lb = lanes + BODY_FIELDS*W;
+		GatherBodies(bodies, ids, W, la);
+		GatherBodies(bodies, ids + W, W, lb);
+
+		cpFloatAVX vax = avx_load(la + BODY_VX*W), vay = avx_load(la + BODY_VY*W), wa = avx_load(la + BODY_W*W);
+		cpFloatAVX vbx = avx_load(lb + BODY_VX*W), vby = avx_load(lb + BODY_VY*W), wb = avx_load(lb + BODY_W*W);
+		cpFloatAVX ma = avx_load(la + BODY_M_INV*W), ia = avx_load(la + BODY_I_INV*W);
+		cpFloatAVX mb = avx_load(lb + BODY_M_INV*W), ib = avx_load(lb + BODY_I_INV*W);
+
+		for(int r=group->rowStart; r<group->rowStart + group->rowCount; r++){
+			const cpFloat *row = solver->rows + ROW_FIELDS*W*r;
+			cpFloatAVX r1x = avx_load(row + ROW_R1X*W), r1y = avx_load(row + ROW_R1Y*W);
+			cpFloatAVX r2x = avx_load(row + ROW_R2X*W), r2y = avx_load(row + ROW_R2Y*W);
+			cpFloatAVX nx = avx_load(row + ROW_NX*W), ny = avx_load(row + ROW_NY*W);
+			cpFloatAVX jn = avx_load(row + ROW_JN*W), jt = avx_load(row + ROW_JT*W);
+			cpFloatAVX c = avx_mul(coef, avx_load(row + ROW_WARM*W));
+
+			cpFloatAVX jx = avx_mul(avx_sub(avx_mul(nx, jn), avx_mul(ny, jt)), c);
+			cpFloatAVX jy = avx_mul(avx_add(avx_mul(nx, jt), avx_mul(ny, jn)), c);
+
+			vax = avx_add(vax, avx_mul(avx_sub(zero, jx), ma));
+			vay = avx_add(vay, avx_mul(avx_sub(zero, jy), ma));
+			wa = avx_sub(wa, avx_mul(ia, avx_sub(avx_mul(r1x, jy), avx_mul(r1y, jx))));
+			vbx = avx_add(vbx, avx_mul(jx, mb));
+			vby = avx_add(vby, avx_mul(jy, mb));
+			wb = avx_add(wb, avx_mul(ib, avx_sub(avx_mul(r2x, jy), avx_mul(r2y, jx))));
+		}
+
+		avx_store(la + BODY_VX*W, vax); avx_store(la + BODY_VY*W, vay); avx_store(la + BODY_W*W, wa);
+		avx_store(lb + BODY_VX*W, vbx); avx_store(lb + BODY_VY*W, vby); avx_store(lb + BODY_W*W, wb);
+		ScatterBodies(bodies, ids, W, group->laneCount, la);
+		ScatterBodies(bodies, ids + W, W, group->laneCount, lb);
+	}
+}
+
+static CP_TARGET_AVX2 void
+ContactSolverApplyImpulse_AVX2(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end)
+{
+	const int W = AVX_LANES;
+	cpFloatAVX zero = avx_zero();
+
+	for(int g=start; g<end; g++){
+		struct ContactGroup *group = solver->groups + g;
+		int *ids = solver->bodyIDs + 2*W*g;
+
+		cpFloat lanes[2*BODY_FIELDS*MAX_LANES];
+		cpFloat *la = lanes, *lb = lanes + BODY_FIELDS*W;
+		GatherBodies(bodies, ids, W, la);
+		GatherBodies(bodies, ids + W, W, lb);
+
+		cpFloatAVX vax = avx_load(la + BODY_VX*W), vay = avx_load(la + BODY_VY*W), wa = avx_load(la + BODY_W*W);
+		cpFloatAVX vbax = avx_load(la + BODY_VBX*W), vbay = avx_load(la + BODY_VBY*W), wba = avx_load(la + BODY_WB*W);
+		cpFloatAVX vbx = avx_load(lb + BODY_VX*W), vby = avx_load(lb + BODY_VY*W), wb = avx_load(lb + BODY_W*W);
+		cpFloatAVX vbbx = avx_load(lb + BODY_VBX*W), vbby = avx_load(lb + BODY_VBY*W), wbb = avx_load(lb + BODY_WB*W);
+		cpFloatAVX ma = avx_load(la + BODY_M_INV*W), ia = avx_load(la + BODY_I_INV*W);
+		cpFloatAVX mb = avx_load(lb + BODY_M_INV*W), ib = avx_load(lb + BODY_I_INV*W);
+
+		for(int r=group->rowStart; r<group->rowStart + group->rowCount; r++){
+			cpFloat *row = solver->rows + ROW_FIELDS*W*r;
+			cpFloatAVX r1x = avx_load(row + ROW_R1X*W), r1y = avx_load(row + ROW_R1Y*W);
+			cpFloatAVX r2x = avx_load(row + ROW_R2X*W), r2y = avx_load(row + ROW_R2Y*W);
+			cpFloatAVX nx = avx_load(row + ROW_NX*W), ny = avx_load(row + ROW_NY*W);
+
+			// Relative bias and normal velocities.
+			cpFloatAVX vb1x = avx_sub(vbax, avx_mul(r1y, wba)), vb1y = avx_add(vbay, avx_mul(r1x, wba));
+			cpFloatAVX vb2x = avx_sub(vbbx, avx_mul(r2y, wbb)), vb2y = avx_add(vbby, avx_mul(r2x, wbb));
+			cpFloatAVX vrx = avx_add(avx_sub(avx_sub(vbx, avx_mul(r2y, wb)), avx_sub(vax, avx_mul(r1y, wa))), avx_load(row + ROW_SVX*W));
+			cpFloatAVX vry = avx_add(avx_sub(avx_add(vby, avx_mul(r2x, wb)), avx_add(vay, avx_mul(r1x, wa))), avx_load(row + ROW_SVY*W));
+
+			cpFloatAVX vbn = avx_add(avx_mul(avx_sub(vb2x, vb1x), nx), avx_mul(avx_sub(vb2y, vb1y), ny));
+			cpFloatAVX vrn = avx_add(avx_mul(vrx, nx), avx_mul(vry, ny));
+			cpFloatAVX vrt = avx_add(avx_mul(vrx, avx_sub(zero, ny)), avx_mul(vry, nx));
+
+			// Accumulate and clamp the impulses.
+			cpFloatAVX nMass = avx_load(row + ROW_NMASS*W);
+			cpFloatAVX jbn = avx_mul(avx_sub(avx_load(row + ROW_BIAS*W), vbn), nMass);
+			cpFloatAVX jbnOld = avx_load(row + ROW_JBIAS*W);
+			cpFloatAVX jBias = avx_max(avx_add(jbnOld, jbn), zero);
+
+			cpFloatAVX jn = avx_mul(avx_sub(zero, avx_add(avx_load(row + ROW_BOUNCE*W), vrn)), nMass);
+			cpFloatAVX jnOld = avx_load(row + ROW_JN*W);
+			cpFloatAVX jnAcc = avx_max(avx_add(jnOld, jn), zero);
+
+			cpFloatAVX jtMax = avx_mul(avx_load(row + ROW_FRICTION*W), jnAcc);
+			cpFloatAVX jt = avx_mul(avx_sub(zero, vrt), avx_load(row + ROW_TMASS*W));
+			cpFloatAVX jtOld = avx_load(row + ROW_JT*W);
+			cpFloatAVX jtAcc = avx_min(avx_max(avx_add(jtOld, jt), avx_sub(zero, jtMax)), jtMax);
+
+			avx_store(row + ROW_JBIAS*W, jBias);
+			avx_store(row + ROW_JN*W, jnAcc);
+			avx_store(row + ROW_JT*W, jtAcc);
+
+			// Apply the bias impulse.
+			cpFloatAVX djb = avx_sub(jBias, jbnOld);
+			cpFloatAVX jbx = avx_mul(nx, djb), jby = avx_mul(ny, djb);
+			vbax = avx_add(vbax, avx_mul(avx_sub(zero, jbx), ma));
+			vbay = avx_add(vbay, avx_mul(avx_sub(zero, jby), ma));
+			wba = avx_sub(wba, avx_mul(ia, avx_sub(avx_mul(r1x, jby), avx_mul(r1y, jbx))));
+			vbbx = avx_add(vbbx, avx_mul(jbx, mb));
+			vbby = avx_add(vbby, avx_mul(jby, mb));
+			wbb = avx_add(wbb, avx_mul(ib, avx_sub(avx_mul(r2x, jby), avx_mul(r2y, jbx))));
+
+			// Apply the contact impulse.
+			cpFloatAVX djn = avx_sub(jnAcc, jnOld), djt = avx_sub(jtAcc, jtOld);
+			cpFloatAVX jx = avx_sub(avx_mul(nx, djn), avx_mul(ny, djt));
+			cpFloatAVX jy = avx_add(avx_mul(nx, djt), avx_mul(ny, djn));
+			vax = avx_add(vax, avx_mul(avx_sub(zero, jx), ma));
+			vay = avx_add(vay, avx_mul(avx_sub(zero, jy), ma));
+			wa = avx_sub(wa, avx_mul(ia, avx_sub(avx_mul(r1x, jy), avx_mul(r1y, jx))));
+			vbx = avx_add(vbx, avx_mul(jx, mb));
+			vby = avx_add(vby, avx_mul(jy, mb));
+			wb = avx_add(wb, avx_mul(ib, avx_sub(avx_mul(r2x, jy), avx_mul(r2y, jx))));
+		}
+
+		avx_store(la + BODY_VX*W, vax); avx_store(la + BODY_VY*W, vay); avx_store(la + BODY_W*W, wa);
+		avx_store(la + BODY_VBX*W, vbax); avx_store(la + BODY_VBY*W, vbay); avx_store(la + BODY_WB*W, wba);
+		avx_store(lb + BODY_VX*W, vbx); avx_store(lb + BODY_VY*W, vby); avx_store(lb + BODY_W*W, wb);
+		avx_store(lb + BODY_VBX*W, vbbx); avx_store(lb + BODY_VBY*W, vbby); avx_store(lb + BODY_WB*W, wbb);
+		ScatterBodies(bodies, ids, W, group->laneCount, la);
+		ScatterBodies(bodies, ids + W, W, group->laneCount, lb);
+	}
+}
+
+#endif
+
+//MARK: Batching
+
+static struct cpContactSolver *
+cpContactSolverNew(void)
+{
+	struct cpContactSolver *solver = (struct cpContactSolver *)cpcalloc(1, sizeof(struct cpContactSolver));
+	solver->overflow = cpArrayNew(0);
+
+	return solver;
+}
+
+void
+cpContactSolverFree(struct cpContactSolver *solver)
+{
+	if(solver){
+		cpfree(solver->groups);
+		cpfree(solver->bodyIDs);
+		cpfree(solver->rows);
+		cpfree(solver->rowContacts);
+		cpArrayFree(solver->overflow);
+		cpfree(solver->bodyColors);
+		cpfree(solver->arbiterColors);
+		cpfree(solver->arbiterOrder);
+
+		cpfree(solver);
+	}
+}
+
+// Greedily color the arbiters, returning the number of arbiters in each color.
+static void
+ColorArbiters(struct cpContactSolver *solver, cpSpace *space, int *counts)
+{
+	cpArray *arbiters = space->arbiters;
+	struct cpSolverBody *bodies = space->solverState;
+	int bodyCount = space->solverBodies->num;
+
+	if(bodyCount > solver->colorCapacity){
+		solver->colorCapacity = bodyCount;
+		solver->bodyColors = (uint32_t *)cprealloc(solver->bodyColors, bodyCount*sizeof(uint32_t));
+	}
+	memset(solver->bodyColors, 0, bodyCount*sizeof(uint32_t));
+
+	if(arbiters->num > solver->arbiterCapacity){
+		solver->arbiterCapacity = arbiters->num;
+		solver->arbiterColors = (unsigned char *)cprealloc(solver->arbiterColors, arbiters->num*sizeof(unsigned char));
+		solver->arbiterOrder = (int *)cprealloc(solver->arbiterOrder, arbiters->num*sizeof(int));
+	}
+
+	memset(counts, 0, (COLORS + 1)*sizeof(int));
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		int a = arb->solver_a, b = arb->solver_b;
+		cpBool fixedA = solver_body_is_fixed(bodies + a), fixedB = solver_body_is_fixed(bodies + b);
+
+		uint32_t used = (fixedA ? 0 : solver->bodyColors[a]) | (fixedB ? 0 : solver->bodyColors[b]);
+		int color = 0;
+		while(color < COLORS && (used & (1u << color))) color++;
+
+		if(color < COLORS){
+			if(!fixedA) solver->bodyColors[a] |= (1u << color);
+			if(!fixedB) solver->bodyColors[b] |= (1u << color);
+		}
+
+		solver->arbiterColors[i] = (unsigned char)color;
+		counts[color]++;
+	}
+}
+
+static void
+ReserveGroups(struct cpContactSolver *solver, int groups, int rows)
+{
+	int W = solver->width;
+
+	if(groups > solver->groupCapacity){
+		solver->groupCapacity = groups;
+		solver->groups = (struct ContactGroup *)cprealloc(solver->groups, groups*sizeof(struct ContactGroup));
+		solver->bodyIDs = (int *)cprealloc(solver->bodyIDs, 2*W*groups*sizeof(int));
+	}
+
+	if(rows > solver->rowCapacity){
+		solver->rowCapacity = rows;
+		solver->rows = (cpFloat *)cprealloc(solver->rows, ROW_FIELDS*W*rows*sizeof(cpFloat));
+		solver->rowContacts = (struct cpContact **)cprealloc(solver->rowContacts, W*rows*sizeof(struct cpContact *));
+	}
+}
+
+static void
+FillRow(struct cpContactSolver *solver, int row, int lane, cpArbiter *arb, struct cpContact *con)
+{
+	int W = solver->width;
+	cpFloat *values = solver->rows + ROW_FIELDS*W*row;
+	solver->rowContacts[W*row + lane] = con;
+
+	if(con){
+		values[ROW_R1X*W + lane] = con->r1.x;
+		values[ROW_R1Y*W + lane] = con->r1.y;
+		values[ROW_R2X*W + lane] = con->r2.x;
+		values[ROW_R2Y*W + lane] = con->r2.y;
+		values[ROW_NX*W + lane] = arb->n.x;
+		values[ROW_NY*W + lane] = arb->n.y;
+		values[ROW_NMASS*W + lane] = con->nMass;
+		values[ROW_TMASS*W + lane] = con->tMass;
+		values[ROW_BIAS*W + lane] = con->bias;
+		values[ROW_BOUNCE*W + lane] = con->bounce;
+		values[ROW_FRICTION*W + lane] = arb->u;
+		values[ROW_SVX*W + lane] = arb->surface_vr.x;
+		values[ROW_SVY*W + lane] = arb->surface_vr.y;
+		values[ROW_JN*W + lane] = con->jnAcc;
+		values[ROW_JT*W + lane] = con->jtAcc;
+		values[ROW_JBIAS*W + lane] = con->jBias;
+		// Like cpArbiterApplyCachedImpulse(), first contacts aren't warm started even if they were cached.
+		values[ROW_WARM*W + lane] = (cpArbiterIsFirstContact(arb) ? 0.0f : 1.0f);
+	} else {
+		// Empty rows apply zero impulses.
+		for(int i=0; i<ROW_FIELDS; i++) values[i*W + lane] = 0.0f;
+	}
+}
+
+struct cpContactSolver *
+cpSpacePrepareContactSolver(cpSpace *space)
+{
+	cpContactSolverType type = ResolveType(space->contactSolverType);
+	if(type == CP_CONTACT_SOLVER_SCALAR) return NULL;
+
+	if(!space->contactSolver) space->contactSolver = cpContactSolverNew();
+	struct cpContactSolver *solver = space->contactSolver;
+
+#if CP_SIMD_X86
+	if(type == CP_CONTACT_SOLVER_AVX2){
+		solver->width = AVX_LANES;
+		solver->warmStart = ContactSolverWarmStart_AVX2;
+		solver->applyImpulse = ContactSolverApplyImpulse_AVX2;
+	} else {
+		solver->width = SSE_LANES;
+		solver->warmStart = ContactSolverWarmStart_SSE2;
+		solver->applyImpulse = ContactSolverApplyImpulse_SSE2;
+	}
+#endif
+
+	// The colored scalar solver doesn't fill any groups, all of the arbiters end up in the overflow array in color order.
+	if(type == CP_CONTACT_SOLVER_SCALAR_COLORED) solver->width = 1;
+
+	solver->type = type;
+
+	cpArray *arbiters = space->arbiters;
+	int W = solver->width;
+
+	int counts[COLORS + 1];
+	ColorArbiters(solver, space, counts);
+
+	// Sort the arbiters by color, keeping them in order within each color.
+	int offsets[COLORS + 1];
+	int groupCount = 0, rowCount = 0;
+	for(int c=0, offset=0; c<=COLORS; c++){
+		offsets[c] = offset;
+		offset += counts[c];
+
+		if(c < COLORS){
+			solver->colorOffsets[c] = groupCount;
+			if(type != CP_CONTACT_SOLVER_SCALAR_COLORED) groupCount += (counts[c] + W - 1)/W;
+		}
+	}
+	solver->colorOffsets[COLORS] = groupCount;
+
+	for(int i=0; i<arbiters->num; i++){
+		solver->arbiterOrder[offsets[solver->arbiterColors[i]]++] = i;
+	}
+
+	// Each group needs at most CP_MAX_CONTACTS_PER_ARBITER rows.
+	ReserveGroups(solver, groupCount, groupCount*CP_MAX_CONTACTS_PER_ARBITER);
+
+	int next = 0;
+	for(int c=0; c<COLORS; c++){
+		for(int g=solver->colorOffsets[c]; g<solver->colorOffsets[c + 1]; g++){
+			struct ContactGroup *group = solver->groups + g;
+			int *ids = solver->bodyIDs + 2*W*g;
+
+			int lanes = counts[c] - (g - solver->colorOffsets[c])*W;
+			group->laneCount = (lanes < W ? lanes : W);
+			group->rowStart = rowCount;
+			group->rowCount = 0;
+
+			for(int lane=0; lane<group->laneCount; lane++){
+				cpArbiter *arb = (cpArbiter *)arbiters->arr[solver->arbiterOrder[next + lane]];
+				if(arb->count > group->rowCount) group->rowCount = arb->count;
+			}
+
+			for(int lane=0; lane<W; lane++){
+				// Padding lanes repeat the first lane's bodies.
+				cpArbiter *arb = (cpArbiter *)arbiters->arr[solver->arbiterOrder[next + (lane < group->laneCount ? lane : 0)]];
+				ids[lane] = arb->solver_a;
+				ids[W + lane] = arb->solver_b;
+
+				for(int r=0; r<group->rowCount; r++){
+					cpBool real = (lane < group->laneCount && r < arb->count);
+					FillRow(solver, rowCount + r, lane, arb, real ? arb->contacts + r : NULL);
+				}
+			}
+
+			next += group->laneCount;
+			rowCount += group->rowCount;
+		}
+	}
+
+	solver->groupCount = groupCount;
+	solver->rowCount = rowCount;
+
+	cpArray *overflow = solver->overflow;
+	overflow->num = 0;
+	for(; next<arbiters->num; next++) cpArrayPush(overflow, arbiters->arr[solver->arbiterOrder[next]]);
+
+	return solver;
+}
+
+int
+cpContactSolverGroupCount(struct cpContactSolver *solver)
+{
+	return solver->groupCount;
+}
+
+int
+cpContactSolverColorCount(struct cpContactSolver *solver)
+{
+	return COLORS;
+}
+
+void
+cpContactSolverGetColorGroups(struct cpContactSolver *solver, int color, int *start, int *end)
+{
+	(*start) = solver->colorOffsets[color];
+	(*end) = solver->colorOffsets[color + 1];
+}
+
+cpArray *
+cpContactSolverGetOverflow(struct cpContactSolver *solver)
+{
+	return solver->overflow;
+}
+
+void
+cpContactSolverWarmStart(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end, cpFloat dt_coef)
+{
+	if(start < end) solver->warmStart(solver, bodies, start, end, dt_coef);
+}
+
+void
+cpContactSolverApplyImpulse(struct cpContactSolver *solver, struct cpSolverBody *bodies, int start, int end)
+{
+	if(start < end) solver->applyImpulse(solver, bodies, start, end);
+}
+
+void
+cpContactSolverFinish(struct cpContactSolver *solver)
+{
+	int W = solver->width;
+
+	for(int r=0; r<solver->rowCount; r++){
+		cpFloat *values = solver->rows + ROW_FIELDS*W*r;
+
+		for(int lane=0; lane<W; lane++){
+			struct cpContact *con = solver->rowContacts[W*r + lane];
+			if(con){
+				con->jnAcc = values[ROW_JN*W + lane];
+				con->jtAcc = values[ROW_JT*W + lane];
+				con->jBias = values[ROW_JBIAS*W + lane];
+			}
+		}
+	}
+}
@@ -43,8 +43,8 @@ preStep(cpDampedRotarySpring *spring, cpFloat dt)
 	cpFloat j_spring = spring->springTorqueFunc((cpConstraint *)spring, a->a - b->a)*dt;
 	spring->jAcc = j_spring;
 	
-	a->w -= j_spring*a->i_inv;
-	b->w += j_spring*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j_spring*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j_spring*b->i_inv;
 }
 
 static void applyCachedImpulse(cpDampedRotarySpring *spring, cpFloat dt_coef){}
@@ -67,8 +67,8 @@ applyImpulse(cpDampedRotarySpring *spring, cpFloat dt)
 	cpFloat j_damp = w_damp*spring->iSum;
 	spring->jAcc += j_damp;
 	
-	a->w += j_damp*a->i_inv;
-	b->w -= j_damp*b->i_inv;
+	if(!body_is_fixed(a)) a->w += j_damp*a->i_inv;
+	if(!body_is_fixed(b)) b->w -= j_damp*b->i_inv;
 }
 
 static cpFloat
@@ -42,8 +42,8 @@ applyCachedImpulse(cpGearJoint *joint, cpFloat dt_coef)
 	cpBody *b = joint->constraint.b;
 	
 	cpFloat j = joint->jAcc*dt_coef;
-	a->w -= j*a->i_inv*joint->ratio_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv*joint->ratio_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static void
@@ -64,8 +64,8 @@ applyImpulse(cpGearJoint *joint, cpFloat dt)
 	j = joint->jAcc - jOld;
 	
 	// apply impulse
-	a->w -= j*a->i_inv*joint->ratio_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv*joint->ratio_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static cpFloat
@@ -0,0 +1,686 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "chipmunk/chipmunk_private.h"
+
+// A hierarchical grid, a stack of spatial hashes whose cell sizes double from one level to the next.
+// Each object goes into the level whose cells are just larger than it, so it only ever covers 2x2 cells
+// no matter how big or small it is. All of the levels share a single hash table of cells.
+// Pairs on the same level are found by looking in the object's own cells,
+// and pairs across levels by having the smaller object look in the cells of every coarser level.
+// The cell size of level 0 is picked from the objects each time the grid is fully rehashed.
+
+static inline cpSpatialIndexClass *Klass(void);
+
+typedef struct Cells Cells;
+typedef struct Entry Entry;
+typedef struct Bin Bin;
+
+#define NULL_INDEX (0xFFFFFFFFu)
+
+#define INITIAL_CAPACITY (16u)
+
+#define MAX_LEVELS (32)
+// Cell coordinates are clamped to this so they fit in an int.
+// Objects beyond it just pile up in the outermost cells.
+#define CELL_LIMIT (1<<30)
+
+// Removed entries are only cleaned up when the bins are rebuilt.
+// Rebuild early once there are this many of them, or more dead entries than live ones.
+#define DEAD_MAX (32u)
+
+struct cpHGrid {
+	cpSpatialIndex spatialIndex;
+	
+	// The cells on level 0 are 2^base units wide, and each level up doubles that.
+	int base;
+	// Reciprocal of the cell size of each level.
+	cpFloat inv[MAX_LEVELS];
+	// Number of live entries on each level and a bit mask of the levels that have any.
+	int levelCounts[MAX_LEVELS];
+	uint32_t levels;
+	
+	// Removed entries stay in the array with a NULL obj until the bins are rebuilt.
+	Entry *entries;
+	uint32_t entryCount, entryCapacity;
+	uint32_t liveCount;
+	
+	// Bins link the entries into the cells they cover. Each bucket is the head of a list of bins.
+	Bin *bins;
+	uint32_t binCount, binCapacity;
+	uint32_t *buckets;
+	uint32_t bucketMask;
+	
+	// Open addressed table that maps objects to their entries.
+	cpObjTable table;
+	
+	cpTimestamp stamp;
+};
+
+// Range of cells covered by a bounding box on one level, inclusive.
+struct Cells {
+	int l, b, r, t;
+};
+
+struct Entry {
+	void *obj;
+	cpHashValue hashid;
+	cpBB bb;
+	
+	// The level the entry was binned on and the cells it covers there.
+	int level;
+	Cells cells;
+	
+	// Used by segment queries to avoid calling the callback twice for the same object.
+	cpTimestamp stamp;
+};
+
+struct Bin {
+	uint32_t entry, next;
+	int x, y;
+};
+
+//MARK: Level Functions
+
+static void
+SetBase(cpHGrid *grid, int base)
+{
+	grid->base = base;
+	for(int level=0; level<MAX_LEVELS; level++) grid->inv[level] = (cpFloat)ldexp(1.0, -(base + level));
+}
+
+// Smallest level whose cells are larger than the extent of the bounding box.
+static inline int
+LevelForBB(cpHGrid *grid, cpBB bb)
+{
+	cpFloat extent = cpfmax(bb.r - bb.l, bb.t - bb.b);
+	if(!(extent > 0.0f)) return 0;
+	
+	int exponent;
+	frexp(extent, &exponent);
+	
+	int level = exponent - grid->base;
+	return (level < 0 ? 0 : (level < MAX_LEVELS ? level : MAX_LEVELS - 1));
+}
+
+static inline int
+CellCoord(cpFloat x, cpFloat inv)
+{
+	cpFloat f = cpfclamp(x*inv, -CELL_LIMIT, CELL_LIMIT);
+	int i = (int)f;
+	return (f < 0.0f && f != i ? i - 1 : i);
+}
+
+static inline Cells
+CellsForBB(cpBB bb, cpFloat inv)
+{
+	Cells cells = {CellCoord(bb.l, inv), CellCoord(bb.b, inv), CellCoord(bb.r, inv), CellCoord(bb.t, inv)};
+	return cells;
+}
+
+static inline cpFloat
+CellsCount(Cells cells)
+{
+	return (cpFloat)(cells.r - cells.l + 1)*(cpFloat)(cells.t - cells.b + 1);
+}
+
+static inline uint32_t
+CellHash(int x, int y, int level)
+{
+	uint32_t h = ((uint32_t)x*1640531513u ^ (uint32_t)y*2654435789u ^ (uint32_t)level*2246822519u);
+	
+	// The low bits of the products only depend on the low bits of the coordinates, so mix the high bits down.
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	return h ^ (h >> 13);
+}
+
+// Objects that overlap can share up to four cells.
+// Only report the pair from the cell at the lower left corner of the overlap.
+static inline cpBool
+FirstSharedCell(int x, int y, Cells a, Cells b)
+{
+	return (x == (a.l > b.l ? a.l : b.l) && y == (a.b > b.b ? a.b : b.b));
+}
+
+// Next level at or above 'level' that has any entries, or MAX_LEVELS if there are none.
+static inline int
+NextLevel(uint32_t levels, int level)
+{
+	while(level < MAX_LEVELS && !(levels & (1u << level))) level++;
+	return level;
+}
+
+static void
+LevelAdd(cpHGrid *grid, int level)
+{
+	grid->levelCounts[level]++;
+	grid->levels |= (1u << level);
+}
+
+static void
+LevelRemove(cpHGrid *grid, int level)
+{
+	if(--grid->levelCounts[level] == 0) grid->levels &= ~(1u << level);
+}
+
+//MARK: Entry Table Functions
+
+static inline void *
+EntryObj(const void *grid, uint32_t entry)
+{
+	return ((const cpHGrid *)grid)->entries[entry].obj;
+}
+
+static inline uint32_t
+TableFind(cpHGrid *grid, void *obj, cpHashValue hashid)
+{
+	return cpObjTableFind(&grid->table, obj, hashid, EntryObj, grid);
+}
+
+// Entries move when the dead ones are compacted, so the table needs to be refilled.
+static void
+TableRefill(cpHGrid *grid)
+{
+	cpObjTableClear(&grid->table);
+	for(uint32_t i=0; i<grid->entryCount; i++) cpObjTableInsert(&grid->table, grid->entries[i].hashid, i);
+}
+
+//MARK: Bin Functions
+
+static void
+BucketsResize(cpHGrid *grid, uint32_t capacity)
+{
+	cpfree(grid->buckets);
+	
+	grid->buckets = (uint32_t *)cpcalloc(capacity, sizeof(uint32_t));
+	grid->bucketMask = capacity - 1;
+	for(uint32_t i=0; i<capacity; i++) grid->buckets[i] = NULL_INDEX;
+}
+
+static inline void
+BinLink(cpHGrid *grid, uint32_t entry, int x, int y, int level)
+{
+	if(grid->binCount == grid->binCapacity){
+		uint32_t capacity = (grid->binCapacity ? 2*grid->binCapacity : 4*INITIAL_CAPACITY);
+		cpAssertHard(capacity > grid->binCount, "Internal Error: Too many bins.");
+		
+		grid->bins = (Bin *)cprealloc(grid->bins, capacity*sizeof(Bin));
+		grid->binCapacity = capacity;
+	}
+	
+	uint32_t *bucket = grid->buckets + (CellHash(x, y, level)&grid->bucketMask);
+	uint32_t idx = grid->binCount++;
+	
+	Bin *bin = grid->bins + idx;
+	bin->entry = entry;
+	bin->next = *bucket;
+	bin->x = x;
+	bin->y = y;
+	
+	*bucket = idx;
+}
+
+// Pick the level for an entry using its current bounding box and link it into its cells.
+static void
+EntryBin(cpHGrid *grid, uint32_t entry)
+{
+	Entry *e = grid->entries + entry;
+	int level = LevelForBB(grid, e->bb);
+	Cells cells = CellsForBB(e->bb, grid->inv[level]);
+	
+	e->level = level;
+	e->cells = cells;
+	LevelAdd(grid, level);
+	
+	for(int x=cells.l; x<=cells.r; x++){
+		for(int y=cells.b; y<=cells.t; y++) BinLink(grid, entry, x, y, level);
+	}
+}
+
+// Pick the size of the level 0 cells from the smallest object.
+// It can't be so small that the cell coordinates of the objects farthest from the origin overflow.
+static int
+ChooseBase(cpHGrid *grid)
+{
+	cpFloat minExtent = FLT_MAX, maxCoord = 0.0f;
+	
+	Entry *entries = grid->entries;
+	for(uint32_t i=0, count=grid->entryCount; i<count; i++){
+		cpBB bb = entries[i].bb;
+		
+		cpFloat extent = cpfmax(bb.r - bb.l, bb.t - bb.b);
+		if(extent > 0.0f) minExtent = cpfmin(minExtent, extent);
+		maxCoord = cpfmax(maxCoord, cpfmax(cpfmax(cpfabs(bb.l), cpfabs(bb.r)), cpfmax(cpfabs(bb.b), cpfabs(bb.t))));
+	}
+	
+	int base = 0, limit = 0;
+	if(minExtent < FLT_MAX) frexp(minExtent, &base);
+	if(maxCoord < FLT_MAX) frexp(maxCoord, &limit);
+	
+	return (base > limit - 30 ? base : limit - 30);
+}
+
+// Throw away the dead entries and relink all of the live ones into fresh bins, picking a new base level size.
+static void
+BinsRebuild(cpHGrid *grid)
+{
+	Entry *entries = grid->entries;
+	uint32_t count = grid->entryCount;
+	
+	uint32_t live = 0;
+	for(uint32_t i=0; i<count; i++){
+		if(entries[i].obj) entries[live++] = entries[i];
+	}
+	
+	grid->entryCount = live;
+	if(live != count) TableRefill(grid);
+	
+	SetBase(grid, ChooseBase(grid));
+	
+	memset(grid->levelCounts, 0, sizeof(grid->levelCounts));
+	grid->levels = 0;
+	
+	// Most objects cover about 2x2 cells, so size the buckets for that.
+	uint32_t capacity = INITIAL_CAPACITY;
+	while(capacity < 4*live) capacity *= 2;
+	if(grid->buckets == NULL || capacity != grid->bucketMask + 1){
+		BucketsResize(grid, capacity);
+	} else {
+		for(uint32_t i=0; i<capacity; i++) grid->buckets[i] = NULL_INDEX;
+	}
+	
+	grid->binCount = 0;
+	for(uint32_t i=0; i<live; i++) EntryBin(grid, i);
+}
+
+//MARK: Memory Management Functions
+
+cpHGrid *
+cpHGridAlloc(void)
+{
+	return (cpHGrid *)cpcalloc(1, sizeof(cpHGrid));
+}
+
+cpSpatialIndex *
+cpHGridInit(cpHGrid *grid, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndexInit((cpSpatialIndex *)grid, Klass(), bbfunc, staticIndex);
+	
+	SetBase(grid, 0);
+	memset(grid->levelCounts, 0, sizeof(grid->levelCounts));
+	grid->levels = 0;
+	
+	grid->entries = NULL;
+	grid->entryCount = grid->entryCapacity = 0;
+	grid->liveCount = 0;
+	
+	grid->bins = NULL;
+	grid->binCount = grid->binCapacity = 0;
+	grid->buckets = NULL;
+	grid->bucketMask = 0;
+	
+	cpObjTableInit(&grid->table);
+	
+	grid->stamp = 1;
+	
+	return (cpSpatialIndex *)grid;
+}
+
+cpSpatialIndex *
+cpHGridNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	return cpHGridInit(cpHGridAlloc(), bbfunc, staticIndex);
+}
+
+static void
+cpHGridDestroy(cpHGrid *grid)
+{
+	cpfree(grid->entries);
+	cpfree(grid->bins);
+	cpfree(grid->buckets);
+	cpObjTableDestroy(&grid->table);
+}
+
+//MARK: Insert/Remove
+
+static void
+cpHGridInsert(cpHGrid *grid, void *obj, cpHashValue hashid)
+{
+	if(grid->entryCount == grid->entryCapacity){
+		uint32_t capacity = (grid->entryCapacity ? 2*grid->entryCapacity : INITIAL_CAPACITY);
+		cpAssertHard(capacity > grid->entryCount && capacity < NULL_INDEX, "Internal Error: Too many objects.");
+		
+		grid->entries = (Entry *)cprealloc(grid->entries, capacity*sizeof(Entry));
+		grid->entryCapacity = capacity;
+	}
+	
+	uint32_t entry = grid->entryCount++;
+	Entry *e = grid->entries + entry;
+	e->obj = obj;
+	e->hashid = hashid;
+	e->bb = grid->spatialIndex.bbfunc(obj);
+	e->stamp = 0;
+	
+	grid->liveCount++;
+	cpObjTableInsert(&grid->table, hashid, entry);
+	
+	if(grid->buckets == NULL || grid->binCount > 2*(grid->bucketMask + 1)){
+		BinsRebuild(grid);
+	} else {
+		EntryBin(grid, entry);
+	}
+}
+
+static void
+cpHGridRemove(cpHGrid *grid, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(grid, obj, hashid);
+	if(slot == CP_OBJ_TABLE_EMPTY) return;
+	
+	Entry *e = grid->entries + grid->table.slots[slot].index;
+	cpObjTableRemove(&grid->table, slot);
+	
+	e->obj = NULL;
+	LevelRemove(grid, e->level);
+	grid->liveCount--;
+	
+	uint32_t dead = grid->entryCount - grid->liveCount;
+	if(dead > DEAD_MAX && dead > grid->liveCount) BinsRebuild(grid);
+}
+
+static cpBool
+cpHGridContains(cpHGrid *grid, void *obj, cpHashValue hashid)
+{
+	return (TableFind(grid, obj, hashid) != CP_OBJ_TABLE_EMPTY);
+}
+
+//MARK: Query
+
+// Levels where the query covers more cells than there are objects are cheaper to check by brute force.
+// All of those levels are checked in a single pass over the entries.
+static void
+ScanLevels(cpHGrid *grid, uint32_t levels, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	Entry *entries = grid->entries;
+	for(uint32_t i=0, count=grid->entryCount; i<count; i++){
+		Entry *e = entries + i;
+		
+		if(e->obj && (levels & (1u << e->level)) && e->obj != obj && cpBBIntersects(e->bb, bb)){
+			func(obj, e->obj, 0, data);
+		}
+	}
+}
+
+static void
+cpHGridQuery(cpHGrid *grid, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	Entry *entries = grid->entries;
+	Bin *bins = grid->bins;
+	uint32_t *buckets = grid->buckets;
+	uint32_t mask = grid->bucketMask;
+	
+	uint32_t scan = 0;
+	uint32_t levels = grid->levels;
+	for(int level = NextLevel(levels, 0); level < MAX_LEVELS; level = NextLevel(levels, level + 1)){
+		Cells cells = CellsForBB(bb, grid->inv[level]);
+		
+		if(CellsCount(cells) > grid->entryCount){
+			scan |= (1u << level);
+			continue;
+		}
+		
+		for(int x=cells.l; x<=cells.r; x++){
+			for(int y=cells.b; y<=cells.t; y++){
+				for(uint32_t i = buckets[CellHash(x, y, level)&mask]; i != NULL_INDEX; i = bins[i].next){
+					Bin *bin = bins + i;
+					Entry *e = entries + bin->entry;
+					
+					if(
+						bin->x == x && bin->y == y && e->level == level && e->obj && e->obj != obj &&
+						FirstSharedCell(x, y, cells, e->cells) && cpBBIntersects(e->bb, bb)
+					){
+						func(obj, e->obj, 0, data);
+					}
+				}
+			}
+		}
+	}
+	
+	if(scan) ScanLevels(grid, scan, obj, bb, func, data);
+}
+
+static inline void
+SegmentQueryEntry(cpHGrid *grid, Entry *e, void *obj, cpVect a, cpVect b, cpFloat *t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	if(e->obj && e->stamp != grid->stamp){
+		e->stamp = grid->stamp;
+		if(cpBBSegmentQuery(e->bb, a, b) < *t_exit) *t_exit = cpfmin(*t_exit, func(obj, e->obj, data));
+	}
+}
+
+// Walk the cells of a level along the segment.
+// Modified from http://playtechs.blogspot.com/2007/03/raytracing-on-grid.html like cpSpaceHash.
+static void
+SegmentQueryLevel(cpHGrid *grid, int level, void *obj, cpVect a, cpVect b, cpFloat *t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	cpFloat inv = grid->inv[level];
+	cpVect ca = cpvmult(a, inv), cb = cpvmult(b, inv);
+	
+	int cell_x = CellCoord(ca.x, 1.0f), cell_y = CellCoord(ca.y, 1.0f);
+	
+	int x_inc, y_inc;
+	cpFloat temp_v, temp_h;
+	
+	if(cb.x > ca.x){
+		x_inc = 1;
+		temp_h = (cpffloor(ca.x + 1.0f) - ca.x);
+	} else {
+		x_inc = -1;
+		temp_h = (ca.x - cpffloor(ca.x));
+	}
+	
+	if(cb.y > ca.y){
+		y_inc = 1;
+		temp_v = (cpffloor(ca.y + 1.0f) - ca.y);
+	} else {
+		y_inc = -1;
+		temp_v = (ca.y - cpffloor(ca.y));
+	}
+	
+	cpFloat dx = cpfabs(cb.x - ca.x), dy = cpfabs(cb.y - ca.y);
+	cpFloat dt_dx = (dx ? 1.0f/dx : FLT_MAX), dt_dy = (dy ? 1.0f/dy : FLT_MAX);
+	
+	cpFloat next_h = (temp_h ? temp_h*dt_dx : dt_dx);
+	cpFloat next_v = (temp_v ? temp_v*dt_dy : dt_dy);
+	
+	Entry *entries = grid->entries;
+	Bin *bins = grid->bins;
+	uint32_t *buckets = grid->buckets;
+	uint32_t mask = grid->bucketMask;
+	
+	cpFloat t = 0.0f;
+	while(t < *t_exit){
+		for(uint32_t i = buckets[CellHash(cell_x, cell_y, level)&mask]; i != NULL_INDEX; i = bins[i].next){
+			Bin *bin = bins + i;
+			Entry *e = entries + bin->entry;
+			
+			if(bin->x == cell_x && bin->y == cell_y && e->level == level){
+				SegmentQueryEntry(grid, e, obj, a, b, t_exit, func, data);
+			}
+		}
+		
+		if(next_v < next_h){
+			cell_y += y_inc;
+			t = next_v;
+			next_v += dt_dy;
+		} else {
+			cell_x += x_inc;
+			t = next_h;
+			next_h += dt_dx;
+		}
+	}
+}
+
+static void
+cpHGridSegmentQuery(cpHGrid *grid, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	uint32_t scan = 0;
+	uint32_t levels = grid->levels;
+	for(int level = NextLevel(levels, 0); level < MAX_LEVELS; level = NextLevel(levels, level + 1)){
+		cpFloat inv = grid->inv[level];
+		
+		// Walking the cells only pays off if the segment crosses fewer of them than there are objects.
+		cpFloat limit = CELL_LIMIT/inv;
+		cpBool inside = (cpfabs(a.x) < limit && cpfabs(a.y) < limit && cpfabs(b.x) < limit && cpfabs(b.y) < limit);
+		cpFloat crossed = (cpfabs(b.x - a.x) + cpfabs(b.y - a.y))*inv + 2.0f;
+		
+		if(inside && crossed <= grid->entryCount){
+			SegmentQueryLevel(grid, level, obj, a, b, &t_exit, func, data);
+		} else {
+			scan |= (1u << level);
+		}
+	}
+	
+	if(scan){
+		Entry *entries = grid->entries;
+		for(uint32_t i=0, count=grid->entryCount; i<count; i++){
+			Entry *e = entries + i;
+			if(scan & (1u << e->level)) SegmentQueryEntry(grid, e, obj, a, b, &t_exit, func, data);
+		}
+	}
+	
+	grid->stamp++;
+}
+
+//MARK: Reindex
+
+static void
+cpHGridReindex(cpHGrid *grid)
+{
+	cpSpatialIndexBBFunc bbfunc = grid->spatialIndex.bbfunc;
+	
+	Entry *entries = grid->entries;
+	for(uint32_t i=0; i<grid->entryCount; i++){
+		if(entries[i].obj) entries[i].bb = bbfunc(entries[i].obj);
+	}
+	
+	BinsRebuild(grid);
+}
+
+static void
+cpHGridReindexObject(cpHGrid *grid, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(grid, obj, hashid);
+	if(slot == CP_OBJ_TABLE_EMPTY) return;
+	
+	cpBB bb = grid->spatialIndex.bbfunc(obj);
+	cpBB old = grid->entries[grid->table.slots[slot].index].bb;
+	
+	if(bb.l != old.l || bb.b != old.b || bb.r != old.r || bb.t != old.t){
+		cpHGridRemove(grid, obj, hashid);
+		cpHGridInsert(grid, obj, hashid);
+	}
+}
+
+static void
+cpHGridReindexQuery(cpHGrid *grid, cpSpatialIndexQueryFunc func, void *data)
+{
+	cpHGridReindex(grid);
+	
+	Entry *entries = grid->entries;
+	Bin *bins = grid->bins;
+	uint32_t *buckets = grid->buckets;
+	uint32_t mask = grid->bucketMask;
+	uint32_t levels = grid->levels;
+	
+	for(uint32_t i=0, count=grid->entryCount; i<count; i++){
+		Entry *a = entries + i;
+		
+		// Look for pairs on the entry's own level and all of the coarser ones.
+		// Pairs on the same level are reported by the entry with the lower index.
+		for(int level = a->level; level < MAX_LEVELS; level = NextLevel(levels, level + 1)){
+			Cells cells = (level == a->level ? a->cells : CellsForBB(a->bb, grid->inv[level]));
+			
+			for(int x=cells.l; x<=cells.r; x++){
+				for(int y=cells.b; y<=cells.t; y++){
+					for(uint32_t j = buckets[CellHash(x, y, level)&mask]; j != NULL_INDEX; j = bins[j].next){
+						Bin *bin = bins + j;
+						Entry *b = entries + bin->entry;
+						
+						if(
+							bin->x == x && bin->y == y && b->level == level && (level != a->level || bin->entry > i) &&
+							FirstSharedCell(x, y, cells, b->cells) && cpBBIntersects(a->bb, b->bb)
+						){
+							func(a->obj, b->obj, 0, data);
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	cpSpatialIndexCollideStatic((cpSpatialIndex *)grid, grid->spatialIndex.staticIndex, func, data);
+}
+
+//MARK: Misc
+
+static int
+cpHGridCount(cpHGrid *grid)
+{
+	return (int)grid->liveCount;
+}
+
+static void
+cpHGridEach(cpHGrid *grid, cpSpatialIndexIteratorFunc func, void *data)
+{
+	Entry *entries = grid->entries;
+	for(uint32_t i=0, count=grid->entryCount; i<count; i++){
+		void *obj = entries[i].obj;
+		if(obj) func(obj, data);
+	}
+}
+
+static cpSpatialIndexClass klass = {
+	(cpSpatialIndexDestroyImpl)cpHGridDestroy,
+	
+	(cpSpatialIndexCountImpl)cpHGridCount,
+	(cpSpatialIndexEachImpl)cpHGridEach,
+	
+	(cpSpatialIndexContainsImpl)cpHGridContains,
+	(cpSpatialIndexInsertImpl)cpHGridInsert,
+	(cpSpatialIndexRemoveImpl)cpHGridRemove,
+	
+	(cpSpatialIndexReindexImpl)cpHGridReindex,
+	(cpSpatialIndexReindexObjectImpl)cpHGridReindexObject,
+	(cpSpatialIndexReindexQueryImpl)cpHGridReindexQuery,
+	
+	(cpSpatialIndexQueryImpl)cpHGridQuery,
+	(cpSpatialIndexSegmentQueryImpl)cpHGridSegmentQuery,
+	
+	NULL,
+};
+
+static inline cpSpatialIndexClass *Klass(){return &klass;}
@@ -85,10 +85,8 @@ setIsFull(cpHashSet *set)
 }
 
 static void
-cpHashSetResize(cpHashSet *set)
+cpHashSetResize(cpHashSet *set, unsigned int newSize)
 {
-	// Get the next approximate doubled prime.
-	unsigned int newSize = next_prime(set->size + 1);
 	// Allocate a new table.
 	cpHashSetBin **newTable = (cpHashSetBin **)cpcalloc(newSize, sizeof(cpHashSetBin *));
 	
@@ -149,6 +147,13 @@ cpHashSetCount(cpHashSet *set)
 	return set->entries;
 }
 
+// Grow the table once up front so inserting count entries doesn't need to resize it again.
+void
+cpHashSetReserve(cpHashSet *set, int count)
+{
+	if((unsigned int)count > set->size) cpHashSetResize(set, next_prime(count));
+}
+
 const void *
 cpHashSetInsert(cpHashSet *set, cpHashValue hash, const void *ptr, cpHashSetTransFunc trans, void *data)
 {
@@ -169,7 +174,8 @@ cpHashSetInsert(cpHashSet *set, cpHashValue hash, const void *ptr, cpHashSetTran
 		set->table[idx] = bin;
 		
 		set->entries++;
-		if(setIsFull(set)) cpHashSetResize(set);
+		// Resize to the next approximate doubled prime.
+		if(setIsFull(set)) cpHashSetResize(set, next_prime(set->size + 1));
 	}
 	
 	return bin->elt;
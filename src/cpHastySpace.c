@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 //TODO: Move all the thread stuff to another file
 
@@ -14,8 +15,11 @@
 
 #ifndef _WIN32
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #elif defined(__MINGW32__)
 #include <pthread.h>
+#include <windows.h>
 #else
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
@@ -362,15 +366,19 @@ cpArbiterApplyImpulse_NEON(cpArbiter *arb)
 		v_b = vadd(v_b, vmul_n(j, b->m_inv));
 		
 		// TODO would moving these earlier help pipeline them better?
-		vst((cpFloat_t *)&a->v_bias, vBias_a);
-		vst((cpFloat_t *)&b->v_bias, vBias_b);
-		vst_lane((cpFloat_t *)&a->w_bias, wBias, 0);
-		vst_lane((cpFloat_t *)&b->w_bias, wBias, 1);
+		if(!body_is_fixed(a)){
+			vst((cpFloat_t *)&a->v_bias, vBias_a);
+			vst_lane((cpFloat_t *)&a->w_bias, wBias, 0);
+			vst((cpFloat_t *)&a->v, v_a);
+			vst_lane((cpFloat_t *)&a->w, w, 0);
+		}
 		
-		vst((cpFloat_t *)&a->v, v_a);
-		vst((cpFloat_t *)&b->v, v_b);
-		vst_lane((cpFloat_t *)&a->w, w, 0);
-		vst_lane((cpFloat_t *)&b->w, w, 1);
+		if(!body_is_fixed(b)){
+			vst((cpFloat_t *)&b->v_bias, vBias_b);
+			vst_lane((cpFloat_t *)&b->w_bias, wBias, 1);
+			vst((cpFloat_t *)&b->v, v_b);
+			vst_lane((cpFloat_t *)&b->w, w, 1);
+		}
 		
 		vst_lane((cpFloat_t *)&con->jBias, jbn_jn, 0);
 		vst_lane((cpFloat_t *)&con->jnAcc, jbn_jn, 1);
@@ -382,9 +390,54 @@ cpArbiterApplyImpulse_NEON(cpArbiter *arb)
 
 //MARK: PThreads
 
-// Right now using more than 2 threads probably wont help your performance any.
-// If you are using a ridiculous number of iterations it could help though.
-#define MAX_THREADS 2
+// Graph coloring keeps the solver race free, so more threads scale with the number of constraints.
+#define MAX_THREADS 32
+
+//MARK: Atomics
+
+#ifdef _MSC_VER
+	static inline unsigned long AtomicIncrement(volatile unsigned long *ptr){return (unsigned long)InterlockedIncrement((volatile LONG *)ptr);}
+	static inline unsigned long AtomicDecrement(volatile unsigned long *ptr){return (unsigned long)InterlockedDecrement((volatile LONG *)ptr);}
+	static inline unsigned long AtomicLoad(volatile unsigned long *ptr){return (unsigned long)InterlockedCompareExchange((volatile LONG *)ptr, 0, 0);}
+	static inline void AtomicStore(volatile unsigned long *ptr, unsigned long value){InterlockedExchange((volatile LONG *)ptr, (LONG)value);}
+	static inline cpBool AtomicCompareExchange(volatile unsigned long *ptr, unsigned long expected, unsigned long desired){
+		return (InterlockedCompareExchange((volatile LONG *)ptr, (LONG)desired, (LONG)expected) == (LONG)expected);
+	}
+	static inline void AtomicFence(void){MemoryBarrier();}
+	static inline void CPUPause(void){YieldProcessor();}
+	static inline void ThreadYield(void){SwitchToThread();}
+#else
+	static inline unsigned long AtomicIncrement(volatile unsigned long *ptr){return __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST);}
+	static inline unsigned long AtomicDecrement(volatile unsigned long *ptr){return __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST);}
+	static inline unsigned long AtomicLoad(volatile unsigned long *ptr){return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);}
+	static inline void AtomicStore(volatile unsigned long *ptr, unsigned long value){__atomic_store_n(ptr, value, __ATOMIC_RELEASE);}
+	static inline cpBool AtomicCompareExchange(volatile unsigned long *ptr, unsigned long expected, unsigned long desired){
+		return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
+	static inline void AtomicFence(void){__atomic_thread_fence(__ATOMIC_SEQ_CST);}
+	
+	static inline void CPUPause(void){
+	#if defined(__i386__) || defined(__x86_64__)
+		__asm__ __volatile__("pause");
+	#elif defined(__aarch64__) || defined(__arm__)
+		__asm__ __volatile__("yield");
+	#endif
+	}
+	
+	#ifdef _WIN32
+		static inline void ThreadYield(void){SwitchToThread();}
+	#else
+		static inline void ThreadYield(void){sched_yield();}
+	#endif
+#endif
+
+//MARK: Job System
+
+// Number of times an idle thread spins looking for work before it parks (or yields when waiting on a job).
+#define SPIN_COUNT 100
+
+// Number of jobs each thread's queue can hold. Jobs that don't fit are run immediately instead.
+#define JOB_QUEUE_SIZE 256
 
 struct ThreadContext {
 	pthread_t thread;
@@ -392,7 +445,42 @@ struct ThreadContext {
 	unsigned long thread_num;
 };
 
-typedef	void (*cpHastySpaceWorkFunction)(cpSpace *space, unsigned long worker, unsigned long worker_count);
+struct Job {
+	cpHastySpaceTaskFunc func;
+	cpHastySpaceJobFunc user_func;
+	void *data;
+	
+	// Range jobs are split in half until they are smaller than the grain size.
+	unsigned long start, end, grain;
+	
+	// Decremented when the job finishes.
+	volatile unsigned long *pending;
+};
+
+// Chase-Lev work stealing deque.
+// The owning thread pushes and pops jobs at the bottom, other threads steal from the top.
+struct JobQueue {
+	volatile unsigned long top, bottom;
+	struct Job jobs[JOB_QUEUE_SIZE];
+};
+
+// Number of colors to split the solver batches into before falling back to a serial batch.
+#define SOLVER_COLORS 32
+
+// Broadphase pair waiting for the parallel narrow-phase.
+struct QueuedCollision {
+	struct cpCollisionInfo info;
+	cpArbiter *arb;
+	struct cpSeparatingAxis *axis;
+	cpBool culled;
+};
+
+// Contact buffer ring owned by a single worker.
+// Each worker writes contacts into its own ring so the narrow-phase doesn't need any locking.
+struct WorkerContacts {
+	cpContactBufferHeader *head;
+	cpArray *allocatedBuffers;
+};
 
 struct cpHastySpace {
 	cpSpace space;
@@ -400,98 +488,975 @@ struct cpHastySpace {
 	// Number of worker threads (including the main thread)
 	unsigned long num_threads;
 	
-	// Number of worker threads currently executing. (also including the main thread)
-	unsigned long num_working;
+	// Task system used to run the parallel phases. Defaults to the built-in worker threads.
+	cpHastySpaceTaskBackend backend;
+	
+	// Minimum number of items processed by a single job.
+	unsigned long grain_size;
 	
-	// Number of constraints (plus contacts) that must exist per step to start the worker threads.
+	// Number of constraints (plus contacts) that must exist per step to run the solver on the worker threads.
 	unsigned long constraint_count_threshold;
 	
-	pthread_mutex_t mutex;
-	pthread_cond_t cond_work, cond_resume;
+	// Broadphase pairs queued for the parallel narrow-phase in the order they were found.
+	int collision_count, collision_capacity;
+	struct QueuedCollision *collisions;
+	
+	// One contact ring per backend worker.
+	unsigned long contact_ring_count;
+	struct WorkerContacts *contacts;
+	
+	// Step stats for the tasks run by each backend worker. Allocated alongside the contact rings.
+	cpSpaceStepStats *worker_stats;
 	
-	// Work function to invoke.
-	cpHastySpaceWorkFunction work;
+	// Solver batches sorted by color. Items in the same color never share a dynamic body.
+	// Color c spans [offsets[c], offsets[c + 1]), the last color holds items that didn't fit in any other color.
+	int arbiter_offsets[SOLVER_COLORS + 2], constraint_offsets[SOLVER_COLORS + 2];
+	int batch_capacity;
+	cpArbiter **batch_arbiters;
+	cpConstraint **batch_constraints;
+	unsigned char *batch_colors;
+	
+	// Batch currently being solved.
+	int solver_color;
+	cpBool solver_warm_start;
+	
+	// SIMD contact solver for the current step, NULL when using the scalar solver.
+	struct cpContactSolver *contact_solver;
+	int contact_group_offset;
+	
+	// Step parameters shared with the workers.
+	cpFloat dt_coef, slop, bias_coef, damping;
+	cpVect gravity;
+	
+	// Always use the parallel code paths, even with a single thread, so results don't depend on the thread count.
+	cpBool deterministic;
+	
+	// Prestep, integrate and solve each island as a separate task.
+	// Task t spans the islands [island_tasks[t], island_tasks[t + 1]).
+	cpBool island_stepping;
+	int island_task_count, island_task_capacity;
+	int *island_tasks;
+	
+	// One job queue per thread. The thread that steps the space owns the first one.
+	struct JobQueue *queues;
+	
+	// Number of unfinished jobs started by the built-in backend's parallel-for.
+	volatile unsigned long task_pending;
+	
+	// Number of unfinished jobs submitted with cpHastySpaceSubmitJob().
+	volatile unsigned long user_pending;
+	
+	// Worker threads exit when this is cleared.
+	volatile unsigned long running;
+	
+	// Idle workers park on cond_work after spinning for a while.
+	volatile unsigned long parked;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_work;
 	
 	struct ThreadContext workers[MAX_THREADS - 1];
 };
 
-static void *
-WorkerThreadLoop(struct ThreadContext *context)
+static cpBool
+JobQueuePush(struct JobQueue *queue, struct Job *job)
 {
-	cpHastySpace *hasty = context->space;
+	unsigned long bottom = AtomicLoad(&queue->bottom);
+	unsigned long top = AtomicLoad(&queue->top);
+	if((long)(bottom - top) >= JOB_QUEUE_SIZE) return cpFalse;
+	
+	queue->jobs[bottom%JOB_QUEUE_SIZE] = *job;
+	AtomicStore(&queue->bottom, bottom + 1);
+	return cpTrue;
+}
+
+static cpBool
+JobQueuePop(struct JobQueue *queue, struct Job *job)
+{
+	unsigned long bottom = AtomicLoad(&queue->bottom) - 1;
+	AtomicStore(&queue->bottom, bottom);
+	AtomicFence();
+	unsigned long top = AtomicLoad(&queue->top);
+	
+	long size = (long)(bottom - top);
+	if(size < 0){
+		// Queue was empty.
+		AtomicStore(&queue->bottom, bottom + 1);
+		return cpFalse;
+	}
+	
+	*job = queue->jobs[bottom%JOB_QUEUE_SIZE];
+	if(size > 0) return cpTrue;
+	
+	// Taking the last job, race the thieves for it.
+	cpBool taken = AtomicCompareExchange(&queue->top, top, top + 1);
+	AtomicStore(&queue->bottom, bottom + 1);
+	return taken;
+}
+
+static cpBool
+JobQueueSteal(struct JobQueue *queue, struct Job *job)
+{
+	unsigned long top = AtomicLoad(&queue->top);
+	AtomicFence();
+	unsigned long bottom = AtomicLoad(&queue->bottom);
+	if((long)(bottom - top) <= 0) return cpFalse;
+	
+	// The copy is discarded if another thread took the job first.
+	*job = queue->jobs[top%JOB_QUEUE_SIZE];
+	return AtomicCompareExchange(&queue->top, top, top + 1);
+}
+
+static cpBool
+HasJobs(cpHastySpace *hasty)
+{
+	for(unsigned long i=0; i<hasty->num_threads; i++){
+		struct JobQueue *queue = hasty->queues + i;
+		if((long)(AtomicLoad(&queue->bottom) - AtomicLoad(&queue->top)) > 0) return cpTrue;
+	}
 	
-	unsigned long thread = context->thread_num;
-	unsigned long num_threads = hasty->num_threads;
+	return cpFalse;
+}
+
+// Pop a job from the worker's own queue, or steal one from another thread.
+static cpBool
+FindJob(cpHastySpace *hasty, unsigned long worker, struct Job *job)
+{
+	if(JobQueuePop(hasty->queues + worker, job)) return cpTrue;
+	
+	unsigned long count = hasty->num_threads;
+	for(unsigned long i=1; i<count; i++){
+		if(JobQueueSteal(hasty->queues + (worker + i)%count, job)) return cpTrue;
+	}
+	
+	return cpFalse;
+}
+
+static void
+WakeWorkers(cpHastySpace *hasty)
+{
+	// Pairs with the increment in ParkWorker() so either the job is seen or the worker is woken.
+	AtomicFence();
 	
-	for(;;){
+	if(AtomicLoad(&hasty->parked) > 0){
 		pthread_mutex_lock(&hasty->mutex); {
-			if(--hasty->num_working == 0){
-				pthread_cond_signal(&hasty->cond_resume);
+			pthread_cond_broadcast(&hasty->cond_work);
+		} pthread_mutex_unlock(&hasty->mutex);
+	}
+}
+
+static void
+ParkWorker(cpHastySpace *hasty)
+{
+	pthread_mutex_lock(&hasty->mutex); {
+		AtomicIncrement(&hasty->parked);
+		
+		// Check again now that WakeWorkers() is guaranteed to see this thread as parked.
+		if(AtomicLoad(&hasty->running) && !HasJobs(hasty)){
+			pthread_cond_wait(&hasty->cond_work, &hasty->mutex);
+		}
+		
+		AtomicDecrement(&hasty->parked);
+	} pthread_mutex_unlock(&hasty->mutex);
+}
+
+static void
+RunJob(cpHastySpace *hasty, struct Job *job, unsigned long worker)
+{
+	if(job->user_func){
+		job->user_func(job->data);
+	} else {
+		// Split off the upper half of the range until it's small enough, leaving it for other threads to steal.
+		while(job->end - job->start > job->grain){
+			struct Job half = *job;
+			half.start = job->start + (job->end - job->start)/2;
+			
+			AtomicIncrement(job->pending);
+			if(!JobQueuePush(hasty->queues + worker, &half)){
+				AtomicDecrement(job->pending);
+				break;
 			}
 			
-			pthread_cond_wait(&hasty->cond_work, &hasty->mutex);
-		} pthread_mutex_unlock(&hasty->mutex);
+			WakeWorkers(hasty);
+			job->end = half.start;
+		}
 		
-		cpHastySpaceWorkFunction func = hasty->work;
-		if(func){
-			hasty->work(&hasty->space, thread, num_threads);
+		job->func(job->data, job->start, job->end, worker);
+	}
+	
+	AtomicDecrement(job->pending);
+}
+
+static void *
+WorkerThreadLoop(struct ThreadContext *context)
+{
+	cpHastySpace *hasty = context->space;
+	unsigned long worker = context->thread_num;
+	
+	for(int spin=0; AtomicLoad(&hasty->running);){
+		struct Job job;
+		if(FindJob(hasty, worker, &job)){
+			RunJob(hasty, &job, worker);
+			spin = 0;
+		} else if(++spin < SPIN_COUNT){
+			CPUPause();
 		} else {
-			break;
+			ParkWorker(hasty);
+			spin = 0;
 		}
 	}
 	
 	return NULL;
 }
 
+// Help run jobs on the calling thread until the pending count reaches zero.
+static void
+WaitForJobs(cpHastySpace *hasty, volatile unsigned long *pending)
+{
+	for(int spin=0; AtomicLoad(pending) > 0;){
+		struct Job job;
+		if(FindJob(hasty, 0, &job)){
+			RunJob(hasty, &job, 0);
+			spin = 0;
+		} else if(++spin < SPIN_COUNT){
+			CPUPause();
+		} else {
+			ThreadYield();
+		}
+	}
+}
+
+//MARK: Task Backends
+
+// Built-in backend's parallel-for. The calling thread starts on the job immediately.
+static void
+ThreadParallelFor(cpHastySpace *hasty, unsigned long count, unsigned long grain, cpHastySpaceTaskFunc func, void *data)
+{
+	if(hasty->num_threads == 1 || count <= grain){
+		func(data, 0, count, 0);
+	} else {
+		AtomicIncrement(&hasty->task_pending);
+		struct Job job = {func, NULL, data, 0, count, grain, &hasty->task_pending};
+		RunJob(hasty, &job, 0);
+	}
+}
+
+static void
+ThreadWait(cpHastySpace *hasty)
+{
+	WaitForJobs(hasty, &hasty->task_pending);
+}
+
+// Serial backend's parallel-for. Runs the range one grain sized chunk at a time on the calling thread.
+static void
+SerialParallelFor(void *context, unsigned long count, unsigned long grain, cpHastySpaceTaskFunc func, void *data)
+{
+	for(unsigned long start=0; start<count; start+=grain){
+		func(data, start, (count - start > grain ? start + grain : count), 0);
+	}
+}
+
+static void SerialWait(void *context){}
+
+static inline cpBool
+IsThreadBackend(cpHastySpace *hasty)
+{
+	return (hasty->backend.parallelFor == (cpHastySpaceParallelForFunc)ThreadParallelFor);
+}
+
+// Returns true if the parallel code paths should be used.
+// An external backend or deterministic mode always uses them, even with only a single worker.
+// The work done by the parallel code paths is partitioned and ordered the same way regardless of the number of workers.
+static inline cpBool
+UseTasks(cpHastySpace *hasty)
+{
+	return (hasty->deterministic || !IsThreadBackend(hasty) || hasty->num_threads > 1);
+}
+
+// Run func over the range [0, count) using the task backend and wait for it to finish.
+// Must be called from the thread that steps the space.
 static void
-RunWorkers(cpHastySpace *hasty, cpHastySpaceWorkFunction func)
+ParallelFor(cpHastySpace *hasty, unsigned long count, unsigned long grain, cpHastySpaceTaskFunc func)
 {
-	hasty->num_working = hasty->num_threads - 1;
-	hasty->work = func;
+	if(count == 0) return;
 	
-	if(hasty->num_working > 0){
-		pthread_mutex_lock(&hasty->mutex); {
-			pthread_cond_broadcast(&hasty->cond_work);
-		} pthread_mutex_unlock(&hasty->mutex);
+	cpHastySpaceTaskBackend *backend = &hasty->backend;
+	backend->parallelFor(backend->context, count, (grain > 0 ? grain : 1), func, hasty);
+	backend->wait(backend->context);
+}
+
+// Parallel-for with an arbitrary data pointer for the spatial index.
+static void
+IndexParallelFor(cpHastySpace *hasty, unsigned long count, unsigned long grain, cpSpatialIndexTaskFunc func, void *data)
+{
+	if(count == 0) return;
+	
+	cpHastySpaceTaskBackend *backend = &hasty->backend;
+	backend->parallelFor(backend->context, count, (grain > 0 ? grain : 1), (cpHastySpaceTaskFunc)func, data);
+	backend->wait(backend->context);
+}
+
+//MARK: Solver
+
+static inline void
+ArbiterApplyImpulse(cpArbiter *arb)
+{
+	#ifdef __ARM_NEON__
+		cpArbiterApplyImpulse_NEON(arb);
+	#else
+		cpArbiterApplyImpulse(arb);
+	#endif
+}
+
+// Only dynamic bodies need to be colored.
+// The solver never writes to static and kinematic bodies, so any number of items in a batch can share them.
+static inline uint32_t
+BodyColors(cpBody *body)
+{
+	return (cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC ? body->solver.colors : 0);
+}
+
+static inline void
+BodyAddColor(cpBody *body, int color)
+{
+	if(cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC) body->solver.colors |= (uint32_t)1 << color;
+}
+
+static inline int
+PickColor(cpBody *a, cpBody *b)
+{
+	uint32_t used = BodyColors(a) | BodyColors(b);
+	
+	for(int color=0; color<SOLVER_COLORS; color++){
+		if(!(used & ((uint32_t)1 << color))){
+			BodyAddColor(a, color);
+			BodyAddColor(b, color);
+			return color;
+		}
+	}
+	
+	// Out of colors, this item will be solved serially.
+	return SOLVER_COLORS;
+}
+
+// Greedily color the arbiters and constraints and sort them into solver batches.
+// The coloring only depends on the order of the arbiter and constraint arrays so it's deterministic.
+// The arbiters are left out when they are batched by the SIMD contact solver instead.
+static void
+ColorSolverBatches(cpHastySpace *hasty, cpBool colorArbiters)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	cpArray *arbiters = space->arbiters;
+	cpArray *constraints = space->constraints;
+	int arbiter_count = (colorArbiters ? arbiters->num : 0);
+	
+	int count = arbiter_count + constraints->num;
+	if(count > hasty->batch_capacity){
+		hasty->batch_capacity = count;
+		hasty->batch_arbiters = (cpArbiter **)cprealloc(hasty->batch_arbiters, count*sizeof(cpArbiter *));
+		hasty->batch_constraints = (cpConstraint **)cprealloc(hasty->batch_constraints, count*sizeof(cpConstraint *));
+		hasty->batch_colors = (unsigned char *)cprealloc(hasty->batch_colors, count*sizeof(unsigned char));
+	}
+	
+	// Clear the colors on every body that might be touched.
+	for(int i=0; i<arbiter_count; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		arb->body_a->solver.colors = arb->body_b->solver.colors = 0;
+	}
+	
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		constraint->a->solver.colors = constraint->b->solver.colors = 0;
+	}
+	
+	int *arbiter_offsets = hasty->arbiter_offsets;
+	int *constraint_offsets = hasty->constraint_offsets;
+	memset(arbiter_offsets, 0, sizeof(hasty->arbiter_offsets));
+	memset(constraint_offsets, 0, sizeof(hasty->constraint_offsets));
+	
+	// Pick colors and count the batch sizes.
+	unsigned char *colors = hasty->batch_colors;
+	for(int i=0; i<arbiter_count; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		int color = colors[i] = PickColor(arb->body_a, arb->body_b);
+		arbiter_offsets[color + 1]++;
+	}
+	
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		int color = colors[arbiter_count + i] = PickColor(constraint->a, constraint->b);
+		constraint_offsets[color + 1]++;
+	}
+	
+	// Convert the counts to offsets and sort the items into the batches.
+	int arbiter_cursor[SOLVER_COLORS + 1], constraint_cursor[SOLVER_COLORS + 1];
+	for(int color=0; color<=SOLVER_COLORS; color++){
+		arbiter_offsets[color + 1] += arbiter_offsets[color];
+		constraint_offsets[color + 1] += constraint_offsets[color];
+		arbiter_cursor[color] = arbiter_offsets[color];
+		constraint_cursor[color] = constraint_offsets[color];
+	}
+	
+	for(int i=0; i<arbiter_count; i++){
+		hasty->batch_arbiters[arbiter_cursor[colors[i]]++] = (cpArbiter *)arbiters->arr[i];
+	}
+	
+	for(int i=0; i<constraints->num; i++){
+		hasty->batch_constraints[constraint_cursor[colors[arbiter_count + i]]++] = (cpConstraint *)constraints->arr[i];
+	}
+}
+
+
+// Solve part of the current color batch. Arbiters come first in the range, followed by the constraints.
+static void
+SolveBatch(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpFloat dt = hasty->space.curr_dt;
+	cpFloat dt_coef = hasty->dt_coef;
+	cpBool warmStart = hasty->solver_warm_start;
+	int color = hasty->solver_color;
+	
+	unsigned long arbiter_start = hasty->arbiter_offsets[color];
+	unsigned long arbiter_count = hasty->arbiter_offsets[color + 1] - arbiter_start;
+	cpArbiter **arbiters = hasty->batch_arbiters + arbiter_start;
+	cpConstraint **constraints = hasty->batch_constraints + hasty->constraint_offsets[color];
+	
+	CP_STATS_START(timer);
+	for(unsigned long i=start; i<end; i++){
+		if(i < arbiter_count){
+			if(warmStart){
+				cpArbiterApplyCachedImpulse(arbiters[i], dt_coef);
+			} else {
+				ArbiterApplyImpulse(arbiters[i]);
+			}
+		} else {
+			cpConstraint *constraint = constraints[i - arbiter_count];
+			if(warmStart){
+				constraint->klass->applyCachedImpulse(constraint, dt_coef);
+			} else {
+				constraint->klass->applyImpulse(constraint, dt);
+			}
+		}
+	}
+	
+	if(warmStart){
+		CP_STATS_LAP(timer, hasty->worker_stats + worker, warmStart);
+	} else {
+		CP_STATS_LAP(timer, hasty->worker_stats + worker, solve);
+	}
+}
+
+static void
+SolveColors(cpHastySpace *hasty)
+{
+	for(int color=0; color<=SOLVER_COLORS; color++){
+		unsigned long count = (
+			(hasty->arbiter_offsets[color + 1] - hasty->arbiter_offsets[color]) +
+			(hasty->constraint_offsets[color + 1] - hasty->constraint_offsets[color])
+		);
 		
-		func((cpSpace *)hasty, 0, hasty->num_threads);
+		hasty->solver_color = color;
+		if(color < SOLVER_COLORS){
+			ParallelFor(hasty, count, hasty->grain_size, SolveBatch);
+		} else {
+			// The overflow batch can't be split up.
+			SolveBatch(hasty, 0, count, 0);
+		}
+	}
+}
+
+// Apply the cached impulses and run the impulse solver one color batch at a time.
+static void
+Solver(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	
+	CP_STATS_START(timer);
+	for(int i=-1; i<space->iterations; i++){
+		hasty->solver_warm_start = (i < 0);
+		SolveColors(hasty);
+		
+		if(i < 0){
+			CP_STATS_LAP(timer, &space->stepStats, warmStart);
+		} else {
+			CP_STATS_LAP(timer, &space->stepStats, solve);
+		}
+	}
+}
+
+// Solve part of the current color's SIMD contact groups.
+static void
+SolveContactGroups(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	struct cpSolverBody *bodies = hasty->space.solverState;
+	int offset = hasty->contact_group_offset;
+	
+	CP_STATS_START(timer);
+	if(hasty->solver_warm_start){
+		cpContactSolverWarmStart(hasty->contact_solver, bodies, offset + start, offset + end, hasty->dt_coef);
+		CP_STATS_LAP(timer, hasty->worker_stats + worker, warmStart);
+	} else {
+		cpContactSolverApplyImpulse(hasty->contact_solver, bodies, offset + start, offset + end);
+		CP_STATS_LAP(timer, hasty->worker_stats + worker, solve);
+	}
+}
+
+// Same as Solver(), but the arbiters are solved by the SIMD contact solver using the space's solver body array.
+// The constraints are still solved in colored batches between syncing the body state.
+// Finishes the contact solver started with cpSpaceSolverBegin() when done.
+static void
+ContactSolver(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	struct cpContactSolver *contactSolver = hasty->contact_solver;
+	struct cpSolverBody *bodies = space->solverState;
+	cpArray *overflow = cpContactSolverGetOverflow(contactSolver);
+	int colors = cpContactSolverColorCount(contactSolver);
+	
+	// Each contact group holds several arbiters.
+	unsigned long grain = (hasty->grain_size + 3)/4;
+	
+	CP_STATS_START(timer);
+	for(int i=-1; i<space->iterations; i++){
+		cpBool warmStart = hasty->solver_warm_start = (i < 0);
+		
+		for(int color=0; color<colors; color++){
+			int start, end;
+			cpContactSolverGetColorGroups(contactSolver, color, &start, &end);
 			
-		pthread_mutex_lock(&hasty->mutex); {
-			if(hasty->num_working > 0){
-				pthread_cond_wait(&hasty->cond_resume, &hasty->mutex);
+			hasty->contact_group_offset = start;
+			ParallelFor(hasty, end - start, grain, SolveContactGroups);
+		}
+		
+		for(int j=0; j<overflow->num; j++){
+			cpArbiter *arb = (cpArbiter *)overflow->arr[j];
+			if(warmStart){
+				cpArbiterSolverApplyCachedImpulse(arb, bodies, hasty->dt_coef);
+			} else {
+				cpArbiterSolverApplyImpulse(arb, bodies);
 			}
-		} pthread_mutex_unlock(&hasty->mutex);
-	} else {
-		func((cpSpace *)hasty, 0, hasty->num_threads);
+		}
+		
+		cpSpaceScatterSolverBodies(space, space->solverSyncBodies);
+		SolveColors(hasty);
+		cpSpaceGatherSolverBodies(space, space->solverSyncBodies);
+		
+		if(warmStart){
+			CP_STATS_LAP(timer, &space->stepStats, warmStart);
+		} else {
+			CP_STATS_LAP(timer, &space->stepStats, solve);
+		}
 	}
 	
-	hasty->work = NULL;
+	cpSpaceSolverEnd(space, contactSolver);
+	CP_STATS_LAP(timer, &space->stepStats, solve);
 }
 
+//MARK: Island Stepping
+
+// Prestep, integrate and solve a single island.
+// Islands don't share any dynamic bodies, so they can be stepped independently in any order.
 static void
-Solver(cpSpace *space, unsigned long worker, unsigned long worker_count)
+StepIsland(cpHastySpace *hasty, struct cpIsland *island)
 {
-	cpArray *constraints = space->constraints;
-	cpArray *arbiters = space->arbiters;
+	cpSpace *space = (cpSpace *)hasty;
+	cpFloat dt = space->curr_dt;
+	
+	cpArbiter **arbiters = (cpArbiter **)space->islandArbiters->arr + island->arbiterStart;
+	cpConstraint **constraints = (cpConstraint **)space->islandConstraints->arr + island->constraintStart;
+	cpBody **bodies = (cpBody **)space->islandBodies->arr + island->bodyStart;
+	int arbiter_count = island->arbiterCount, constraint_count = island->constraintCount;
+	
+	for(int i=0; i<arbiter_count; i++) cpArbiterPreStep(arbiters[i], dt, hasty->slop, hasty->bias_coef);
+	for(int i=0; i<constraint_count; i++) constraints[i]->klass->preStep(constraints[i], dt);
+	
+	for(int i=0; i<island->bodyCount; i++){
+		cpBody *body = bodies[i];
+		body->velocity_func(body, hasty->gravity, hasty->damping, dt);
+	}
 	
+	for(int i=0; i<arbiter_count; i++) cpArbiterApplyCachedImpulse(arbiters[i], hasty->dt_coef);
+	for(int i=0; i<constraint_count; i++) constraints[i]->klass->applyCachedImpulse(constraints[i], hasty->dt_coef);
+	
+	for(int i=0; i<space->iterations; i++){
+		for(int j=0; j<arbiter_count; j++) ArbiterApplyImpulse(arbiters[j]);
+		for(int j=0; j<constraint_count; j++) constraints[j]->klass->applyImpulse(constraints[j], dt);
+	}
+}
+
+static void
+IslandSolver(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	
+	CP_STATS_START(timer);
+	for(unsigned long task=start; task<end; task++){
+		for(int i=hasty->island_tasks[task]; i<hasty->island_tasks[task + 1]; i++){
+			StepIsland(hasty, hasty->space.islands + i);
+		}
+	}
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, solve);
+}
+
+// Batch consecutive small islands together so each task has at least grain_size items to work on.
+static void
+BatchIslands(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	
+	if(space->islandCount + 1 > hasty->island_task_capacity){
+		hasty->island_task_capacity = space->islandCount + 1;
+		hasty->island_tasks = (int *)cprealloc(hasty->island_tasks, hasty->island_task_capacity*sizeof(int));
+	}
+	
+	int count = 0;
+	unsigned long batch = 0;
+	hasty->island_tasks[0] = 0;
+	
+	for(int i=0; i<space->islandCount; i++){
+		struct cpIsland *island = space->islands + i;
+		batch += island->bodyCount + island->arbiterCount + island->constraintCount;
+		
+		if(batch >= hasty->grain_size || i == space->islandCount - 1){
+			hasty->island_tasks[++count] = i + 1;
+			batch = 0;
+		}
+	}
+	
+	hasty->island_task_count = count;
+}
+
+static void
+SolveIslands(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
 	cpFloat dt = space->curr_dt;
-	unsigned long iterations = (space->iterations + worker_count - 1)/worker_count;
-	
-	for(unsigned long i=0; i<iterations; i++){
-		for(int j=0; j<arbiters->num; j++){
-			cpArbiter *arb = (cpArbiter *)arbiters->arr[j];
-			#ifdef __ARM_NEON__
-				cpArbiterApplyImpulse_NEON(arb);
-			#else
-				cpArbiterApplyImpulse(arb);
-			#endif
+	
+	// Kinematic bodies aren't part of any island, but still need their velocities updated.
+	cpArray *bodies = space->dynamicBodies;
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		if(cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC) body->velocity_func(body, hasty->gravity, hasty->damping, dt);
+	}
+	
+	// Tasks are already batched, so they are handed out one at a time.
+	BatchIslands(hasty);
+	ParallelFor(hasty, hasty->island_task_count, 1, IslandSolver);
+	
+	// Solve the leftover items that aren't part of an awake island.
+	struct cpIsland leftovers = {0, 0, 0, 0, 0, 0};
+	struct cpIsland *last = space->islands + (space->islandCount - 1);
+	leftovers.arbiterStart = last->arbiterStart + last->arbiterCount;
+	leftovers.arbiterCount = space->islandArbiters->num - leftovers.arbiterStart;
+	leftovers.constraintStart = last->constraintStart + last->constraintCount;
+	leftovers.constraintCount = space->islandConstraints->num - leftovers.constraintStart;
+	StepIsland(hasty, &leftovers);
+}
+
+//MARK: Integration
+
+static void
+IntegratePositions(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpBody **bodies = (cpBody **)hasty->space.dynamicBodies->arr;
+	cpFloat dt = hasty->space.curr_dt;
+	
+	CP_STATS_START(timer);
+	for(unsigned long i=start; i<end; i++){
+		cpBody *body = bodies[i];
+		if(body->bullet.enabled){
+			body->bullet.p = body->p;
+			body->bullet.a = body->a;
+		}
+		
+		body->position_func(body, dt);
+	}
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, integratePositions);
+}
+
+// Same as running cpShapeUpdateFunc() over the dynamic shapes index, but split up by body.
+static void
+UpdateBBs(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpBody **bodies = (cpBody **)hasty->space.dynamicBodies->arr;
+	
+	CP_STATS_START(timer);
+	for(unsigned long i=start; i<end; i++){
+		CP_BODY_FOREACH_SHAPE(bodies[i], shape) cpShapeCacheBB(shape);
+	}
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, updateBBs);
+}
+
+static void
+PreStepArbiters(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpArbiter **arbiters = (cpArbiter **)hasty->space.arbiters->arr;
+	cpFloat dt = hasty->space.curr_dt;
+	
+	CP_STATS_START(timer);
+	for(unsigned long i=start; i<end; i++){
+		cpArbiterPreStep(arbiters[i], dt, hasty->slop, hasty->bias_coef);
+	}
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, preStep);
+}
+
+static void
+IntegrateVelocities(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpBody **bodies = (cpBody **)hasty->space.dynamicBodies->arr;
+	cpFloat dt = hasty->space.curr_dt;
+	
+	CP_STATS_START(timer);
+	for(unsigned long i=start; i<end; i++){
+		cpBody *body = bodies[i];
+		body->velocity_func(body, hasty->gravity, hasty->damping, dt);
+	}
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, integrateVelocities);
+}
+
+//MARK: Parallel Narrow-Phase
+
+// Spatial index callback used instead of cpSpaceCollideShapes() when the narrow-phase runs on the worker threads.
+// It only records the pair, everything else is deferred to NarrowPhase() and MergeCollisions().
+static cpCollisionID
+QueueCollision(cpShape *a, cpShape *b, cpCollisionID id, cpHastySpace *hasty)
+{
+	if(hasty->collision_count == hasty->collision_capacity){
+		hasty->collision_capacity = (hasty->collision_capacity ? 2*hasty->collision_capacity : 256);
+		hasty->collisions = (struct QueuedCollision *)cprealloc(hasty->collisions, hasty->collision_capacity*sizeof(struct QueuedCollision));
+	}
+	
+	struct QueuedCollision *collision = hasty->collisions + hasty->collision_count++;
+	collision->info.a = a;
+	collision->info.b = b;
+	collision->info.id = id;
+	collision->info.count = 0;
+	collision->info.separation = 0.0f;
+	collision->arb = NULL;
+	collision->axis = NULL;
+	collision->culled = cpFalse;
+	
+	// The new collision id isn't known yet. Arbiters keep their own id for warm starting instead.
+	return id;
+}
+
+// Collide a worker's batched pairs and write their contacts to its ring.
+// Their arbiters are looked up later by MergeCollisions().
+static void
+CollideBatch(cpHastySpace *hasty, unsigned long worker, const struct cpBatchPair *pairs, const unsigned long *indexes, int count)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	struct WorkerContacts *ring = hasty->contacts + worker;
+	
+	struct cpBatchCollision results[CP_COLLISION_BATCH_SIZE];
+	cpCollideBatch(pairs, count, results);
+	
+	for(int i=0; i<count; i++){
+		struct QueuedCollision *collision = hasty->collisions + indexes[i];
+		struct cpContact *contacts = cpContactBufferRingGetArray(&ring->head, ring->allocatedBuffers, space->stamp, space->collisionPersistence);
+		collision->info = cpCollisionInfoForBatch(pairs + i, results + i, contacts);
+		
+		CP_STATS_COUNT(hasty->worker_stats + worker, contactsCreated, collision->info.count);
+		if(collision->info.count > 0) cpContactBufferRingPushContacts(ring->head, collision->info.count);
+	}
+}
+
+static void
+NarrowPhase(void *data, unsigned long start, unsigned long end, unsigned long worker)
+{
+	cpHastySpace *hasty = (cpHastySpace *)data;
+	cpSpace *space = (cpSpace *)hasty;
+	struct WorkerContacts *ring = hasty->contacts + worker;
+	
+	CP_STATS_START(timer);
+	CP_STATS_COUNT(hasty->worker_stats + worker, pairsTested, end - start);
+	
+	// Circle pairs waiting to be collided in a batch.
+	struct cpBatchPair batched[CP_COLLISION_BATCH_SIZE];
+	unsigned long batchedIndexes[CP_COLLISION_BATCH_SIZE];
+	int batchedCount = 0;
+	
+	// Workers only read from the space and the arbiter and separating axis caches here.
+	// They only write to their own collisions and contact ring.
+	for(unsigned long i=start; i<end; i++){
+		struct QueuedCollision *collision = hasty->collisions + i;
+		cpShape *a = (cpShape *)collision->info.a;
+		cpShape *b = (cpShape *)collision->info.b;
+		
+		// Reject any of the simple cases
+		cpFloat margin = cpSpaceSpeculativeMargin(space, a, b);
+		if(cpSpaceShapesQueryReject(a, b, margin)){
+			CP_STATS_COUNT(hasty->worker_stats + worker, pairsRejected, 1);
+			continue;
 		}
+		
+		if(cpShapesCollideInBatches(a, b)){
+			// Make sure the circle is first.
+			struct cpBatchPair pair = {a, b, collision->info.id, margin};
+			if(a->klass->type > b->klass->type){
+				pair.a = b;
+				pair.b = a;
+			}
+			
+			batched[batchedCount] = pair;
+			batchedIndexes[batchedCount] = i;
+			if(++batchedCount == CP_COLLISION_BATCH_SIZE){
+				CollideBatch(hasty, worker, batched, batchedIndexes, batchedCount);
+				batchedCount = 0;
+			}
 			
-		for(int j=0; j<constraints->num; j++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[j];
-			constraint->klass->applyImpulse(constraint, dt);
+			continue;
 		}
+		
+		if(cpShapesCacheSeparatingAxes(a, b) && cpSpaceSeparatingAxisCulls(space, a, b, margin, &collision->axis)){
+			CP_STATS_COUNT(hasty->worker_stats + worker, pairsCulled, 1);
+			collision->culled = cpTrue;
+			continue;
+		}
+		
+		const cpShape *shape_pair[] = {a, b};
+		cpHashValue arbHashID = CP_HASH_PAIR((cpHashValue)a, (cpHashValue)b);
+		cpArbiter *arb = (cpArbiter *)cpHashSetFind(space->cachedArbiters, arbHashID, shape_pair);
+		
+		cpCollisionID id = (arb ? arb->id : collision->info.id);
+		struct cpContact *contacts = cpContactBufferRingGetArray(&ring->head, ring->allocatedBuffers, space->stamp, space->collisionPersistence);
+		collision->info = cpCollide(a, b, id, margin, contacts);
+		collision->arb = arb;
+		
+		CP_STATS_COUNT(hasty->worker_stats + worker, gjkIterations, collision->info.gjkIterations);
+		CP_STATS_COUNT(hasty->worker_stats + worker, epaIterations, collision->info.epaIterations);
+		CP_STATS_COUNT(hasty->worker_stats + worker, contactsCreated, collision->info.count);
+		
+		if(collision->info.count > 0) cpContactBufferRingPushContacts(ring->head, collision->info.count);
 	}
+	
+	if(batchedCount > 0) CollideBatch(hasty, worker, batched, batchedIndexes, batchedCount);
+	
+	CP_STATS_LAP(timer, hasty->worker_stats + worker, narrowphase);
+}
+
+// Process the narrow-phase results serially in broadphase order.
+// This keeps the arbiter cache and the begin/preSolve callbacks deterministic regardless of the number of threads.
+static void
+MergeCollisions(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	
+	for(int i=0; i<hasty->collision_count; i++){
+		struct QueuedCollision *collision = hasty->collisions + i;
+		
+		// Contacts that end up rejected are simply left in the worker's buffer.
+		// They can't be popped since other pairs may have been written after them.
+		if(collision->info.count > 0){
+			cpSpaceProcessCollision(space, &collision->info, collision->arb);
+		} else if(collision->culled){
+			collision->axis->stamp = space->stamp;
+		} else if(collision->info.separation > 0.0f){
+			cpSpaceCacheSeparatingAxis(space, &collision->info, collision->axis);
+		}
+	}
+	
+	hasty->collision_count = 0;
+}
+
+#if CP_STEP_STATS
+// Add up the narrow-phase counters from the workers.
+static void
+MergeNarrowPhaseStats(cpHastySpace *hasty)
+{
+	cpSpaceStepStats *stats = &hasty->space.stepStats;
+	
+	for(unsigned long i=0; i<hasty->contact_ring_count; i++){
+		cpSpaceStepStats *worker = hasty->worker_stats + i;
+		stats->pairsRejected += worker->pairsRejected;
+		stats->pairsCulled += worker->pairsCulled;
+		stats->gjkIterations += worker->gjkIterations;
+		stats->epaIterations += worker->epaIterations;
+		stats->contactsCreated += worker->contactsCreated;
+	}
+}
+#endif
+
+static void
+CollideShapes(cpHastySpace *hasty)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	
+	CP_STATS_START(timer);
+	if(UseTasks(hasty)){
+		cpSpatialIndexReindexQueryParallel(space->dynamicShapes, (cpSpatialIndexQueryFunc)QueueCollision, hasty, (cpSpatialIndexParallelForFunc)IndexParallelFor, hasty);
+		CP_STATS_COUNT(&space->stepStats, pairsTested, hasty->collision_count);
+		CP_STATS_LAP(timer, &space->stepStats, broadphase);
+		
+		for(unsigned long i=0; i<hasty->contact_ring_count; i++){
+			struct WorkerContacts *ring = hasty->contacts + i;
+			ring->head = cpContactBufferRingPushFresh(ring->head, ring->allocatedBuffers, space->stamp, space->collisionPersistence);
+		}
+		
+		ParallelFor(hasty, hasty->collision_count, hasty->grain_size, NarrowPhase);
+		
+#if CP_STEP_STATS
+		MergeNarrowPhaseStats(hasty);
+#endif
+		
+		MergeCollisions(hasty);
+		CP_STATS_LAP(timer, &space->stepStats, narrowphase);
+	} else {
+		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		cpSpaceCollideBatchedShapes(space);
+		CP_STATS_LAP(timer, &space->stepStats, broadphase);
+#if CP_STEP_STATS
+		// The narrow-phase runs from inside the broadphase query, don't count it twice.
+		space->stepStats.broadphase -= space->stepStats.narrowphase;
+#endif
+	}
+}
+
+//MARK: Task Backend Functions
+
+// Make sure there is a contact ring (and step stats) for each of the backend's workers.
+// Rings are never freed before the space since cached arbiters may still point to their contacts.
+static void
+ReserveContactRings(cpHastySpace *hasty, unsigned long count)
+{
+	if(count <= hasty->contact_ring_count) return;
+	
+	hasty->contacts = (struct WorkerContacts *)cprealloc(hasty->contacts, count*sizeof(struct WorkerContacts));
+	hasty->worker_stats = (cpSpaceStepStats *)cprealloc(hasty->worker_stats, count*sizeof(cpSpaceStepStats));
+	
+	cpSpaceStepStats emptyStats = {0};
+	for(unsigned long i=hasty->contact_ring_count; i<count; i++){
+		hasty->contacts[i].head = NULL;
+		hasty->contacts[i].allocatedBuffers = cpArrayNew(0);
+		hasty->worker_stats[i] = emptyStats;
+	}
+	
+	hasty->contact_ring_count = count;
+}
+
+static void
+SetBackend(cpHastySpace *hasty, cpHastySpaceTaskBackend backend)
+{
+	hasty->backend = backend;
+	ReserveContactRings(hasty, backend.workerCount);
+}
+
+static cpHastySpaceTaskBackend
+ThreadBackend(cpHastySpace *hasty)
+{
+	cpHastySpaceTaskBackend backend = {
+		(cpHastySpaceParallelForFunc)ThreadParallelFor,
+		(cpHastySpaceWaitFunc)ThreadWait,
+		hasty->num_threads,
+		hasty,
+	};
+	
+	return backend;
 }
 
 //MARK: Thread Management Functions
@@ -499,9 +1464,12 @@ Solver(cpSpace *space, unsigned long worker, unsigned long worker_count)
 static void
 HaltThreads(cpHastySpace *hasty)
 {
+	// Let any submitted jobs finish first.
+	WaitForJobs(hasty, &hasty->user_pending);
+	
 	pthread_mutex_t *mutex = &hasty->mutex;
 	pthread_mutex_lock(mutex); {
-		hasty->work = NULL; // NULL work function means break and exit
+		AtomicStore(&hasty->running, 0);
 		pthread_cond_broadcast(&hasty->cond_work);
 	} pthread_mutex_unlock(mutex);
 	
@@ -522,31 +1490,35 @@ cpHastySpaceSetThreads(cpSpace *space, unsigned long threads)
 	cpHastySpace *hasty = (cpHastySpace *)space;
 	HaltThreads(hasty);
 	
-#ifdef __APPLE__
 	if(threads == 0){
+	#if defined(__APPLE__)
 		size_t size = sizeof(threads);
 		sysctlbyname("hw.ncpu", &threads, &size, NULL, 0);
+	#elif defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threads = info.dwNumberOfProcessors;
+	#else
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0 ? cpus : 1);
+	#endif
 	}
-#else
-	if(threads == 0) threads = 1;
-#endif
 	
 	hasty->num_threads = (threads < MAX_THREADS ? threads : MAX_THREADS);
-	hasty->num_working = hasty->num_threads - 1;
-	
-	// Create the worker threads and wait for them to signal ready.
-	if(hasty->num_working > 0){
-		pthread_mutex_lock(&hasty->mutex);
-		for(unsigned long i=0; i<(hasty->num_threads-1); i++){
-			hasty->workers[i].space = hasty;
-			hasty->workers[i].thread_num = i + 1;
-			
-			pthread_create(&hasty->workers[i].thread, NULL, (void*(*)(void*))WorkerThreadLoop, &hasty->workers[i]);
-		}
+	
+	hasty->queues = (struct JobQueue *)cprealloc(hasty->queues, hasty->num_threads*sizeof(struct JobQueue));
+	memset(hasty->queues, 0, hasty->num_threads*sizeof(struct JobQueue));
+	
+	// Create the worker threads.
+	AtomicStore(&hasty->running, 1);
+	for(unsigned long i=0; i<(hasty->num_threads-1); i++){
+		hasty->workers[i].space = hasty;
+		hasty->workers[i].thread_num = i + 1;
 		
-		pthread_cond_wait(&hasty->cond_resume, &hasty->mutex);
-		pthread_mutex_unlock(&hasty->mutex);
+		pthread_create(&hasty->workers[i].thread, NULL, (void*(*)(void*))WorkerThreadLoop, &hasty->workers[i]);
 	}
+	
+	SetBackend(hasty, ThreadBackend(hasty));
 }
 
 unsigned long
@@ -555,6 +1527,105 @@ cpHastySpaceGetThreads(cpSpace *space)
 	return ((cpHastySpace *)space)->num_threads;
 }
 
+void
+cpHastySpaceSetTaskBackend(cpSpace *space, const cpHastySpaceTaskBackend *backend)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	
+	if(backend){
+		cpAssertHard(backend->parallelFor && backend->wait, "The task backend's parallelFor and wait functions must be set.");
+		cpAssertHard(backend->workerCount > 0, "The task backend must have at least one worker.");
+		
+		// Shut down the built-in worker threads so they don't compete with the backend's.
+		cpHastySpaceSetThreads(space, 1);
+		SetBackend(hasty, *backend);
+	} else {
+		cpHastySpaceSetThreads(space, 1);
+	}
+}
+
+cpHastySpaceTaskBackend
+cpHastySpaceGetTaskBackend(cpSpace *space)
+{
+	return ((cpHastySpace *)space)->backend;
+}
+
+cpHastySpaceTaskBackend
+cpHastySpaceSerialTaskBackend(void)
+{
+	cpHastySpaceTaskBackend backend = {SerialParallelFor, SerialWait, 1, NULL};
+	return backend;
+}
+
+void
+cpHastySpaceSetGrainSize(cpSpace *space, unsigned long grain)
+{
+	((cpHastySpace *)space)->grain_size = (grain > 0 ? grain : 1);
+}
+
+unsigned long
+cpHastySpaceGetGrainSize(cpSpace *space)
+{
+	return ((cpHastySpace *)space)->grain_size;
+}
+
+void
+cpHastySpaceSubmitJob(cpSpace *space, cpHastySpaceJobFunc func, void *data)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	struct Job job = {NULL, func, data, 0, 1, 1, &hasty->user_pending};
+	
+	AtomicIncrement(&hasty->user_pending);
+	if(JobQueuePush(hasty->queues, &job)){
+		WakeWorkers(hasty);
+	} else {
+		// The queue is full, run it now instead.
+		RunJob(hasty, &job, 0);
+	}
+}
+
+void
+cpHastySpaceWaitJobs(cpSpace *space)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	WaitForJobs(hasty, &hasty->user_pending);
+}
+
+void
+cpHastySpaceSetIslandStepping(cpSpace *space, cpBool enabled)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	hasty->island_stepping = enabled;
+	space->buildIslands = enabled;
+}
+
+cpBool
+cpHastySpaceGetIslandStepping(cpSpace *space)
+{
+	return ((cpHastySpace *)space)->island_stepping;
+}
+
+void
+cpHastySpaceSetDeterministic(cpSpace *space, cpBool deterministic)
+{
+	((cpHastySpace *)space)->deterministic = deterministic;
+}
+
+cpBool
+cpHastySpaceGetDeterministic(cpSpace *space)
+{
+	return ((cpHastySpace *)space)->deterministic;
+}
+
+cpSpaceStepStats
+cpHastySpaceGetThreadStepStats(cpSpace *space, unsigned long thread)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	cpAssertHard(thread < hasty->backend.workerCount, "Thread index is out of range.");
+	
+	return hasty->worker_stats[thread];
+}
+
 //MARK: Overriden cpSpace Functions.
 
 cpSpace *
@@ -565,10 +1636,10 @@ cpHastySpaceNew(void)
 	
 	pthread_mutex_init(&hasty->mutex, NULL);
 	pthread_cond_init(&hasty->cond_work, NULL);
-	pthread_cond_init(&hasty->cond_resume, NULL);
 	
 	// TODO magic number, should test this more thoroughly.
 	hasty->constraint_count_threshold = 50;
+	hasty->grain_size = 32;
 	
 	// Default to 1 thread for determinism.
 	hasty->num_threads = 1;
@@ -586,7 +1657,20 @@ cpHastySpaceFree(cpSpace *space)
 	
 	pthread_mutex_destroy(&hasty->mutex);
 	pthread_cond_destroy(&hasty->cond_work);
-	pthread_cond_destroy(&hasty->cond_resume);
+	
+	for(unsigned long i=0; i<hasty->contact_ring_count; i++){
+		cpArrayFreeEach(hasty->contacts[i].allocatedBuffers, cpfree);
+		cpArrayFree(hasty->contacts[i].allocatedBuffers);
+	}
+	
+	cpfree(hasty->contacts);
+	cpfree(hasty->worker_stats);
+	cpfree(hasty->collisions);
+	cpfree(hasty->batch_arbiters);
+	cpfree(hasty->batch_constraints);
+	cpfree(hasty->batch_colors);
+	cpfree(hasty->island_tasks);
+	cpfree(hasty->queues);
 	
 	cpSpaceFree(space);
 }
@@ -597,6 +1681,15 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 	// don't step if the timestep is 0!
 	if(dt == 0.0f) return;
 	
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	
+#if CP_STEP_STATS
+	cpSpaceStepStats emptyStats = {0};
+	space->stepStats = emptyStats;
+	for(unsigned long i=0; i<hasty->contact_ring_count; i++) hasty->worker_stats[i] = emptyStats;
+#endif
+	CP_STATS_START(stepTimer);
+	
 	space->stamp++;
 	
 	cpFloat prev_dt = space->curr_dt;
@@ -618,67 +1711,90 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 	}
 	arbiters->num = 0;
 	
+	CP_STATS_START(timer);
 	cpSpaceLock(space); {
 		// Integrate positions
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->position_func(body, dt);
-		}
+		ParallelFor(hasty, bodies->num, hasty->grain_size, IntegratePositions);
+		CP_STATS_LAP(timer, &space->stepStats, integratePositions);
+		
+		// Move bullets back to where they first hit a static shape.
+		cpSpaceSweepBullets(space);
+		CP_STATS_LAP(timer, &space->stepStats, sweepBullets);
 		
 		// Find colliding pairs.
 		cpSpacePushFreshContactBuffer(space);
-		cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
-		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		ParallelFor(hasty, bodies->num, hasty->grain_size, UpdateBBs);
+		CP_STATS_LAP(timer, &space->stepStats, updateBBs);
+		
+		CollideShapes(hasty);
+		CP_STATS_RESTART(timer);
 	} cpSpaceUnlock(space, cpFalse);
 	
 	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
 	cpSpaceProcessComponents(space, dt);
+	CP_STATS_LAP(timer, &space->stepStats, components);
 	
 	cpSpaceLock(space); {
 		// Clear out old cached arbiters and call separate callbacks
 		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
-
-		// Prestep the arbiters and constraints.
-		cpFloat slop = space->collisionSlop;
-		cpFloat biasCoef = 1.0f - cpfpow(space->collisionBias, dt);
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiterPreStep((cpArbiter *)arbiters->arr[i], dt, slop, biasCoef);
-		}
-
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			
-			cpConstraintPreSolveFunc preSolve = constraint->preSolve;
-			if(preSolve) preSolve(constraint, space);
-			
-			constraint->klass->preStep(constraint, dt);
-		}
-	
-		// Integrate velocities.
-		cpFloat damping = cpfpow(space->damping, dt);
-		cpVect gravity = space->gravity;
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->velocity_func(body, gravity, damping, dt);
-		}
-		
-		// Apply cached impulses
-		cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiterApplyCachedImpulse((cpArbiter *)arbiters->arr[i], dt_coef);
-		}
+		cpHashSetFilter(space->separatingAxes, (cpHashSetFilterFunc)cpSpaceSeparatingAxisFilter, space);
+		CP_STATS_LAP(timer, &space->stepStats, filterArbiters);
 		
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			constraint->klass->applyCachedImpulse(constraint, dt_coef);
-		}
+		hasty->slop = space->collisionSlop;
+		hasty->bias_coef = 1.0f - cpfpow(space->collisionBias, dt);
+		hasty->damping = cpfpow(space->damping, dt);
+		hasty->gravity = space->gravity;
+		hasty->dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
 		
-		// Run the impulse solver.
-		cpHastySpace *hasty = (cpHastySpace *)space;
-		if((unsigned long)(arbiters->num + constraints->num) > hasty->constraint_count_threshold){
-			RunWorkers(hasty, Solver);
+		if(hasty->island_stepping && UseTasks(hasty) && space->islandCount > 1){
+			// The constraint preSolve callbacks need to be called from this thread.
+			for(int i=0; i<constraints->num; i++){
+				cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+				
+				cpConstraintPreSolveFunc preSolve = constraint->preSolve;
+				if(preSolve) preSolve(constraint, space);
+			}
+			
+			// Islands are prestepped, integrated and solved all at once.
+			// Islands are usually too small to fill the SIMD lanes, so they always use the scalar contact solver.
+			SolveIslands(hasty);
+			CP_STATS_LAP(timer, &space->stepStats, solve);
 		} else {
-			Solver(space, 0, 1);
+			// Prestep the arbiters and constraints.
+			ParallelFor(hasty, arbiters->num, hasty->grain_size, PreStepArbiters);
+			
+			for(int i=0; i<constraints->num; i++){
+				cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+				
+				cpConstraintPreSolveFunc preSolve = constraint->preSolve;
+				if(preSolve) preSolve(constraint, space);
+				
+				constraint->klass->preStep(constraint, dt);
+			}
+			CP_STATS_LAP(timer, &space->stepStats, preStep);
+			
+			// Integrate velocities.
+			ParallelFor(hasty, bodies->num, hasty->grain_size, IntegrateVelocities);
+			CP_STATS_LAP(timer, &space->stepStats, integrateVelocities);
+			
+			// Apply cached impulses and run the impulse solver.
+			if(UseTasks(hasty) && (unsigned long)(arbiters->num + constraints->num) > hasty->constraint_count_threshold){
+				hasty->contact_solver = NULL;
+				if(space->contactSolverType != CP_CONTACT_SOLVER_SCALAR) hasty->contact_solver = cpSpaceSolverBegin(space);
+				
+				// Coloring the batches is counted as part of the prestep.
+				ColorSolverBatches(hasty, hasty->contact_solver == NULL);
+				CP_STATS_LAP(timer, &space->stepStats, preStep);
+				
+				if(hasty->contact_solver){
+					ContactSolver(hasty);
+				} else {
+					Solver(hasty);
+				}
+			} else {
+				cpSpaceSolve(space, hasty->dt_coef);
+			}
+			CP_STATS_RESTART(timer);
 		}
 		
 		// Run the constraint post-solve callbacks
@@ -697,4 +1813,7 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 			handler->postSolveFunc(arb, space, handler->userData);
 		}
 	} cpSpaceUnlock(space, cpTrue);
+	
+	CP_STATS_LAP(timer, &space->stepStats, callbacks);
+	CP_STATS_LAP(stepTimer, &space->stepStats, step);
 }
@@ -0,0 +1,109 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chipmunk/chipmunk_private.h"
+
+#define INITIAL_CAPACITY (32u)
+
+void
+cpObjTableInit(cpObjTable *table)
+{
+	table->slots = NULL;
+	table->mask = 0;
+	table->count = 0;
+}
+
+void
+cpObjTableDestroy(cpObjTable *table)
+{
+	cpfree(table->slots);
+	cpObjTableInit(table);
+}
+
+static void
+InsertSlot(struct cpObjTableSlot *slots, uint32_t mask, struct cpObjTableSlot slot)
+{
+	uint32_t i = cpObjTableHash(slot.hashid)&mask;
+	while(slots[i].index != CP_OBJ_TABLE_EMPTY) i = (i + 1)&mask;
+	slots[i] = slot;
+}
+
+static void
+Resize(cpObjTable *table, uint32_t capacity)
+{
+	struct cpObjTableSlot *slots = (struct cpObjTableSlot *)cpcalloc(capacity, sizeof(struct cpObjTableSlot));
+	for(uint32_t i=0; i<capacity; i++) slots[i].index = CP_OBJ_TABLE_EMPTY;
+	
+	struct cpObjTableSlot *old = table->slots;
+	if(old){
+		for(uint32_t i=0; i<=table->mask; i++){
+			if(old[i].index != CP_OBJ_TABLE_EMPTY) InsertSlot(slots, capacity - 1, old[i]);
+		}
+		
+		cpfree(old);
+	}
+	
+	table->slots = slots;
+	table->mask = capacity - 1;
+}
+
+void
+cpObjTableInsert(cpObjTable *table, cpHashValue hashid, uint32_t index)
+{
+	// Keep the load factor at 1/2 or less.
+	uint32_t capacity = (table->slots ? table->mask + 1 : 0);
+	if(2*(table->count + 1) > capacity) Resize(table, capacity ? 2*capacity : INITIAL_CAPACITY);
+	
+	struct cpObjTableSlot slot = {hashid, index};
+	InsertSlot(table->slots, table->mask, slot);
+	table->count++;
+}
+
+void
+cpObjTableRemove(cpObjTable *table, uint32_t i)
+{
+	struct cpObjTableSlot *slots = table->slots;
+	uint32_t mask = table->mask;
+	
+	// Shift back any following slots that would no longer be reachable.
+	for(uint32_t j = (i + 1)&mask; slots[j].index != CP_OBJ_TABLE_EMPTY; j = (j + 1)&mask){
+		uint32_t home = cpObjTableHash(slots[j].hashid)&mask;
+		cpBool reachable = (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+		
+		if(!reachable){
+			slots[i] = slots[j];
+			i = j;
+		}
+	}
+	
+	slots[i].index = CP_OBJ_TABLE_EMPTY;
+	table->count--;
+}
+
+void
+cpObjTableClear(cpObjTable *table)
+{
+	if(table->slots){
+		for(uint32_t i=0; i<=table->mask; i++) table->slots[i].index = CP_OBJ_TABLE_EMPTY;
+	}
+	
+	table->count = 0;
+}
@@ -303,6 +303,7 @@ cpPolyShapeSetVertsRaw(cpShape *shape, int count, cpVect *verts)
 	cpPolyShapeDestroy(poly);
 	
 	SetVerts(poly, count, verts);
+	shape->geometryStamp++;
 	
 	cpFloat mass = shape->massInfo.m;
 	shape->massInfo = cpPolyShapeMassInfo(shape->massInfo.m, count, verts, poly->r);
@@ -315,7 +316,7 @@ cpPolyShapeSetRadius(cpShape *shape, cpFloat radius)
 	cpAssertHard(shape->klass == &polyClass, "Shape is not a poly shape.");
 	cpPolyShape *poly = (cpPolyShape *)shape;
 	poly->r = radius;
-	
+	shape->geometryStamp++;
 	
 	// TODO radius is not handled by moment/area
 //	cpFloat mass = shape->massInfo.m;
@@ -59,8 +59,8 @@ applyCachedImpulse(cpRatchetJoint *joint, cpFloat dt_coef)
 	cpBody *b = joint->constraint.b;
 	
 	cpFloat j = joint->jAcc*dt_coef;
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static void
@@ -84,8 +84,8 @@ applyImpulse(cpRatchetJoint *joint, cpFloat dt)
 	j = joint->jAcc - jOld;
 	
 	// apply impulse
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static cpFloat
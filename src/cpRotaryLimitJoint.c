@@ -53,8 +53,8 @@ applyCachedImpulse(cpRotaryLimitJoint *joint, cpFloat dt_coef)
 	cpBody *b = joint->constraint.b;
 	
 	cpFloat j = joint->jAcc*dt_coef;
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static void
@@ -81,8 +81,8 @@ applyImpulse(cpRotaryLimitJoint *joint, cpFloat dt)
 	j = joint->jAcc - jOld;
 	
 	// apply impulse
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static cpFloat
@@ -0,0 +1,164 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Private SIMD helpers shared by the contact solver and the batched collision kernels.
+// Kernels are compiled for their instruction set with CP_TARGET_SSE2 or CP_TARGET_AVX2,
+// and should only be called after checking cpCPUSupportsSSE2() or cpCPUSupportsAVX2().
+// The sse_*/avx_* macros operate on cpFloat lanes, 2/4 doubles or 4/8 floats wide.
+
+#ifndef CP_SIMD_H
+#define CP_SIMD_H
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define CP_SIMD_X86 1
+	
+	#include <immintrin.h>
+	
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define CP_TARGET_SSE2
+		#define CP_TARGET_AVX2
+	#else
+		#define CP_TARGET_SSE2 __attribute__((target("sse2")))
+		#define CP_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#else
+	#define CP_SIMD_X86 0
+#endif
+
+#if CP_SIMD_X86
+
+//MARK: CPU Detection
+
+static inline cpBool
+cpCPUSupportsSSE2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return cpTrue;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("sse2") != 0);
+#endif
+}
+
+static inline cpBool
+cpCPUSupportsAVX2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	// The OS must also save the AVX registers on context switches.
+	if(!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return cpFalse;
+	
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") != 0);
+#endif
+}
+
+//MARK: SSE2
+
+#if CP_USE_DOUBLES
+	typedef __m128d cpFloatSSE;
+	#define SSE_LANES 2
+	#define sse_load _mm_loadu_pd
+	#define sse_store _mm_storeu_pd
+	#define sse_set1 _mm_set1_pd
+	#define sse_zero _mm_setzero_pd
+	#define sse_add _mm_add_pd
+	#define sse_sub _mm_sub_pd
+	#define sse_mul _mm_mul_pd
+	#define sse_div _mm_div_pd
+	#define sse_sqrt _mm_sqrt_pd
+	#define sse_min _mm_min_pd
+	#define sse_max _mm_max_pd
+	#define sse_cmpeq _mm_cmpeq_pd
+	#define sse_and _mm_and_pd
+	#define sse_andnot _mm_andnot_pd
+	#define sse_or _mm_or_pd
+#else
+	typedef __m128 cpFloatSSE;
+	#define SSE_LANES 4
+	#define sse_load _mm_loadu_ps
+	#define sse_store _mm_storeu_ps
+	#define sse_set1 _mm_set1_ps
+	#define sse_zero _mm_setzero_ps
+	#define sse_add _mm_add_ps
+	#define sse_sub _mm_sub_ps
+	#define sse_mul _mm_mul_ps
+	#define sse_div _mm_div_ps
+	#define sse_sqrt _mm_sqrt_ps
+	#define sse_min _mm_min_ps
+	#define sse_max _mm_max_ps
+	#define sse_cmpeq _mm_cmpeq_ps
+	#define sse_and _mm_and_ps
+	#define sse_andnot _mm_andnot_ps
+	#define sse_or _mm_or_ps
+#endif
+
+// Lanes where mask is set get a, the rest get b.
+#define sse_select(mask, a, b) sse_or(sse_and(mask, a), sse_andnot(mask, b))
+
+//MARK: AVX2
+
+#if CP_USE_DOUBLES
+	typedef __m256d cpFloatAVX;
+	#define AVX_LANES 4
+	#define avx_load _mm256_loadu_pd
+	#define avx_store _mm256_storeu_pd
+	#define avx_set1 _mm256_set1_pd
+	#define avx_zero _mm256_setzero_pd
+	#define avx_add _mm256_add_pd
+	#define avx_sub _mm256_sub_pd
+	#define avx_mul _mm256_mul_pd
+	#define avx_div _mm256_div_pd
+	#define avx_sqrt _mm256_sqrt_pd
+	#define avx_min _mm256_min_pd
+	#define avx_max _mm256_max_pd
+	#define avx_cmpeq(a, b) _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+	#define avx_select(mask, a, b) _mm256_blendv_pd(b, a, mask)
+#else
+	typedef __m256 cpFloatAVX;
+	#define AVX_LANES 8
+	#define avx_load _mm256_loadu_ps
+	#define avx_store _mm256_storeu_ps
+	#define avx_set1 _mm256_set1_ps
+	#define avx_zero _mm256_setzero_ps
+	#define avx_add _mm256_add_ps
+	#define avx_sub _mm256_sub_ps
+	#define avx_mul _mm256_mul_ps
+	#define avx_div _mm256_div_ps
+	#define avx_sqrt _mm256_sqrt_ps
+	#define avx_min _mm256_min_ps
+	#define avx_max _mm256_max_ps
+	#define avx_cmpeq(a, b) _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+	#define avx_select(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#endif
+
+#endif
+
+#endif
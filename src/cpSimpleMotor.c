@@ -38,8 +38,8 @@ applyCachedImpulse(cpSimpleMotor *joint, cpFloat dt_coef)
 	cpBody *b = joint->constraint.b;
 	
 	cpFloat j = joint->jAcc*dt_coef;
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static void
@@ -60,8 +60,8 @@ applyImpulse(cpSimpleMotor *joint, cpFloat dt)
 	j = joint->jAcc - jOld;
 	
 	// apply impulse
-	a->w -= j*a->i_inv;
-	b->w += j*b->i_inv;
+	if(!body_is_fixed(a)) a->w -= j*a->i_inv;
+	if(!body_is_fixed(b)) b->w += j*b->i_inv;
 }
 
 static cpFloat
@@ -36,6 +36,16 @@ arbiterSetEql(cpShape **shapes, cpArbiter *arb)
 	return ((a == arb->a && b == arb->b) || (b == arb->a && a == arb->b));
 }
 
+// Equal function for separatingAxes.
+static cpBool
+separatingAxisSetEql(cpShape **shapes, struct cpSeparatingAxis *axis)
+{
+	cpShape *a = shapes[0];
+	cpShape *b = shapes[1];
+	
+	return ((a == axis->a && b == axis->b) || (b == axis->a && a == axis->b));
+}
+
 //MARK: Collision Handler Set HelperFunctions
 
 // Equals function for collisionHandlers.
@@ -105,6 +115,16 @@ cpCollisionHandler cpCollisionHandlerDoNothing = {
 // function to get the estimated velocity of a shape for the cpBBTree.
 static cpVect ShapeVelocityFunc(cpShape *shape){return shape->body->v;}
 
+// Dynamic shapes are indexed by their bounding box grown by how far they can move in a step
+// so the index finds pairs that need speculative contacts.
+static cpBB
+DynamicShapeBBFunc(cpShape *shape)
+{
+	cpBB bb = shape->bb;
+	cpFloat margin = (shape->space ? cpSpaceShapeSpeculativeMargin(shape->space, shape) : 0.0f);
+	return cpBBNew(bb.l - margin, bb.b - margin, bb.r + margin, bb.t + margin);
+}
+
 // Used for disposing of collision handlers.
 static void FreeWrap(void *ptr, void *unused){cpfree(ptr);}
 
@@ -136,13 +156,14 @@ cpSpaceInit(cpSpace *space)
 	space->collisionSlop = 0.1f;
 	space->collisionBias = cpfpow(1.0f - 0.1f, 60.0f);
 	space->collisionPersistence = 3;
+	space->speculativeContacts = cpFalse;
 	
 	space->locked = 0;
 	space->stamp = 0;
 	
 	space->shapeIDCounter = 0;
 	space->staticShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
-	space->dynamicShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, space->staticShapes);
+	space->dynamicShapes = cpBBTreeNew((cpSpatialIndexBBFunc)DynamicShapeBBFunc, space->staticShapes);
 	cpBBTreeSetVelocityFunc(space->dynamicShapes, (cpBBTreeVelocityFunc)ShapeVelocityFunc);
 	
 	space->allocatedBuffers = cpArrayNew(0);
@@ -161,6 +182,12 @@ cpSpaceInit(cpSpace *space)
 	space->contactBuffersHead = NULL;
 	space->cachedArbiters = cpHashSetNew(0, (cpHashSetEqlFunc)arbiterSetEql);
 	
+	space->separatingAxes = cpHashSetNew(0, (cpHashSetEqlFunc)separatingAxisSetEql);
+	space->pooledSeparatingAxes = cpArrayNew(0);
+	
+	space->batchedCount = 0;
+	space->batchedPairs = (struct cpBatchPair *)cpcalloc(CP_COLLISION_BATCH_SIZE, sizeof(struct cpBatchPair));
+	
 	space->constraints = cpArrayNew(0);
 	
 	space->usesWildcards = cpFalse;
@@ -170,6 +197,24 @@ cpSpaceInit(cpSpace *space)
 	space->postStepCallbacks = cpArrayNew(0);
 	space->skipPostStep = cpFalse;
 	
+	space->buildIslands = cpFalse;
+	space->islandCount = space->islandCapacity = 0;
+	space->islands = NULL;
+	space->islandBodies = cpArrayNew(0);
+	space->islandArbiters = cpArrayNew(0);
+	space->islandConstraints = cpArrayNew(0);
+	
+	space->solverBodies = cpArrayNew(0);
+	space->solverSyncBodies = cpArrayNew(0);
+	space->solverStateCapacity = 0;
+	space->solverState = NULL;
+	
+	space->contactSolverType = CP_CONTACT_SOLVER_SCALAR;
+	space->contactSolver = NULL;
+	
+	cpSpaceStepStats stepStats = {0};
+	space->stepStats = stepStats;
+	
 	cpBody *staticBody = cpBodyInit(&space->_staticBody, 0.0f, 0.0f);
 	cpBodySetType(staticBody, CP_BODY_TYPE_STATIC);
 	cpSpaceSetStaticBody(space, staticBody);
@@ -205,6 +250,21 @@ cpSpaceDestroy(cpSpace *space)
 	cpArrayFree(space->arbiters);
 	cpArrayFree(space->pooledArbiters);
 	
+	cpHashSetFree(space->separatingAxes);
+	cpArrayFree(space->pooledSeparatingAxes);
+	
+	cpfree(space->batchedPairs);
+	
+	cpfree(space->islands);
+	cpArrayFree(space->islandBodies);
+	cpArrayFree(space->islandArbiters);
+	cpArrayFree(space->islandConstraints);
+	
+	cpArrayFree(space->solverBodies);
+	cpArrayFree(space->solverSyncBodies);
+	cpfree(space->solverState);
+	cpContactSolverFree(space->contactSolver);
+	
 	if(space->allocatedBuffers){
 		cpArrayFreeEach(space->allocatedBuffers, cpfree);
 		cpArrayFree(space->allocatedBuffers);
@@ -244,6 +304,24 @@ cpSpaceSetIterations(cpSpace *space, int iterations)
 	space->iterations = iterations;
 }
 
+cpContactSolverType
+cpSpaceGetContactSolver(const cpSpace *space)
+{
+	return space->contactSolverType;
+}
+
+cpSpaceStepStats
+cpSpaceGetStepStats(const cpSpace *space)
+{
+	return space->stepStats;
+}
+
+void
+cpSpaceSetContactSolver(cpSpace *space, cpContactSolverType solver)
+{
+	space->contactSolverType = solver;
+}
+
 cpVect
 cpSpaceGetGravity(const cpSpace *space)
 {
@@ -335,6 +413,18 @@ cpSpaceSetCollisionPersistence(cpSpace *space, cpTimestamp collisionPersistence)
 	space->collisionPersistence = collisionPersistence;
 }
 
+cpBool
+cpSpaceGetSpeculativeContacts(const cpSpace *space)
+{
+	return space->speculativeContacts;
+}
+
+void
+cpSpaceSetSpeculativeContacts(cpSpace *space, cpBool speculativeContacts)
+{
+	space->speculativeContacts = speculativeContacts;
+}
+
 cpDataPointer
 cpSpaceGetUserData(const cpSpace *space)
 {
@@ -437,6 +527,49 @@ cpSpaceAddShape(cpSpace *space, cpShape *shape)
 	return shape;
 }
 
+void
+cpSpaceAddShapes(cpSpace *space, cpShape **shapes, int count)
+{
+	cpAssertSpaceUnlocked(space);
+	if(count <= 0) return;
+	
+	int staticCount = 0;
+	for(int i=0; i<count; i++){
+		cpShape *shape = shapes[i];
+		cpAssertHard(shape->space != space, "You have already added this shape to this space. You must not add it a second time.");
+		cpAssertHard(!shape->space, "You have already added this shape to another space. You cannot add it to a second.");
+		cpAssertHard(shape->body, "The shape's body is not defined.");
+		cpAssertHard(shape->body->space == space, "The shape's body must be added to the space before the shape.");
+		
+		cpBody *body = shape->body;
+		
+		cpBool isStatic = (cpBodyGetType(body) == CP_BODY_TYPE_STATIC);
+		if(isStatic) staticCount++; else cpBodyActivate(body);
+		cpBodyAddShape(body, shape);
+		
+		shape->hashid = space->shapeIDCounter++;
+		cpShapeUpdate(shape, body->transform);
+		shape->space = space;
+	}
+	
+	// Split the shapes into static shapes followed by dynamic shapes.
+	void **objs = (void **)cpcalloc(count, sizeof(void *));
+	cpHashValue *hashids = (cpHashValue *)cpcalloc(count, sizeof(cpHashValue));
+	
+	for(int i=0, s=0, d=staticCount; i<count; i++){
+		cpShape *shape = shapes[i];
+		int j = (cpBodyGetType(shape->body) == CP_BODY_TYPE_STATIC ? s++ : d++);
+		objs[j] = shape;
+		hashids[j] = shape->hashid;
+	}
+	
+	cpSpatialIndexInsertBulk(space->staticShapes, objs, hashids, staticCount);
+	cpSpatialIndexInsertBulk(space->dynamicShapes, objs + staticCount, hashids + staticCount, count - staticCount);
+	
+	cpfree(objs);
+	cpfree(hashids);
+}
+
 cpBody *
 cpSpaceAddBody(cpSpace *space, cpBody *body)
 {
@@ -519,6 +652,23 @@ cpSpaceFilterArbiters(cpSpace *space, cpBody *body, cpShape *filter)
 	} cpSpaceUnlock(space, cpTrue);
 }
 
+static cpBool
+separatingAxesFilter(struct cpSeparatingAxis *axis, cpShape *shape)
+{
+	if(axis->a == shape || axis->b == shape){
+		cpArrayPush(shape->space->pooledSeparatingAxes, axis);
+		return cpFalse;
+	}
+	
+	return cpTrue;
+}
+
+void
+cpSpaceFilterSeparatingAxes(cpSpace *space, cpShape *shape)
+{
+	cpHashSetFilter(space->separatingAxes, (cpHashSetFilterFunc)separatingAxesFilter, shape);
+}
+
 void
 cpSpaceRemoveShape(cpSpace *space, cpShape *shape)
 {
@@ -535,6 +685,7 @@ cpSpaceRemoveShape(cpSpace *space, cpShape *shape)
 
 	cpBodyRemoveShape(body, shape);
 	cpSpaceFilterArbiters(space, body, shape);
+	cpSpaceFilterSeparatingAxes(space, shape);
 	cpSpatialIndexRemove(isStatic ? space->staticShapes : space->dynamicShapes, shape, shape->hashid);
 	shape->space = NULL;
 	shape->hashid = 0;
@@ -688,7 +839,7 @@ void
 cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count)
 {
 	cpSpatialIndex *staticShapes = cpSpaceHashNew(dim, count, (cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
-	cpSpatialIndex *dynamicShapes = cpSpaceHashNew(dim, count, (cpSpatialIndexBBFunc)cpShapeGetBB, staticShapes);
+	cpSpatialIndex *dynamicShapes = cpSpaceHashNew(dim, count, (cpSpatialIndexBBFunc)DynamicShapeBBFunc, staticShapes);
 	
 	cpSpatialIndexEach(space->staticShapes, (cpSpatialIndexIteratorFunc)copyShapes, staticShapes);
 	cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)copyShapes, dynamicShapes);
@@ -699,3 +850,100 @@ cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count)
 	space->staticShapes = staticShapes;
 	space->dynamicShapes = dynamicShapes;
 }
+
+static void pushShape(cpShape *shape, cpArray *shapes){cpArrayPush(shapes, shape);}
+
+// Remove all of the shapes from an index one at a time.
+// Trees cache collision pairs with their partner index, and this cleans them up before the index is replaced.
+static cpArray *
+removeAllShapes(cpSpatialIndex *index)
+{
+	cpArray *shapes = cpArrayNew(cpSpatialIndexCount(index));
+	cpSpatialIndexEach(index, (cpSpatialIndexIteratorFunc)pushShape, shapes);
+	
+	for(int i=0; i<shapes->num; i++){
+		cpShape *shape = (cpShape *)shapes->arr[i];
+		cpSpatialIndexRemove(index, shape, shape->hashid);
+	}
+	
+	return shapes;
+}
+
+// Insert the shapes returned by removeAllShapes() and free the array.
+static void
+insertAllShapes(cpSpatialIndex *index, cpArray *shapes)
+{
+	int count = shapes->num;
+	cpHashValue *hashids = (cpHashValue *)cpcalloc(count > 0 ? count : 1, sizeof(cpHashValue));
+	for(int i=0; i<count; i++) hashids[i] = ((cpShape *)shapes->arr[i])->hashid;
+	
+	cpSpatialIndexInsertBulk(index, shapes->arr, hashids, count);
+	
+	cpfree(hashids);
+	cpArrayFree(shapes);
+}
+
+void
+cpSpaceSetStaticIndex(cpSpace *space, cpSpatialIndexNewFunc constructor)
+{
+	cpAssertSpaceUnlocked(space);
+	cpAssertHard(constructor, "The spatial index constructor cannot be NULL.");
+	
+	cpArray *shapes = removeAllShapes(space->staticShapes);
+	cpSpatialIndexFree(space->staticShapes);
+	
+	cpSpatialIndex *staticShapes = constructor((cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
+	space->dynamicShapes->staticIndex = staticShapes;
+	staticShapes->dynamicIndex = space->dynamicShapes;
+	
+	space->staticShapes = staticShapes;
+	insertAllShapes(staticShapes, shapes);
+}
+
+void
+cpSpaceSetDynamicIndex(cpSpace *space, cpSpatialIndexNewFunc constructor)
+{
+	cpAssertSpaceUnlocked(space);
+	cpAssertHard(constructor, "The spatial index constructor cannot be NULL.");
+	
+	cpArray *shapes = removeAllShapes(space->dynamicShapes);
+	cpSpatialIndexFree(space->dynamicShapes);
+	space->staticShapes->dynamicIndex = NULL;
+	
+	cpSpatialIndex *dynamicShapes = constructor((cpSpatialIndexBBFunc)DynamicShapeBBFunc, space->staticShapes);
+	if(cpBBTreeIsTree(dynamicShapes)){
+		cpBBTreeSetVelocityFunc(dynamicShapes, (cpBBTreeVelocityFunc)ShapeVelocityFunc);
+	} else if(cpCompactBBTreeIsTree(dynamicShapes)){
+		cpCompactBBTreeSetVelocityFunc(dynamicShapes, (cpBBTreeVelocityFunc)ShapeVelocityFunc);
+	}
+	
+	space->dynamicShapes = dynamicShapes;
+	insertAllShapes(dynamicShapes, shapes);
+}
+
+cpSpatialIndex *
+cpSpaceGetStaticIndex(cpSpace *space)
+{
+	return space->staticShapes;
+}
+
+cpSpatialIndex *
+cpSpaceGetDynamicIndex(cpSpace *space)
+{
+	return space->dynamicShapes;
+}
+
+void
+cpSpaceUseAutoSpatialHash(cpSpace *space, cpFloat dim, int count)
+{
+	cpSpaceUseSpatialHash(space, dim, count);
+	
+	cpSpaceHashSetAutoTune(space->staticShapes, cpTrue);
+	cpSpaceHashSetAutoTune(space->dynamicShapes, cpTrue);
+}
+
+cpSpaceHashStats
+cpSpaceGetSpatialHashStats(cpSpace *space)
+{
+	return cpSpaceHashGetStats(space->dynamicShapes);
+}
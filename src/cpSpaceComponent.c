@@ -217,12 +217,80 @@ ComponentActive(cpBody *root, cpFloat threshold)
 	return cpFalse;
 }
 
+// Awake dynamic bodies are the only bodies that belong to an island.
+static inline cpBool
+BodyInIsland(cpBody *body)
+{
+	return (cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC && !cpBodyIsSleeping(body));
+}
+
+// Record an awake component as an island along with the arbiters and constraints that belong to it.
+// Items between two island bodies are arbitrarily owned by bodyA like in cpSpaceActivateBody().
+static void
+cpSpacePushIsland(cpSpace *space, cpBody *root)
+{
+	if(space->islandCount == space->islandCapacity){
+		space->islandCapacity = (space->islandCapacity ? 2*space->islandCapacity : 16);
+		space->islands = (struct cpIsland *)cprealloc(space->islands, space->islandCapacity*sizeof(struct cpIsland));
+	}
+	
+	struct cpIsland *island = space->islands + space->islandCount++;
+	island->bodyStart = space->islandBodies->num;
+	island->arbiterStart = space->islandArbiters->num;
+	island->constraintStart = space->islandConstraints->num;
+	
+	CP_BODY_FOREACH_COMPONENT(root, body){
+		// Bodies attached by constraints aren't required to be added to the space.
+		if(body->space == space) cpArrayPush(space->islandBodies, body);
+		
+		CP_BODY_FOREACH_ARBITER(body, arb){
+			cpBody *other = (arb->body_a == body ? arb->body_b : arb->body_a);
+			if(body == arb->body_a || cpBodyGetType(other) != CP_BODY_TYPE_DYNAMIC) cpArrayPush(space->islandArbiters, arb);
+		}
+		
+		CP_BODY_FOREACH_CONSTRAINT(body, constraint){
+			cpBody *other = (constraint->a == body ? constraint->b : constraint->a);
+			if(body == constraint->a || cpBodyGetType(other) != CP_BODY_TYPE_DYNAMIC) cpArrayPush(space->islandConstraints, constraint);
+		}
+	}
+	
+	island->bodyCount = space->islandBodies->num - island->bodyStart;
+	island->arbiterCount = space->islandArbiters->num - island->arbiterStart;
+	island->constraintCount = space->islandConstraints->num - island->constraintStart;
+}
+
+// Append the arbiters and constraints that aren't part of any awake island.
+// This happens for arbiters of components that just fell asleep or constraints between non-dynamic bodies.
+static void
+cpSpacePushIslandLeftovers(cpSpace *space)
+{
+	cpArray *arbiters = space->arbiters;
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		if(!BodyInIsland(arb->body_a) && !BodyInIsland(arb->body_b)) cpArrayPush(space->islandArbiters, arb);
+	}
+	
+	cpArray *constraints = space->constraints;
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		if(!BodyInIsland(constraint->a) && !BodyInIsland(constraint->b)) cpArrayPush(space->islandConstraints, constraint);
+	}
+}
+
 void
 cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 {
 	cpBool sleep = (space->sleepTimeThreshold != INFINITY);
+	cpBool islands = space->buildIslands;
 	cpArray *bodies = space->dynamicBodies;
 	
+	if(islands){
+		space->islandCount = 0;
+		space->islandBodies->num = 0;
+		space->islandArbiters->num = 0;
+		space->islandConstraints->num = 0;
+	}
+	
 #ifndef NDEBUG
 	for(int i=0; i<bodies->num; i++){
 		cpBody *body = (cpBody*)bodies->arr[i];
@@ -276,7 +344,9 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 			if(cpBodyGetType(b) == CP_BODY_TYPE_KINEMATIC) cpBodyActivate(a);
 			if(cpBodyGetType(a) == CP_BODY_TYPE_KINEMATIC) cpBodyActivate(b);
 		}
-		
+	}
+	
+	if(sleep || islands){
 		// Generate components and deactivate sleeping ones
 		for(int i=0; i<bodies->num;){
 			cpBody *body = (cpBody*)bodies->arr[i];
@@ -287,7 +357,7 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 				FloodFillComponent(body, body);
 				
 				// Check if the component should be put to sleep.
-				if(!ComponentActive(body, space->sleepTimeThreshold)){
+				if(sleep && !ComponentActive(body, space->sleepTimeThreshold)){
 					cpArrayPush(space->sleepingComponents, body);
 					CP_BODY_FOREACH_COMPONENT(body, other) cpSpaceDeactivateBody(space, other);
 					
@@ -295,6 +365,9 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 					// Skip incrementing the index counter.
 					continue;
 				}
+				
+				// Kinematic bodies are never part of a component.
+				if(islands && ComponentRoot(body) != NULL) cpSpacePushIsland(space, body);
 			}
 			
 			i++;
@@ -304,6 +377,8 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 			body->sleeping.next = NULL;
 		}
 	}
+	
+	if(islands) cpSpacePushIslandLeftovers(space);
 }
 
 void
@@ -19,9 +19,28 @@
  * SOFTWARE.
  */
 
+#include <string.h>
+
 #include "chipmunk/chipmunk_private.h"
 #include "prime.h"
 
+// Auto tuning parameters.
+// Objects covering more cells than this on average means the cells are too small.
+#define TUNE_CELLS_MAX 9.0f
+// Handles sharing an occupied cell on average before the cells are considered too large.
+#define TUNE_HANDLES_MAX 8.0f
+// The cell size is only changed when it's off from the mean object size by more than this factor.
+#define TUNE_DIM_BAND 1.5f
+// Range of bins per table cell before the table is resized, and the load it's resized to.
+#define TUNE_LOAD_MIN 0.125f
+#define TUNE_LOAD_MAX 1.0f
+#define TUNE_LOAD 0.5f
+#define TUNE_TABLE_MAX (1<<24)
+// Objects covering more cells than this are counted as spanning objects in the stats.
+#define TUNE_SPAN_CELLS 9
+// Number of full rehashes to wait after a resize before retuning again.
+#define TUNE_COOLDOWN 8
+
 typedef struct cpSpaceHashBin cpSpaceHashBin;
 typedef struct cpHandle cpHandle;
 
@@ -39,6 +58,14 @@ struct cpSpaceHash {
 	cpArray *allocatedBuffers;
 	
 	cpTimestamp stamp;
+	
+	cpBool autoTune;
+	int tuneCooldown;
+	cpSpaceHashStats stats;
+	
+	// Running totals for the stats, restarted by each full rehash.
+	int tallyObjects, tallyBins, tallyOccupied, tallySpanning;
+	cpFloat tallyCells, tallyExtent;
 };
 
 
@@ -187,6 +214,10 @@ cpSpaceHashInit(cpSpaceHash *hash, cpFloat celldim, int numcells, cpSpatialIndex
 	
 	hash->stamp = 1;
 	
+	hash->autoTune = cpFalse;
+	hash->tuneCooldown = 0;
+	memset(&hash->stats, 0, sizeof(hash->stats));
+	
 	return (cpSpatialIndex *)hash;
 }
 
@@ -238,6 +269,91 @@ floor_int(cpFloat f)
 	return (f < 0.0f && f != i ? i - 1 : i);
 }
 
+//MARK: Statistics
+
+static inline void
+tallyObject(cpSpaceHash *hash, cpBB bb, int l, int r, int b, int t)
+{
+	cpFloat cells = (cpFloat)(r - l + 1)*(cpFloat)(t - b + 1);
+	
+	hash->tallyObjects++;
+	hash->tallyCells += cells;
+	hash->tallyExtent += ((bb.r - bb.l) + (bb.t - bb.b))*0.5f;
+	if(cells > TUNE_SPAN_CELLS) hash->tallySpanning++;
+}
+
+static inline void
+tallyBin(cpSpaceHash *hash, cpSpaceHashBin *bin)
+{
+	hash->tallyBins++;
+	if(bin == NULL) hash->tallyOccupied++;
+}
+
+static void
+beginTally(cpSpaceHash *hash)
+{
+	hash->tallyObjects = hash->tallyBins = hash->tallyOccupied = hash->tallySpanning = 0;
+	hash->tallyCells = hash->tallyExtent = 0.0f;
+}
+
+static void
+endTally(cpSpaceHash *hash)
+{
+	cpSpaceHashStats *stats = &hash->stats;
+	int objects = hash->tallyObjects;
+	
+	stats->objects = objects;
+	stats->bins = hash->tallyBins;
+	stats->occupiedCells = hash->tallyOccupied;
+	stats->spanningObjects = hash->tallySpanning;
+	stats->meanExtent = (objects ? hash->tallyExtent/objects : 0.0f);
+	stats->cellsPerObject = (objects ? hash->tallyCells/objects : 0.0f);
+	stats->handlesPerCell = (hash->tallyOccupied ? (cpFloat)hash->tallyBins/(cpFloat)hash->tallyOccupied : 0.0f);
+}
+
+static void cpSpaceHashResizeTable(cpSpaceHash *hash, cpFloat celldim, int numcells);
+
+// Pick a new cell size and table size from the stats of the last full rehash.
+static void
+cpSpaceHashTune(cpSpaceHash *hash)
+{
+	cpSpaceHashStats *stats = &hash->stats;
+	if(hash->tuneCooldown > 0){
+		hash->tuneCooldown--;
+		return;
+	}
+	
+	if(stats->objects == 0) return;
+	
+	// Move the cell size to the mean object size when the objects span too many cells,
+	// or when they pile up in too few. The band keeps it from flip flopping between sizes.
+	cpFloat dim = hash->celldim;
+	cpFloat target = stats->meanExtent;
+	if(target > 0.0f){
+		cpBool tooSmall = (stats->cellsPerObject > TUNE_CELLS_MAX && target > dim*TUNE_DIM_BAND);
+		cpBool tooLarge = (stats->handlesPerCell > TUNE_HANDLES_MAX && target*TUNE_DIM_BAND < dim);
+		if(tooSmall || tooLarge) dim = target;
+	}
+	
+	// Estimate how many bins the objects will need with the new cell size to size the table.
+	cpFloat span = stats->meanExtent/dim + 1.0f;
+	cpFloat bins = stats->objects*span*span;
+	
+	int numcells = hash->numcells;
+	if(bins > numcells*TUNE_LOAD_MAX || bins < numcells*TUNE_LOAD_MIN){
+		numcells = (int)cpfmin(bins/TUNE_LOAD, TUNE_TABLE_MAX);
+	}
+	
+	if(dim != hash->celldim || next_prime(numcells) != hash->numcells){
+		cpSpaceHashResizeTable(hash, dim, numcells);
+		
+		stats->resizes++;
+		hash->tuneCooldown = TUNE_COOLDOWN;
+	}
+}
+
+//MARK: Hashing
+
 static inline void
 hashHandle(cpSpaceHash *hash, cpHandle *hand, cpBB bb)
 {
@@ -247,6 +363,7 @@ hashHandle(cpSpaceHash *hash, cpHandle *hand, cpBB bb)
 	int r = floor_int(bb.r/dim);
 	int b = floor_int(bb.b/dim);
 	int t = floor_int(bb.t/dim);
+	tallyObject(hash, bb, l, r, b, t);
 	
 	int n = hash->numcells;
 	for(int i=l; i<=r; i++){
@@ -256,6 +373,7 @@ hashHandle(cpSpaceHash *hash, cpHandle *hand, cpBB bb)
 			
 			// Don't add an object twice to the same cell.
 			if(containsHandle(bin, hand)) continue;
+			tallyBin(hash, bin);
 
 			cpHandleRetain(hand);
 			// Insert a new bin for the handle in this cell.
@@ -276,6 +394,27 @@ cpSpaceHashInsert(cpSpaceHash *hash, void *obj, cpHashValue hashid)
 	hashHandle(hash, hand, hash->spatialIndex.bbfunc(obj));
 }
 
+static void
+cpSpaceHashInsertBulk(cpSpaceHash *hash, void **objs, cpHashValue *hashids, int count)
+{
+	cpHashSetReserve(hash->handleSet, cpHashSetCount(hash->handleSet) + count);
+	
+	// Allocate all of the missing handles in a single buffer.
+	int needed = count - hash->pooledHandles->num;
+	if(needed > 0){
+		cpHandle *buffer = (cpHandle *)cpcalloc(needed, sizeof(cpHandle));
+		cpArrayPush(hash->allocatedBuffers, buffer);
+		
+		for(int i=0; i<needed; i++) cpArrayPush(hash->pooledHandles, buffer + i);
+	}
+	
+	cpSpatialIndexBBFunc bbfunc = hash->spatialIndex.bbfunc;
+	for(int i=0; i<count; i++){
+		cpHandle *hand = (cpHandle *)cpHashSetInsert(hash->handleSet, hashids[i], objs[i], (cpHashSetTransFunc)handleSetTrans, hash);
+		hashHandle(hash, hand, bbfunc(objs[i]));
+	}
+}
+
 static void
 cpSpaceHashRehashObject(cpSpaceHash *hash, void *obj, cpHashValue hashid)
 {
@@ -298,8 +437,12 @@ rehash_helper(cpHandle *hand, cpSpaceHash *hash)
 static void
 cpSpaceHashRehash(cpSpaceHash *hash)
 {
+	if(hash->autoTune) cpSpaceHashTune(hash);
 	clearTable(hash);
+	
+	beginTally(hash);
 	cpHashSetEach(hash->handleSet, (cpHashSetIteratorFunc)rehash_helper, hash);
+	endTally(hash);
 }
 
 static void
@@ -421,6 +564,7 @@ queryRehash_helper(cpHandle *hand, queryRehashContext *context)
 	int r = floor_int(bb.r/dim);
 	int b = floor_int(bb.b/dim);
 	int t = floor_int(bb.t/dim);
+	tallyObject(hash, bb, l, r, b, t);
 	
 	cpSpaceHashBin **table = hash->table;
 
@@ -430,6 +574,7 @@ queryRehash_helper(cpHandle *hand, queryRehashContext *context)
 			cpSpaceHashBin *bin = table[idx];
 			
 			if(containsHandle(bin, hand)) continue;
+			tallyBin(hash, bin);
 			
 			cpHandleRetain(hand); // this MUST be done first in case the object is removed in func()
 			query_helper(hash, &bin, obj, func, data);
@@ -448,10 +593,14 @@ queryRehash_helper(cpHandle *hand, queryRehashContext *context)
 static void
 cpSpaceHashReindexQuery(cpSpaceHash *hash, cpSpatialIndexQueryFunc func, void *data)
 {
+	// Resizing clears the table anyway, so retune before rehashing everything.
+	if(hash->autoTune) cpSpaceHashTune(hash);
 	clearTable(hash);
 	
+	beginTally(hash);
 	queryRehashContext context = {hash, func, data};
 	cpHashSetEach(hash->handleSet, (cpHashSetIteratorFunc)queryRehash_helper, &context);
+	endTally(hash);
 	
 	cpSpatialIndexCollideStatic((cpSpatialIndex *)hash, hash->spatialIndex.staticIndex, func, data);
 }
@@ -544,6 +693,16 @@ cpSpaceHashSegmentQuery(cpSpaceHash *hash, void *obj, cpVect a, cpVect b, cpFloa
 
 //MARK: Misc
 
+// Leaves the table empty, the objects need to be rehashed afterwards.
+static void
+cpSpaceHashResizeTable(cpSpaceHash *hash, cpFloat celldim, int numcells)
+{
+	clearTable(hash);
+	
+	hash->celldim = celldim;
+	cpSpaceHashAllocTable(hash, next_prime(numcells));
+}
+
 void
 cpSpaceHashResize(cpSpaceHash *hash, cpFloat celldim, int numcells)
 {
@@ -552,10 +711,38 @@ cpSpaceHashResize(cpSpaceHash *hash, cpFloat celldim, int numcells)
 		return;
 	}
 	
-	clearTable(hash);
+	cpSpaceHashResizeTable(hash, celldim, numcells);
+}
+
+void
+cpSpaceHashSetAutoTune(cpSpatialIndex *index, cpBool autoTune)
+{
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpSpaceHashSetAutoTune() call to non-cpSpaceHash spatial index.");
+		return;
+	}
 	
-	hash->celldim = celldim;
-	cpSpaceHashAllocTable(hash, next_prime(numcells));
+	cpSpaceHash *hash = (cpSpaceHash *)index;
+	hash->autoTune = autoTune;
+	hash->tuneCooldown = 0;
+}
+
+cpSpaceHashStats
+cpSpaceHashGetStats(cpSpatialIndex *index)
+{
+	cpSpaceHashStats stats = {0.0f, 0, 0, 0, 0, 0.0f, 0.0f, 0.0f, 0, 0};
+	
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpSpaceHashGetStats() call to non-cpSpaceHash spatial index.");
+		return stats;
+	}
+	
+	cpSpaceHash *hash = (cpSpaceHash *)index;
+	stats = hash->stats;
+	stats.celldim = hash->celldim;
+	stats.numcells = hash->numcells;
+	
+	return stats;
 }
 
 static int
@@ -586,6 +773,8 @@ static cpSpatialIndexClass klass = {
 	
 	(cpSpatialIndexQueryImpl)cpSpaceHashQuery,
 	(cpSpatialIndexSegmentQueryImpl)cpSpaceHashSegmentQuery,
+	
+	(cpSpatialIndexInsertBulkImpl)cpSpaceHashInsertBulk,
 };
 
 static inline cpSpatialIndexClass *Klass(){return &klass;}
@@ -21,6 +21,39 @@
 
 #include "chipmunk/chipmunk_private.h"
 
+#if CP_STEP_STATS
+	#if defined(_WIN32)
+		#include <windows.h>
+	#elif defined(__APPLE__)
+		#include <mach/mach_time.h>
+	#else
+		#include <time.h>
+	#endif
+#endif
+
+//MARK: Step Stats
+
+#if CP_STEP_STATS
+uint64_t
+cpStepStatsTime(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)((double)counter.QuadPart*(1e9/(double)frequency.QuadPart));
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if(timebase.denom == 0) mach_timebase_info(&timebase);
+	return mach_absolute_time()*timebase.numer/timebase.denom;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec*1000000000ull + (uint64_t)time.tv_nsec;
+#endif
+}
+#endif
+
 //MARK: Post Step Callback Functions
 
 cpPostStepCallback *
@@ -119,10 +152,10 @@ typedef struct cpContactBuffer {
 } cpContactBuffer;
 
 static cpContactBufferHeader *
-cpSpaceAllocContactBuffer(cpSpace *space)
+cpContactBufferAlloc(cpArray *allocatedBuffers)
 {
 	cpContactBuffer *buffer = (cpContactBuffer *)cpcalloc(1, sizeof(cpContactBuffer));
-	cpArrayPush(space->allocatedBuffers, buffer);
+	cpArrayPush(allocatedBuffers, buffer);
 	return (cpContactBufferHeader *)buffer;
 }
 
@@ -136,45 +169,57 @@ cpContactBufferHeaderInit(cpContactBufferHeader *header, cpTimestamp stamp, cpCo
 	return header;
 }
 
-void
-cpSpacePushFreshContactBuffer(cpSpace *space)
+cpContactBufferHeader *
+cpContactBufferRingPushFresh(cpContactBufferHeader *head, cpArray *allocatedBuffers, cpTimestamp stamp, cpTimestamp persistence)
 {
-	cpTimestamp stamp = space->stamp;
-	
-	cpContactBufferHeader *head = space->contactBuffersHead;
-	
 	if(!head){
 		// No buffers have been allocated, make one
-		space->contactBuffersHead = cpContactBufferHeaderInit(cpSpaceAllocContactBuffer(space), stamp, NULL);
-	} else if(stamp - head->next->stamp > space->collisionPersistence){
+		return cpContactBufferHeaderInit(cpContactBufferAlloc(allocatedBuffers), stamp, NULL);
+	} else if(stamp - head->next->stamp > persistence){
 		// The tail buffer is available, rotate the ring
-	cpContactBufferHeader *tail = head->next;
-		space->contactBuffersHead = cpContactBufferHeaderInit(tail, stamp, tail);
+		cpContactBufferHeader *tail = head->next;
+		return cpContactBufferHeaderInit(tail, stamp, tail);
 	} else {
 		// Allocate a new buffer and push it into the ring
-		cpContactBufferHeader *buffer = cpContactBufferHeaderInit(cpSpaceAllocContactBuffer(space), stamp, head);
-		space->contactBuffersHead = head->next = buffer;
+		cpContactBufferHeader *buffer = cpContactBufferHeaderInit(cpContactBufferAlloc(allocatedBuffers), stamp, head);
+		return (head->next = buffer);
 	}
 }
 
-
 struct cpContact *
-cpContactBufferGetArray(cpSpace *space)
+cpContactBufferRingGetArray(cpContactBufferHeader **head, cpArray *allocatedBuffers, cpTimestamp stamp, cpTimestamp persistence)
 {
-	if(space->contactBuffersHead->numContacts + CP_MAX_CONTACTS_PER_ARBITER > CP_CONTACTS_BUFFER_SIZE){
+	if((*head)->numContacts + CP_MAX_CONTACTS_PER_ARBITER > CP_CONTACTS_BUFFER_SIZE){
 		// contact buffer could overflow on the next collision, push a fresh one.
-		cpSpacePushFreshContactBuffer(space);
+		(*head) = cpContactBufferRingPushFresh(*head, allocatedBuffers, stamp, persistence);
 	}
 	
-	cpContactBufferHeader *head = space->contactBuffersHead;
-	return ((cpContactBuffer *)head)->contacts + head->numContacts;
+	return ((cpContactBuffer *)(*head))->contacts + (*head)->numContacts;
 }
 
 void
-cpSpacePushContacts(cpSpace *space, int count)
+cpContactBufferRingPushContacts(cpContactBufferHeader *head, int count)
 {
 	cpAssertHard(count <= CP_MAX_CONTACTS_PER_ARBITER, "Internal Error: Contact buffer overflow!");
-	space->contactBuffersHead->numContacts += count;
+	head->numContacts += count;
+}
+
+void
+cpSpacePushFreshContactBuffer(cpSpace *space)
+{
+	space->contactBuffersHead = cpContactBufferRingPushFresh(space->contactBuffersHead, space->allocatedBuffers, space->stamp, space->collisionPersistence);
+}
+
+struct cpContact *
+cpContactBufferGetArray(cpSpace *space)
+{
+	return cpContactBufferRingGetArray(&space->contactBuffersHead, space->allocatedBuffers, space->stamp, space->collisionPersistence);
+}
+
+void
+cpSpacePushContacts(cpSpace *space, int count)
+{
+	cpContactBufferRingPushContacts(space->contactBuffersHead, count);
 }
 
 static void
@@ -182,6 +227,129 @@ cpSpacePopContacts(cpSpace *space, int count){
 	space->contactBuffersHead->numContacts -= count;
 }
 
+//MARK: Separating Axis Cache
+
+static void *
+cpSpaceSeparatingAxisTrans(const cpShape **shapes, cpSpace *space)
+{
+	if(space->pooledSeparatingAxes->num == 0){
+		int count = CP_BUFFER_BYTES/sizeof(struct cpSeparatingAxis);
+		cpAssertHard(count, "Internal Error: Buffer size too small.");
+		
+		struct cpSeparatingAxis *buffer = (struct cpSeparatingAxis *)cpcalloc(1, CP_BUFFER_BYTES);
+		cpArrayPush(space->allocatedBuffers, buffer);
+		
+		for(int i=0; i<count; i++) cpArrayPush(space->pooledSeparatingAxes, buffer + i);
+	}
+	
+	struct cpSeparatingAxis *axis = (struct cpSeparatingAxis *)cpArrayPop(space->pooledSeparatingAxes);
+	axis->a = shapes[0];
+	axis->b = shapes[1];
+	return axis;
+}
+
+// Distance from the origin of a shape's body to the farthest corner of its bounding box.
+// This limits how far any point on the shape can move when the body rotates.
+static inline cpFloat
+ShapeReach(const cpShape *shape, cpVect origin)
+{
+	cpBB bb = shape->bb;
+	cpFloat dx = cpfmax(origin.x - bb.l, bb.r - origin.x);
+	cpFloat dy = cpfmax(origin.y - bb.b, bb.t - origin.y);
+	return cpfsqrt(dx*dx + dy*dy);
+}
+
+cpBool
+cpSpaceSeparatingAxisCulls(cpSpace *space, const cpShape *a, const cpShape *b, cpFloat margin, struct cpSeparatingAxis **axisPtr)
+{
+	const cpShape *shape_pair[] = {a, b};
+	struct cpSeparatingAxis *axis = (struct cpSeparatingAxis *)cpHashSetFind(space->separatingAxes, CP_HASH_PAIR((cpHashValue)a, (cpHashValue)b), shape_pair);
+	(*axisPtr) = axis;
+	if(axis == NULL) return cpFalse;
+	
+	// The axis is no good if either shape was reshaped after it was found.
+	if(axis->geometryA != axis->a->geometryStamp || axis->geometryB != axis->b->geometryStamp) return cpFalse;
+	
+	cpTransform ta = axis->a->body->transform, tb = axis->b->body->transform;
+	cpVect qa = cpv(ta.a, ta.b), pa = cpv(ta.tx, ta.ty);
+	cpVect qb = cpv(tb.a, tb.b), pb = cpv(tb.tx, tb.ty);
+	
+	// Translating the bodies changes the gap along the axis directly.
+	// Rotating them moves each point on the shapes by at most |q - q0| times its distance from the body's origin.
+	cpFloat gap = axis->d - cpvdot(axis->n, cpvsub(pa, axis->ta)) + cpvdot(axis->n, cpvsub(pb, axis->tb));
+	gap -= cpvdist(qa, axis->qa)*ShapeReach(axis->a, pa) + cpvdist(qb, axis->qb)*ShapeReach(axis->b, pb);
+	
+	// Pairs within the speculative margin need contacts even if they aren't touching.
+	return (gap > margin);
+}
+
+void
+cpSpaceCacheSeparatingAxis(cpSpace *space, struct cpCollisionInfo *info, struct cpSeparatingAxis *axis)
+{
+	if(axis == NULL){
+		const cpShape *shape_pair[] = {info->a, info->b};
+		cpHashValue hash = CP_HASH_PAIR((cpHashValue)info->a, (cpHashValue)info->b);
+		axis = (struct cpSeparatingAxis *)cpHashSetInsert(space->separatingAxes, hash, shape_pair, (cpHashSetTransFunc)cpSpaceSeparatingAxisTrans, space);
+	}
+	
+	cpTransform ta = info->a->body->transform, tb = info->b->body->transform;
+	axis->a = info->a;
+	axis->b = info->b;
+	axis->n = info->n;
+	axis->d = info->separation;
+	axis->qa = cpv(ta.a, ta.b);
+	axis->ta = cpv(ta.tx, ta.ty);
+	axis->qb = cpv(tb.a, tb.b);
+	axis->tb = cpv(tb.tx, tb.ty);
+	axis->geometryA = info->a->geometryStamp;
+	axis->geometryB = info->b->geometryStamp;
+	axis->stamp = space->stamp;
+}
+
+// Hashset filter func to throw away old separating axes.
+cpBool
+cpSpaceSeparatingAxisFilter(struct cpSeparatingAxis *axis, cpSpace *space)
+{
+	if(space->stamp - axis->stamp >= space->collisionPersistence){
+		cpArrayPush(space->pooledSeparatingAxes, axis);
+		return cpFalse;
+	}
+	
+	return cpTrue;
+}
+
+//MARK: Speculative Contacts
+
+// Upper bound on how far any point on a body's shape can move during the next step.
+// Gravity is applied before the positions are integrated, so it's included as well.
+static inline cpFloat
+ShapeSpeculativeMotion(const cpShape *shape, cpFloat dt, cpFloat gravity)
+{
+	cpBody *body = shape->body;
+	return (cpvlength(body->v) + cpfabs(body->w)*ShapeReach(shape, body->p) + gravity*dt)*dt;
+}
+
+cpFloat
+cpSpaceShapeSpeculativeMargin(cpSpace *space, const cpShape *shape)
+{
+	if(!space->speculativeContacts || shape->sensor || cpBodyGetType(shape->body) == CP_BODY_TYPE_STATIC) return 0.0f;
+	
+	return ShapeSpeculativeMotion(shape, space->curr_dt, cpvlength(space->gravity));
+}
+
+cpFloat
+cpSpaceSpeculativeMargin(cpSpace *space, const cpShape *a, const cpShape *b)
+{
+	if(!space->speculativeContacts || a->sensor || b->sensor) return 0.0f;
+	
+	// Only the relative linear velocity of the bodies can close the gap.
+	cpBody *body_a = a->body, *body_b = b->body;
+	cpFloat dt = space->curr_dt;
+	cpFloat speed = cpvlength(cpvsub(body_b->v, body_a->v));
+	speed += cpfabs(body_a->w)*ShapeReach(a, body_a->p) + cpfabs(body_b->w)*ShapeReach(b, body_b->p);
+	return (speed + cpvlength(space->gravity)*dt)*dt;
+}
+
 //MARK: Collision Detection Functions
 
 static void *
@@ -198,6 +366,7 @@ cpSpaceArbiterSetTrans(cpShape **shapes, cpSpace *space)
 		for(int i=0; i<count; i++) cpArrayPush(space->pooledArbiters, buffer + i);
 	}
 	
+	CP_STATS_COUNT(&space->stepStats, arbitersCreated, 1);
 	return cpArbiterInit((cpArbiter *)cpArrayPop(space->pooledArbiters), shapes[0], shapes[1]);
 }
 
@@ -217,11 +386,13 @@ QueryRejectConstraint(cpBody *a, cpBody *b)
 }
 
 static inline cpBool
-QueryReject(cpShape *a, cpShape *b)
+QueryReject(cpShape *a, cpShape *b, cpFloat margin)
 {
+	cpBB bb = a->bb;
+	
 	return (
-		// BBoxes must overlap
-		!cpBBIntersects(a->bb, b->bb)
+		// BBoxes must overlap, or be close enough for speculative contacts.
+		!cpBBIntersects(cpBBNew(bb.l - margin, bb.b - margin, bb.r + margin, bb.t + margin), b->bb)
 		// Don't collide shapes attached to the same body.
 		|| a->body == b->body
 		// Don't collide shapes that are filtered.
@@ -231,25 +402,29 @@ QueryReject(cpShape *a, cpShape *b)
 	);
 }
 
-// Callback from the spatial hash.
-cpCollisionID
-cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
+cpBool
+cpSpaceShapesQueryReject(cpShape *a, cpShape *b, cpFloat margin)
 {
-	// Reject any of the simple cases
-	if(QueryReject(a,b)) return id;
-	
-	// Narrow-phase collision detection.
-	struct cpCollisionInfo info = cpCollide(a, b, id, cpContactBufferGetArray(space));
-	
-	if(info.count == 0) return info.id; // Shapes are not colliding.
-	cpSpacePushContacts(space, info.count);
+	return QueryReject(a, b, margin);
+}
+
+// Update the arbiter for a narrow-phase collision and run the begin/preSolve callbacks.
+// If arb is NULL it's looked up (or created) in the arbiter cache.
+// Returns cpFalse if the contacts were rejected and can be discarded.
+cpBool
+cpSpaceProcessCollision(cpSpace *space, struct cpCollisionInfo *info, cpArbiter *arb)
+{
+	const cpShape *a = info->a, *b = info->b;
 	
 	// Get an arbiter from space->arbiterSet for the two shapes.
 	// This is where the persistant contact magic comes from.
-	const cpShape *shape_pair[] = {info.a, info.b};
-	cpHashValue arbHashID = CP_HASH_PAIR((cpHashValue)info.a, (cpHashValue)info.b);
-	cpArbiter *arb = (cpArbiter *)cpHashSetInsert(space->cachedArbiters, arbHashID, shape_pair, (cpHashSetTransFunc)cpSpaceArbiterSetTrans, space);
-	cpArbiterUpdate(arb, &info, space);
+	if(arb == NULL){
+		const cpShape *shape_pair[] = {a, b};
+		cpHashValue arbHashID = CP_HASH_PAIR((cpHashValue)a, (cpHashValue)b);
+		arb = (cpArbiter *)cpHashSetInsert(space->cachedArbiters, arbHashID, shape_pair, (cpHashSetTransFunc)cpSpaceArbiterSetTrans, space);
+	}
+	
+	cpArbiterUpdate(arb, info, space);
 	
 	cpCollisionHandler *handler = arb->handler;
 	
@@ -258,7 +433,7 @@ cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
 		cpArbiterIgnore(arb); // permanently ignore the collision until separation
 	}
 	
-	if(
+	cpBool accepted = (
 		// Ignore the arbiter if it has been flagged
 		(arb->state != CP_ARBITER_STATE_IGNORE) && 
 		// Call preSolve
@@ -270,11 +445,11 @@ cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
 		// Don't process collisions between two infinite mass bodies.
 		// This includes collisions between two kinematic bodies, or a kinematic body and a static body.
 		!(a->body->m == INFINITY && b->body->m == INFINITY)
-	){
+	);
+	
+	if(accepted){
 		cpArrayPush(space->arbiters, arb);
 	} else {
-		cpSpacePopContacts(space, info.count);
-		
 		arb->contacts = NULL;
 		arb->count = 0;
 		
@@ -285,6 +460,100 @@ cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
 	
 	// Time stamp the arbiter so we know it was used recently.
 	arb->stamp = space->stamp;
+	return accepted;
+}
+
+static void
+CollideBatchedShapes(cpSpace *space)
+{
+	struct cpBatchCollision results[CP_COLLISION_BATCH_SIZE];
+	cpCollideBatch(space->batchedPairs, space->batchedCount, results);
+	
+	// Process the results in the order the broadphase found them.
+	for(int i=0; i<space->batchedCount; i++){
+		struct cpCollisionInfo info = cpCollisionInfoForBatch(space->batchedPairs + i, results + i, cpContactBufferGetArray(space));
+		CP_STATS_COUNT(&space->stepStats, contactsCreated, info.count);
+		
+		if(info.count > 0){
+			cpSpacePushContacts(space, info.count);
+			
+			if(!cpSpaceProcessCollision(space, &info, NULL)){
+				// The contacts were not used, give them back to the buffer.
+				cpSpacePopContacts(space, info.count);
+			}
+		}
+	}
+	
+	space->batchedCount = 0;
+}
+
+void
+cpSpaceCollideBatchedShapes(cpSpace *space)
+{
+	CP_STATS_START(timer);
+	CollideBatchedShapes(space);
+	CP_STATS_LAP(timer, &space->stepStats, narrowphase);
+}
+
+// Callback from the spatial hash.
+cpCollisionID
+cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
+{
+	CP_STATS_COUNT(&space->stepStats, pairsTested, 1);
+	
+	// Reject any of the simple cases
+	cpFloat margin = cpSpaceSpeculativeMargin(space, a, b);
+	if(QueryReject(a, b, margin)){
+		CP_STATS_COUNT(&space->stepStats, pairsRejected, 1);
+		return id;
+	}
+	
+	CP_STATS_START(timer);
+	
+	// Queue up circle pairs to be collided in batches.
+	if(cpShapesCollideInBatches(a, b)){
+		if(space->batchedCount == CP_COLLISION_BATCH_SIZE) CollideBatchedShapes(space);
+		
+		// Make sure the circle is first.
+		struct cpBatchPair pair = {a, b, id, margin};
+		if(a->klass->type > b->klass->type){
+			pair.a = b;
+			pair.b = a;
+		}
+		
+		space->batchedPairs[space->batchedCount++] = pair;
+		CP_STATS_LAP(timer, &space->stepStats, narrowphase);
+		return id;
+	}
+	
+	// Pairs that weren't touching recently can skip the narrow-phase until their bodies move enough to close the gap.
+	struct cpSeparatingAxis *axis = NULL;
+	if(cpShapesCacheSeparatingAxes(a, b) && cpSpaceSeparatingAxisCulls(space, a, b, margin, &axis)){
+		axis->stamp = space->stamp;
+		CP_STATS_COUNT(&space->stepStats, pairsCulled, 1);
+		CP_STATS_LAP(timer, &space->stepStats, narrowphase);
+		return id;
+	}
+	
+	// Narrow-phase collision detection.
+	struct cpCollisionInfo info = cpCollide(a, b, id, margin, cpContactBufferGetArray(space));
+	CP_STATS_COUNT(&space->stepStats, gjkIterations, info.gjkIterations);
+	CP_STATS_COUNT(&space->stepStats, epaIterations, info.epaIterations);
+	CP_STATS_COUNT(&space->stepStats, contactsCreated, info.count);
+	
+	// Shapes are colliding.
+	if(info.count > 0){
+		cpSpacePushContacts(space, info.count);
+		
+		if(!cpSpaceProcessCollision(space, &info, NULL)){
+			// The contacts were not used, give them back to the buffer.
+			cpSpacePopContacts(space, info.count);
+		}
+	} else if(info.separation > 0.0f){
+		cpSpaceCacheSeparatingAxis(space, &info, axis);
+	}
+	
+	CP_STATS_LAP(timer, &space->stepStats, narrowphase);
 	return info.id;
 }
 
@@ -324,6 +593,130 @@ cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space)
 	return cpTrue;
 }
 
+//MARK: Bullets
+
+// Conservative advancement iterations to run per shape pair before giving up and stopping the bullet where it is.
+#define BULLET_MAX_ITERATIONS 20
+
+struct BulletSweep {
+	cpSpace *space;
+	cpBody *body;
+	
+	// Pose of the body before and after its position was integrated.
+	cpVect p0, p1;
+	cpFloat a0, a1;
+	
+	// How far the body's origin moves during the step.
+	cpVect delta;
+	// Upper bound on how far any point on the shape being swept moves during the step, and how much of that is from rotating.
+	cpFloat motion, rotation;
+	// Earliest time of impact found so far as a fraction of the step.
+	cpFloat toi;
+};
+
+// Pose the body at fraction t of the way through the step and update the shape being swept.
+static inline void
+BulletSetPose(const struct BulletSweep *sweep, cpShape *shape, cpFloat t)
+{
+	cpBodySetPose(sweep->body, cpvlerp(sweep->p0, sweep->p1, t), cpflerp(sweep->a0, sweep->a1, t));
+	cpShapeCacheBB(shape);
+}
+
+// Distance between two shapes, negative when they overlap, and the normal pointing from a towards b.
+// Returns cpFalse if they are farther than maxDistance apart.
+static cpBool
+ShapeDistance(const cpShape *a, const cpShape *b, cpFloat maxDistance, cpFloat *distance, cpVect *normal)
+{
+	struct cpContact contacts[CP_MAX_CONTACTS_PER_ARBITER];
+	struct cpCollisionInfo info = cpCollide(a, b, 0, maxDistance, contacts);
+	if(info.count == 0) return cpFalse;
+	
+	cpFloat d = INFINITY;
+	for(int i=0; i<info.count; i++) d = cpfmin(d, cpvdot(cpvsub(contacts[i].r2, contacts[i].r1), info.n));
+	
+	(*distance) = d;
+	(*normal) = (info.a == a ? info.n : cpvneg(info.n));
+	return cpTrue;
+}
+
+// Spatial index callback to find the time of impact between a bullet's shape and a static shape.
+static cpCollisionID
+BulletSweepQuery(cpShape *shape, cpShape *other, cpCollisionID id, struct BulletSweep *sweep)
+{
+	if(
+		other->sensor || other->body == shape->body ||
+		cpShapeFilterReject(shape->filter, other->filter) ||
+		QueryRejectConstraint(shape->body, other->body)
+	) return id;
+	
+	cpFloat t = 0.0f, d;
+	cpVect n;
+	BulletSetPose(sweep, shape, t);
+	if(!ShapeDistance(shape, other, sweep->motion, &d, &n)) return id;
+	
+	// Stop the bullet when the shapes overlap by half of the slop.
+	// That's enough for the narrow-phase to find contacts, but not enough for them to be pushed apart.
+	// Shapes that already overlap can slide along each other, but not move any deeper.
+	cpFloat slop = sweep->space->collisionSlop;
+	cpFloat target = cpfmin(d, 0.0f) - 0.5f*slop, tolerance = 0.25f*slop;
+	
+	for(int i=0; i<BULLET_MAX_ITERATIONS; i++){
+		// The separation along n can't shrink faster than the shape moves towards the other one, plus its rotation.
+		cpFloat approach = cpfmax(cpvdot(sweep->delta, n), 0.0f) + sweep->rotation;
+		if(approach == 0.0f) return id;
+		
+		t += (d - target)/approach;
+		if(t >= sweep->toi) return id;
+		
+		BulletSetPose(sweep, shape, t);
+		if(!ShapeDistance(shape, other, (1.0f - t)*sweep->motion, &d, &n)) return id;
+		if(d <= target + tolerance) break;
+	}
+	
+	// If it didn't converge, t is still before the impact.
+	// The bullet is stopped short and continues from there next step.
+	sweep->toi = t;
+	return id;
+}
+
+void
+cpSpaceSweepBullets(cpSpace *space)
+{
+	cpArray *bodies = space->dynamicBodies;
+	
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		if(!body->bullet.enabled || cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC) continue;
+		
+		struct BulletSweep sweep = {space, body, body->bullet.p, body->p, body->bullet.a, body->a, cpvsub(body->p, body->bullet.p), 0.0f, 0.0f, 1.0f};
+		
+		CP_BODY_FOREACH_SHAPE(body, shape){
+			if(shape->sensor) continue;
+			
+			BulletSetPose(&sweep, shape, 0.0f);
+			cpBB bb0 = shape->bb;
+			cpFloat rotation = sweep.rotation = cpfabs(sweep.a1 - sweep.a0)*ShapeReach(shape, sweep.p0);
+			sweep.motion = cpvlength(sweep.delta) + rotation;
+			if(sweep.motion == 0.0f) continue;
+			
+			// Bounding box of the whole sweep. Points rotating between the two poses can bulge out by up to their arc length.
+			BulletSetPose(&sweep, shape, 1.0f);
+			cpBB bb = cpBBMerge(bb0, shape->bb);
+			bb = cpBBNew(bb.l - rotation, bb.b - rotation, bb.r + rotation, bb.t + rotation);
+			
+			cpSpatialIndexQuery(space->staticShapes, shape, bb, (cpSpatialIndexQueryFunc)BulletSweepQuery, &sweep);
+		}
+		
+		// Move the body to its time of impact, or back to where it was integrated to.
+		if(sweep.toi < 1.0f){
+			cpBodySetPose(body, cpvlerp(sweep.p0, sweep.p1, sweep.toi), cpflerp(sweep.a0, sweep.a1, sweep.toi));
+			CP_STATS_COUNT(&space->stepStats, bulletImpacts, 1);
+		} else {
+			cpBodySetPose(body, sweep.p1, sweep.a1);
+		}
+	}
+}
+
 //MARK: All Important cpSpaceStep() Function
 
  void
@@ -332,12 +725,173 @@ cpShapeUpdateFunc(cpShape *shape, void *unused)
 	cpShapeCacheBB(shape);
 }
 
+//MARK: Solver
+
+// Returns the index of the body in the solver body array, copying its state in if it's not there yet.
+static int
+cpSpaceSolverBodyID(cpSpace *space, cpBody *body)
+{
+	cpArray *bodies = space->solverBodies;
+	int id = body->solver.id;
+	if((unsigned int)id < (unsigned int)bodies->num && bodies->arr[id] == body) return id;
+	
+	id = bodies->num;
+	cpArrayPush(bodies, body);
+	body->solver.id = id;
+	
+	if(id == space->solverStateCapacity){
+		space->solverStateCapacity = (id ? 2*id : 64);
+		space->solverState = (struct cpSolverBody *)cprealloc(space->solverState, space->solverStateCapacity*sizeof(struct cpSolverBody));
+	}
+	
+	struct cpSolverBody *state = space->solverState + id;
+	state->v = body->v;
+	state->v_bias = body->v_bias;
+	state->w = body->w;
+	state->w_bias = body->w_bias;
+	state->m_inv = body->m_inv;
+	state->i_inv = body->i_inv;
+	
+	return id;
+}
+
+// Copy the solver state of the bodies back to the bodies.
+void
+cpSpaceScatterSolverBodies(cpSpace *space, cpArray *bodies)
+{
+	struct cpSolverBody *states = space->solverState;
+	
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		struct cpSolverBody *state = states + body->solver.id;
+		
+		body->v = state->v;
+		body->v_bias = state->v_bias;
+		body->w = state->w;
+		body->w_bias = state->w_bias;
+	}
+}
+
+// Copy the state of the bodies back into the solver body array after the constraints have modified it.
+void
+cpSpaceGatherSolverBodies(cpSpace *space, cpArray *bodies)
+{
+	struct cpSolverBody *states = space->solverState;
+	
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		struct cpSolverBody *state = states + body->solver.id;
+		
+		state->v = body->v;
+		state->v_bias = body->v_bias;
+		state->w = body->w;
+		state->w_bias = body->w_bias;
+	}
+}
+
+static inline void
+cpSpaceSyncSolverBody(cpSpace *space, cpBody *body)
+{
+	cpArray *bodies = space->solverBodies;
+	int id = body->solver.id;
+	if((unsigned int)id < (unsigned int)bodies->num && bodies->arr[id] == body) cpArrayPush(space->solverSyncBodies, body);
+}
+
+struct cpContactSolver *
+cpSpaceSolverBegin(cpSpace *space)
+{
+	cpArray *arbiters = space->arbiters;
+	cpArray *constraints = space->constraints;
+	
+	// Gather the state of the bodies touched by the arbiters into a compact array.
+	// Bodies are stored in the order they are first touched so arbiters that are solved together tend to share cache lines.
+	space->solverBodies->num = 0;
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		arb->solver_a = cpSpaceSolverBodyID(space, arb->body_a);
+		arb->solver_b = cpSpaceSolverBodyID(space, arb->body_b);
+	}
+	
+	// Find the gathered bodies that are also used by constraints.
+	space->solverSyncBodies->num = 0;
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		cpSpaceSyncSolverBody(space, constraint->a);
+		cpSpaceSyncSolverBody(space, constraint->b);
+	}
+	
+	// The SIMD solver handles the arbiters it was able to group, the scalar solver does the rest.
+	return cpSpacePrepareContactSolver(space);
+}
+
+void
+cpSpaceSolverEnd(cpSpace *space, struct cpContactSolver *contactSolver)
+{
+	// Copy the results back to the bodies and contacts.
+	cpSpaceScatterSolverBodies(space, space->solverBodies);
+	if(contactSolver) cpContactSolverFinish(contactSolver);
+}
+
+void
+cpSpaceSolve(cpSpace *space, cpFloat dt_coef)
+{
+	cpArray *arbiters = space->arbiters;
+	cpArray *constraints = space->constraints;
+	cpFloat dt = space->curr_dt;
+	
+	CP_STATS_START(timer);
+	struct cpContactSolver *contactSolver = cpSpaceSolverBegin(space);
+	struct cpSolverBody *bodies = space->solverState;
+	cpArray *syncBodies = space->solverSyncBodies;
+	
+	cpArray *scalarArbiters = (contactSolver ? cpContactSolverGetOverflow(contactSolver) : arbiters);
+	int groupCount = (contactSolver ? cpContactSolverGroupCount(contactSolver) : 0);
+	
+	// Apply cached impulses
+	if(contactSolver) cpContactSolverWarmStart(contactSolver, bodies, 0, groupCount, dt_coef);
+	for(int i=0; i<scalarArbiters->num; i++){
+		cpArbiterSolverApplyCachedImpulse((cpArbiter *)scalarArbiters->arr[i], bodies, dt_coef);
+	}
+	
+	cpSpaceScatterSolverBodies(space, syncBodies);
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		constraint->klass->applyCachedImpulse(constraint, dt_coef);
+	}
+	cpSpaceGatherSolverBodies(space, syncBodies);
+	CP_STATS_LAP(timer, &space->stepStats, warmStart);
+	
+	// Run the impulse solver.
+	for(int i=0; i<space->iterations; i++){
+		if(contactSolver) cpContactSolverApplyImpulse(contactSolver, bodies, 0, groupCount);
+		for(int j=0; j<scalarArbiters->num; j++){
+			cpArbiterSolverApplyImpulse((cpArbiter *)scalarArbiters->arr[j], bodies);
+		}
+		
+		cpSpaceScatterSolverBodies(space, syncBodies);
+		for(int j=0; j<constraints->num; j++){
+			cpConstraint *constraint = (cpConstraint *)constraints->arr[j];
+			constraint->klass->applyImpulse(constraint, dt);
+		}
+		cpSpaceGatherSolverBodies(space, syncBodies);
+	}
+	
+	cpSpaceSolverEnd(space, contactSolver);
+	CP_STATS_LAP(timer, &space->stepStats, solve);
+}
+
 void
 cpSpaceStep(cpSpace *space, cpFloat dt)
 {
 	// don't step if the timestep is 0!
 	if(dt == 0.0f) return;
 	
+#if CP_STEP_STATS
+	cpSpaceStepStats emptyStats = {0};
+	space->stepStats = emptyStats;
+#endif
+	CP_STATS_START(stepTimer);
+	
 	space->stamp++;
 	
 	cpFloat prev_dt = space->curr_dt;
@@ -358,26 +912,48 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 		}
 	}
 	arbiters->num = 0;
-
+	
+	CP_STATS_START(timer);
 	cpSpaceLock(space); {
 		// Integrate positions
 		for(int i=0; i<bodies->num; i++){
 			cpBody *body = (cpBody *)bodies->arr[i];
+			if(body->bullet.enabled){
+				body->bullet.p = body->p;
+				body->bullet.a = body->a;
+			}
+			
 			body->position_func(body, dt);
 		}
+		CP_STATS_LAP(timer, &space->stepStats, integratePositions);
+		
+		// Move bullets back to where they first hit a static shape.
+		cpSpaceSweepBullets(space);
+		CP_STATS_LAP(timer, &space->stepStats, sweepBullets);
 		
 		// Find colliding pairs.
 		cpSpacePushFreshContactBuffer(space);
 		cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
+		CP_STATS_LAP(timer, &space->stepStats, updateBBs);
+		
 		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		cpSpaceCollideBatchedShapes(space);
+		CP_STATS_LAP(timer, &space->stepStats, broadphase);
+#if CP_STEP_STATS
+		// The narrow-phase runs from inside the broadphase query, don't count it twice.
+		space->stepStats.broadphase -= space->stepStats.narrowphase;
+#endif
 	} cpSpaceUnlock(space, cpFalse);
 	
 	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
 	cpSpaceProcessComponents(space, dt);
+	CP_STATS_LAP(timer, &space->stepStats, components);
 	
 	cpSpaceLock(space); {
 		// Clear out old cached arbiters and call separate callbacks
 		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+		cpHashSetFilter(space->separatingAxes, (cpHashSetFilterFunc)cpSpaceSeparatingAxisFilter, space);
+		CP_STATS_LAP(timer, &space->stepStats, filterArbiters);
 
 		// Prestep the arbiters and constraints.
 		cpFloat slop = space->collisionSlop;
@@ -394,6 +970,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			
 			constraint->klass->preStep(constraint, dt);
 		}
+		CP_STATS_LAP(timer, &space->stepStats, preStep);
 	
 		// Integrate velocities.
 		cpFloat damping = cpfpow(space->damping, dt);
@@ -402,29 +979,11 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			cpBody *body = (cpBody *)bodies->arr[i];
 			body->velocity_func(body, gravity, damping, dt);
 		}
+		CP_STATS_LAP(timer, &space->stepStats, integrateVelocities);
 		
-		// Apply cached impulses
-		cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiterApplyCachedImpulse((cpArbiter *)arbiters->arr[i], dt_coef);
-		}
-		
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			constraint->klass->applyCachedImpulse(constraint, dt_coef);
-		}
-		
-		// Run the impulse solver.
-		for(int i=0; i<space->iterations; i++){
-			for(int j=0; j<arbiters->num; j++){
-				cpArbiterApplyImpulse((cpArbiter *)arbiters->arr[j]);
-			}
-				
-			for(int j=0; j<constraints->num; j++){
-				cpConstraint *constraint = (cpConstraint *)constraints->arr[j];
-				constraint->klass->applyImpulse(constraint, dt);
-			}
-		}
+		// Apply cached impulses and run the impulse solver.
+		cpSpaceSolve(space, (prev_dt == 0.0f ? 0.0f : dt/prev_dt));
+		CP_STATS_RESTART(timer);
 		
 		// Run the constraint post-solve callbacks
 		for(int i=0; i<constraints->num; i++){
@@ -442,4 +1001,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			handler->postSolveFunc(arb, space, handler->userData);
 		}
 	} cpSpaceUnlock(space, cpTrue);
+	
+	CP_STATS_LAP(timer, &space->stepStats, callbacks);
+	CP_STATS_LAP(stepTimer, &space->stepStats, step);
 }
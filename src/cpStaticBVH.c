@@ -0,0 +1,817 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <float.h>
+
+#include "chipmunk/chipmunk_private.h"
+
+// A bounding volume hierarchy meant for objects that rarely move, like the static shapes of a space.
+// The whole tree is built top down in one go and stored as a flat array of nodes with four children each.
+// The bounds of the children are stored as structures of arrays so all four can be tested with a single SIMD compare.
+// Objects inserted or removed after the build are patched into the tree,
+// and once enough of them pile up the tree is simply rebuilt from scratch.
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define CP_STATIC_BVH_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define CP_STATIC_BVH_SSE 0
+#endif
+
+static inline cpSpatialIndexClass *Klass(void);
+
+typedef struct cpIndexBounds Bounds;
+typedef struct Node Node;
+typedef struct Entry Entry;
+
+#define NULL_INDEX (0xFFFFFFFFu)
+// Set on child references that point to entries instead of nodes.
+#define LEAF_CHILD (0x80000000u)
+
+#define INITIAL_CAPACITY (16u)
+
+// Limits on the depth of the tree so the query stacks can be fixed size.
+// Past BUILD_SAH_DEPTH the build splits the objects evenly so the tree can't go deeper than MAX_DEPTH.
+#define BUILD_SAH_DEPTH (24)
+#define MAX_DEPTH (48)
+#define STACK_SIZE (4*MAX_DEPTH)
+
+// The tree is rebuilt once this many objects, or the rebuild threshold fraction of the objects if that is more,
+// have been inserted, removed or reindexed since it was last built.
+#define REBUILD_MIN (32u)
+#define REBUILD_THRESHOLD (0.25f)
+
+struct cpStaticBVH {
+	cpSpatialIndex spatialIndex;
+	
+	// Node 0 is the root.
+	Node *nodes;
+	uint32_t nodeCount, nodeCapacity;
+	
+	// Entries are stored in the order their leaves were laid out by the last build,
+	// followed by any that were inserted since. Removed entries stay until the next build.
+	Entry *entries;
+	uint32_t entryCount, entryCapacity;
+	uint32_t liveCount;
+	
+	// Number of inserts, removals and reindexed objects since the last build.
+	uint32_t changes;
+	cpFloat rebuildThreshold;
+	
+	// Open addressed table that maps objects to their entries.
+	cpObjTable table;
+};
+
+struct Node {
+	// Child bounds rounded outward to floats.
+	// Empty children have inverted bounds so they never overlap anything.
+	float l[4], b[4], r[4], t[4];
+	// Child node indexes, entry indexes tagged with LEAF_CHILD or NULL_INDEX for empty children.
+	uint32_t children[4];
+};
+
+struct Entry {
+	void *obj;
+	cpHashValue hashid;
+	cpBB bb;
+	// Node and child that reference this entry.
+	uint32_t node, child;
+};
+
+//MARK: Bounds Functions
+
+// Half of the perimeter is the 2D equivalent of the surface area heuristic.
+// Unlike the area it still works for long thin shapes like terrain segments.
+static inline float
+BoundsPerimeter(Bounds bb)
+{
+	return (bb.r - bb.l) + (bb.t - bb.b);
+}
+
+static inline cpFloat
+BBPerimeter(cpBB bb)
+{
+	return (bb.r - bb.l) + (bb.t - bb.b);
+}
+
+//MARK: Node Functions
+
+static inline Bounds
+NodeGetBounds(Node *node, int i)
+{
+	Bounds bounds = {node->l[i], node->b[i], node->r[i], node->t[i]};
+	return bounds;
+}
+
+static inline void
+NodeSetBounds(Node *node, int i, Bounds bounds)
+{
+	node->l[i] = bounds.l;
+	node->b[i] = bounds.b;
+	node->r[i] = bounds.r;
+	node->t[i] = bounds.t;
+}
+
+static inline void
+NodeSetChild(Node *node, int i, uint32_t child, Bounds bounds)
+{
+	node->children[i] = child;
+	NodeSetBounds(node, i, bounds);
+}
+
+static inline void
+NodeClearChild(Node *node, int i)
+{
+	Bounds empty = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+	NodeSetChild(node, i, NULL_INDEX, empty);
+}
+
+// Returns a bitmask of the children that overlap the bounds.
+static inline unsigned
+NodeOverlaps(const Node *node, Bounds bb)
+{
+#if CP_STATIC_BVH_SSE
+	__m128 l = _mm_cmple_ps(_mm_loadu_ps(node->l), _mm_set1_ps(bb.r));
+	__m128 b = _mm_cmple_ps(_mm_loadu_ps(node->b), _mm_set1_ps(bb.t));
+	__m128 r = _mm_cmple_ps(_mm_set1_ps(bb.l), _mm_loadu_ps(node->r));
+	__m128 t = _mm_cmple_ps(_mm_set1_ps(bb.b), _mm_loadu_ps(node->t));
+	
+	return (unsigned)_mm_movemask_ps(_mm_and_ps(_mm_and_ps(l, b), _mm_and_ps(r, t)));
+#else
+	unsigned mask = 0;
+	for(int i=0; i<4; i++){
+		if(node->l[i] <= bb.r && node->b[i] <= bb.t && bb.l <= node->r[i] && bb.b <= node->t[i]) mask |= 1u << i;
+	}
+	
+	return mask;
+#endif
+}
+
+// Index of the lowest child set in a mask returned by NodeOverlaps().
+static inline int
+FirstChild(unsigned mask)
+{
+	return (mask&1 ? 0 : (mask&2 ? 1 : (mask&4 ? 2 : 3)));
+}
+
+static uint32_t
+NodeNew(cpStaticBVH *bvh)
+{
+	if(bvh->nodeCount == bvh->nodeCapacity){
+		uint32_t capacity = (bvh->nodeCapacity ? 2*bvh->nodeCapacity : INITIAL_CAPACITY);
+		bvh->nodes = (Node *)cprealloc(bvh->nodes, capacity*sizeof(Node));
+		bvh->nodeCapacity = capacity;
+	}
+	
+	uint32_t index = bvh->nodeCount++;
+	Node *node = bvh->nodes + index;
+	for(int i=0; i<4; i++) NodeClearChild(node, i);
+	
+	return index;
+}
+
+static void
+NodeReserve(cpStaticBVH *bvh, uint32_t count)
+{
+	if(count > bvh->nodeCapacity){
+		bvh->nodes = (Node *)cprealloc(bvh->nodes, count*sizeof(Node));
+		bvh->nodeCapacity = count;
+	}
+}
+
+//MARK: Entry Table Functions
+
+static inline void *
+EntryObj(const void *bvh, uint32_t entry)
+{
+	return ((const cpStaticBVH *)bvh)->entries[entry].obj;
+}
+
+static inline uint32_t
+TableFind(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	return cpObjTableFind(&bvh->table, obj, hashid, EntryObj, bvh);
+}
+
+// Entries move when the tree is rebuilt, so the table needs to be refilled.
+static void
+TableRefill(cpStaticBVH *bvh)
+{
+	cpObjTableClear(&bvh->table);
+	for(uint32_t i=0; i<bvh->entryCount; i++) cpObjTableInsert(&bvh->table, bvh->entries[i].hashid, i);
+}
+
+//MARK: Building
+
+// Number of bins used when looking for the best split.
+#define SAH_BINS 16
+
+typedef struct BuildItem {
+	cpBB bb;
+	cpVect center;
+	uint32_t entry;
+} BuildItem;
+
+static inline int
+SAHBin(cpFloat value, cpFloat min, cpFloat scale)
+{
+	int bin = (int)((value - min)*scale);
+	return (bin < SAH_BINS - 1 ? bin : SAH_BINS - 1);
+}
+
+// Partition the items in two using a binned SAH split and return the start of the second half.
+// Both halves always have at least one item in them.
+static int
+SplitItems(BuildItem *items, int count, int depth)
+{
+	// Past the depth limit just split evenly. Any split is valid, they just aren't all as good.
+	if(depth >= BUILD_SAH_DEPTH) return count/2;
+	
+	cpVect center = items[0].center;
+	cpBB centers = cpBBNew(center.x, center.y, center.x, center.y);
+	for(int i=1; i<count; i++) centers = cpBBExpand(centers, items[i].center);
+	
+	cpFloat mins[] = {centers.l, centers.b};
+	cpFloat extents[] = {centers.r - centers.l, centers.t - centers.b};
+	
+	cpFloat scales[] = {
+		(extents[0] > 0.0f ? SAH_BINS/extents[0] : 0.0f),
+		(extents[1] > 0.0f ? SAH_BINS/extents[1] : 0.0f),
+	};
+	
+	// Bin the items along both axes in a single pass.
+	int binCounts[2][SAH_BINS] = {{0}};
+	cpBB binBBs[2][SAH_BINS];
+	for(int i=0; i<SAH_BINS; i++) binBBs[0][i] = binBBs[1][i] = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+	
+	for(int i=0; i<count; i++){
+		BuildItem *item = items + i;
+		
+		int x = SAHBin(item->center.x, mins[0], scales[0]);
+		binBBs[0][x] = cpBBMerge(binBBs[0][x], item->bb);
+		binCounts[0][x]++;
+		
+		int y = SAHBin(item->center.y, mins[1], scales[1]);
+		binBBs[1][y] = cpBBMerge(binBBs[1][y], item->bb);
+		binCounts[1][y]++;
+	}
+	
+	cpFloat bestCost = INFINITY;
+	int bestAxis = -1, bestSplit = 0;
+	
+	for(int axis=0; axis<2; axis++){
+		if(extents[axis] <= 0.0f) continue;
+		
+		// Sweep from the right to find the perimeter and count on the right side of each split.
+		cpFloat rightCosts[SAH_BINS];
+		int rightCounts[SAH_BINS];
+		cpBB bb = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+		int n = 0;
+		for(int i=SAH_BINS - 1; i>0; i--){
+			bb = cpBBMerge(bb, binBBs[axis][i]);
+			n += binCounts[axis][i];
+			rightCosts[i] = (n ? BBPerimeter(bb)*n : 0.0f);
+			rightCounts[i] = n;
+		}
+		
+		// Then sweep from the left to find the cost of each split.
+		bb = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+		n = 0;
+		for(int i=0; i<SAH_BINS - 1; i++){
+			bb = cpBBMerge(bb, binBBs[axis][i]);
+			n += binCounts[axis][i];
+			if(n == 0 || rightCounts[i + 1] == 0) continue;
+			
+			cpFloat cost = BBPerimeter(bb)*n + rightCosts[i + 1];
+			if(cost < bestCost){
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+	
+	// When all the centers are the same any split is as good as any other.
+	if(bestAxis < 0) return count/2;
+	
+	cpFloat min = mins[bestAxis], scale = scales[bestAxis];
+	int right = count;
+	
+	for(int left=0; left < right;){
+		BuildItem item = items[left];
+		if(SAHBin(bestAxis == 0 ? item.center.x : item.center.y, min, scale) > bestSplit){
+			right--;
+			items[left] = items[right];
+			items[right] = item;
+		} else {
+			left++;
+		}
+	}
+	
+	return right;
+}
+
+static uint32_t
+BuildNode(cpStaticBVH *bvh, Entry *entries, BuildItem *items, int count, int depth)
+{
+	uint32_t index = NodeNew(bvh);
+	
+	// Split the items in half, then split each half again to get up to four children.
+	int mid = (count > 1 ? SplitItems(items, count, depth) : count);
+	int q1 = (mid > 1 ? SplitItems(items, mid, depth) : mid);
+	int q3 = (count - mid > 1 ? mid + SplitItems(items + mid, count - mid, depth) : count);
+	int starts[] = {0, q1, mid, q3, count};
+	
+	for(int i=0, child=0; i<4; i++){
+		BuildItem *part = items + starts[i];
+		int n = starts[i + 1] - starts[i];
+		if(n == 0) continue;
+		
+		if(n == 1){
+			// Entries are laid out in the same order as the leaves that reference them.
+			uint32_t entry = bvh->entryCount++;
+			Entry *e = bvh->entries + entry;
+			*e = entries[part->entry];
+			e->node = index;
+			e->child = child;
+			
+			NodeSetChild(bvh->nodes + index, child, entry | LEAF_CHILD, cpIndexBoundsFromBB(e->bb));
+		} else {
+			cpBB bb = part[0].bb;
+			for(int j=1; j<n; j++) bb = cpBBMerge(bb, part[j].bb);
+			
+			uint32_t node = BuildNode(bvh, entries, part, n, depth + 1);
+			NodeSetChild(bvh->nodes + index, child, node, cpIndexBoundsFromBB(bb));
+		}
+		
+		child++;
+	}
+	
+	return index;
+}
+
+static void
+Build(cpStaticBVH *bvh)
+{
+	uint32_t count = bvh->liveCount;
+	Entry *entries = bvh->entries;
+	
+	BuildItem *items = (BuildItem *)cpcalloc(count ? count : 1, sizeof(BuildItem));
+	for(uint32_t i=0, j=0; i<bvh->entryCount; i++){
+		if(entries[i].obj){
+			BuildItem item = {entries[i].bb, cpBBCenter(entries[i].bb), i};
+			items[j++] = item;
+		}
+	}
+	
+	uint32_t capacity = (count > INITIAL_CAPACITY ? count : INITIAL_CAPACITY);
+	bvh->entries = (Entry *)cpcalloc(capacity, sizeof(Entry));
+	bvh->entryCapacity = capacity;
+	bvh->entryCount = 0;
+	
+	// Every node has at least two children, so there can't be more nodes than objects.
+	bvh->nodeCount = 0;
+	if(count > 0){
+		NodeReserve(bvh, count);
+		BuildNode(bvh, entries, items, count, 0);
+	}
+	
+	cpfree(entries);
+	cpfree(items);
+	
+	bvh->changes = 0;
+	TableRefill(bvh);
+}
+
+//MARK: Incremental Updates
+
+static inline cpBool
+NeedsRebuild(cpStaticBVH *bvh)
+{
+	return (bvh->changes > REBUILD_MIN && bvh->changes > bvh->rebuildThreshold*bvh->liveCount);
+}
+
+static uint32_t
+EntryNew(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	if(bvh->entryCount == bvh->entryCapacity){
+		uint32_t capacity = (bvh->entryCapacity ? 2*bvh->entryCapacity : INITIAL_CAPACITY);
+		cpAssertHard(capacity > bvh->entryCount && capacity <= LEAF_CHILD, "Internal Error: Too many objects.");
+		
+		bvh->entries = (Entry *)cprealloc(bvh->entries, capacity*sizeof(Entry));
+		bvh->entryCapacity = capacity;
+	}
+	
+	uint32_t entry = bvh->entryCount++;
+	Entry *e = bvh->entries + entry;
+	e->obj = obj;
+	e->hashid = hashid;
+	e->bb = bvh->spatialIndex.bbfunc(obj);
+	e->node = e->child = NULL_INDEX;
+	
+	bvh->liveCount++;
+	return entry;
+}
+
+static inline void
+EntrySetLeaf(cpStaticBVH *bvh, uint32_t entry, uint32_t node, int child, Bounds bounds)
+{
+	NodeSetChild(bvh->nodes + node, child, entry | LEAF_CHILD, bounds);
+	bvh->entries[entry].node = node;
+	bvh->entries[entry].child = child;
+}
+
+// Walk down the tree to the child that grows the least, expanding the bounds along the way.
+// Returns the depth of the node the leaf was added to.
+static int
+InsertLeaf(cpStaticBVH *bvh, uint32_t entry)
+{
+	Bounds bb = cpIndexBoundsFromBB(bvh->entries[entry].bb);
+	if(bvh->nodeCount == 0) NodeNew(bvh);
+	
+	uint32_t index = 0;
+	for(int depth=0;; depth++){
+		Node *node = bvh->nodes + index;
+		
+		int best = 0;
+		float bestCost = INFINITY;
+		for(int i=0; i<4; i++){
+			if(node->children[i] == NULL_INDEX){
+				EntrySetLeaf(bvh, entry, index, i, bb);
+				return depth;
+			}
+			
+			Bounds child = NodeGetBounds(node, i);
+			float cost = BoundsPerimeter(cpIndexBoundsMerge(child, bb)) - BoundsPerimeter(child);
+			if(cost < bestCost){
+				best = i;
+				bestCost = cost;
+			}
+		}
+		
+		uint32_t child = node->children[best];
+		Bounds childBB = NodeGetBounds(node, best);
+		NodeSetBounds(node, best, cpIndexBoundsMerge(childBB, bb));
+		
+		if(child & LEAF_CHILD){
+			// Replace the leaf with a new node that holds both leaves.
+			uint32_t split = NodeNew(bvh);
+			bvh->nodes[index].children[best] = split;
+			
+			EntrySetLeaf(bvh, child & ~LEAF_CHILD, split, 0, childBB);
+			EntrySetLeaf(bvh, entry, split, 1, bb);
+			return depth + 1;
+		} else {
+			index = child;
+		}
+	}
+}
+
+static void
+RemoveLeaf(cpStaticBVH *bvh, uint32_t entry)
+{
+	// The bounds of the ancestors are left alone. They are still conservative until the next build.
+	Entry *e = bvh->entries + entry;
+	NodeClearChild(bvh->nodes + e->node, e->child);
+}
+
+static void
+AddLeaf(cpStaticBVH *bvh, uint32_t entry)
+{
+	if(NeedsRebuild(bvh) || InsertLeaf(bvh, entry) >= MAX_DEPTH - 1) Build(bvh);
+}
+
+//MARK: Memory Management Functions
+
+cpStaticBVH *
+cpStaticBVHAlloc(void)
+{
+	return (cpStaticBVH *)cpcalloc(1, sizeof(cpStaticBVH));
+}
+
+cpSpatialIndex *
+cpStaticBVHInit(cpStaticBVH *bvh, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndexInit((cpSpatialIndex *)bvh, Klass(), bbfunc, staticIndex);
+	
+	bvh->nodes = NULL;
+	bvh->nodeCount = bvh->nodeCapacity = 0;
+	
+	bvh->entries = NULL;
+	bvh->entryCount = bvh->entryCapacity = 0;
+	bvh->liveCount = 0;
+	
+	bvh->changes = 0;
+	bvh->rebuildThreshold = REBUILD_THRESHOLD;
+	
+	cpObjTableInit(&bvh->table);
+	
+	return (cpSpatialIndex *)bvh;
+}
+
+cpSpatialIndex *
+cpStaticBVHNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	return cpStaticBVHInit(cpStaticBVHAlloc(), bbfunc, staticIndex);
+}
+
+void
+cpStaticBVHSetRebuildThreshold(cpSpatialIndex *index, cpFloat threshold)
+{
+	if(index->klass != Klass()){
+		cpAssertWarn(cpFalse, "Ignoring cpStaticBVHSetRebuildThreshold() call to non-BVH spatial index.");
+		return;
+	}
+	
+	cpAssertHard(threshold >= 0.0f, "The rebuild threshold must not be negative.");
+	((cpStaticBVH *)index)->rebuildThreshold = threshold;
+}
+
+static void
+cpStaticBVHDestroy(cpStaticBVH *bvh)
+{
+	cpfree(bvh->nodes);
+	cpfree(bvh->entries);
+	cpObjTableDestroy(&bvh->table);
+}
+
+//MARK: Insert/Remove
+
+static void
+cpStaticBVHInsert(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	uint32_t entry = EntryNew(bvh, obj, hashid);
+	cpObjTableInsert(&bvh->table, hashid, entry);
+	
+	bvh->changes++;
+	AddLeaf(bvh, entry);
+}
+
+static void
+cpStaticBVHInsertBulk(cpStaticBVH *bvh, void **objs, cpHashValue *hashids, int count)
+{
+	uint32_t first = bvh->entryCount;
+	for(int i=0; i<count; i++) cpObjTableInsert(&bvh->table, hashids[i], EntryNew(bvh, objs[i], hashids[i]));
+	
+	// Large batches are built along with the rest of the tree in one go.
+	bvh->changes += count;
+	if(NeedsRebuild(bvh)){
+		Build(bvh);
+	} else {
+		for(uint32_t i=first; i<bvh->entryCount; i++){
+			if(InsertLeaf(bvh, i) >= MAX_DEPTH - 1){
+				Build(bvh);
+				break;
+			}
+		}
+	}
+}
+
+static void
+cpStaticBVHRemove(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(bvh, obj, hashid);
+	if(slot == CP_OBJ_TABLE_EMPTY) return;
+	
+	uint32_t entry = bvh->table.slots[slot].index;
+	cpObjTableRemove(&bvh->table, slot);
+	RemoveLeaf(bvh, entry);
+	
+	bvh->entries[entry].obj = NULL;
+	bvh->liveCount--;
+	
+	bvh->changes++;
+	if(NeedsRebuild(bvh)) Build(bvh);
+}
+
+static cpBool
+cpStaticBVHContains(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	return (TableFind(bvh, obj, hashid) != CP_OBJ_TABLE_EMPTY);
+}
+
+//MARK: Query
+
+static void
+cpStaticBVHQuery(cpStaticBVH *bvh, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	if(bvh->nodeCount == 0) return;
+	
+	Node *nodes = bvh->nodes;
+	Entry *entries = bvh->entries;
+	Bounds bounds = cpIndexBoundsFromBB(bb);
+	
+	uint32_t stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	
+	while(top > 0){
+		Node *node = nodes + stack[--top];
+		
+		for(unsigned mask = NodeOverlaps(node, bounds); mask; mask &= mask - 1){
+			int i = FirstChild(mask);
+			uint32_t child = node->children[i];
+			
+			if(child == NULL_INDEX){
+				continue;
+			} else if(child & LEAF_CHILD){
+				// The node bounds are rounded, so check the exact bounds of the object before reporting it.
+				Entry *e = entries + (child & ~LEAF_CHILD);
+				if(cpBBIntersects(e->bb, bb)) func(obj, e->obj, 0, data);
+			} else {
+				stack[top++] = child;
+			}
+		}
+	}
+}
+
+typedef struct SegmentItem {
+	uint32_t child;
+	cpFloat t;
+} SegmentItem;
+
+static void
+cpStaticBVHSegmentQuery(cpStaticBVH *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	if(bvh->nodeCount == 0) return;
+	
+	Node *nodes = bvh->nodes;
+	Entry *entries = bvh->entries;
+	
+	// Children that don't overlap the bounds of the segment are rejected with SIMD first.
+	// The rest are sorted by where the segment enters them so the nearest are visited first.
+	Bounds bounds = cpIndexBoundsFromBB(cpBBNew(cpfmin(a.x, b.x), cpfmin(a.y, b.y), cpfmax(a.x, b.x), cpfmax(a.y, b.y)));
+	
+	SegmentItem stack[STACK_SIZE];
+	int top = 0;
+	SegmentItem root = {0, 0.0f};
+	stack[top++] = root;
+	
+	while(top > 0){
+		SegmentItem item = stack[--top];
+		if(item.t >= t_exit) continue;
+		
+		if(item.child & LEAF_CHILD){
+			t_exit = cpfmin(t_exit, func(obj, entries[item.child & ~LEAF_CHILD].obj, data));
+			continue;
+		}
+		
+		Node *node = nodes + item.child;
+		SegmentItem hits[4];
+		int count = 0;
+		
+		for(unsigned mask = NodeOverlaps(node, bounds); mask; mask &= mask - 1){
+			int i = FirstChild(mask);
+			uint32_t child = node->children[i];
+			if(child == NULL_INDEX) continue;
+			
+			cpBB bb;
+			if(child & LEAF_CHILD){
+				bb = entries[child & ~LEAF_CHILD].bb;
+			} else {
+				bb = cpBBNew(node->l[i], node->b[i], node->r[i], node->t[i]);
+			}
+			
+			cpFloat t = cpBBSegmentQuery(bb, a, b);
+			if(t < t_exit){
+				// Insertion sort, nearest first.
+				int j = count++;
+				for(; j > 0 && hits[j - 1].t > t; j--) hits[j] = hits[j - 1];
+				hits[j].child = child;
+				hits[j].t = t;
+			}
+		}
+		
+		// Push the farthest first so the nearest is popped next.
+		while(count > 0) stack[top++] = hits[--count];
+	}
+}
+
+//MARK: Reindex
+
+static void
+cpStaticBVHReindex(cpStaticBVH *bvh)
+{
+	Entry *entries = bvh->entries;
+	for(uint32_t i=0; i<bvh->entryCount; i++){
+		if(entries[i].obj) entries[i].bb = bvh->spatialIndex.bbfunc(entries[i].obj);
+	}
+	
+	Build(bvh);
+}
+
+static void
+cpStaticBVHReindexObject(cpStaticBVH *bvh, void *obj, cpHashValue hashid)
+{
+	uint32_t slot = TableFind(bvh, obj, hashid);
+	if(slot == CP_OBJ_TABLE_EMPTY) return;
+	
+	uint32_t entry = bvh->table.slots[slot].index;
+	Entry *e = bvh->entries + entry;
+	
+	cpBB bb = bvh->spatialIndex.bbfunc(obj);
+	if(bb.l != e->bb.l || bb.b != e->bb.b || bb.r != e->bb.r || bb.t != e->bb.t){
+		RemoveLeaf(bvh, entry);
+		e->bb = bb;
+		
+		bvh->changes++;
+		AddLeaf(bvh, entry);
+	}
+}
+
+static void
+cpStaticBVHReindexQuery(cpStaticBVH *bvh, cpSpatialIndexQueryFunc func, void *data)
+{
+	cpStaticBVHReindex(bvh);
+	
+	Node *nodes = bvh->nodes;
+	Entry *entries = bvh->entries;
+	
+	// After a build the entries are exactly the leaves, so each pair can be reported from the entry with the lower index.
+	for(uint32_t i=0; i<bvh->entryCount; i++){
+		cpBB bb = entries[i].bb;
+		Bounds bounds = cpIndexBoundsFromBB(bb);
+		
+		uint32_t stack[STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		
+		while(top > 0){
+			Node *node = nodes + stack[--top];
+			
+			for(unsigned mask = NodeOverlaps(node, bounds); mask; mask &= mask - 1){
+				int j = FirstChild(mask);
+				uint32_t child = node->children[j];
+				
+				if(child == NULL_INDEX){
+					continue;
+				} else if(child & LEAF_CHILD){
+					uint32_t entry = child & ~LEAF_CHILD;
+					if(entry > i && cpBBIntersects(entries[entry].bb, bb)) func(entries[i].obj, entries[entry].obj, 0, data);
+				} else {
+					stack[top++] = child;
+				}
+			}
+		}
+	}
+	
+	cpSpatialIndexCollideStatic((cpSpatialIndex *)bvh, bvh->spatialIndex.staticIndex, func, data);
+}
+
+//MARK: Misc
+
+static int
+cpStaticBVHCount(cpStaticBVH *bvh)
+{
+	return (int)bvh->liveCount;
+}
+
+static void
+cpStaticBVHEach(cpStaticBVH *bvh, cpSpatialIndexIteratorFunc func, void *data)
+{
+	Entry *entries = bvh->entries;
+	for(uint32_t i=0, count=bvh->entryCount; i<count; i++){
+		void *obj = entries[i].obj;
+		if(obj) func(obj, data);
+	}
+}
+
+static cpSpatialIndexClass klass = {
+	(cpSpatialIndexDestroyImpl)cpStaticBVHDestroy,
+	
+	(cpSpatialIndexCountImpl)cpStaticBVHCount,
+	(cpSpatialIndexEachImpl)cpStaticBVHEach,
+	
+	(cpSpatialIndexContainsImpl)cpStaticBVHContains,
+	(cpSpatialIndexInsertImpl)cpStaticBVHInsert,
+	(cpSpatialIndexRemoveImpl)cpStaticBVHRemove,
+	
+	(cpSpatialIndexReindexImpl)cpStaticBVHReindex,
+	(cpSpatialIndexReindexObjectImpl)cpStaticBVHReindexObject,
+	(cpSpatialIndexReindexQueryImpl)cpStaticBVHReindexQuery,
+	
+	(cpSpatialIndexQueryImpl)cpStaticBVHQuery,
+	(cpSpatialIndexSegmentQueryImpl)cpStaticBVHSegmentQuery,
+	
+	(cpSpatialIndexInsertBulkImpl)cpStaticBVHInsertBulk,
+};
+
+static inline cpSpatialIndexClass *Klass(){return &klass;}
@@ -19,10 +19,39 @@
  * SOFTWARE.
  */
 
+#include <float.h>
+#include <string.h>
+
 #include "chipmunk/chipmunk_private.h"
 
+// The cells are kept sorted by the lower bound of their objects along the sweep axis.
+// Objects only move a little each step, so the order from the last step is almost right
+// and an insertion sort is usually all that is needed to fix it up.
+// The axis with the largest spread of object centers is used as the sweep axis.
+// The sweep itself tests the other axis for four cells at a time using floats packed into separate arrays.
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define CP_SWEEP1D_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define CP_SWEEP1D_SSE 0
+#endif
+
 static inline cpSpatialIndexClass *Klass(void);
 
+// Use qsort() instead of an insertion sort when more than this many cells were added since the last sort.
+#define UNSORTED_MAX 32
+// Give up on the insertion sort and use qsort() when it needs more than this many moves per cell.
+#define INSERTION_SORT_MOVES 8
+// Only switch the sweep axis when the variance of the other axis is this much larger.
+// Switching requires a full sort, so avoid flip flopping between them.
+#define AXIS_HYSTERESIS 1.25f
+
+// Number of cells swept by a single parallel task.
+#define PARALLEL_GRAIN 256
+// Tables with fewer cells than this are swept serially.
+#define PARALLEL_MIN_CELLS 1024
+
 //MARK: Basic Structures
 
 typedef struct Bounds {
@@ -31,9 +60,13 @@ typedef struct Bounds {
 
 typedef struct TableCell {
 	void *obj;
+	cpBB bb;
+	// Bounds of the object along the sweep axis.
 	Bounds bounds;
 } TableCell;
 
+typedef struct SweepTask SweepTask;
+
 struct cpSweep1D
 {
 	cpSpatialIndex spatialIndex;
@@ -41,6 +74,20 @@ struct cpSweep1D
 	int num;
 	int max;
 	TableCell *table;
+	
+	// The sweep axis, 0 for x and 1 for y.
+	int axis;
+	// The first 'sorted' cells of the table are in order. Cells inserted since the last sort come after them.
+	int sorted;
+	
+	// Bounds of the cells in table order rounded outward to floats, updated by each sort.
+	// Lower bounds along the sweep axis followed by the lower and upper bounds along the other axis.
+	float *packed;
+	int packedCapacity;
+	
+	// Pair lists for the parallel sweep, allocated on first use.
+	SweepTask *tasks;
+	int taskCapacity;
 };
 
 static inline cpBool
@@ -53,13 +100,19 @@ static inline Bounds
 BBToBounds(cpSweep1D *sweep, cpBB bb)
 {
 	Bounds bounds = {bb.l, bb.r};
+	if(sweep->axis){
+		bounds.min = bb.b;
+		bounds.max = bb.t;
+	}
+	
 	return bounds;
 }
 
 static inline TableCell
 MakeTableCell(cpSweep1D *sweep, void *obj)
 {
-	TableCell cell = {obj, BBToBounds(sweep, sweep->spatialIndex.bbfunc(obj))};
+	cpBB bb = sweep->spatialIndex.bbfunc(obj);
+	TableCell cell = {obj, bb, BBToBounds(sweep, bb)};
 	return cell;
 }
 
@@ -86,6 +139,15 @@ cpSweep1DInit(cpSweep1D *sweep, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *sta
 	sweep->num = 0;
 	ResizeTable(sweep, 32);
 	
+	sweep->axis = 0;
+	sweep->sorted = 0;
+	
+	sweep->packed = NULL;
+	sweep->packedCapacity = 0;
+	
+	sweep->tasks = NULL;
+	sweep->taskCapacity = 0;
+	
 	return (cpSpatialIndex *)sweep;
 }
 
@@ -95,11 +157,18 @@ cpSweep1DNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
 	return cpSweep1DInit(cpSweep1DAlloc(), bbfunc, staticIndex);
 }
 
+static void TasksFree(cpSweep1D *sweep);
+
 static void
 cpSweep1DDestroy(cpSweep1D *sweep)
 {
 	cpfree(sweep->table);
 	sweep->table = NULL;
+	
+	cpfree(sweep->packed);
+	sweep->packed = NULL;
+	
+	TasksFree(sweep);
 }
 
 //MARK: Misc
@@ -118,14 +187,20 @@ cpSweep1DEach(cpSweep1D *sweep, cpSpatialIndexIteratorFunc func, void *data)
 }
 
 static int
-cpSweep1DContains(cpSweep1D *sweep, void *obj, cpHashValue hashid)
+FindCell(cpSweep1D *sweep, void *obj)
 {
 	TableCell *table = sweep->table;
 	for(int i=0, count=sweep->num; i<count; i++){
-		if(table[i].obj == obj) return cpTrue;
+		if(table[i].obj == obj) return i;
 	}
 	
-	return cpFalse;
+	return -1;
+}
+
+static int
+cpSweep1DContains(cpSweep1D *sweep, void *obj, cpHashValue hashid)
+{
+	return (FindCell(sweep, obj) >= 0);
 }
 
 //MARK: Basic Operations
@@ -135,23 +210,128 @@ cpSweep1DInsert(cpSweep1D *sweep, void *obj, cpHashValue hashid)
 {
 	if(sweep->num == sweep->max) ResizeTable(sweep, sweep->max*2);
 	
+	// New cells go at the end, and are moved into place by the next sort.
 	sweep->table[sweep->num] = MakeTableCell(sweep, obj);
 	sweep->num++;
 }
 
+static void
+RemoveCell(cpSweep1D *sweep, int i)
+{
+	// Shift the following cells down to keep them in order.
+	TableCell *table = sweep->table;
+	int num = --sweep->num;
+	memmove(table + i, table + i + 1, (num - i)*sizeof(TableCell));
+	table[num].obj = NULL;
+	
+	if(i < sweep->sorted) sweep->sorted--;
+}
+
 static void
 cpSweep1DRemove(cpSweep1D *sweep, void *obj, cpHashValue hashid)
+{
+	int i = FindCell(sweep, obj);
+	if(i >= 0) RemoveCell(sweep, i);
+}
+
+//MARK: Sorting Functions
+
+static int
+TableSort(TableCell *a, TableCell *b)
+{
+	return (a->bounds.min < b->bounds.min ? -1 : (a->bounds.min > b->bounds.min ? 1 : 0));
+}
+
+// Returns false if it gave up because the table was too far out of order.
+static cpBool
+InsertionSort(TableCell *table, int count)
+{
+	int moves = INSERTION_SORT_MOVES*count;
+	
+	for(int i=1; i<count; i++){
+		TableCell cell = table[i];
+		cpFloat min = cell.bounds.min;
+		
+		int j = i;
+		for(; j > 0 && table[j - 1].bounds.min > min; j--) table[j] = table[j - 1];
+		table[j] = cell;
+		
+		moves -= i - j;
+		if(moves < 0) return cpFalse;
+	}
+	
+	return cpTrue;
+}
+
+// Update the bounds of every cell, pick the sweep axis and sort the table along it.
+static void
+UpdateTable(cpSweep1D *sweep)
 {
 	TableCell *table = sweep->table;
-	for(int i=0, count=sweep->num; i<count; i++){
-		if(table[i].obj == obj){
-			int num = --sweep->num;
-			
-			table[i] = table[num];
-			table[num].obj = NULL;
-			
-			return;
-		}
+	int count = sweep->num;
+	if(count == 0) return;
+	
+	cpSpatialIndexBBFunc bbfunc = sweep->spatialIndex.bbfunc;
+	cpFloat sx = 0.0f, sy = 0.0f, sxx = 0.0f, syy = 0.0f;
+	
+	for(int i=0; i<count; i++){
+		cpBB bb = table[i].bb = bbfunc(table[i].obj);
+		cpFloat x = (bb.l + bb.r)*0.5f, y = (bb.b + bb.t)*0.5f;
+		sx += x; sxx += x*x;
+		sy += y; syy += y*y;
+	}
+	
+	// Sweep along the axis the centers are most spread out along so the fewest cells overlap.
+	cpFloat varX = sxx/count - (sx/count)*(sx/count);
+	cpFloat varY = syy/count - (sy/count)*(sy/count);
+	
+	int axis = sweep->axis;
+	if(axis == 0 && varY > AXIS_HYSTERESIS*varX){
+		axis = 1;
+	} else if(axis == 1 && varX > AXIS_HYSTERESIS*varY){
+		axis = 0;
+	}
+	
+	cpBool fullSort = (axis != sweep->axis || count - sweep->sorted > UNSORTED_MAX);
+	sweep->axis = axis;
+	
+	for(int i=0; i<count; i++) table[i].bounds = BBToBounds(sweep, table[i].bb);
+	
+	if(fullSort || !InsertionSort(table, count)){
+		qsort(table, count, sizeof(TableCell), (int (*)(const void *, const void *))TableSort);
+	}
+	
+	sweep->sorted = count;
+}
+
+// Pack the bounds used by the sweep into floats. Each array is padded to a multiple of 4.
+static void
+PackBounds(cpSweep1D *sweep)
+{
+	int count = sweep->num;
+	int stride = (count + 3)&~3;
+	
+	if(3*stride > sweep->packedCapacity){
+		sweep->packedCapacity = 3*stride;
+		sweep->packed = (float *)cprealloc(sweep->packed, sweep->packedCapacity*sizeof(float));
+	}
+	
+	float *mins = sweep->packed, *crossMins = mins + stride, *crossMaxs = crossMins + stride;
+	TableCell *table = sweep->table;
+	int axis = sweep->axis;
+	
+	for(int i=0; i<count; i++){
+		cpBB bb = table[i].bb;
+		mins[i] = cpRoundDownFloat(table[i].bounds.min);
+		crossMins[i] = cpRoundDownFloat(axis ? bb.l : bb.b);
+		crossMaxs[i] = cpRoundUpFloat(axis ? bb.r : bb.t);
+	}
+	
+	// Padding that never overlaps anything.
+	for(int i=count; i<stride; i++){
+		mins[i] = FLT_MAX;
+		crossMins[i] = FLT_MAX;
+		crossMaxs[i] = -FLT_MAX;
 	}
 }
 
@@ -160,14 +340,19 @@ cpSweep1DRemove(cpSweep1D *sweep, void *obj, cpHashValue hashid)
 static void
 cpSweep1DReindexObject(cpSweep1D *sweep, void *obj, cpHashValue hashid)
 {
-	// Nothing to do here
+	// Move the object to the end of the table with its new bounds.
+	// The next sort will put it back in place.
+	int i = FindCell(sweep, obj);
+	if(i >= 0){
+		RemoveCell(sweep, i);
+		cpSweep1DInsert(sweep, obj, hashid);
+	}
 }
 
 static void
 cpSweep1DReindex(cpSweep1D *sweep)
 {
-	// Nothing to do here
-	// Could perform a sort, but queries are not accelerated anyway.
+	UpdateTable(sweep);
 }
 
 //MARK: Query Functions
@@ -175,15 +360,20 @@ cpSweep1DReindex(cpSweep1D *sweep)
 static void
 cpSweep1DQuery(cpSweep1D *sweep, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
 {
-	// Implementing binary search here would allow you to find an upper limit
-	// but not a lower limit. Probably not worth the hassle.
-	
 	Bounds bounds = BBToBounds(sweep, bb);
-	
 	TableCell *table = sweep->table;
-	for(int i=0, count=sweep->num; i<count; i++){
+	int sorted = sweep->sorted;
+	
+	// The sorted part of the table can stop at the first cell that starts past the end of the query.
+	for(int i=0; i<sorted; i++){
+		TableCell cell = table[i];
+		if(cell.bounds.min > bounds.max) break;
+		if(cpBBIntersects(bb, cell.bb) && obj != cell.obj) func(obj, cell.obj, 0, data);
+	}
+	
+	for(int i=sorted, count=sweep->num; i<count; i++){
 		TableCell cell = table[i];
-		if(BoundsOverlap(bounds, cell.bounds) && obj != cell.obj) func(obj, cell.obj, 0, data);
+		if(cpBBIntersects(bb, cell.bb) && obj != cell.obj) func(obj, cell.obj, 0, data);
 	}
 }
 
@@ -191,47 +381,173 @@ static void
 cpSweep1DSegmentQuery(cpSweep1D *sweep, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
 {
 	cpBB bb = cpBBExpand(cpBBNew(a.x, a.y, a.x, a.y), b);
-	Bounds bounds = BBToBounds(sweep, bb);
 	
 	TableCell *table = sweep->table;
 	for(int i=0, count=sweep->num; i<count; i++){
 		TableCell cell = table[i];
-		if(BoundsOverlap(bounds, cell.bounds)) func(obj, cell.obj, data);
+		if(cpBBIntersects(bb, cell.bb)) func(obj, cell.obj, data);
 	}
 }
 
 //MARK: Reindex/Query
 
-static int
-TableSort(TableCell *a, TableCell *b)
-{
-	return (a->bounds.min < b->bounds.min ? -1 : (a->bounds.min > b->bounds.min ? 1 : 0));
-}
+typedef void (*SweepPairFunc)(void *context, int a, int b);
 
-static void
-cpSweep1DReindexQuery(cpSweep1D *sweep, cpSpatialIndexQueryFunc func, void *data)
+// Finds the cells after cell i that overlap it. The table must be sorted and packed.
+static inline void
+SweepCell(cpSweep1D *sweep, int i, SweepPairFunc pairFunc, void *context)
 {
 	TableCell *table = sweep->table;
 	int count = sweep->num;
+	int stride = (count + 3)&~3;
+	const float *mins = sweep->packed, *crossMins = mins + stride, *crossMaxs = crossMins + stride;
 	
-	// Update bounds and sort
-	for(int i=0; i<count; i++) table[i] = MakeTableCell(sweep, table[i].obj);
-	qsort(table, count, sizeof(TableCell), (int (*)(const void *, const void *))TableSort); // TODO: use insertion sort instead
+	cpBB bb = table[i].bb;
+	float max = cpRoundUpFloat(table[i].bounds.max);
+	float crossMin = cpRoundDownFloat(sweep->axis ? bb.l : bb.b);
+	float crossMax = cpRoundUpFloat(sweep->axis ? bb.r : bb.t);
 	
-	for(int i=0; i<count; i++){
-		TableCell cell = table[i];
-		cpFloat max = cell.bounds.max;
+#if CP_SWEEP1D_SSE
+	__m128 vmax = _mm_set1_ps(max), vcrossMin = _mm_set1_ps(crossMin), vcrossMax = _mm_set1_ps(crossMax);
+#endif
+	
+	// Test four cells at a time, starting from the aligned block that holds cell i + 1.
+	for(int j=(i + 1)&~3; j<count; j+=4){
+#if CP_SWEEP1D_SSE
+		unsigned starts = (unsigned)_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(mins + j), vmax));
+		unsigned overlaps = (unsigned)_mm_movemask_ps(_mm_and_ps(
+			_mm_cmple_ps(_mm_loadu_ps(crossMins + j), vcrossMax),
+			_mm_cmple_ps(vcrossMin, _mm_loadu_ps(crossMaxs + j))
+		));
+#else
+		unsigned starts = 0, overlaps = 0;
+		for(int k=0; k<4; k++){
+			if(mins[j + k] <= max) starts |= 1u << k;
+			if(crossMins[j + k] <= crossMax && crossMin <= crossMaxs[j + k]) overlaps |= 1u << k;
+		}
+#endif
 		
-		for(int j=i+1; table[j].bounds.min < max && j<count; j++){
-			func(cell.obj, table[j].obj, 0, data);
+		// Skip the cells in the first block that come before i + 1.
+		unsigned mask = starts & overlaps & (0xFu << (j <= i ? i + 1 - j : 0));
+		// And the padding in the last block.
+		if(count - j < 4) mask &= (1u << (count - j)) - 1;
+		
+		for(; mask; mask &= mask - 1){
+			int k = (mask&1 ? 0 : (mask&2 ? 1 : (mask&4 ? 2 : 3)));
+			// The packed bounds are rounded, so check the exact bounds before reporting the pair.
+			if(cpBBIntersects(bb, table[j + k].bb)) pairFunc(context, i, j + k);
 		}
+		
+		// The cells are sorted, so once one starts past the end of cell i the rest do too.
+		if(starts != 0xF) break;
 	}
+}
+
+typedef struct SweepContext {
+	TableCell *table;
+	cpSpatialIndexQueryFunc func;
+	void *data;
+} SweepContext;
+
+static void
+SweepCallPair(SweepContext *context, int a, int b)
+{
+	context->func(context->table[a].obj, context->table[b].obj, 0, context->data);
+}
+
+static void
+cpSweep1DReindexQuery(cpSweep1D *sweep, cpSpatialIndexQueryFunc func, void *data)
+{
+	UpdateTable(sweep);
+	PackBounds(sweep);
+	
+	SweepContext context = {sweep->table, func, data};
+	for(int i=0, count=sweep->num; i<count; i++) SweepCell(sweep, i, (SweepPairFunc)SweepCallPair, &context);
 	
 	// Reindex query is also responsible for colliding against the static index.
 	// Fortunately there is a helper function for that.
 	cpSpatialIndexCollideStatic((cpSpatialIndex *)sweep, sweep->spatialIndex.staticIndex, func, data);
 }
 
+//MARK: Parallel Reindex/Query
+
+// Each task sweeps a fixed range of cells and records the pairs it finds.
+// The pairs are reported afterwards on the calling thread, task by task,
+// so the query function sees them in the same order as cpSweep1DReindexQuery() would report them.
+
+struct SweepTask {
+	int count, capacity;
+	int *pairs;
+};
+
+static void
+TasksFree(cpSweep1D *sweep)
+{
+	for(int i=0; i<sweep->taskCapacity; i++) cpfree(sweep->tasks[i].pairs);
+	cpfree(sweep->tasks);
+	
+	sweep->tasks = NULL;
+	sweep->taskCapacity = 0;
+}
+
+static void
+SweepRecordPair(SweepTask *task, int a, int b)
+{
+	if(task->count == task->capacity){
+		task->capacity = (task->capacity ? 2*task->capacity : 64);
+		task->pairs = (int *)cprealloc(task->pairs, 2*task->capacity*sizeof(int));
+	}
+	
+	task->pairs[2*task->count + 0] = a;
+	task->pairs[2*task->count + 1] = b;
+	task->count++;
+}
+
+static void
+SweepTaskRun(cpSweep1D *sweep, unsigned long start, unsigned long end, unsigned long worker)
+{
+	for(unsigned long t=start; t<end; t++){
+		SweepTask *task = sweep->tasks + t;
+		task->count = 0;
+		
+		int first = (int)t*PARALLEL_GRAIN;
+		int last = (first + PARALLEL_GRAIN < sweep->num ? first + PARALLEL_GRAIN : sweep->num);
+		for(int i=first; i<last; i++) SweepCell(sweep, i, (SweepPairFunc)SweepRecordPair, task);
+	}
+}
+
+static void
+cpSweep1DReindexQueryParallel(cpSweep1D *sweep, cpSpatialIndexQueryFunc func, void *data, cpSpatialIndexParallelForFunc parallelFor, void *context)
+{
+	int count = sweep->num;
+	if(count < PARALLEL_MIN_CELLS){
+		cpSweep1DReindexQuery(sweep, func, data);
+		return;
+	}
+	
+	UpdateTable(sweep);
+	PackBounds(sweep);
+	
+	int taskCount = (count + PARALLEL_GRAIN - 1)/PARALLEL_GRAIN;
+	if(taskCount > sweep->taskCapacity){
+		sweep->tasks = (SweepTask *)cprealloc(sweep->tasks, taskCount*sizeof(SweepTask));
+		memset(sweep->tasks + sweep->taskCapacity, 0, (taskCount - sweep->taskCapacity)*sizeof(SweepTask));
+		sweep->taskCapacity = taskCount;
+	}
+	
+	parallelFor(context, taskCount, 1, (cpSpatialIndexTaskFunc)SweepTaskRun, sweep);
+	
+	TableCell *table = sweep->table;
+	for(int t=0; t<taskCount; t++){
+		SweepTask *task = sweep->tasks + t;
+		for(int i=0; i<task->count; i++){
+			func(table[task->pairs[2*i + 0]].obj, table[task->pairs[2*i + 1]].obj, 0, data);
+		}
+	}
+	
+	cpSpatialIndexCollideStatic((cpSpatialIndex *)sweep, sweep->spatialIndex.staticIndex, func, data);
+}
+
 static cpSpatialIndexClass klass = {
 	(cpSpatialIndexDestroyImpl)cpSweep1DDestroy,
 	
@@ -248,7 +564,9 @@ static cpSpatialIndexClass klass = {
 	
 	(cpSpatialIndexQueryImpl)cpSweep1DQuery,
 	(cpSpatialIndexSegmentQueryImpl)cpSweep1DSegmentQuery,
+	
+	NULL,
+	(cpSpatialIndexReindexQueryParallelImpl)cpSweep1DReindexQueryParallel,
 };
 
 static inline cpSpatialIndexClass *Klass(){return &klass;}
-